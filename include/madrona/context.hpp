@@ -43,9 +43,38 @@ public:
     template <typename ArchetypeT>
     inline Loc makeTemporary();
 
+    // Create num_temporaries Temporaries of archetype ArchetypeT at once,
+    // in consecutive rows of the same table. Returns the Loc of the first
+    // one. Cheaper than repeated makeTemporary calls since the table only
+    // grows (and the world is only locked) once.
+    template <typename ArchetypeT>
+    inline Loc makeTemporaries(CountT num_temporaries);
+
     // Destroy Entity e
     inline void destroyEntity(Entity e);
 
+    // Deferred versions of the above for use from systems that run in
+    // parallel. Ops recorded into txn take effect once the transaction
+    // has been passed to commitTransaction and the world's
+    // ApplyTransactionsNode has run. Use one Transaction per system
+    // invocation / worker, they are not thread safe.
+    inline Transaction makeTransaction();
+
+    // The returned Entity can be stored immediately, but has no components
+    // until the transaction is applied. Either pass a value for every
+    // component of ArchetypeT (in order) or none.
+    template <typename ArchetypeT, typename... Args>
+    inline Entity makeEntity(Transaction &txn, Args && ...args);
+
+    inline void destroyEntity(Transaction &txn, Entity e);
+
+    // Overwrite ComponentT of Entity e with value
+    template <typename ComponentT>
+    inline void modifyEntity(Transaction &txn, Entity e,
+                             const ComponentT &value);
+
+    inline void commitTransaction(Transaction &&txn);
+
     // Get the Loc (row and table ID) of Entity e. This can be used to
     // fetch components more efficiently than by entity ID. Loc generally
     // only is valid within a single ECS system or when no entities of the
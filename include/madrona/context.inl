@@ -23,12 +23,50 @@ Loc Context::makeTemporary()
         MADRONA_MW_COND(cur_world_id_));
 }
 
+template <typename ArchetypeT>
+Loc Context::makeTemporaries(CountT num_temporaries)
+{
+    return state_mgr_->makeTemporaries<ArchetypeT>(
+        MADRONA_MW_COND(cur_world_id_,) num_temporaries);
+}
+
 void Context::destroyEntity(Entity e)
 {
     state_mgr_->destroyEntityNow(MADRONA_MW_COND(cur_world_id_,)
                                  *state_cache_, e);
 }
 
+Transaction Context::makeTransaction()
+{
+    return state_mgr_->makeTransaction(MADRONA_MW_COND(cur_world_id_));
+}
+
+template <typename ArchetypeT, typename... Args>
+Entity Context::makeEntity(Transaction &txn, Args && ...args)
+{
+    return state_mgr_->makeEntity<ArchetypeT>(
+        MADRONA_MW_COND(cur_world_id_,) txn, *state_cache_,
+        std::forward<Args>(args)...);
+}
+
+void Context::destroyEntity(Transaction &txn, Entity e)
+{
+    state_mgr_->destroyEntity(MADRONA_MW_COND(cur_world_id_,)
+                              txn, *state_cache_, e);
+}
+
+template <typename ComponentT>
+void Context::modifyEntity(Transaction &txn, Entity e,
+                           const ComponentT &value)
+{
+    state_mgr_->modifyEntity(MADRONA_MW_COND(cur_world_id_,) txn, e, value);
+}
+
+void Context::commitTransaction(Transaction &&txn)
+{
+    state_mgr_->commitTransaction(std::move(txn));
+}
+
 Loc Context::loc(Entity e) const
 {
     return state_mgr_->getLoc(e);
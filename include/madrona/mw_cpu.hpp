@@ -24,6 +24,22 @@ public:
         uint32_t numExportedBuffers;
         // Number of worker threads
         uint32_t numWorkers = 0;
+        // Max number of entities per world of archetypes registered
+        // without a max number of entities. Their columns are stored
+        // world-major, with world i's rows starting at row
+        // i * maxRowsPerWorld. 0 splits Table::maxRowsPerTable across the
+        // worlds (with a floor of 64K rows).
+        uint32_t maxRowsPerWorld = 0;
+        // Hand out a copy of the exported data from getExported rather
+        // than the live ECS data, so results stay readable while the next
+        // step runs. Costs two memcpys of the exported rows of every
+        // stepped world per step, see getExported for the ordering.
+        bool doubleBufferExports = false;
+        // Number of trace events kept per worker for writeChromeTrace.
+        // Each worker records the start & end of every node chunk it runs
+        // into a preallocated ring buffer, so only the most recent events
+        // are kept. 0 disables tracing.
+        uint32_t numTraceEventsPerWorker = 0;
     };
 
     struct Job {
@@ -31,16 +47,73 @@ public:
         void *data;
     };
 
+    // Scheduling counters of one worker thread, covering the most recent
+    // call to run or runTaskGraphs
+    struct WorkerStats {
+        // Node chunks (or jobs) executed
+        uint64_t numChunks;
+        // Work items taken from other workers' queues
+        uint64_t numSteals;
+        // Time spent looking for work. Doesn't include time asleep
+        // between runs.
+        uint64_t idleNanoseconds;
+    };
+
     ThreadPoolExecutor(const Config &cfg);
     ThreadPoolExecutor(ThreadPoolExecutor &&o);
 
     ~ThreadPoolExecutor();
     void run(Job *jobs, CountT num_jobs);
 
+    // Run one invocation of each world's taskgraph. Independent nodes, both
+    // within and across worlds, run concurrently, and the invocations of
+    // parallel nodes (ParallelForNode) are split across all worker threads.
+    // Each worker starts on a contiguous range of worlds and steals from
+    // other workers (on the same NUMA node first) once it runs out.
+    void runTaskGraphs(TaskGraph **taskgraphs, Context **ctxs,
+                       CountT num_worlds);
+
+    // Same as runTaskGraphs, but returns without waiting for the worlds
+    // to finish. wait() must be called before the next run or before
+    // touching any ECS state.
+    void runTaskGraphsAsync(TaskGraph **taskgraphs, Context **ctxs,
+                            CountT num_worlds);
+
+    // Blocks until the run started by runTaskGraphsAsync finishes. Does
+    // nothing if no run is in flight.
+    void wait();
+
     // Get the base pointer of the component data exported with
-    // ECSRegister::exportColumn
+    // ECSRegister::exportColumn. By default this is the live ECS data, so
+    // it is only safe to access between calls to run.
+    // With Config::doubleBufferExports it is a copy, synced with the live
+    // data of the stepped worlds as follows:
+    //  - Starting a run (runTaskGraphs or runTaskGraphsAsync) first copies
+    //    the buffer into the live columns, so values written since the
+    //    last wait() (e.g. actions or reset flags) are seen by the step.
+    //  - While a runTaskGraphsAsync run is in flight the buffer holds the
+    //    state from before the run and may be read from any thread.
+    //    Writes made in this window are overwritten by wait().
+    //  - wait() copies the results of the run into the buffer. It must not
+    //    overlap with other threads accessing the buffer.
     void * getExported(CountT slot) const;
 
+    // Exported columns are world-major: world i's rows start at row
+    // i * getExportedRowsPerWorld(slot). This is the max number of entities
+    // the archetype was registered with, or Config::maxRowsPerWorld for
+    // archetypes registered without one. Only the first numRows of each
+    // world's slice are live.
+    CountT getExportedRowsPerWorld(CountT slot) const;
+
+    // Per worker scheduling statistics of the last step
+    Span<const WorkerStats> getWorkerStats() const;
+
+    // Write the recorded trace events as Chrome trace event JSON, viewable
+    // in Perfetto or chrome://tracing. Each node chunk shows up on its
+    // worker's track, named after the node's function and tagged with the
+    // world & node index. Only call between runs.
+    void writeChromeTrace(const char *path) const;
+
 protected:
     void initializeContexts(
         Context & (*init_fn)(void *, const WorkerInit &, CountT),
@@ -48,7 +121,10 @@ protected:
 
     ECSRegistry getECSRegistry();
 
-    void initExport();
+    // Copies the current exported data into the buffers returned by
+    // getExported when exports are double buffered
+    void snapshotExports();
+
 private:
     struct Impl;
     std::unique_ptr<Impl> impl_;
@@ -81,9 +157,43 @@ public:
     // Run one invocation of the task graph across all worlds (one step)
     inline void run();
 
+    // Step only some of the worlds, given either as a mask with one entry
+    // per world or as a list of world indices. The other worlds are skipped
+    // entirely: no nodes are scheduled and their exports aren't copied.
+    inline void run(Span<const bool> world_mask);
+    inline void run(Span<const int32_t> world_idxs);
+
+    // Start a step and return immediately, so the caller can do other work
+    // (like preparing the next actions) while the worlds run. Call wait()
+    // before the next step or before accessing world data. With
+    // Config::doubleBufferExports the exported buffers can be read during
+    // the step, but inputs for the next step must be written after wait()
+    // (see ThreadPoolExecutor::getExported).
+    inline void runAsync();
+    inline void runAsync(Span<const bool> world_mask);
+    inline void runAsync(Span<const int32_t> world_idxs);
+    using ThreadPoolExecutor::wait;
+
+    // Run the taskgraph with ID graph_id (see TaskGraphManager) across all
+    // worlds, or only across the selected worlds.
+    template <typename EnumT>
+    inline void runTaskGraph(EnumT graph_id);
+    template <typename EnumT>
+    inline void runTaskGraph(EnumT graph_id, Span<const bool> world_mask);
+    template <typename EnumT>
+    inline void runTaskGraph(EnumT graph_id, Span<const int32_t> world_idxs);
+
     // Get the base pointer of the component data exported with
-    // ECSRegister::exportColumn
+    // ECSRegister::exportColumn, and the number of rows between worlds
     using ThreadPoolExecutor::getExported;
+    using ThreadPoolExecutor::getExportedRowsPerWorld;
+
+    // Steal & idle time counters of each worker thread for the last step
+    using ThreadPoolExecutor::WorkerStats;
+    using ThreadPoolExecutor::getWorkerStats;
+
+    // Per node timing, see Config::numTraceEventsPerWorker
+    using ThreadPoolExecutor::writeChromeTrace;
 
     // Get a reference to the per world data class
     inline WorldT & getWorldData(CountT world_idx);
@@ -91,17 +201,34 @@ public:
 private:
     struct RunData {
         ContextT ctx;
-        TaskGraph taskgraph;
+        HeapArray<TaskGraph> taskgraphs;
 
         inline RunData(WorldT *world_data, const ConfigT &cfg,
                        const WorkerInit &worker_init);
     };
 
-    static inline void stepWorld(void *data_raw);
+    static inline HeapArray<TaskGraph> buildTaskGraphs(
+        const ConfigT &cfg, const WorkerInit &worker_init);
+
+    // Fill masked_taskgraphs_ & masked_ctxs_ with the selected worlds,
+    // returns the number of worlds selected. Fails if a world index is out
+    // of range or listed twice, since a world must not run concurrently
+    // with itself.
+    inline CountT selectWorlds(CountT graph_idx, Span<const bool> world_mask);
+    inline CountT selectWorlds(CountT graph_idx,
+                               Span<const int32_t> world_idxs);
 
     HeapArray<RunData> run_datas_;
     HeapArray<WorldT> world_datas_;
-    HeapArray<Job> jobs_;
+    CountT num_taskgraphs_;
+    // Graph major: graph i of world j is at i * numWorlds + j
+    HeapArray<TaskGraph *> taskgraphs_;
+    HeapArray<Context *> ctxs_;
+    // Scratch for runs on a subset of the worlds
+    HeapArray<TaskGraph *> masked_taskgraphs_;
+    HeapArray<Context *> masked_ctxs_;
+    // All false outside of selectWorlds
+    HeapArray<bool> world_selected_;
 };
 
 }
@@ -10,7 +10,12 @@ TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::TaskGraphExecutor(
     : ThreadPoolExecutor(cfg),
       run_datas_(cfg.numWorlds),
       world_datas_(cfg.numWorlds),
-      jobs_(cfg.numWorlds)
+      num_taskgraphs_(0),
+      taskgraphs_(0),
+      ctxs_(cfg.numWorlds),
+      masked_taskgraphs_(cfg.numWorlds),
+      masked_ctxs_(cfg.numWorlds),
+      world_selected_(cfg.numWorlds)
 {
     auto ecs_reg = getECSRegistry();
     WorldT::registerTypes(ecs_reg, user_cfg);
@@ -31,48 +36,199 @@ TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::TaskGraphExecutor(
         return (*(CBPtrT)ptr_raw)(worker_init, world_idx);
     }, &ctx_init_cb, cfg.numWorlds);
 
+    num_taskgraphs_ = run_datas_[0].taskgraphs.size();
+    if (num_taskgraphs_ == 0) {
+        FATAL("setupTasks must initialize at least one taskgraph");
+    }
+
+    taskgraphs_ = HeapArray<TaskGraph *>(num_taskgraphs_ * cfg.numWorlds);
+
     for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
+        world_selected_[i] = false;
         world_datas_.emplace(i, run_datas_[i].ctx, user_cfg, user_inits[i]);
 
-        jobs_[i].fn = [](void *ptr) {
-            stepWorld(ptr);
-        };
-        jobs_[i].data = &run_datas_[i];
+        for (CountT j = 0; j < num_taskgraphs_; j++) {
+            taskgraphs_[j * cfg.numWorlds + i] = &run_datas_[i].taskgraphs[j];
+        }
+        ctxs_[i] = &run_datas_[i].ctx;
     }
 
-    initExport();
+    // Make the initial state visible through getExported
+    snapshotExports();
 }
 
 template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
 void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::run()
 {
-    ThreadPoolExecutor::run(jobs_.data(), jobs_.size());
+    ThreadPoolExecutor::runTaskGraphs(taskgraphs_.data(), ctxs_.data(),
+                                      ctxs_.size());
 }
 
 template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
-WorldT & TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::getWorldData(
-    CountT world_idx)
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runAsync()
 {
-    return world_datas_[world_idx];
+    ThreadPoolExecutor::runTaskGraphsAsync(taskgraphs_.data(), ctxs_.data(),
+                                           ctxs_.size());
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+template <typename EnumT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runTaskGraph(
+    EnumT graph_id)
+{
+    CountT graph_idx = CountT(graph_id);
+    assert(graph_idx < num_taskgraphs_);
+
+    CountT num_worlds = ctxs_.size();
+    ThreadPoolExecutor::runTaskGraphs(
+        taskgraphs_.data() + graph_idx * num_worlds, ctxs_.data(),
+        num_worlds);
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+template <typename EnumT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runTaskGraph(
+    EnumT graph_id, Span<const bool> world_mask)
+{
+    CountT num_selected = selectWorlds(CountT(graph_id), world_mask);
+    ThreadPoolExecutor::runTaskGraphs(masked_taskgraphs_.data(),
+                                      masked_ctxs_.data(), num_selected);
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+template <typename EnumT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runTaskGraph(
+    EnumT graph_id, Span<const int32_t> world_idxs)
+{
+    CountT num_selected = selectWorlds(CountT(graph_id), world_idxs);
+    ThreadPoolExecutor::runTaskGraphs(masked_taskgraphs_.data(),
+                                      masked_ctxs_.data(), num_selected);
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::run(
+    Span<const bool> world_mask)
+{
+    runTaskGraph(0, world_mask);
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::run(
+    Span<const int32_t> world_idxs)
+{
+    runTaskGraph(0, world_idxs);
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runAsync(
+    Span<const bool> world_mask)
+{
+    CountT num_selected = selectWorlds(0, world_mask);
+    ThreadPoolExecutor::runTaskGraphsAsync(masked_taskgraphs_.data(),
+                                           masked_ctxs_.data(), num_selected);
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::runAsync(
+    Span<const int32_t> world_idxs)
+{
+    CountT num_selected = selectWorlds(0, world_idxs);
+    ThreadPoolExecutor::runTaskGraphsAsync(masked_taskgraphs_.data(),
+                                           masked_ctxs_.data(), num_selected);
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+CountT TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::selectWorlds(
+    CountT graph_idx, Span<const bool> world_mask)
+{
+    assert(graph_idx < num_taskgraphs_);
+
+    CountT num_worlds = ctxs_.size();
+    if (world_mask.size() != num_worlds) {
+        FATAL("World mask has %ld entries, expected %ld",
+              (long)world_mask.size(), (long)num_worlds);
+    }
+
+    TaskGraph **graph_taskgraphs = taskgraphs_.data() + graph_idx * num_worlds;
+
+    CountT num_selected = 0;
+    for (CountT i = 0; i < num_worlds; i++) {
+        if (world_mask[i]) {
+            masked_taskgraphs_[num_selected] = graph_taskgraphs[i];
+            masked_ctxs_[num_selected] = ctxs_[i];
+            num_selected++;
+        }
+    }
+
+    return num_selected;
+}
+
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+CountT TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::selectWorlds(
+    CountT graph_idx, Span<const int32_t> world_idxs)
+{
+    assert(graph_idx < num_taskgraphs_);
+
+    CountT num_worlds = ctxs_.size();
+
+    // Validate the whole list before building the run list
+    for (CountT i = 0; i < world_idxs.size(); i++) {
+        int32_t world_idx = world_idxs[i];
+        if (world_idx < 0 || world_idx >= num_worlds) {
+            FATAL("World index %d out of range [0, %ld)",
+                  world_idx, (long)num_worlds);
+        }
+
+        if (world_selected_[world_idx]) {
+            FATAL("World index %d selected more than once", world_idx);
+        }
+        world_selected_[world_idx] = true;
+    }
+
+    TaskGraph **graph_taskgraphs = taskgraphs_.data() + graph_idx * num_worlds;
+
+    for (CountT i = 0; i < world_idxs.size(); i++) {
+        int32_t world_idx = world_idxs[i];
+        world_selected_[world_idx] = false;
+
+        masked_taskgraphs_[i] = graph_taskgraphs[world_idx];
+        masked_ctxs_[i] = ctxs_[world_idx];
+    }
+
+    return world_idxs.size();
 }
 
 template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
-void TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::stepWorld(
-    void *data_raw)
+WorldT & TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::getWorldData(
+    CountT world_idx)
 {
-    auto run_data = (RunData *)data_raw;
-    run_data->taskgraph.run(&run_data->ctx);
+    return world_datas_[world_idx];
 }
 
 template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
 TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::RunData::RunData(
         WorldT *world_data, const ConfigT &cfg, const WorkerInit &init)
     : ctx(world_data, init),
-      taskgraph([&cfg, &init]() {
-          TaskGraphBuilder builder(init);
-          WorldT::setupTasks(builder, cfg);
-          return builder.build();
-      }())
+      taskgraphs(buildTaskGraphs(cfg, init))
 {}
 
+template <typename ContextT, typename WorldT, typename ConfigT, typename InitT>
+HeapArray<TaskGraph>
+    TaskGraphExecutor<ContextT, WorldT, ConfigT, InitT>::buildTaskGraphs(
+        const ConfigT &cfg, const WorkerInit &init)
+{
+    TaskGraphManager mgr(init);
+
+    // Worlds with a single taskgraph take the builder directly
+    if constexpr (requires (TaskGraphBuilder &builder) {
+        WorldT::setupTasks(builder, cfg);
+    }) {
+        WorldT::setupTasks(mgr.init(0), cfg);
+    } else {
+        WorldT::setupTasks(mgr, cfg);
+    }
+
+    return mgr.build();
+}
+
 }
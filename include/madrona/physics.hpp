@@ -71,6 +71,18 @@ struct CollisionEvent {
     Entity b;
 };
 
+struct Ray {
+    math::Vector3 o;
+    math::Vector3 d;
+};
+
+// Entity is Entity::none() if the ray didn't hit anything
+struct RayHit {
+    Entity entity;
+    float t;
+    math::Vector3 normal;
+};
+
 struct CandidateCollision {
     Loc a;
     Loc b;
@@ -80,6 +92,16 @@ struct CandidateCollision {
 
 struct CandidateTemporary : Archetype<CandidateCollision> {};
 
+// Identifies the same contact manifold across substeps and steps: the pair
+// of colliding primitives plus the SAT features (faces / edges) that
+// produced the manifold.
+struct ContactID {
+    uint32_t refPrim;
+    uint32_t altPrim;
+    uint32_t refFeature;
+    uint32_t altFeature;
+};
+
 struct Contact {
     Loc ref;
     Loc alt;
@@ -87,6 +109,11 @@ struct Contact {
     int32_t numPoints;
     math::Vector3 normal;
     float lambdaN[4];
+    ContactID id;
+    // Generated at the bodies' start of substep poses with points up to a
+    // motion bound apart (negative depth), rather than at the integrated
+    // poses. See RigidBodyPhysicsSystem::configureSpeculativeContacts.
+    bool speculative;
 };
 
 struct CollisionEventTemporary : Archetype<CollisionEvent> {};
@@ -194,10 +221,40 @@ struct ObjectData {
     ObjectManager *mgr;
 };
 
+// Two bodies only collide if each one is in a group the other's mask
+// accepts. Bodies start out in every group and accept every group.
+struct CollisionFilter {
+    uint32_t groups;
+    uint32_t mask;
+
+    inline bool collidesWith(CollisionFilter o) const;
+
+    static inline CollisionFilter all();
+};
+
 namespace broadphase {
 
 struct LeafID {
     int32_t id;
+    // Set for leaves reserved from the StaticBVH. Code picking a tree (or
+    // indexing per dynamic leaf data like SleepData) must go by this rather
+    // than the entity's current ResponseType, see isStaticLeaf.
+    bool isStatic;
+};
+
+// Returns leaf_id.isStatic, asserting that response_type still agrees with
+// the tree the leaf was registered in. Bodies can't switch between static
+// and non-static without being unregistered and registered again.
+inline bool isStaticLeaf(LeafID leaf_id, ResponseType response_type);
+
+// How BVH::rebuild splits the leaves under each node. Midpoint splits at
+// the center of the leaf centroid bounds and is cheapest to build.
+// BinnedSAH picks the split that minimizes the surface area heuristic,
+// which is slower to build but gives much less overlap between siblings
+// for clustered scenes.
+enum class BuildMethod : uint32_t {
+    Midpoint,
+    BinnedSAH,
 };
 
 class BVH {
@@ -205,14 +262,29 @@ public:
     BVH(const ObjectManager *obj_mgr,
         CountT max_leaves,
         float leaf_velocity_expansion,
-        float leaf_accel_expansion);
+        float leaf_accel_expansion,
+        BuildMethod build_method = BuildMethod::Midpoint);
 
+    // Leaf IDs freed by removeLeaf are handed out again after the next
+    // updateTree(), so a tree never holds more than max_leaves leaves at
+    // once. Fails if it would.
     inline LeafID reserveLeaf(Entity e, base::ObjectID obj_id);
+    void removeLeaf(LeafID leaf_id);
     inline math::AABB getLeafAABB(LeafID leaf_id) const;
 
+    inline void setLeafFilter(LeafID leaf_id, CollisionFilter filter);
+    inline CollisionFilter getLeafFilter(LeafID leaf_id) const;
+
     template <typename Fn>
     inline void findOverlaps(const math::AABB &aabb, Fn &&fn) const;
 
+    // Only reports leaves whose filter collides with filter
+    template <typename Fn>
+    inline void findOverlaps(const math::AABB &aabb,
+                             CollisionFilter filter,
+                             Fn &&fn) const;
+
+    // Finds leaves overlapping leaf_id that its filter collides with
     template <typename Fn>
     inline void findOverlapsForLeaf(LeafID leaf_id, Fn &&fn) const;
 
@@ -222,6 +294,15 @@ public:
                     math::Vector3 *out_hit_normal,
                     float t_max = float(INFINITY));
 
+    // Traces rays in groups of consecutive rays that share one walk of the
+    // tree. Nodes are still tested ray by ray (there is no bounds test for
+    // the whole group); sharing the walk saves stack traffic and only pays
+    // off when neighboring rays are coherent (e.g. the pixels of a depth
+    // camera). hits must hold at least rays.size() entries initialized by
+    // the caller: ray i is traced up to hits[i].t and hits[i] is only
+    // overwritten by a closer hit.
+    void traceRays(Span<const Ray> rays, Span<RayHit> hits);
+
     void updateLeafPosition(LeafID leaf_id,
                             const math::Vector3 &pos,
                             const math::Quat &rot,
@@ -235,13 +316,32 @@ public:
     void refitLeaf(LeafID leaf_id, const math::AABB &leaf_aabb);
 
     inline void rebuildOnUpdate();
+    inline bool rebuildPending() const;
     void updateTree();
 
     inline void clearLeaves();
+    inline int32_t numLeaves() const;
 
 private:
+    // Lets tests check the tree's internal invariants
+    friend class BVHTestAccess;
+
     static constexpr int32_t sentinel_ = 0xFFFF'FFFF_i32;
 
+    // leaf_parents_ value of leaves that aren't linked into the tree
+    static constexpr uint32_t unlinked_leaf_ = 0xFFFF'FFFF_u32;
+
+    // Deepest level incremental insertion and rotations may push a subtree
+    // to. Keeps the fixed size traversal stacks from overflowing.
+    static constexpr int32_t max_incremental_depth_ = 24;
+
+    // A subtree is rebuilt once its SAH cost (relative to its own surface
+    // area) grows past this multiple of the cost it was built with.
+    static constexpr float max_sah_degradation_ = 1.5f;
+
+    // Rays traversed together by traceRays, one bit per ray in a mask
+    static constexpr CountT ray_packet_size_ = 32;
+
     struct Node {
         float minX[4];
         float minY[4];
@@ -259,6 +359,25 @@ private:
         inline void setInternal(CountT child, int32_t internal_idx);
         inline bool hasChild(CountT child) const;
         inline void clearChild(CountT child);
+
+        inline math::AABB childAABB(CountT child) const;
+        inline void setChildAABB(CountT child, const math::AABB &aabb);
+
+        // Test all 4 children at once. Bit i of the result is set if
+        // child i exists and passes the test.
+        inline uint32_t overlapMask(const math::AABB &aabb) const;
+        inline uint32_t rayIntersectMask(math::Vector3 ray_o,
+                                         math::Diag3x3 inv_ray_d,
+                                         float ray_t_min,
+                                         float ray_t_max) const;
+    };
+
+    // Bookkeeping for incremental maintenance, recomputed every update
+    struct NodeInfo {
+        int32_t height;
+        float sah;
+        float builtQuality;
+        bool degraded;
     };
 
     // FIXME: evaluate whether storing this in-line in the tree
@@ -271,9 +390,30 @@ private:
 
     inline CountT numInternalNodes(CountT num_leaves) const;
 
+    template <typename Fn>
+    inline void findOverlappingLeaves(const math::AABB &aabb,
+                                      Fn &&fn) const;
+
     void rebuild();
+    void buildSubtree(int32_t parent_idx, int32_t num_leaves);
     void refit(LeafID *leaf_ids, CountT num_moved);
 
+    int32_t midpointSplit(int32_t base, int32_t num_elems);
+    int32_t binnedSAHSplit(int32_t base, int32_t num_elems);
+
+    // Incremental maintenance between rebuilds
+    int32_t allocNode();
+    inline CountT numAvailableNodes() const;
+    bool insertLeaf(int32_t leaf_idx);
+    void refitAndRotate();
+    bool rebuildSubtree(int32_t parent_idx, CountT slot);
+    bool rebuildDegradedSubtrees();
+    void setChildParent(int32_t child, int32_t parent_idx, CountT slot);
+
+    void traceRayPacket(const Ray *rays, RayHit *hits, CountT num_rays);
+
+    inline int32_t allocLeafID();
+
     bool traceRayIntoLeaf(int32_t leaf_idx,
                           math::Vector3 world_ray_o,
                           math::Vector3 world_ray_d,
@@ -288,17 +428,43 @@ private:
     Entity *leaf_entities_;
     const ObjectManager *obj_mgr_;
     base::ObjectID *leaf_obj_ids_;
+    CollisionFilter *leaf_filters_;
     math::AABB *leaf_aabbs_; // FIXME: remove this, it's duplicated data
     LeafTransform  *leaf_transforms_;
     uint32_t *leaf_parents_;
     int32_t *sorted_leaves_;
+    NodeInfo *node_info_;
+    int32_t *free_nodes_;
+    CountT num_free_nodes_;
+    // High water mark of the leaf IDs handed out
     AtomicI32 num_leaves_;
     int32_t num_allocated_leaves_;
+    // Leaf IDs released by removeLeaf, moved to free_leaves_ by the next
+    // updateTree() and reused before growing num_leaves_
+    int32_t *released_leaves_;
+    AtomicI32 num_released_leaves_;
+    int32_t *free_leaves_;
+    AtomicI32 num_free_leaves_;
+    // Leaves reserved since the last updateTree(), linked in by it
+    int32_t *pending_leaves_;
+    AtomicI32 num_pending_leaves_;
     float leaf_velocity_expansion_;
     float leaf_accel_expansion_;
+    BuildMethod build_method_;
     bool force_rebuild_;
 };
 
+// ResponseType::Static bodies are kept in their own tree. Static leaves are
+// only written and the tree only rebuilt when rebuildOnUpdate() has been
+// called (on reset or when statics are added / moved), so the per-step
+// refit only touches dynamic leaves.
+class StaticBVH : public BVH {
+public:
+    using BVH::BVH;
+
+    inline LeafID reserveLeaf(Entity e, base::ObjectID obj_id);
+};
+
 }
 
 namespace solver {
@@ -328,12 +494,92 @@ struct RigidBodyPhysicsSystem {
                      math::Vector3 gravity,
                      CountT max_dynamic_objects,
                      CountT max_contacts_per_world,
-                     CountT max_joint_constraints_per_world);
+                     CountT max_joint_constraints_per_world,
+                     CountT max_static_objects = 0,
+                     broadphase::BuildMethod bvh_build_method =
+                         broadphase::BuildMethod::Midpoint);
 
     static void reset(Context &ctx);
-    static broadphase::LeafID registerEntity(Context &ctx,
-                                             Entity e,
-                                             base::ObjectID obj_id);
+
+    // The response type picks which BVH the returned leaf belongs to, and
+    // must match the entity's ResponseType component for as long as it
+    // stays registered.
+    static broadphase::LeafID registerEntity(
+        Context &ctx,
+        Entity e,
+        base::ObjectID obj_id,
+        ResponseType response_type);
+
+    // Removes the entity's leaf from its BVH. Must be called before the
+    // entity is destroyed or its LeafID component is removed. If the body
+    // was asleep, the rest of its island wakes at the start of the next
+    // step.
+    static void unregisterEntity(Context &ctx,
+                                 broadphase::LeafID leaf_id,
+                                 ResponseType response_type);
+
+    // Call after moving or otherwise modifying static bodies to have the
+    // static BVH rebuilt at the start of the next step.
+    static void markStaticBodiesModified(Context &ctx);
+
+    // Islands of touching or jointed dynamic bodies whose kinetic energy
+    // per unit mass stays below energy_threshold for time_to_sleep seconds
+    // are put to sleep: they skip integration, broadphase, narrowphase and
+    // the solver until an awake body touches them. Pass INFINITY as
+    // time_to_sleep to disable sleeping.
+    static void configureSleep(Context &ctx,
+                               float energy_threshold,
+                               float time_to_sleep);
+
+    // Colliding pairs whose relative motion over a substep exceeds
+    // motion_threshold times the smaller body's thinnest half extent are
+    // collided at their start of substep poses with a margin covering that
+    // motion. The resulting speculative contacts stop fast bodies from
+    // tunnelling through each other even with only 1 or 2 substeps. Pass
+    // INFINITY to disable.
+    static void configureSpeculativeContacts(Context &ctx,
+                                             float motion_threshold);
+
+    // Persistent contacts start each substep's position solve from the
+    // normal correction they needed in the previous one, which lets stacks
+    // and resting bodies settle with less sinking. Enabled by default.
+    static void configureContactWarmStart(Context &ctx, bool enabled);
+
+    // Filtered out pairs are dropped while traversing the BVHs, before any
+    // narrowphase work is queued for them.
+    static void setCollisionFilter(Context &ctx,
+                                   broadphase::LeafID leaf_id,
+                                   ResponseType response_type,
+                                   CollisionFilter filter);
+
+    // Stops (or resumes) collisions between two specific bodies, e.g. the
+    // links of one articulated robot. Exclusions are cleared by reset().
+    static void disableCollisions(Context &ctx, Entity a, Entity b);
+    static void enableCollisions(Context &ctx, Entity a, Entity b);
+
+    // Wakes the body's island at the start of the next step. Sleeping
+    // bodies wake on their own when given a velocity or external force,
+    // but must be woken explicitly after being teleported. leaf_id must
+    // come from a non-static body.
+    static void wakeBody(Context &ctx, broadphase::LeafID leaf_id);
+    static bool isBodyAsleep(Context &ctx, broadphase::LeafID leaf_id);
+
+    static Entity traceRay(Context &ctx,
+                           math::Vector3 o,
+                           math::Vector3 d,
+                           float *out_hit_t,
+                           math::Vector3 *out_hit_normal,
+                           float t_max = float(INFINITY));
+
+    // Batched version of traceRay across both BVHs, for sensors like depth
+    // cameras or lidar that cast many rays at once. hits[i].t is the
+    // distance along rays[i].d (depth for unit directions) and
+    // hits[i].entity can be used for segmentation. hits must hold at least
+    // rays.size() entries.
+    static void traceRays(Context &ctx,
+                          Span<const Ray> rays,
+                          Span<RayHit> hits,
+                          float t_max = float(INFINITY));
 
     template <typename Fn>
     static void findEntitiesWithinAABB(Context &ctx,
@@ -361,6 +607,7 @@ struct RigidBodyPhysicsSystem {
 };
 
 struct Cols {
+    static constexpr inline CountT Entity = 0;
     static constexpr inline CountT Position = 2;
     static constexpr inline CountT Rotation = 3;
     static constexpr inline CountT Scale = 4;
@@ -1,5 +1,12 @@
 #pragma once
 
+#if defined(MADRONA_GPU_MODE)
+#elif defined(MADRONA_X64)
+#include <immintrin.h>
+#elif defined(MADRONA_ARM)
+#include <arm_neon.h>
+#endif
+
 namespace madrona::phys {
 
 namespace geometry {
@@ -39,28 +46,109 @@ uint32_t HalfEdgeMesh::edgeToHalfEdge(uint32_t edge_id) const
 
 }
 
+bool CollisionFilter::collidesWith(CollisionFilter o) const
+{
+    return (groups & o.mask) != 0 && (o.groups & mask) != 0;
+}
+
+CollisionFilter CollisionFilter::all()
+{
+    return CollisionFilter {
+        .groups = 0xFFFF'FFFF,
+        .mask = 0xFFFF'FFFF,
+    };
+}
+
 namespace broadphase {
 
-LeafID BVH::reserveLeaf(Entity e, base::ObjectID obj_id)
+bool isStaticLeaf(LeafID leaf_id, ResponseType response_type)
+{
+    assert(leaf_id.isStatic == (response_type == ResponseType::Static));
+    (void)response_type;
+
+    return leaf_id.isStatic;
+}
+
+int32_t BVH::allocLeafID()
 {
+    // Only popped from between updates, can go negative once empty
+    int32_t free_idx = num_free_leaves_.fetch_sub_relaxed(1) - 1;
+    if (free_idx >= 0) {
+        return free_leaves_[free_idx];
+    }
+
     int32_t leaf_idx = num_leaves_.fetch_add_relaxed(1);
-    assert(leaf_idx < num_allocated_leaves_);
+    if (leaf_idx >= num_allocated_leaves_) {
+        FATAL("BVH out of leaves (max %d)", num_allocated_leaves_);
+    }
+
+    return leaf_idx;
+}
+
+LeafID BVH::reserveLeaf(Entity e, base::ObjectID obj_id)
+{
+    int32_t leaf_idx = allocLeafID();
 
     leaf_entities_[leaf_idx] = e;
     leaf_obj_ids_[leaf_idx] = obj_id;
+    leaf_filters_[leaf_idx] = CollisionFilter::all();
+    leaf_parents_[leaf_idx] = unlinked_leaf_;
+
+    // IDs aren't reused within a step, so this can't overflow
+    int32_t pending_idx = num_pending_leaves_.fetch_add_relaxed(1);
+    pending_leaves_[pending_idx] = leaf_idx;
 
     return LeafID {
-        leaf_idx,
+        .id = leaf_idx,
+        .isStatic = false,
     };
 }
 
+LeafID StaticBVH::reserveLeaf(Entity e, base::ObjectID obj_id)
+{
+    LeafID leaf_id = BVH::reserveLeaf(e, obj_id);
+    leaf_id.isStatic = true;
+
+    return leaf_id;
+}
+
 math::AABB BVH::getLeafAABB(LeafID leaf_id) const
 {
     return leaf_aabbs_[leaf_id.id];
 }
 
+void BVH::setLeafFilter(LeafID leaf_id, CollisionFilter filter)
+{
+    leaf_filters_[leaf_id.id] = filter;
+}
+
+CollisionFilter BVH::getLeafFilter(LeafID leaf_id) const
+{
+    return leaf_filters_[leaf_id.id];
+}
+
 template <typename Fn>
 void BVH::findOverlaps(const math::AABB &aabb, Fn &&fn) const
+{
+    findOverlappingLeaves(aabb, [&](int32_t leaf_idx) {
+        fn(leaf_entities_[leaf_idx]);
+    });
+}
+
+template <typename Fn>
+void BVH::findOverlaps(const math::AABB &aabb,
+                       CollisionFilter filter,
+                       Fn &&fn) const
+{
+    findOverlappingLeaves(aabb, [&](int32_t leaf_idx) {
+        if (filter.collidesWith(leaf_filters_[leaf_idx])) {
+            fn(leaf_entities_[leaf_idx]);
+        }
+    });
+}
+
+template <typename Fn>
+void BVH::findOverlappingLeaves(const math::AABB &aabb, Fn &&fn) const
 {
     int32_t stack[128];
     stack[0] = 0;
@@ -69,31 +157,17 @@ void BVH::findOverlaps(const math::AABB &aabb, Fn &&fn) const
     while (stack_size > 0) {
         int32_t node_idx = stack[--stack_size];
         const Node &node = nodes_[node_idx];
+
+        uint32_t overlap_mask = node.overlapMask(aabb);
         for (int i = 0; i < 4; i++) {
-            if (!node.hasChild(i)) {
-                continue; // Technically this could be break?
-            };
-
-            madrona::math::AABB child_aabb {
-                /* .pMin = */ {
-                    node.minX[i],
-                    node.minY[i],
-                    node.minZ[i],
-                },
-                /* .pMax = */ {
-                    node.maxX[i],
-                    node.maxY[i],
-                    node.maxZ[i],
-                },
-            };
-
-            if (aabb.overlaps(child_aabb)) {
-                if (node.isLeaf(i)) {
-                    Entity e = leaf_entities_[node.leafIDX(i)];
-                    fn(e);
-                } else {
-                    stack[stack_size++] = node.children[i];
-                }
+            if ((overlap_mask & (1 << i)) == 0) {
+                continue;
+            }
+
+            if (node.isLeaf(i)) {
+                fn(node.leafIDX(i));
+            } else {
+                stack[stack_size++] = node.children[i];
             }
         }
     }
@@ -102,8 +176,8 @@ void BVH::findOverlaps(const math::AABB &aabb, Fn &&fn) const
 template <typename Fn>
 void BVH::findOverlapsForLeaf(LeafID leaf_id, Fn &&fn) const
 {
-    math::AABB leaf_aabb = leaf_aabbs_[leaf_id.id];
-    findOverlaps(leaf_aabb, std::forward<Fn>(fn));
+    findOverlaps(leaf_aabbs_[leaf_id.id], leaf_filters_[leaf_id.id],
+                 std::forward<Fn>(fn));
 }
 
 void BVH::rebuildOnUpdate()
@@ -111,9 +185,27 @@ void BVH::rebuildOnUpdate()
     force_rebuild_ = true;
 }
 
+bool BVH::rebuildPending() const
+{
+    return force_rebuild_;
+}
+
+CountT BVH::numAvailableNodes() const
+{
+    return num_free_nodes_ + num_allocated_nodes_ - num_nodes_;
+}
+
 void BVH::clearLeaves()
 {
     num_leaves_.store_relaxed(0);
+    num_released_leaves_.store_relaxed(0);
+    num_free_leaves_.store_relaxed(0);
+    num_pending_leaves_.store_relaxed(0);
+}
+
+int32_t BVH::numLeaves() const
+{
+    return num_leaves_.load_relaxed();
 }
 
 bool BVH::Node::isLeaf(CountT child) const
@@ -146,6 +238,172 @@ void BVH::Node::clearChild(CountT child)
     children[child] = sentinel_;
 }
 
+math::AABB BVH::Node::childAABB(CountT child) const
+{
+    return math::AABB {
+        /* .pMin = */ {
+            minX[child],
+            minY[child],
+            minZ[child],
+        },
+        /* .pMax = */ {
+            maxX[child],
+            maxY[child],
+            maxZ[child],
+        },
+    };
+}
+
+void BVH::Node::setChildAABB(CountT child, const math::AABB &aabb)
+{
+    minX[child] = aabb.pMin.x;
+    minY[child] = aabb.pMin.y;
+    minZ[child] = aabb.pMin.z;
+    maxX[child] = aabb.pMax.x;
+    maxY[child] = aabb.pMax.y;
+    maxZ[child] = aabb.pMax.z;
+}
+
+// Same tests as AABB::overlaps and AABB::rayIntersects, with the 4 children
+// in the lanes of one vector. Nodes aren't 16 byte aligned in the nodes_
+// array, so the loads are unaligned.
+uint32_t BVH::Node::overlapMask(const math::AABB &aabb) const
+{
+#if defined(MADRONA_GPU_MODE)
+    uint32_t mask = 0;
+    for (CountT i = 0; i < 4; i++) {
+        if (hasChild(i) && aabb.overlaps(childAABB(i))) {
+            mask |= 1_u32 << i;
+        }
+    }
+
+    return mask;
+#elif defined(MADRONA_X64)
+    __m128 overlap_x = _mm_and_ps(
+        _mm_cmplt_ps(_mm_set1_ps(aabb.pMin.x), _mm_loadu_ps(maxX)),
+        _mm_cmplt_ps(_mm_loadu_ps(minX), _mm_set1_ps(aabb.pMax.x)));
+    __m128 overlap_y = _mm_and_ps(
+        _mm_cmplt_ps(_mm_set1_ps(aabb.pMin.y), _mm_loadu_ps(maxY)),
+        _mm_cmplt_ps(_mm_loadu_ps(minY), _mm_set1_ps(aabb.pMax.y)));
+    __m128 overlap_z = _mm_and_ps(
+        _mm_cmplt_ps(_mm_set1_ps(aabb.pMin.z), _mm_loadu_ps(maxZ)),
+        _mm_cmplt_ps(_mm_loadu_ps(minZ), _mm_set1_ps(aabb.pMax.z)));
+
+    __m128 empty = _mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_loadu_si128((const __m128i *)children),
+        _mm_set1_epi32(sentinel_)));
+
+    __m128 overlap =
+        _mm_and_ps(_mm_and_ps(overlap_x, overlap_y), overlap_z);
+
+    return (uint32_t)_mm_movemask_ps(_mm_andnot_ps(empty, overlap));
+#elif defined(MADRONA_ARM)
+    uint32x4_t overlap_x = vandq_u32(
+        vcltq_f32(vdupq_n_f32(aabb.pMin.x), vld1q_f32(maxX)),
+        vcltq_f32(vld1q_f32(minX), vdupq_n_f32(aabb.pMax.x)));
+    uint32x4_t overlap_y = vandq_u32(
+        vcltq_f32(vdupq_n_f32(aabb.pMin.y), vld1q_f32(maxY)),
+        vcltq_f32(vld1q_f32(minY), vdupq_n_f32(aabb.pMax.y)));
+    uint32x4_t overlap_z = vandq_u32(
+        vcltq_f32(vdupq_n_f32(aabb.pMin.z), vld1q_f32(maxZ)),
+        vcltq_f32(vld1q_f32(minZ), vdupq_n_f32(aabb.pMax.z)));
+
+    uint32x4_t empty =
+        vceqq_s32(vld1q_s32(children), vdupq_n_s32(sentinel_));
+
+    uint32x4_t overlap = vbicq_u32(
+        vandq_u32(vandq_u32(overlap_x, overlap_y), overlap_z), empty);
+
+    const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(overlap, vld1q_u32(lane_bits)));
+#else
+    STATIC_UNIMPLEMENTED();
+#endif
+}
+
+uint32_t BVH::Node::rayIntersectMask(math::Vector3 ray_o,
+                                     math::Diag3x3 inv_ray_d,
+                                     float ray_t_min,
+                                     float ray_t_max) const
+{
+#if defined(MADRONA_GPU_MODE)
+    uint32_t mask = 0;
+    for (CountT i = 0; i < 4; i++) {
+        if (hasChild(i) && childAABB(i).rayIntersects(
+                ray_o, inv_ray_d, ray_t_min, ray_t_max)) {
+            mask |= 1_u32 << i;
+        }
+    }
+
+    return mask;
+#elif defined(MADRONA_X64)
+    // A slab test that is 0 * inf produces NaN. _mm_min_ps / _mm_max_ps
+    // return their second operand if either is NaN, so passing the
+    // running interval second skips the NaN like fminf / fmaxf would.
+    __m128 t_near = _mm_set1_ps(ray_t_min);
+    __m128 t_far = _mm_set1_ps(ray_t_max);
+
+    auto slab = [&](const float *mins, const float *maxs,
+                    float o, float inv_d) {
+        __m128 o_v = _mm_set1_ps(o);
+        __m128 inv_d_v = _mm_set1_ps(inv_d);
+
+        __m128 t_lower = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mins), o_v),
+                                    inv_d_v);
+        __m128 t_upper = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxs), o_v),
+                                    inv_d_v);
+
+        t_near = _mm_max_ps(_mm_min_ps(t_lower, t_upper), t_near);
+        t_far = _mm_min_ps(_mm_max_ps(t_lower, t_upper), t_far);
+    };
+
+    slab(minX, maxX, ray_o.x, inv_ray_d.d0);
+    slab(minY, maxY, ray_o.y, inv_ray_d.d1);
+    slab(minZ, maxZ, ray_o.z, inv_ray_d.d2);
+
+    __m128 empty = _mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_loadu_si128((const __m128i *)children),
+        _mm_set1_epi32(sentinel_)));
+
+    __m128 hit = _mm_cmple_ps(t_near, t_far);
+
+    return (uint32_t)_mm_movemask_ps(_mm_andnot_ps(empty, hit));
+#elif defined(MADRONA_ARM)
+    // vminnmq / vmaxnmq return the number when one operand is NaN,
+    // matching fminf / fmaxf in AABB::rayIntersects
+    float32x4_t t_near = vdupq_n_f32(ray_t_min);
+    float32x4_t t_far = vdupq_n_f32(ray_t_max);
+
+    auto slab = [&](const float *mins, const float *maxs,
+                    float o, float inv_d) {
+        float32x4_t o_v = vdupq_n_f32(o);
+        float32x4_t inv_d_v = vdupq_n_f32(inv_d);
+
+        float32x4_t t_lower = vmulq_f32(vsubq_f32(vld1q_f32(mins), o_v),
+                                        inv_d_v);
+        float32x4_t t_upper = vmulq_f32(vsubq_f32(vld1q_f32(maxs), o_v),
+                                        inv_d_v);
+
+        t_near = vmaxnmq_f32(vminnmq_f32(t_lower, t_upper), t_near);
+        t_far = vminnmq_f32(vmaxnmq_f32(t_lower, t_upper), t_far);
+    };
+
+    slab(minX, maxX, ray_o.x, inv_ray_d.d0);
+    slab(minY, maxY, ray_o.y, inv_ray_d.d1);
+    slab(minZ, maxZ, ray_o.z, inv_ray_d.d2);
+
+    uint32x4_t empty =
+        vceqq_s32(vld1q_s32(children), vdupq_n_s32(sentinel_));
+
+    uint32x4_t hit = vbicq_u32(vcleq_f32(t_near, t_far), empty);
+
+    const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(hit, vld1q_u32(lane_bits)));
+#else
+    STATIC_UNIMPLEMENTED();
+#endif
+}
+
 }
 
 JointConstraint JointConstraint::setupFixed(
@@ -197,15 +455,16 @@ void RigidBodyPhysicsSystem::findEntitiesWithinAABB(Context &ctx,
     using namespace madrona::base;
     using namespace madrona::math;
 
-    auto &bvh = ctx.singleton<broadphase::BVH>();
-
-    bvh.findOverlaps(aabb, [&](Entity e) {
+    auto check_overlap = [&](Entity e) {
         bool overlap = RigidBodyPhysicsSystem::checkEntityAABBOverlap(
             ctx, aabb, e);
         if (overlap) {
             fn(e);
         }
-    });
+    };
+
+    ctx.singleton<broadphase::StaticBVH>().findOverlaps(aabb, check_overlap);
+    ctx.singleton<broadphase::BVH>().findOverlaps(aabb, check_overlap);
 }
 
 }
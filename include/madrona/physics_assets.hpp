@@ -47,6 +47,55 @@ public:
         HeapArray<math::AABB> objectAABBs;
     };
 
+    // Limits applied to every hull imported by importRigidBodyData. Zero
+    // disables the corresponding step unless noted otherwise. Simplified
+    // hulls are conservative: each face plane is pushed out to the furthest
+    // source vertex, so the result always contains the source hull.
+    struct HullSimplification {
+        // Face and vertex budgets. Hulls over budget have the pair of face
+        // planes with the smallest area weighted angle between them merged
+        // until they fit (with a floor of 4 faces), unless that would grow
+        // the hull by more than maxMergeDistance.
+        uint32_t maxFaces;
+        uint32_t maxVertices;
+        // Faces whose normals are within this angle (radians) are merged
+        // into a single plane
+        float mergeAngle;
+        // Small faces are collapsed into their neighbors, clustering their
+        // vertices, when the hull still extends at most this far beyond
+        // the source hull
+        float clusterDistance;
+        // How far merging down to the budgets may extend the hull beyond
+        // the source hull, as a fraction of the hull's largest extent.
+        // Hulls that can't meet the budgets within it are left over budget.
+        // 0 means 0.1.
+        float maxMergeDistance;
+    };
+
+    // View of ImportedRigidBodies that were serialized by cookRigidBodies.
+    // All pointers point into the cooked blob, which must outlive the view.
+    // Hull pointers in collisionPrimitives are stored as element offsets
+    // into the hull arrays below and are rebased by loadObjects.
+    struct CookedRigidBodies {
+        const RigidBodyMetadata *metadatas;
+        const math::AABB *objectAABBs;
+        const uint32_t *primOffsets;
+        const uint32_t *primCounts;
+        CountT numObjects;
+
+        const CollisionPrimitive *collisionPrimitives;
+        const math::AABB *primitiveAABBs;
+        CountT numPrimitives;
+
+        const geometry::HalfEdge *halfEdges;
+        CountT numHalfEdges;
+        const uint32_t *faceBaseHEs;
+        const geometry::Plane *facePlanes;
+        CountT numFaces;
+        const math::Vector3 *positions;
+        CountT numVertices;
+    };
+
     PhysicsLoader(ExecMode exec_mode, CountT max_objects);
     ~PhysicsLoader();
     PhysicsLoader(PhysicsLoader &&o);
@@ -54,7 +103,8 @@ public:
     Optional<ImportedRigidBodies> importRigidBodyData(
         const SourceCollisionObject *collision_objs,
         CountT num_objects,
-        bool build_hulls = true);
+        bool build_hulls = true,
+        const HullSimplification &hull_simplification = {});
 
     CountT loadObjects(const RigidBodyMetadata *metadatas,
                        const math::AABB *obj_aabbs,
@@ -72,11 +122,72 @@ public:
                        const math::Vector3 *hull_verts,
                        CountT total_num_hull_verts);
 
-
+    // Cache key for cooked rigid bodies: hashes every input that
+    // importRigidBodyData reads (source meshes, primitive parameters,
+    // mass, friction and hull settings).
+    static uint64_t hashSourceObjects(
+        const SourceCollisionObject *collision_objs,
+        CountT num_objects,
+        bool build_hulls = true,
+        const HullSimplification &hull_simplification = {});
+
+    // Serializes imported to a single versioned, relocatable blob tagged
+    // with source_hash.
+    static HeapArray<char> cookRigidBodies(
+        const ImportedRigidBodies &imported,
+        uint64_t source_hash);
+
+    static bool writeCookedRigidBodies(
+        const char *path,
+        const ImportedRigidBodies &imported,
+        uint64_t source_hash);
+
+    // Validates the blob header (magic, version, layout, size and
+    // source_hash) and every offset, count and hull index stored in it,
+    // then returns a view into blob without copying.
+    static Optional<CookedRigidBodies> readCookedRigidBodies(
+        const void *blob,
+        CountT num_bytes,
+        uint64_t source_hash);
+
+    CountT loadObjects(const CookedRigidBodies &cooked);
+
+    // Maps the cooked blob at path and passes it directly to loadObjects.
+    // Returns none if the file is missing, out of date or doesn't match
+    // source_hash, in which case the caller should import and cook again.
+    Optional<CountT> loadCookedObjects(const char *path,
+                                       uint64_t source_hash);
+
+    // Loads collision_objs from the cooked blob at path when it is valid
+    // and up to date, otherwise imports them from source and rewrites the
+    // blob. Returns none only if importing fails.
+    Optional<CountT> loadOrCookObjects(
+        const char *path,
+        const SourceCollisionObject *collision_objs,
+        CountT num_objects,
+        bool build_hulls = true,
+        const HullSimplification &hull_simplification = {});
 
     ObjectManager & getObjectManager();
 
 private:
+    CountT loadObjectsImpl(const RigidBodyMetadata *metadatas,
+                           const math::AABB *obj_aabbs,
+                           const uint32_t *prim_offsets,
+                           const uint32_t *prim_counts,
+                           CountT num_objs,
+                           const CollisionPrimitive *primitives,
+                           const math::AABB *primitive_aabbs,
+                           CountT total_num_primitives,
+                           const geometry::HalfEdge *hull_halfedges,
+                           CountT total_num_hull_halfedges,
+                           const uint32_t *hull_face_base_halfedges,
+                           const geometry::Plane *hull_face_planes,
+                           CountT total_num_hull_faces,
+                           const math::Vector3 *hull_verts,
+                           CountT total_num_hull_verts,
+                           bool hull_ptrs_are_offsets);
+
     struct Impl;
     std::unique_ptr<Impl> impl_;
 };
@@ -23,6 +23,7 @@
 namespace madrona {
 
 class StateManager;
+class StateCache;
 
 struct ArchetypeID {
     uint32_t id;
@@ -40,24 +41,62 @@ private:
 friend class StateManager;
 };
 
+// Command buffer for deferred structural changes. Entity creation,
+// destruction and component writes recorded into a Transaction are only
+// applied once the transaction is committed and the world's
+// ApplyTransactionsNode runs, so systems running in parallel can record
+// changes without touching the archetype tables.
+// A single Transaction must not be recorded into from multiple threads,
+// each worker / system invocation should use its own.
+// Entity IDs returned by makeEntity are reserved immediately; if the
+// Transaction is destroyed without being committed they are released.
 class Transaction {
+public:
+    Transaction(Transaction &&o);
+    ~Transaction();
+
 private:
-    enum Op : uint32_t {
+    enum class Op : uint32_t {
         Make,
         Destroy,
         Modify,
     };
 
     static constexpr uint32_t bytes_per_block_ = 8192;
+    static constexpr uint32_t max_payload_align_ = 64;
 
     struct Block {
+        alignas(max_payload_align_) char data[bytes_per_block_];
         Block *next;
         uint32_t curOffset;
         uint32_t numEntries;
-        char data[bytes_per_block_];
     };
 
+    // Every op starts with this header. The payload (component values for
+    // Make / Modify) starts payloadOffset bytes after the header.
+    struct OpHeader {
+        Op op;
+        uint32_t id; // Archetype ID for Make, component ID for Modify
+        uint32_t payloadOffset;
+        uint32_t numBytes;
+        Entity e;
+    };
+
+    Transaction(StateManager *state_mgr
+                MADRONA_MW_COND(, uint32_t world_id));
+
+    void * record(Op op, uint32_t id, Entity e, uint32_t num_payload_bytes,
+                  uint32_t payload_alignment);
+
     Block *head;
+    Block *tail;
+    StateManager *stateMgr;
+    // Cache the entity IDs of Make ops were allocated from, used to
+    // release them if the transaction is dropped
+    StateCache *stateCache;
+#ifdef MADRONA_MW_MODE
+    uint32_t worldID;
+#endif
 
 friend class StateManager;
 };
@@ -110,7 +149,10 @@ friend class StateManager;
 class StateManager {
 public:
 #ifdef MADRONA_MW_MODE
-    StateManager(CountT num_worlds);
+    // Archetypes registered without a max number of entities can hold up
+    // to max_rows_per_world rows in each world. 0 splits
+    // Table::maxRowsPerTable across the worlds (with a floor of 64K rows).
+    StateManager(CountT num_worlds, CountT max_rows_per_world = 0);
 #else
     StateManager();
 #endif
@@ -130,8 +172,20 @@ public:
     template <typename SingletonT>
     SingletonT * exportSingleton();
 
-    void copyInExportedColumns();
-    void copyOutExportedColumns();
+#ifdef MADRONA_MW_MODE
+    // Layout of a buffer returned by exportColumn: world i's rows start at
+    // row i * rowsPerWorld, and the first numArchetypeRows(i, archetypeID)
+    // of them are live.
+    struct ExportInfo {
+        void *ptr;
+        uint32_t archetypeID;
+        uint32_t numBytesPerRow;
+        CountT rowsPerWorld;
+    };
+
+    // Returns nullptr if exported wasn't returned by exportColumn
+    const ExportInfo * getExportInfo(void *exported) const;
+#endif
 
     template <typename SingletonT>
     SingletonT & getSingleton(MADRONA_MW_COND(uint32_t world_id));
@@ -180,9 +234,40 @@ public:
     inline void iterateEntities(MADRONA_MW_COND(uint32_t world_id,)
                                 const Query<ComponentTs...> &query, Fn &&fn);
 
-    Transaction makeTransaction();
+    // Same as above but only visits the entities in
+    // [entity_offset, entity_offset + num_entities), where the rows of all
+    // matching archetypes are treated as one contiguous range. Used to split
+    // a query across multiple threads.
+    template <typename... ComponentTs, typename Fn>
+    inline void iterateEntities(MADRONA_MW_COND(uint32_t world_id,)
+                                const Query<ComponentTs...> &query,
+                                CountT entity_offset,
+                                CountT num_entities,
+                                Fn &&fn);
+
+    template <typename... ComponentTs>
+    inline CountT numMatchingEntities(MADRONA_MW_COND(uint32_t world_id,)
+                                      const Query<ComponentTs...> &query);
+
+    Transaction makeTransaction(MADRONA_MW_COND(uint32_t world_id));
+
+    // Hands the recorded ops over to the world, they are applied by the
+    // next applyTransactions call.
     void commitTransaction(Transaction &&txn);
 
+    // Releases the entity IDs reserved by an uncommitted transaction.
+    // Called by ~Transaction.
+    void discardTransaction(Transaction &txn);
+
+    // Applies all committed transactions of the world in one batch. All
+    // Make ops are applied first (grouped by archetype so each table only
+    // grows once), followed by Modify ops and finally Destroy ops (grouped
+    // by archetype with the entity IDs released in bulk).
+    void applyTransactions(MADRONA_MW_COND(uint32_t world_id,)
+                           StateCache &cache);
+
+    // The returned Entity is immediately valid as an ID, but has no
+    // components until the transaction is applied.
     template <typename ArchetypeT, typename... Args>
     inline Entity makeEntity(MADRONA_MW_COND(uint32_t world_id,)
                              Transaction &txn, StateCache &cache,
@@ -191,6 +276,11 @@ public:
     void destroyEntity(MADRONA_MW_COND(uint32_t world_id,)
                        Transaction &txn, StateCache &cache, Entity e);
 
+    template <typename ComponentT>
+    inline void modifyEntity(MADRONA_MW_COND(uint32_t world_id,)
+                             Transaction &txn, Entity e,
+                             const ComponentT &value);
+
     template <typename ArchetypeT, typename... Args>
     inline Entity makeEntityNow(MADRONA_MW_COND(uint32_t world_id,)
                                 StateCache &cache, Args && ...args);
@@ -201,6 +291,27 @@ public:
     template <typename ArchetypeT>
     inline Loc makeTemporary(MADRONA_MW_COND(uint32_t world_id));
 
+    template <typename ArchetypeT>
+    inline Loc makeTemporaries(MADRONA_MW_COND(uint32_t world_id,)
+                               CountT num_temporaries);
+
+    // Raw access to an archetype's table, used by nodes like
+    // SortArchetypeNode that operate on whole columns. Column 0 is always
+    // the Entity column.
+    inline CountT numArchetypeRows(MADRONA_MW_COND(uint32_t world_id,)
+                                   uint32_t archetype_id);
+    int32_t getArchetypeColumnIndex(uint32_t archetype_id,
+                                    uint32_t component_id);
+    inline void * getArchetypeColumn(MADRONA_MW_COND(uint32_t world_id,)
+                                     uint32_t archetype_id,
+                                     int32_t column_idx);
+    uint32_t getArchetypeColumnBytesPerRow(uint32_t archetype_id,
+                                           int32_t column_idx);
+    inline int32_t getArchetypeNumColumns(uint32_t archetype_id);
+
+    // Updates the row of Entity e after it was moved within its table
+    inline void remapEntity(Entity e, int32_t row_idx);
+
     template <typename ArchetypeT>
     inline void clear(MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
                       bool is_temporary);
@@ -229,16 +340,35 @@ private:
             HeapArray<int32_t> activeRows;
         };
 
+        // The per-world tables of archetypes without a max number of
+        // entities share one world-major region per column, so the number
+        // of mappings doesn't grow with the number of worlds. World i's
+        // rows start at row i * rowsPerWorld, which also makes the columns
+        // directly exportable.
+        struct WorldMajorColumn {
+            VirtualRegion mem;
+            uint32_t numBytesPerRow;
+        };
+
         union {
             HeapArray<Table> tbls;
             Fixed fixed;
         };
         CountT maxNumPerWorld;
 
+        HeapArray<WorldMajorColumn> worldMajorColumns;
+        CountT rowsPerWorld;
+        // Rows committed per world, only tracked when the column regions
+        // can't be committed lazily
+        HeapArray<uint32_t> numCommittedRows;
+
         inline TableStorage(Span<TypeInfo> types,
                             CountT num_worlds,
-                            CountT max_num_per_world);
+                            CountT max_num_per_world,
+                            CountT rows_per_world);
         ~TableStorage();
+
+        void commitRows(uint32_t world_id, CountT num_rows);
 #else
         inline TableStorage(Span<TypeInfo> types);
 
@@ -254,6 +384,8 @@ private:
         inline void clear(MADRONA_MW_COND(uint32_t world_id));
 
         inline CountT addRow(MADRONA_MW_COND(uint32_t world_id));
+        inline CountT addRows(MADRONA_MW_COND(uint32_t world_id,)
+                              CountT num_rows);
         inline bool removeRow(MADRONA_MW_COND(uint32_t world_id,) CountT row);
     };
 
@@ -274,18 +406,6 @@ private:
         VirtualArray<uint32_t> queryData;
     };
 
-#ifdef MADRONA_MW_MODE
-    struct ExportJob {
-        uint32_t archetypeIdx;
-        uint32_t columnIdx;
-        uint32_t numBytesPerRow;
-
-        uint32_t numMappedChunks;
-
-        VirtualRegion mem;
-    };
-#endif
-
     template <typename... ComponentTs, typename Fn, uint32_t... Indices>
     void iterateArchetypesImpl(MADRONA_MW_COND(uint32_t world_id,) 
                                const Query<ComponentTs...> &query, Fn &&fn,
@@ -304,16 +424,20 @@ private:
     void clear(MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
                uint32_t archetype_id, bool is_temporary);
 
+    void applyMakeOps(MADRONA_MW_COND(uint32_t world_id,)
+                      Span<Transaction::OpHeader *> ops);
+    void applyModifyOps(MADRONA_MW_COND(uint32_t world_id,)
+                        Span<Transaction::OpHeader *> ops);
+    void applyDestroyOps(MADRONA_MW_COND(uint32_t world_id,)
+                         StateCache &cache,
+                         Span<Transaction::OpHeader *> ops);
+
     StateCache init_state_cache_; // FIXME remove
     EntityStore entity_store_;
     DynArray<Optional<TypeInfo>> component_infos_;
     DynArray<ComponentID> archetype_components_;
     DynArray<Optional<ArchetypeStore>> archetype_stores_;
 
-#ifdef MADRONA_MW_MODE
-    DynArray<ExportJob> export_jobs_;
-#endif
-
     // FIXME: TmpAllocator doesn't belong here should be per CPU worker
     struct TmpAllocator {
         struct Block;
@@ -349,9 +473,30 @@ private:
     TmpAllocator tmp_allocator_;
 #endif
 
+    // Blocks of committed transactions waiting for applyTransactions
+    struct PendingTransactions {
+        Transaction::Block *head;
+        Transaction::Block *tail;
+    };
+
+#ifdef MADRONA_MW_MODE
+    HeapArray<PendingTransactions> pending_txns_;
+#else
+    PendingTransactions pending_txns_;
+    SpinLock pending_txns_lock_;
+#endif
+
 #ifdef MADRONA_MW_MODE
     uint32_t num_worlds_;
+    CountT max_rows_per_world_;
+    DynArray<ExportInfo> export_infos_;
     SpinLock register_lock_;
+
+    // Serializes structural changes (entity creation / deletion,
+    // temporaries, tmpAlloc and committed transactions) within a world,
+    // since the CPU backend may run multiple invocations of a world's
+    // taskgraph nodes concurrently.
+    HeapArray<SpinLock> world_locks_;
 #endif
 
     static constexpr uint32_t user_component_offset_ =
@@ -358,10 +358,53 @@ void StateManager::iterateEntities(MADRONA_MW_COND(uint32_t world_id,)
     });
 }
 
+template <typename... ComponentTs, typename Fn>
+void StateManager::iterateEntities(MADRONA_MW_COND(uint32_t world_id,)
+                                   const Query<ComponentTs...> &query,
+                                   CountT entity_offset,
+                                   CountT num_entities,
+                                   Fn &&fn)
+{
+    CountT range_end = entity_offset + num_entities;
+    CountT archetype_start = 0;
+
+    iterateArchetypes(MADRONA_MW_COND(world_id,) query,
+            [&](int num_rows, auto ...ptrs) {
+        CountT archetype_end = archetype_start + num_rows;
+
+        CountT start = std::max(archetype_start, entity_offset);
+        CountT end = std::min(archetype_end, range_end);
+
+        for (CountT i = start - archetype_start;
+             i < end - archetype_start; i++) {
+            fn(ptrs[i] ...);
+        }
+
+        archetype_start = archetype_end;
+    });
+}
+
+template <typename... ComponentTs>
+CountT StateManager::numMatchingEntities(MADRONA_MW_COND(uint32_t world_id,)
+                                         const Query<ComponentTs...> &query)
+{
+    CountT num_entities = 0;
+    iterateArchetypes(MADRONA_MW_COND(world_id,) query,
+            [&](int num_rows, auto ...) {
+        num_entities += num_rows;
+    });
+
+    return num_entities;
+}
+
 template <typename ArchetypeT, typename... Args>
 Entity StateManager::makeEntityNow(MADRONA_MW_COND(uint32_t world_id,)
                                    StateCache &cache, Args && ...args)
 {
+#ifdef MADRONA_MW_MODE
+    std::lock_guard lock(world_locks_[world_id]);
+#endif
+
     ArchetypeID archetype_id = archetypeID<ArchetypeT>();
 
     ArchetypeStore &archetype = *archetype_stores_[archetype_id.id];
@@ -411,9 +454,97 @@ Entity StateManager::makeEntityNow(MADRONA_MW_COND(uint32_t world_id,)
     return e;
 }
 
+template <typename ArchetypeT, typename... Args>
+Entity StateManager::makeEntity(MADRONA_MW_COND(uint32_t world_id,)
+                                Transaction &txn, StateCache &cache,
+                                Args && ...args)
+{
+    ArchetypeID archetype_id = archetypeID<ArchetypeT>();
+
+#ifndef NDEBUG
+    ArchetypeStore &archetype = *archetype_stores_[archetype_id.id];
+    constexpr uint32_t num_args = sizeof...(Args);
+
+    assert((num_args == 0 || num_args == archetype.numComponents) &&
+           "Trying to construct entity with wrong number of arguments");
+#endif
+
+    assert(txn.stateCache == nullptr || txn.stateCache == &cache);
+    txn.stateCache = &cache;
+
+    Entity e;
+    {
+#ifdef MADRONA_MW_MODE
+        assert(world_id == txn.worldID);
+        std::lock_guard lock(world_locks_[world_id]);
+#endif
+        e = entity_store_.newEntity(cache.entity_cache_);
+        entity_store_.setLoc(e, Loc::none());
+    }
+
+    // Component values are packed back to back, each aligned to its own
+    // alignment. applyMakeOps recomputes the same offsets from the
+    // archetype's TypeInfos.
+    uint32_t num_payload_bytes = 0;
+    uint32_t payload_alignment = 1;
+
+    auto addPayloadBytes = [&]<typename ComponentT>() {
+        num_payload_bytes = utils::roundUp(num_payload_bytes,
+            uint32_t(alignof(ComponentT))) + uint32_t(sizeof(ComponentT));
+        payload_alignment = std::max(payload_alignment,
+            uint32_t(alignof(ComponentT)));
+    };
+
+    ( addPayloadBytes.template operator()<std::remove_cvref_t<Args>>(), ... );
+
+    char *payload = (char *)txn.record(Transaction::Op::Make,
+        archetype_id.id, e, num_payload_bytes, payload_alignment);
+
+    uint32_t cur_offset = 0;
+    int component_idx = 0;
+    auto constructNextComponent = [&](auto &&arg) {
+        using ArgT = decltype(arg);
+        using ComponentT = std::remove_cvref_t<ArgT>;
+
+        assert(componentID<ComponentT>().id ==
+               archetype_components_[archetype.componentOffset +
+                   component_idx].id);
+
+        cur_offset = utils::roundUp(cur_offset, uint32_t(alignof(ComponentT)));
+        new (payload + cur_offset) ComponentT(std::forward<ArgT>(arg));
+        cur_offset += sizeof(ComponentT);
+
+        component_idx++;
+    };
+
+    ( constructNextComponent(std::forward<Args>(args)), ... );
+
+    return e;
+}
+
+template <typename ComponentT>
+void StateManager::modifyEntity(MADRONA_MW_COND(uint32_t world_id,)
+                                Transaction &txn, Entity e,
+                                const ComponentT &value)
+{
+#ifdef MADRONA_MW_MODE
+    assert(world_id == txn.worldID);
+#endif
+
+    void *payload = txn.record(Transaction::Op::Modify,
+        componentID<ComponentT>().id, e, sizeof(ComponentT),
+        alignof(ComponentT));
+
+    new (payload) ComponentT(value);
+}
+
 template <typename ArchetypeT>
 Loc StateManager::makeTemporary(MADRONA_MW_COND(uint32_t world_id))
 {
+#ifdef MADRONA_MW_MODE
+    std::lock_guard lock(world_locks_[world_id]);
+#endif
+
     ArchetypeID archetype_id = archetypeID<ArchetypeT>();
     ArchetypeStore &archetype = *archetype_stores_[archetype_id.id];
 
@@ -426,6 +557,52 @@ Loc StateManager::makeTemporary(MADRONA_MW_COND(uint32_t world_id))
     };
 }
 
+template <typename ArchetypeT>
+Loc StateManager::makeTemporaries(MADRONA_MW_COND(uint32_t world_id,)
+                                  CountT num_temporaries)
+{
+#ifdef MADRONA_MW_MODE
+    std::lock_guard lock(world_locks_[world_id]);
+#endif
+
+    ArchetypeID archetype_id = archetypeID<ArchetypeT>();
+    ArchetypeStore &archetype = *archetype_stores_[archetype_id.id];
+
+    CountT base_row = archetype.tblStorage.addRows(
+        MADRONA_MW_COND(world_id,) num_temporaries);
+
+    return Loc {
+        archetype_id.id,
+        int32_t(base_row),
+    };
+}
+
+CountT StateManager::numArchetypeRows(MADRONA_MW_COND(uint32_t world_id,)
+                                      uint32_t archetype_id)
+{
+    return archetype_stores_[archetype_id]->tblStorage.numRows(
+        MADRONA_MW_COND(world_id));
+}
+
+void * StateManager::getArchetypeColumn(MADRONA_MW_COND(uint32_t world_id,)
+                                        uint32_t archetype_id,
+                                        int32_t column_idx)
+{
+    return archetype_stores_[archetype_id]->tblStorage.column<char>(
+        MADRONA_MW_COND(world_id,) column_idx);
+}
+
+int32_t StateManager::getArchetypeNumColumns(uint32_t archetype_id)
+{
+    return int32_t(archetype_stores_[archetype_id]->numComponents +
+                   user_component_offset_);
+}
+
+void StateManager::remapEntity(Entity e, int32_t row_idx)
+{
+    entity_store_.setRow(e, uint32_t(row_idx));
+}
+
 template <typename ArchetypeT>
 void StateManager::clear(MADRONA_MW_COND(uint32_t world_id,) StateCache &cache,
                          bool is_temporary)
@@ -491,7 +668,14 @@ CountT StateManager::TableStorage::addRow(
 {
 #ifdef MADRONA_MW_MODE
     if (maxNumPerWorld == 0) {
-        return tbls[world_id].addRow();
+        CountT row = tbls[world_id].addRow();
+
+        if (numCommittedRows.size() > 0 &&
+                row >= (CountT)numCommittedRows[world_id]) [[unlikely]] {
+            commitRows(world_id, row + 1);
+        }
+
+        return row;
     } else {
         return fixed.activeRows[world_id]++;
     }
@@ -500,6 +684,31 @@ CountT StateManager::TableStorage::addRow(
 #endif
 }
 
+CountT StateManager::TableStorage::addRows(
+    MADRONA_MW_COND(uint32_t world_id,) CountT num_rows)
+{
+#ifdef MADRONA_MW_MODE
+    if (maxNumPerWorld == 0) {
+        CountT row = tbls[world_id].addRows(uint32_t(num_rows));
+
+        if (numCommittedRows.size() > 0 &&
+                row + num_rows > (CountT)numCommittedRows[world_id]) {
+            commitRows(world_id, row + num_rows);
+        }
+
+        return row;
+    } else {
+        CountT row = fixed.activeRows[world_id];
+        fixed.activeRows[world_id] += int32_t(num_rows);
+        assert(fixed.activeRows[world_id] <= maxNumPerWorld);
+
+        return row;
+    }
+#else
+    return tbl.addRows(uint32_t(num_rows));
+#endif
+}
+
 bool StateManager::TableStorage::removeRow(MADRONA_MW_COND(uint32_t world_id,)
                                            CountT row)
 {
@@ -24,10 +24,25 @@ struct TypeInfo {
 
 class Table {
 public:
+    static constexpr uint32_t maxColumns = 128;
+    static constexpr CountT maxRowsPerTable = 1 << 28;
+
+    // Each column reserves virtual memory for max_num_rows rows up front
+    // and commits pages as rows are added, so column pointers stay stable
+    // for the lifetime of the table.
+    Table(const TypeInfo *component_types, CountT num_components,
+          CountT init_num_rows, CountT max_num_rows = maxRowsPerTable);
+
+    // Table whose columns live in memory owned by the caller, such as
+    // slices of regions shared by many tables. column_data[i] must stay
+    // readable & writable for max_num_rows rows of column i; the table
+    // never commits or frees it.
     Table(const TypeInfo *component_types, CountT num_components,
-          CountT init_num_rows);
+          CountT max_num_rows, void * const *column_data);
 
     uint32_t addRow();
+    // Adds num_rows contiguous rows, returns the index of the first one
+    uint32_t addRows(uint32_t num_rows);
     bool removeRow(uint32_t row);
     void copyRow(uint32_t dst, uint32_t src);
 
@@ -42,12 +57,14 @@ public:
     // Drops all rows in the table and frees memory
     void clear();
 
-    static constexpr uint32_t maxColumns = 128;
-
 private:
+    void commitRows(uint32_t num_rows);
+
     uint32_t num_rows_;
     uint32_t num_allocated_rows_;
+    uint32_t max_rows_;
     uint32_t num_components_;
+    HeapArray<VirtualRegion> column_regions_;
     InlineArray<void *, maxColumns> columns_;
     InlineArray<uint32_t, maxColumns> bytes_per_column_;
 };
@@ -24,8 +24,19 @@ private:
 
     struct Node {
         void (*fn)(NodeBase *, Context *, TaskGraph *);
+        // Only set for nodes that can be split into independent invocations
+        // (see TaskGraphBuilder::addDynamicCountNode).
+        void (*invocationsFn)(NodeBase *, Context *, TaskGraph *,
+                              CountT, CountT);
+        CountT (*countFn)(NodeBase *, TaskGraph *);
+        // Compiler generated signature naming the node's function, for
+        // profiling output
+        const char *name;
         uint32_t dataIDX;
         uint32_t numChildren;
+        uint32_t numDependencies;
+        uint32_t dependentsOffset;
+        uint32_t numDependents;
     };
 
 public:
@@ -33,20 +44,67 @@ public:
               StateCache *state_cache,
               MADRONA_MW_COND(uint32_t world_id,) 
               HeapArray<Node> &&sorted_nodes,
-              HeapArray<NodeData> &&node_datas);
+              HeapArray<NodeData> &&node_datas,
+              HeapArray<void (*)(NodeBase *)> &&data_destructors,
+              HeapArray<uint32_t> &&dependents);
     TaskGraph(const TaskGraph &) = delete;
+    ~TaskGraph();
 
+    // Runs all nodes serially on the calling thread
     void run(Context *ctx);
 
+    // The below functions let a backend schedule the graph itself. Nodes
+    // are indexed in topologically sorted order; a node may run once all
+    // numDependencies(node_idx) nodes listing it in dependents() finish.
+    inline CountT numNodes() const;
+    inline uint32_t numDependencies(CountT node_idx) const;
+    inline Span<const uint32_t> dependents(CountT node_idx) const;
+
+    // True if the node's work can be split into numInvocations(node_idx)
+    // independent pieces with runNodeInvocations. Otherwise use runNode.
+    inline bool isParallelNode(CountT node_idx) const;
+    inline CountT numInvocations(CountT node_idx);
+    inline const char * nodeName(CountT node_idx) const;
+
+    inline void runNode(Context *ctx, CountT node_idx);
+    inline void runNodeInvocations(Context *ctx, CountT node_idx,
+                                   CountT invocation_offset,
+                                   CountT num_invocations);
+
     template <typename ArchetypeT>
     void clearTemporaries();
     void resetTmpAlloc();
+    void applyTransactions();
+
+    // Table access for nodes that operate on whole archetypes, see
+    // the matching StateManager functions.
+    inline CountT numArchetypeRows(uint32_t archetype_id);
+    inline void * getArchetypeColumn(uint32_t archetype_id,
+                                     int32_t column_idx);
+    inline uint32_t getArchetypeColumnBytesPerRow(uint32_t archetype_id,
+                                                  int32_t column_idx);
+    inline int32_t getArchetypeNumColumns(uint32_t archetype_id);
+    inline void remapEntity(Entity e, int32_t row_idx);
+
+    // For custom nodes that size their invocation count from world state
+    template <typename SingletonT>
+    inline SingletonT & getSingleton();
 
     template <typename ContextT, typename Fn, typename ...ComponentTs>
     void iterateQuery(ContextT &ctx,
                       Query<ComponentTs...> &query,
                       Fn &&fn);
 
+    template <typename ContextT, typename Fn, typename ...ComponentTs>
+    void iterateQuery(ContextT &ctx,
+                      Query<ComponentTs...> &query,
+                      CountT offset,
+                      CountT num_entities,
+                      Fn &&fn);
+
+    template <typename ...ComponentTs>
+    CountT numMatchingEntities(Query<ComponentTs...> &query);
+
 private:
     StateManager *state_mgr_;
     StateCache *state_cache_;
@@ -55,6 +113,9 @@ private:
 #endif
     HeapArray<Node> sorted_nodes_;
     HeapArray<NodeData> node_datas_;
+    // Destructor of each node data, nullptr if trivially destructible
+    HeapArray<void (*)(NodeBase *)> data_destructors_;
+    HeapArray<uint32_t> dependents_;
 
 friend class TaskGraphBuilder;
 };
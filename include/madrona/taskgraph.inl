@@ -2,6 +2,55 @@
 
 namespace madrona {
 
+CountT TaskGraph::numNodes() const
+{
+    return sorted_nodes_.size();
+}
+
+uint32_t TaskGraph::numDependencies(CountT node_idx) const
+{
+    return sorted_nodes_[node_idx].numDependencies;
+}
+
+Span<const uint32_t> TaskGraph::dependents(CountT node_idx) const
+{
+    const Node &node = sorted_nodes_[node_idx];
+    return Span<const uint32_t>(dependents_.data() + node.dependentsOffset,
+                                node.numDependents);
+}
+
+bool TaskGraph::isParallelNode(CountT node_idx) const
+{
+    return sorted_nodes_[node_idx].invocationsFn != nullptr;
+}
+
+CountT TaskGraph::numInvocations(CountT node_idx)
+{
+    const Node &node = sorted_nodes_[node_idx];
+    return node.countFn(
+        (NodeBase *)(&node_datas_[node.dataIDX].userData[0]), this);
+}
+
+const char * TaskGraph::nodeName(CountT node_idx) const
+{
+    return sorted_nodes_[node_idx].name;
+}
+
+void TaskGraph::runNode(Context *ctx, CountT node_idx)
+{
+    const Node &node = sorted_nodes_[node_idx];
+    node.fn((NodeBase *)(&node_datas_[node.dataIDX].userData[0]), ctx, this);
+}
+
+void TaskGraph::runNodeInvocations(Context *ctx, CountT node_idx,
+                                   CountT invocation_offset,
+                                   CountT num_invocations)
+{
+    const Node &node = sorted_nodes_[node_idx];
+    node.invocationsFn((NodeBase *)(&node_datas_[node.dataIDX].userData[0]),
+                       ctx, this, invocation_offset, num_invocations);
+}
+
 template <typename ArchetypeT>
 void TaskGraph::clearTemporaries()
 {
@@ -9,6 +58,43 @@ void TaskGraph::clearTemporaries()
                                   *state_cache_, true);
 }
 
+CountT TaskGraph::numArchetypeRows(uint32_t archetype_id)
+{
+    return state_mgr_->numArchetypeRows(MADRONA_MW_COND(cur_world_id_,)
+                                        archetype_id);
+}
+
+void * TaskGraph::getArchetypeColumn(uint32_t archetype_id,
+                                     int32_t column_idx)
+{
+    return state_mgr_->getArchetypeColumn(MADRONA_MW_COND(cur_world_id_,)
+                                          archetype_id, column_idx);
+}
+
+uint32_t TaskGraph::getArchetypeColumnBytesPerRow(uint32_t archetype_id,
+                                                  int32_t column_idx)
+{
+    return state_mgr_->getArchetypeColumnBytesPerRow(archetype_id,
+                                                     column_idx);
+}
+
+int32_t TaskGraph::getArchetypeNumColumns(uint32_t archetype_id)
+{
+    return state_mgr_->getArchetypeNumColumns(archetype_id);
+}
+
+void TaskGraph::remapEntity(Entity e, int32_t row_idx)
+{
+    state_mgr_->remapEntity(e, row_idx);
+}
+
+template <typename SingletonT>
+SingletonT & TaskGraph::getSingleton()
+{
+    return state_mgr_->getSingleton<SingletonT>(
+        MADRONA_MW_COND(cur_world_id_));
+}
+
 template <typename ContextT, typename Fn, typename ...ComponentTs>
 void TaskGraph::iterateQuery(ContextT &ctx,
                              Query<ComponentTs...> &query,
@@ -20,4 +106,24 @@ void TaskGraph::iterateQuery(ContextT &ctx,
         });
 }
 
+template <typename ContextT, typename Fn, typename ...ComponentTs>
+void TaskGraph::iterateQuery(ContextT &ctx,
+                             Query<ComponentTs...> &query,
+                             CountT offset,
+                             CountT num_entities,
+                             Fn &&fn)
+{
+    state_mgr_->iterateEntities(MADRONA_MW_COND(cur_world_id_,) query,
+        offset, num_entities, [&](auto &...refs) {
+            fn(ctx, refs...);
+        });
+}
+
+template <typename ...ComponentTs>
+CountT TaskGraph::numMatchingEntities(Query<ComponentTs...> &query)
+{
+    return state_mgr_->numMatchingEntities(
+        MADRONA_MW_COND(cur_world_id_,) query);
+}
+
 }
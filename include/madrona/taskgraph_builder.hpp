@@ -1,6 +1,7 @@
 #pragma once 
 
 #include <madrona/fwd.hpp>
+#include <madrona/macros.hpp>
 #include <madrona/taskgraph.hpp>
 #include <madrona/context.hpp>
 
@@ -25,6 +26,13 @@ public:
     // Pass in the template'd type of the node to create and the
     // TaskGraphNodeIDs the node should depend on.
     // Returns a TaskGraphNodeID for the newly added taskgraph node.
+    //
+    // Dependencies are the only ordering guarantee. The CPU backend runs
+    // any two nodes without a dependency path between them concurrently,
+    // so nodes touching the same data (with at least one of them writing
+    // it) must be linked, directly or transitively. The GPU backend runs
+    // one node at a time in the sorted order, so a missing dependency
+    // there can go unnoticed until the graph runs on the CPU.
     // Example:
     //   auto next_node = builder.addToGraph<ParallelForNode<
     //      MyContext, mySystem, MyComponent>>({other_node});
@@ -56,6 +64,24 @@ public:
     TaskGraphNodeID addDefaultNode(Span<const TaskGraphNodeID> dependencies,
                                    Args && ...args);
 
+    // Adds a node whose work can be split into independent invocations that
+    // the backend is free to run concurrently. NodeT must provide:
+    //   CountT numInvocations(TaskGraph &);
+    //   void runInvocations(Context &, TaskGraph &,
+    //                       CountT invocation_offset, CountT num_invocations);
+    // numInvocations is evaluated once all of the node's dependencies finish.
+    template <typename NodeT, typename... Args>
+    TaskGraphNodeID addDynamicCountNode(
+        Span<const TaskGraphNodeID> dependencies,
+        Args && ...args);
+
+    // Same as addDynamicCountNode, but for an existing node data and with
+    // explicit member functions, so one node data can back multiple nodes.
+    template <auto count_fn, auto invocations_fn, typename NodeT>
+    TaskGraphNodeID addDynamicCountNodeFn(
+        TypedDataID<NodeT> data,
+        Span<const TaskGraphNodeID> dependencies);
+
     template <typename NodeT>
     NodeT & getDataRef(TypedDataID<NodeT> data_id);
 
@@ -63,8 +89,15 @@ public:
     TaskGraph build();
 
 private:
+    template <auto fn>
+    static inline const char * nodeFnName();
+
     TaskGraphNodeID registerNode(uint32_t data_idx,
         void (*fn)(NodeBase *, Context *, TaskGraph *),
+        void (*invocations_fn)(NodeBase *, Context *, TaskGraph *,
+                               CountT, CountT),
+        CountT (*count_fn)(NodeBase *, TaskGraph *),
+        const char *name,
         Span<const TaskGraphNodeID> dependencies,
         Optional<TaskGraphNodeID> parent_node);
 
@@ -82,9 +115,37 @@ private:
 #endif
     DynArray<StagedNode> staged_;
     DynArray<TaskGraph::NodeData> node_datas_;
+    DynArray<void (*)(NodeBase *)> data_destructors_;
     DynArray<TaskGraphNodeID> all_dependencies_;
 };
 
+// TaskGraphManager lets a world define multiple taskgraphs that the backend
+// can run independently, for example separate step, reset and observation
+// graphs, so only the systems that are needed get executed. To use it,
+// define setupTasks as
+//   static void setupTasks(TaskGraphManager &mgr, const MyConfig &cfg);
+// and call init once per graph to get the builder for that graph:
+//   TaskGraphBuilder &step = mgr.init(TaskGraphID::Step);
+// Graph IDs are user defined enums (or integers) numbered from 0 without
+// gaps. Graph 0 is the graph run by the backend's run() function.
+// FIXME: only supported by the CPU backend.
+class TaskGraphManager {
+public:
+    TaskGraphManager(const WorkerInit &init);
+
+    template <typename EnumT>
+    inline TaskGraphBuilder & init(EnumT graph_id);
+    TaskGraphBuilder & init(uint32_t graph_id);
+
+    // Called by the backend to build all the taskgraphs, indexed by
+    // graph ID.
+    HeapArray<TaskGraph> build();
+
+private:
+    const WorkerInit *init_;
+    DynArray<Optional<TaskGraphBuilder>> builders_;
+};
+
 // Builtin taskgraph nodes
 
 // ParallelForNode is the core of the ECS taskgraph. This node will
@@ -104,6 +165,14 @@ public:
 
     inline void run(Context &ctx_base, TaskGraph &taskgraph);
 
+    // The CPU backend splits the matching entities across worker threads,
+    // so Fn may be called concurrently for different entities in the same
+    // world (as on the GPU backend).
+    inline CountT numInvocations(TaskGraph &taskgraph);
+    inline void runInvocations(Context &ctx_base, TaskGraph &taskgraph,
+                               CountT invocation_offset,
+                               CountT num_invocations);
+
     static TaskGraphNodeID addToGraph(
         StateManager &state_mgr,
         TaskGraphBuilder &builder,
@@ -125,6 +194,19 @@ public:
         Span<const TaskGraphNodeID> dependencies);
 };
 
+// This node applies all transactions committed for the world since the
+// last time it ran (see Context::commitTransaction). It acts as a sync
+// point: add the nodes recording the transactions as dependencies.
+class ApplyTransactionsNode : public NodeBase {
+public:
+    inline void run(Context &ctx, TaskGraph &taskgraph);
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+};
+
 // This node destroys all the temporary entities of archetype ArchetypeT
 template <typename ArchetypeT>
 class ClearTmpNode : public NodeBase {
@@ -137,6 +219,88 @@ public:
         Span<const TaskGraphNodeID> dependencies);
 };
 
+// Sorts the rows of an archetype's table by the value of one of its
+// components, which must be a 32 bit key (compared as an unsigned integer).
+// Every column is permuted and the Loc of each Entity is updated, so
+// Entity handles stay valid while Locs from before the sort do not.
+// On the CPU backend each world's table is sorted independently.
+class SortArchetypeNodeBase : public NodeBase {
+public:
+    SortArchetypeNodeBase(uint32_t archetype_id, int32_t col_idx);
+    ~SortArchetypeNodeBase();
+
+    void sortRows(Context &, TaskGraph &taskgraph);
+
+    CountT numRearrangeInvocations(TaskGraph &taskgraph);
+    void stageColumns(Context &, TaskGraph &taskgraph,
+                      CountT invocation_offset, CountT num_invocations);
+    void rearrangeColumns(Context &, TaskGraph &taskgraph,
+                          CountT invocation_offset, CountT num_invocations);
+
+    void finishSort(Context &, TaskGraph &taskgraph);
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &state_mgr,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies,
+        uint32_t archetype_id,
+        uint32_t component_id);
+
+private:
+    // Columns are moved in blocks of this many rows so large tables can be
+    // split across threads.
+    static inline constexpr CountT num_rows_per_block_ = 4096;
+
+    // Constant state
+    uint32_t archetypeID;
+    int32_t sortColumnIndex;
+
+    // Sort & staging scratch memory, kept between runs and only grown
+    char *scratch;
+    uint64_t numScratchBytes;
+
+    // Per-run state, numRowBlocks is 0 if the table is already sorted
+    CountT numRows;
+    CountT numRowBlocks;
+    int32_t numColumns;
+    const int32_t *sortedRows;
+    char *columnStaging;
+};
+
+template <typename ArchetypeT, typename ComponentT>
+class SortArchetypeNode : public SortArchetypeNodeBase {
+public:
+    static TaskGraphNodeID addToGraph(
+        StateManager &state_mgr,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+};
+
+// CPU tables are compacted as soon as an entity is destroyed and entity IDs
+// are released immediately, so these nodes are no-ops on the CPU backend.
+// They exist so the same setupTasks code builds for both backends.
+class CompactArchetypeNodeBase : public NodeBase {
+public:
+    inline void run(Context &, TaskGraph &) {}
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+};
+
+template <typename ArchetypeT>
+class CompactArchetypeNode : public CompactArchetypeNodeBase {};
+
+class RecycleEntitiesNode : public NodeBase {
+public:
+    inline void run(Context &, TaskGraph &) {}
+
+    static TaskGraphNodeID addToGraph(
+        StateManager &,
+        TaskGraphBuilder &builder,
+        Span<const TaskGraphNodeID> dependencies);
+};
 
 }
 
@@ -19,6 +19,14 @@ TaskGraphBuilder::TypedDataID<NodeT> TaskGraphBuilder::constructNodeData(
     CountT data_idx = node_datas_.uninit_back();
     new (&node_datas_[data_idx]) NodeT(std::forward<Args>(args)...);
 
+    if constexpr (std::is_trivially_destructible_v<NodeT>) {
+        data_destructors_.push_back(nullptr);
+    } else {
+        data_destructors_.push_back([](NodeBase *data) {
+            ((NodeT *)data)->~NodeT();
+        });
+    }
+
     return TypedDataID<NodeT> {
         DataID { int32_t(data_idx) },
     };
@@ -35,6 +43,9 @@ TaskGraphNodeID TaskGraphBuilder::addNodeFn(
                                               TaskGraph *task_graph) {
             std::invoke(fn, ((NodeT *)node_data), *ctx, *task_graph);
         },
+        nullptr,
+        nullptr,
+        nodeFnName<fn>(),
         dependencies,
         parent_node);
 }
@@ -50,12 +61,64 @@ TaskGraphNodeID TaskGraphBuilder::addDefaultNode(
                                   Optional<TaskGraphNodeID>::none());
 }
 
+template <typename NodeT, typename... Args>
+TaskGraphNodeID TaskGraphBuilder::addDynamicCountNode(
+    Span<const TaskGraphNodeID> dependencies,
+    Args && ...args)
+{
+    auto data_id = constructNodeData<NodeT>(
+        std::forward<Args>(args)...);
+
+    return addDynamicCountNodeFn<&NodeT::numInvocations,
+                                 &NodeT::runInvocations>(
+        data_id, dependencies);
+}
+
+template <auto count_fn, auto invocations_fn, typename NodeT>
+TaskGraphNodeID TaskGraphBuilder::addDynamicCountNodeFn(
+    TypedDataID<NodeT> data,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    return registerNode(uint32_t(data.id), [](NodeBase *node_data,
+                                              Context *ctx,
+                                              TaskGraph *task_graph) {
+            auto node = (NodeT *)node_data;
+            std::invoke(invocations_fn, node, *ctx, *task_graph, 0,
+                        std::invoke(count_fn, node, *task_graph));
+        },
+        [](NodeBase *node_data, Context *ctx, TaskGraph *task_graph,
+           CountT invocation_offset, CountT num_invocations) {
+            std::invoke(invocations_fn, (NodeT *)node_data, *ctx,
+                        *task_graph, invocation_offset, num_invocations);
+        },
+        [](NodeBase *node_data, TaskGraph *task_graph) -> CountT {
+            return std::invoke(count_fn, (NodeT *)node_data, *task_graph);
+        },
+        nodeFnName<invocations_fn>(),
+        dependencies,
+        Optional<TaskGraphNodeID>::none());
+}
+
+// The signature contains fn, for example
+// "const char *TaskGraphBuilder::nodeFnName() [with auto fn = ...]"
+template <auto fn>
+const char * TaskGraphBuilder::nodeFnName()
+{
+    return MADRONA_COMPILER_FUNCTION_NAME;
+}
+
 template <typename NodeT>
 NodeT & TaskGraphBuilder::getDataRef(TypedDataID<NodeT> data_id)
 {
     return *(NodeT *)node_datas_[data_id.id].userData;
 }
 
+template <typename EnumT>
+TaskGraphBuilder & TaskGraphManager::init(EnumT graph_id)
+{
+    return init(uint32_t(graph_id));
+}
+
 template <typename ContextT, auto Fn, typename ...ComponentTs>
 ParallelForNode<ContextT, Fn, ComponentTs...>::ParallelForNode(
         Query<ComponentTs...> &&query)
@@ -70,6 +133,23 @@ void ParallelForNode<ContextT, Fn, ComponentTs...>::run(
     taskgraph.iterateQuery(ctx, query_, Fn); 
 }
 
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+CountT ParallelForNode<ContextT, Fn, ComponentTs...>::numInvocations(
+    TaskGraph &taskgraph)
+{
+    return taskgraph.numMatchingEntities(query_);
+}
+
+template <typename ContextT, auto Fn, typename ...ComponentTs>
+void ParallelForNode<ContextT, Fn, ComponentTs...>::runInvocations(
+    Context &ctx_base, TaskGraph &taskgraph,
+    CountT invocation_offset, CountT num_invocations)
+{
+    ContextT &ctx = static_cast<ContextT &>(ctx_base);
+    taskgraph.iterateQuery(ctx, query_, invocation_offset, num_invocations,
+                           Fn);
+}
+
 template <typename ContextT, auto Fn, typename ...ComponentTs>
 TaskGraphNodeID
 ParallelForNode<ContextT, Fn, ComponentTs...>::addToGraph(
@@ -80,7 +160,7 @@ ParallelForNode<ContextT, Fn, ComponentTs...>::addToGraph(
     using NodeT = ParallelForNode<ContextT, Fn, ComponentTs...>;
 
     auto query = state_mgr.query<ComponentTs...>();
-    return builder.addDefaultNode<NodeT>(dependencies, std::move(query));
+    return builder.addDynamicCountNode<NodeT>(dependencies, std::move(query));
 }
 
 void ResetTmpAllocNode::run(Context &, TaskGraph &taskgraph)
@@ -88,6 +168,11 @@ void ResetTmpAllocNode::run(Context &, TaskGraph &taskgraph)
     taskgraph.resetTmpAlloc();
 }
 
+void ApplyTransactionsNode::run(Context &, TaskGraph &taskgraph)
+{
+    taskgraph.applyTransactions();
+}
+
 template <typename ArchetypeT>
 void ClearTmpNode<ArchetypeT>::run(Context &, TaskGraph &taskgraph)
 {
@@ -103,4 +188,18 @@ TaskGraphNodeID ClearTmpNode<ArchetypeT>::addToGraph(
     return builder.addDefaultNode<ClearTmpNode>(dependencies);
 }
 
+template <typename ArchetypeT, typename ComponentT>
+TaskGraphNodeID SortArchetypeNode<ArchetypeT, ComponentT>::addToGraph(
+    StateManager &state_mgr,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    static_assert(sizeof(ComponentT) == sizeof(uint32_t),
+                  "SortArchetypeNode requires a 32 bit key component");
+
+    return SortArchetypeNodeBase::addToGraph(state_mgr, builder,
+        dependencies, state_mgr.archetypeID<ArchetypeT>().id,
+        state_mgr.componentID<ComponentT>().id);
+}
+
 }
@@ -30,6 +30,16 @@ public:
     void commitChunks(uint64_t start_chunk, uint64_t num_chunks);
     void decommitChunks(uint64_t start_chunk, uint64_t num_chunks);
 
+    // Makes the whole region readable & writable at once, with pages only
+    // backed by memory when first touched. Unlike committing chunk by
+    // chunk, sparse use of the region doesn't split it into many mappings
+    // (which count against the OS limit on mappings per process). Returns
+    // false where the OS charges committed memory up front (Windows, or
+    // Linux with strict overcommit accounting), in which case the region
+    // is left untouched and the caller must commitChunks the ranges it
+    // uses.
+    bool commitLazily();
+
     inline uint64_t chunkSize() const { return 1_u64 << chunk_shift_; }
 
 private:
@@ -6,55 +6,82 @@
  * https://opensource.org/licenses/MIT.
  */
 #include <madrona/table.hpp>
+#include <madrona/crash.hpp>
+#include <madrona/macros.hpp>
 
 #include <cstring>
 #include <type_traits>
 
 namespace madrona {
 
-namespace ICfg {
-inline constexpr uint32_t maxRowsPerTable = 1u << 28u;
-}
-
 Table::Table(const TypeInfo *component_types, CountT num_components,
-             CountT init_num_rows)
+             CountT init_num_rows, CountT max_num_rows)
     : num_rows_(init_num_rows),
-      num_allocated_rows_(std::max(uint32_t(init_num_rows), 1_u32)),
+      num_allocated_rows_(0),
+      max_rows_(max_num_rows),
       num_components_(num_components),
+      column_regions_(num_components),
       columns_(),
       bytes_per_column_()
 {
+    assert(init_num_rows <= max_num_rows);
+
     for (int i = 0; i < (int)num_components; i++) {
         const TypeInfo &type = component_types[i];
 
-#if 0
-        // 3rd argument is offsetting the start from the page aligned boundary
-        // to avoid everything mapping to the same cache sets. Should revisit -
-        // maybe add a random offset for each Table as well?
-        columns_.emplace_back(type.numBytes, type.alignment,
-            MADRONA_CACHE_LINE * (i + 1), ICfg::maxRowsPerTable);
-#endif
-
-        uint32_t column_bytes_per_row = type.numBytes;
-        columns_[i] = malloc(column_bytes_per_row * num_allocated_rows_);
-        bytes_per_column_[i] = column_bytes_per_row;
+        // Offset the start of each column from the page aligned region base
+        // to avoid every column of the table mapping to the same cache sets.
+        uint64_t start_offset = utils::roundUp(
+            uint64_t(MADRONA_CACHE_LINE) * uint64_t(i + 1),
+            uint64_t(type.alignment));
+
+        VirtualRegion &region = column_regions_.emplace(i,
+            start_offset + uint64_t(max_num_rows) * uint64_t(type.numBytes),
+            0, 1);
+
+        columns_[i] = (char *)region.ptr() + start_offset;
+        bytes_per_column_[i] = type.numBytes;
+    }
+
+    if (init_num_rows > 0) {
+        commitRows(init_num_rows);
+    }
+}
+
+Table::Table(const TypeInfo *component_types, CountT num_components,
+             CountT max_num_rows, void * const *column_data)
+    : num_rows_(0),
+      num_allocated_rows_(max_num_rows),
+      max_rows_(max_num_rows),
+      num_components_(num_components),
+      column_regions_(0),
+      columns_(),
+      bytes_per_column_()
+{
+    for (int i = 0; i < (int)num_components; i++) {
+        columns_[i] = column_data[i];
+        bytes_per_column_[i] = component_types[i].numBytes;
     }
 }
 
 uint32_t Table::addRow()
 {
-    uint32_t idx = num_rows_++;
+    return addRows(1);
+}
 
-    if (idx >= num_allocated_rows_) {
-        uint32_t new_num_rows =
-            std::max(std::max(10_u32, uint32_t(num_allocated_rows_ * 2)), idx);
+uint32_t Table::addRows(uint32_t num_rows)
+{
+    uint32_t idx = num_rows_;
+    uint32_t new_num_rows = idx + num_rows;
+    num_rows_ = new_num_rows;
 
-        for (int i = 0; i < (int)num_components_; i++) {
-            columns_[i] = realloc(columns_[i],
-                uint64_t(new_num_rows) * uint64_t(bytes_per_column_[i]));
+    if (new_num_rows > num_allocated_rows_) {
+        if (new_num_rows > max_rows_) [[unlikely]] {
+            FATAL("Table exceeded max number of rows (%u)", max_rows_);
         }
 
-        num_allocated_rows_ = new_num_rows;
+        commitRows(std::min(
+            std::max(new_num_rows, num_allocated_rows_ * 2), max_rows_));
     }
 
     return idx;
@@ -85,4 +112,27 @@ void Table::clear()
     num_rows_ = 0;
 }
 
+void Table::commitRows(uint32_t num_rows)
+{
+    for (int i = 0; i < (int)num_components_; i++) {
+        VirtualRegion &region = column_regions_[i];
+        uint64_t chunk_size = region.chunkSize();
+        uint64_t start_offset =
+            uint64_t((char *)columns_[i] - (char *)region.ptr());
+        uint64_t num_bytes_per_row = bytes_per_column_[i];
+
+        uint64_t cur_chunks = num_allocated_rows_ == 0 ? 0 :
+            utils::divideRoundUp(start_offset +
+                uint64_t(num_allocated_rows_) * num_bytes_per_row, chunk_size);
+        uint64_t new_chunks = utils::divideRoundUp(start_offset +
+            uint64_t(num_rows) * num_bytes_per_row, chunk_size);
+
+        if (new_chunks > cur_chunks) {
+            region.commitChunks(cur_chunks, new_chunks - cur_chunks);
+        }
+    }
+
+    num_allocated_rows_ = num_rows;
+}
+
 }
@@ -168,9 +168,10 @@ void VirtualRegion::commitChunks(uint64_t start_chunk, uint64_t num_chunks)
     uint64_t num_bytes = num_chunks << chunk_shift_;
 
 #if defined(__linux__) or defined(__APPLE__)
-    void *res = mmap(start, num_bytes, PROT_READ | PROT_WRITE,
-        MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0);
-    bool fail = res == MAP_FAILED;
+    // mprotect rather than mmap over the range, so committing a chunk that
+    // is already committed keeps its contents, like MEM_COMMIT on Windows
+    int res = mprotect(start, num_bytes, PROT_READ | PROT_WRITE);
+    bool fail = res != 0;
 #elif defined(_WIN32)
     void *res = VirtualAlloc(start, num_bytes, MEM_COMMIT, PAGE_READWRITE);
     bool fail = res == nullptr;
@@ -210,6 +211,25 @@ void VirtualRegion::decommitChunks(uint64_t start_chunk, uint64_t num_chunks)
     }
 }
 
+bool VirtualRegion::commitLazily()
+{
+#if defined(__linux__) or defined(__APPLE__)
+    // The reservation is MAP_NORESERVE on Linux, which mprotect preserves,
+    // so this doesn't charge the whole region against the overcommit limit
+    // and the region stays a single mapping. With strict overcommit
+    // (vm.overcommit_memory=2) MAP_NORESERVE is ignored and this fails
+    // with ENOMEM for large regions; leave the region reserved and let the
+    // caller commit what it uses instead.
+    int res = mprotect(base_, total_size_, PROT_READ | PROT_WRITE);
+
+    return res == 0;
+#elif defined(_WIN32)
+    return false;
+#else
+    STATIC_UNIMPLEMENTED();
+#endif
+}
+
 static uint64_t computeChunkShift(uint32_t bytes_per_item)
 {
     static constexpr uint64_t min_chunk_shift = 14;
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <madrona/taskgraph_builder.hpp>
+#include <madrona/memory.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <utility>
+
+namespace madrona {
+
+namespace {
+
+constexpr int32_t numRadixBits = 8;
+constexpr int32_t numRadixDigits = 1 << numRadixBits;
+constexpr int32_t numRadixPasses = 32 / numRadixBits;
+
+inline uint32_t radixDigit(uint32_t key, int32_t pass)
+{
+    return (key >> (pass * numRadixBits)) & (numRadixDigits - 1);
+}
+
+}
+
+SortArchetypeNodeBase::SortArchetypeNodeBase(uint32_t archetype_id,
+                                             int32_t col_idx)
+    : NodeBase(),
+      archetypeID(archetype_id),
+      sortColumnIndex(col_idx),
+      scratch(nullptr),
+      numScratchBytes(0),
+      numRows(0),
+      numRowBlocks(0),
+      numColumns(0),
+      sortedRows(nullptr),
+      columnStaging(nullptr)
+{}
+
+SortArchetypeNodeBase::~SortArchetypeNodeBase()
+{
+    if (scratch != nullptr) {
+        rawDealloc(scratch);
+    }
+}
+
+// LSD radix sort of the row indices by key. Passes where every key has the
+// same digit are skipped, so small key ranges only cost the histogram.
+// The histogram & scatter passes run serially on one thread: they only
+// touch the 4 byte keys and row indices of a single world's table, while
+// the per-column copies that dominate the cost (stageColumns /
+// rearrangeColumns) are split across invocations, and other worlds' graphs
+// keep the remaining workers busy in the meantime.
+void SortArchetypeNodeBase::sortRows(Context &, TaskGraph &taskgraph)
+{
+    numRows = taskgraph.numArchetypeRows(archetypeID);
+    numRowBlocks = 0;
+
+    if (numRows <= 1) {
+        return;
+    }
+
+    const uint32_t *keys = (const uint32_t *)taskgraph.getArchetypeColumn(
+        archetypeID, sortColumnIndex);
+
+    bool already_sorted = true;
+    std::array<std::array<int32_t, numRadixDigits>, numRadixPasses> hists {};
+    for (CountT i = 0; i < numRows; i++) {
+        uint32_t key = keys[i];
+
+        for (int32_t pass = 0; pass < numRadixPasses; pass++) {
+            hists[pass][radixDigit(key, pass)] += 1;
+        }
+
+        if (i > 0 && keys[i - 1] > key) {
+            already_sorted = false;
+        }
+    }
+
+    if (already_sorted) {
+        return;
+    }
+
+    numColumns = taskgraph.getArchetypeNumColumns(archetypeID);
+    numRowBlocks = utils::divideRoundUp(numRows, num_rows_per_block_);
+
+    uint64_t num_row_bytes = 0;
+    for (int32_t col_idx = 0; col_idx < numColumns; col_idx++) {
+        num_row_bytes +=
+            taskgraph.getArchetypeColumnBytesPerRow(archetypeID, col_idx);
+    }
+
+    // Double buffered row indices & keys for the sort, followed by the
+    // staging area that holds every column back to back in sorted order.
+    uint64_t num_sort_bytes = (sizeof(int32_t) + sizeof(uint32_t)) * 2 *
+        uint64_t(numRows);
+    uint64_t num_needed_bytes =
+        num_sort_bytes + num_row_bytes * uint64_t(numRows);
+
+    if (num_needed_bytes > numScratchBytes) {
+        if (scratch != nullptr) {
+            rawDealloc(scratch);
+        }
+
+        // Grow geometrically so a slowly growing table doesn't reallocate
+        // every step
+        numScratchBytes = std::max(num_needed_bytes, numScratchBytes * 2);
+        scratch = (char *)rawAlloc(numScratchBytes);
+    }
+
+    columnStaging = scratch + num_sort_bytes;
+
+    int32_t *rows = (int32_t *)scratch;
+    int32_t *rows_alt = rows + numRows;
+    uint32_t *sorted_keys = (uint32_t *)(rows_alt + numRows);
+    uint32_t *sorted_keys_alt = sorted_keys + numRows;
+
+    // The first executed pass reads the keys straight from the column with
+    // the identity as the row order
+    const uint32_t *src_keys = keys;
+    const int32_t *src_rows = nullptr;
+
+    for (int32_t pass = 0; pass < numRadixPasses; pass++) {
+        auto &hist = hists[pass];
+
+        if (hist[radixDigit(keys[0], pass)] == numRows) {
+            continue;
+        }
+
+        std::array<int32_t, numRadixDigits> offsets;
+        int32_t cur_offset = 0;
+        for (int32_t digit = 0; digit < numRadixDigits; digit++) {
+            offsets[digit] = cur_offset;
+            cur_offset += hist[digit];
+        }
+
+        for (CountT i = 0; i < numRows; i++) {
+            uint32_t key = src_keys[i];
+            int32_t dst_idx = offsets[radixDigit(key, pass)]++;
+
+            sorted_keys[dst_idx] = key;
+            rows[dst_idx] = src_rows == nullptr ? int32_t(i) : src_rows[i];
+        }
+
+        src_keys = sorted_keys;
+        src_rows = rows;
+        std::swap(sorted_keys, sorted_keys_alt);
+        std::swap(rows, rows_alt);
+    }
+
+    sortedRows = src_rows;
+}
+
+CountT SortArchetypeNodeBase::numRearrangeInvocations(TaskGraph &)
+{
+    return numRowBlocks * CountT(numColumns);
+}
+
+void SortArchetypeNodeBase::stageColumns(Context &, TaskGraph &taskgraph,
+                                         CountT invocation_offset,
+                                         CountT num_invocations)
+{
+    for (CountT invocation_idx = invocation_offset;
+         invocation_idx < invocation_offset + num_invocations;
+         invocation_idx++) {
+        int32_t col_idx = int32_t(invocation_idx / numRowBlocks);
+        CountT block_idx = invocation_idx % numRowBlocks;
+
+        uint64_t staging_offset = 0;
+        for (int32_t i = 0; i < col_idx; i++) {
+            staging_offset += uint64_t(numRows) *
+                taskgraph.getArchetypeColumnBytesPerRow(archetypeID, i);
+        }
+
+        uint32_t num_bytes =
+            taskgraph.getArchetypeColumnBytesPerRow(archetypeID, col_idx);
+        const char *src =
+            (const char *)taskgraph.getArchetypeColumn(archetypeID, col_idx);
+        char *dst = columnStaging + staging_offset;
+
+        CountT row_start = block_idx * num_rows_per_block_;
+        CountT row_end = std::min(row_start + num_rows_per_block_, numRows);
+
+        for (CountT row = row_start; row < row_end; row++) {
+            memcpy(dst + uint64_t(row) * num_bytes,
+                   src + uint64_t(sortedRows[row]) * num_bytes,
+                   num_bytes);
+        }
+    }
+}
+
+void SortArchetypeNodeBase::rearrangeColumns(Context &, TaskGraph &taskgraph,
+                                             CountT invocation_offset,
+                                             CountT num_invocations)
+{
+    for (CountT invocation_idx = invocation_offset;
+         invocation_idx < invocation_offset + num_invocations;
+         invocation_idx++) {
+        int32_t col_idx = int32_t(invocation_idx / numRowBlocks);
+        CountT block_idx = invocation_idx % numRowBlocks;
+
+        uint64_t staging_offset = 0;
+        for (int32_t i = 0; i < col_idx; i++) {
+            staging_offset += uint64_t(numRows) *
+                taskgraph.getArchetypeColumnBytesPerRow(archetypeID, i);
+        }
+
+        uint32_t num_bytes =
+            taskgraph.getArchetypeColumnBytesPerRow(archetypeID, col_idx);
+        char *dst = (char *)taskgraph.getArchetypeColumn(archetypeID, col_idx);
+        const char *src = columnStaging + staging_offset;
+
+        CountT row_start = block_idx * num_rows_per_block_;
+        CountT row_end = std::min(row_start + num_rows_per_block_, numRows);
+
+        uint64_t byte_offset = uint64_t(row_start) * num_bytes;
+        memcpy(dst + byte_offset, src + byte_offset,
+               uint64_t(row_end - row_start) * num_bytes);
+
+        // Column 0 is the Entity column
+        if (col_idx == 0) {
+            const Entity *entities = (const Entity *)dst;
+            for (CountT row = row_start; row < row_end; row++) {
+                taskgraph.remapEntity(entities[row], int32_t(row));
+            }
+        }
+    }
+}
+
+void SortArchetypeNodeBase::finishSort(Context &, TaskGraph &)
+{
+    // The scratch buffer is reused by the next run
+    sortedRows = nullptr;
+    columnStaging = nullptr;
+}
+
+TaskGraphNodeID SortArchetypeNodeBase::addToGraph(
+    StateManager &state_mgr,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies,
+    uint32_t archetype_id,
+    uint32_t component_id)
+{
+    int32_t sort_column_idx = state_mgr.getArchetypeColumnIndex(
+        archetype_id, component_id);
+
+    auto data_id = builder.constructNodeData<SortArchetypeNodeBase>(
+        archetype_id, sort_column_idx);
+
+    TaskGraphNodeID sort = builder.addNodeFn<
+        &SortArchetypeNodeBase::sortRows>(data_id, dependencies);
+
+    // All columns need to be staged before any can be overwritten, since
+    // the permutation reads rows from anywhere in the table.
+    TaskGraphNodeID stage = builder.addDynamicCountNodeFn<
+        &SortArchetypeNodeBase::numRearrangeInvocations,
+        &SortArchetypeNodeBase::stageColumns>(data_id, {sort});
+
+    TaskGraphNodeID rearrange = builder.addDynamicCountNodeFn<
+        &SortArchetypeNodeBase::numRearrangeInvocations,
+        &SortArchetypeNodeBase::rearrangeColumns>(data_id, {stage});
+
+    return builder.addNodeFn<&SortArchetypeNodeBase::finishSort>(
+        data_id, {rearrange});
+}
+
+TaskGraphNodeID CompactArchetypeNodeBase::addToGraph(
+    StateManager &,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    return builder.addDefaultNode<CompactArchetypeNodeBase>(dependencies);
+}
+
+TaskGraphNodeID RecycleEntitiesNode::addToGraph(
+    StateManager &,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    return builder.addDefaultNode<RecycleEntitiesNode>(dependencies);
+}
+
+}
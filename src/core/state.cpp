@@ -10,6 +10,7 @@
 #include <madrona/utils.hpp>
 #include <madrona/dyn_array.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <mutex>
@@ -28,6 +29,9 @@ namespace madrona {
 
 namespace ICfg {
 static constexpr uint32_t maxQueryOffsets = 100'000;
+#ifdef MADRONA_MW_MODE
+static constexpr CountT minRowsPerWorldTable = 1 << 16;
+#endif
 }
 
 ECSRegistry::ECSRegistry(StateManager *state_mgr, void **export_ptrs)
@@ -129,23 +133,129 @@ void StateManager::TmpAllocator::reset()
     cur_block_ = cur_block;
 }
 
+Transaction::Transaction(StateManager *state_mgr
+                         MADRONA_MW_COND(, uint32_t world_id))
+    : head(nullptr),
+      tail(nullptr),
+      stateMgr(state_mgr),
+      stateCache(nullptr)
 #ifdef MADRONA_MW_MODE
-StateManager::StateManager(CountT num_worlds)
+      , worldID(world_id)
+#endif
+{}
+
+Transaction::Transaction(Transaction &&o)
+    : head(o.head),
+      tail(o.tail),
+      stateMgr(o.stateMgr),
+      stateCache(o.stateCache)
+#ifdef MADRONA_MW_MODE
+      , worldID(o.worldID)
+#endif
+{
+    o.head = nullptr;
+    o.tail = nullptr;
+}
+
+Transaction::~Transaction()
+{
+    if (head == nullptr) {
+        return;
+    }
+
+    // Never committed: release the entity IDs handed out by makeEntity
+    // and drop the recorded ops
+    stateMgr->discardTransaction(*this);
+
+    Block *block = head;
+    while (block != nullptr) {
+        Block *next = block->next;
+        rawDeallocAligned(block);
+        block = next;
+    }
+}
+
+void * Transaction::record(Op op, uint32_t id, Entity e,
+                           uint32_t num_payload_bytes,
+                           uint32_t payload_alignment)
+{
+    assert(payload_alignment <= max_payload_align_);
+
+    auto recordOffsets = [&](uint32_t block_offset) {
+        uint32_t header_offset = utils::roundUp(block_offset,
+            uint32_t(alignof(OpHeader)));
+        uint32_t payload_offset = utils::roundUp(
+            header_offset + uint32_t(sizeof(OpHeader)), payload_alignment);
+
+        return std::make_pair(header_offset, payload_offset);
+    };
+
+    auto [header_offset, payload_offset] =
+        recordOffsets(tail == nullptr ? bytes_per_block_ : tail->curOffset);
+
+    if (payload_offset + num_payload_bytes > bytes_per_block_) {
+        Block *new_block =
+            (Block *)rawAllocAligned(sizeof(Block), alignof(Block));
+        new_block->next = nullptr;
+        new_block->curOffset = 0;
+        new_block->numEntries = 0;
+
+        if (tail == nullptr) {
+            head = new_block;
+        } else {
+            tail->next = new_block;
+        }
+        tail = new_block;
+
+        std::tie(header_offset, payload_offset) = recordOffsets(0);
+
+        if (payload_offset + num_payload_bytes > bytes_per_block_) {
+            FATAL("Transaction op too large (%u bytes)", num_payload_bytes);
+        }
+    }
+
+    uint32_t end_offset = payload_offset + num_payload_bytes;
+
+    OpHeader *header = (OpHeader *)(tail->data + header_offset);
+    *header = OpHeader {
+        .op = op,
+        .id = id,
+        .payloadOffset = payload_offset - header_offset,
+        .numBytes = end_offset - header_offset,
+        .e = e,
+    };
+
+    tail->curOffset = end_offset;
+    tail->numEntries += 1;
+
+    return tail->data + payload_offset;
+}
+
+#ifdef MADRONA_MW_MODE
+StateManager::StateManager(CountT num_worlds,
+                           CountT max_rows_per_world)
     : init_state_cache_(),
       entity_store_(),
       component_infos_(0),
       archetype_components_(0),
       archetype_stores_(0),
-      export_jobs_(0),
       tmp_allocators_(num_worlds),
+      pending_txns_(num_worlds),
       num_worlds_(num_worlds),
-      register_lock_()
+      max_rows_per_world_(max_rows_per_world != 0 ? max_rows_per_world :
+          std::max(Table::maxRowsPerTable / num_worlds,
+                   ICfg::minRowsPerWorldTable)),
+      export_infos_(0),
+      register_lock_(),
+      world_locks_(num_worlds)
 {
     registerComponent<Entity>();
     registerComponent<WorldID>();
 
     for (CountT i = 0; i < num_worlds; i++) {
         tmp_allocators_.emplace(i);
+        world_locks_.emplace(i);
+        pending_txns_[i] = { nullptr, nullptr };
     }
 }
 #else
@@ -154,36 +264,344 @@ StateManager::StateManager()
       component_infos_(0),
       archetype_components_(0),
       archetype_stores_(0),
-      tmp_allocator_()
+      tmp_allocator_(),
+      pending_txns_ { nullptr, nullptr },
+      pending_txns_lock_()
 {
     registerComponent<Entity>();
 }
 #endif
 
-Transaction StateManager::makeTransaction()
+Transaction StateManager::makeTransaction(MADRONA_MW_COND(uint32_t world_id))
 {
-    return Transaction();
+    return Transaction(this MADRONA_MW_COND(, world_id));
 }
 
 void StateManager::commitTransaction(Transaction &&txn)
 {
-    (void)txn;
+    if (txn.head == nullptr) {
+        return;
+    }
+
+    {
+#ifdef MADRONA_MW_MODE
+        std::lock_guard lock(world_locks_[txn.worldID]);
+        PendingTransactions &pending = pending_txns_[txn.worldID];
+#else
+        std::lock_guard lock(pending_txns_lock_);
+        PendingTransactions &pending = pending_txns_;
+#endif
+
+        if (pending.tail == nullptr) {
+            pending.head = txn.head;
+        } else {
+            pending.tail->next = txn.head;
+        }
+        pending.tail = txn.tail;
+    }
+
+    txn.head = nullptr;
+    txn.tail = nullptr;
+}
+
+void StateManager::discardTransaction(Transaction &txn)
+{
+    if (txn.stateCache == nullptr) {
+        // No Make ops were recorded
+        return;
+    }
+
+#ifdef MADRONA_MW_MODE
+    std::lock_guard lock(world_locks_[txn.worldID]);
+#endif
+
+    for (Transaction::Block *block = txn.head; block != nullptr;
+         block = block->next) {
+        uint32_t offset = 0;
+        for (CountT i = 0; i < (CountT)block->numEntries; i++) {
+            auto *op = (Transaction::OpHeader *)(block->data + offset);
+            offset = utils::roundUp(offset + op->numBytes,
+                                    uint32_t(alignof(Transaction::OpHeader)));
+
+            if (op->op == Transaction::Op::Make) {
+                entity_store_.freeEntity(txn.stateCache->entity_cache_,
+                                         op->e);
+            }
+        }
+    }
 }
 
 void StateManager::destroyEntity(MADRONA_MW_COND(uint32_t world_id,)
-                                 Transaction &txn, StateCache &cache, Entity e)
+                                 Transaction &txn, StateCache &, Entity e)
 {
 #ifdef MADRONA_MW_MODE
+    assert(world_id == txn.worldID);
     (void)world_id;
 #endif
-    (void)txn.head;
-    (void)cache;
-    (void)e;
+
+    txn.record(Transaction::Op::Destroy, 0, e, 0, 1);
+}
+
+void StateManager::applyTransactions(MADRONA_MW_COND(uint32_t world_id,)
+                                     StateCache &cache)
+{
+#ifdef MADRONA_MW_MODE
+    std::lock_guard lock(world_locks_[world_id]);
+    PendingTransactions &pending = pending_txns_[world_id];
+#else
+    std::lock_guard lock(pending_txns_lock_);
+    PendingTransactions &pending = pending_txns_;
+#endif
+
+    Transaction::Block *head = pending.head;
+    pending.head = nullptr;
+    pending.tail = nullptr;
+
+    if (head == nullptr) {
+        return;
+    }
+
+    CountT num_ops = 0;
+    for (Transaction::Block *block = head; block != nullptr;
+         block = block->next) {
+        num_ops += block->numEntries;
+    }
+
+    // Partition the ops by type: makes from the front of the array,
+    // destroys from the back, modifies in a separate pass. Each partition
+    // keeps the order the ops were recorded & committed in.
+    HeapArray<Transaction::OpHeader *> ops(num_ops);
+    CountT num_makes = 0;
+    CountT num_destroys = 0;
+
+    for (Transaction::Block *block = head; block != nullptr;
+         block = block->next) {
+        uint32_t offset = 0;
+        for (CountT i = 0; i < (CountT)block->numEntries; i++) {
+            auto *op = (Transaction::OpHeader *)(block->data + offset);
+            offset = utils::roundUp(offset + op->numBytes,
+                                    uint32_t(alignof(Transaction::OpHeader)));
+
+            if (op->op == Transaction::Op::Make) {
+                ops[num_makes++] = op;
+            } else if (op->op == Transaction::Op::Destroy) {
+                ops[num_ops - ++num_destroys] = op;
+            }
+        }
+    }
+
+    CountT num_modifies = 0;
+    for (Transaction::Block *block = head; block != nullptr;
+         block = block->next) {
+        uint32_t offset = 0;
+        for (CountT i = 0; i < (CountT)block->numEntries; i++) {
+            auto *op = (Transaction::OpHeader *)(block->data + offset);
+            offset = utils::roundUp(offset + op->numBytes,
+                                    uint32_t(alignof(Transaction::OpHeader)));
+
+            if (op->op == Transaction::Op::Modify) {
+                ops[num_makes + num_modifies++] = op;
+            }
+        }
+    }
+
+    // Destroys were filled in back to front
+    std::reverse(ops.data() + num_ops - num_destroys, ops.data() + num_ops);
+
+    applyMakeOps(MADRONA_MW_COND(world_id,) Span(ops.data(), num_makes));
+    applyModifyOps(MADRONA_MW_COND(world_id,)
+                   Span(ops.data() + num_makes, num_modifies));
+    applyDestroyOps(MADRONA_MW_COND(world_id,) cache,
+                    Span(ops.data() + num_makes + num_modifies, num_destroys));
+
+    Transaction::Block *block = head;
+    while (block != nullptr) {
+        Transaction::Block *next = block->next;
+        rawDeallocAligned(block);
+        block = next;
+    }
+}
+
+void StateManager::applyMakeOps(MADRONA_MW_COND(uint32_t world_id,)
+                                Span<Transaction::OpHeader *> ops)
+{
+    std::stable_sort(ops.begin(), ops.end(),
+        [](const Transaction::OpHeader *a, const Transaction::OpHeader *b) {
+            return a->id < b->id;
+        });
+
+    CountT range_start = 0;
+    while (range_start < ops.size()) {
+        uint32_t archetype_id = ops[range_start]->id;
+
+        CountT range_end = range_start + 1;
+        while (range_end < ops.size() && ops[range_end]->id == archetype_id) {
+            range_end++;
+        }
+
+        ArchetypeStore &archetype = *archetype_stores_[archetype_id];
+
+        // Grow the table once for every entity of this archetype
+        CountT num_new_rows = range_end - range_start;
+        CountT base_row = archetype.tblStorage.addRows(
+            MADRONA_MW_COND(world_id,) num_new_rows);
+
+        Entity *entity_col = archetype.tblStorage.column<Entity>(
+            MADRONA_MW_COND(world_id,) 0);
+
+#ifdef MADRONA_MW_MODE
+        WorldID *world_col =
+            archetype.tblStorage.column<WorldID>(world_id, 1);
+#endif
+
+        // Payload layout of the user components, matches makeEntity
+        std::array<uint32_t, max_archetype_components_> payload_offsets;
+        std::array<uint32_t, max_archetype_components_> component_sizes;
+        uint32_t cur_payload_offset = 0;
+        for (CountT i = 0; i < (CountT)archetype.numComponents; i++) {
+            ComponentID component_id =
+                archetype_components_[archetype.componentOffset + i];
+            const TypeInfo &type = *component_infos_[component_id.id];
+
+            cur_payload_offset = utils::roundUp(cur_payload_offset,
+                                                type.alignment);
+            payload_offsets[i] = cur_payload_offset;
+            component_sizes[i] = type.numBytes;
+            cur_payload_offset += type.numBytes;
+        }
+
+        for (CountT i = range_start; i < range_end; i++) {
+            Transaction::OpHeader *op = ops[i];
+            CountT row = base_row + i - range_start;
+
+            entity_col[row] = op->e;
+#ifdef MADRONA_MW_MODE
+            world_col[row] = WorldID { (int32_t)world_id };
+#endif
+
+            // Entities made without component values have no payload
+            if (op->numBytes > op->payloadOffset) {
+                char *payload = (char *)op + op->payloadOffset;
+
+                for (CountT j = 0; j < (CountT)archetype.numComponents; j++) {
+                    char *col = archetype.tblStorage.column<char>(
+                        MADRONA_MW_COND(world_id,) j + user_component_offset_);
+
+                    memcpy(col + row * component_sizes[j],
+                           payload + payload_offsets[j], component_sizes[j]);
+                }
+            }
+
+            entity_store_.setLoc(op->e, Loc {
+                .archetype = archetype_id,
+                .row = int32_t(row),
+            });
+        }
+
+        range_start = range_end;
+    }
+}
+
+void StateManager::applyModifyOps(MADRONA_MW_COND(uint32_t world_id,)
+                                  Span<Transaction::OpHeader *> ops)
+{
+    for (Transaction::OpHeader *op : ops) {
+        Loc loc = entity_store_.getLoc(op->e);
+        if (!loc.valid()) {
+            continue;
+        }
+
+        ArchetypeStore &archetype = *archetype_stores_[loc.archetype];
+        auto col_idx = archetype.columnLookup.lookup(op->id);
+        if (!col_idx.has_value()) {
+            continue;
+        }
+
+        uint32_t num_bytes = component_infos_[op->id]->numBytes;
+        char *col = archetype.tblStorage.column<char>(
+            MADRONA_MW_COND(world_id,) *col_idx);
+
+        memcpy(col + CountT(loc.row) * num_bytes,
+               (char *)op + op->payloadOffset, num_bytes);
+    }
+}
+
+void StateManager::applyDestroyOps(MADRONA_MW_COND(uint32_t world_id,)
+                                   StateCache &cache,
+                                   Span<Transaction::OpHeader *> ops)
+{
+    struct DestroyRef {
+        Loc loc;
+        Entity e;
+    };
+
+    HeapArray<DestroyRef> refs(ops.size());
+    CountT num_refs = 0;
+    for (Transaction::OpHeader *op : ops) {
+        Loc loc = entity_store_.getLoc(op->e);
+        if (!loc.valid()) {
+            continue;
+        }
+
+        refs[num_refs++] = DestroyRef { loc, op->e };
+    }
+
+    // Within an archetype remove rows from the back of the table forward:
+    // removeRow only moves the last row of the table, which can then never
+    // be a row that is still waiting to be removed.
+    std::sort(refs.data(), refs.data() + num_refs,
+        [](const DestroyRef &a, const DestroyRef &b) {
+            if (a.loc.archetype != b.loc.archetype) {
+                return a.loc.archetype < b.loc.archetype;
+            }
+
+            return a.loc.row > b.loc.row;
+        });
+
+    HeapArray<Entity> freed_entities(num_refs);
+
+    CountT range_start = 0;
+    while (range_start < num_refs) {
+        uint32_t archetype_id = refs[range_start].loc.archetype;
+        ArchetypeStore &archetype = *archetype_stores_[archetype_id];
+
+        CountT num_freed = 0;
+        CountT range_end = range_start;
+        for (; range_end < num_refs &&
+               refs[range_end].loc.archetype == archetype_id; range_end++) {
+            const DestroyRef &ref = refs[range_end];
+
+            // The same entity destroyed more than once
+            if (num_freed > 0 && freed_entities[num_freed - 1].id == ref.e.id) {
+                continue;
+            }
+
+            bool row_moved = archetype.tblStorage.removeRow(
+                MADRONA_MW_COND(world_id,) ref.loc.row);
+
+            if (row_moved) {
+                Entity moved_entity = archetype.tblStorage.column<Entity>(
+                    MADRONA_MW_COND(world_id,) 0)[ref.loc.row];
+                entity_store_.setRow(moved_entity, ref.loc.row);
+            }
+
+            freed_entities[num_freed++] = ref.e;
+        }
+
+        entity_store_.bulkFree(cache.entity_cache_, freed_entities.data(),
+                               uint32_t(num_freed));
+
+        range_start = range_end;
+    }
 }
 
 void StateManager::destroyEntityNow(MADRONA_MW_COND(uint32_t world_id,)
                                     StateCache &cache, Entity e)
 {
+#ifdef MADRONA_MW_MODE
+    std::lock_guard lock(world_locks_[world_id]);
+#endif
+
     Loc loc = entity_store_.getLoc(e);
     
     if (!loc.valid()) {
@@ -207,19 +625,63 @@ void StateManager::destroyEntityNow(MADRONA_MW_COND(uint32_t world_id,)
 #ifdef MADRONA_MW_MODE
 StateManager::TableStorage::TableStorage(Span<TypeInfo> types,
                                          CountT num_worlds,
-                                         CountT max_num_per_world)
+                                         CountT max_num_per_world,
+                                         CountT rows_per_world)
+    : maxNumPerWorld(max_num_per_world),
+      worldMajorColumns(0),
+      rowsPerWorld(rows_per_world),
+      numCommittedRows(0)
 {
-    maxNumPerWorld = max_num_per_world;
-
     if (max_num_per_world == 0) {
+        CountT num_columns = types.size();
+        worldMajorColumns = HeapArray<WorldMajorColumn>(num_columns);
+
+        bool lazily_committed = true;
+        InlineArray<char *, Table::maxColumns> column_bases;
+        for (CountT i = 0; i < num_columns; i++) {
+            const TypeInfo &type = types[i];
+
+            // Stagger the columns like Table does, so the same row of every
+            // column doesn't map to the same cache sets
+            uint64_t start_offset = utils::roundUp(
+                uint64_t(MADRONA_CACHE_LINE) * uint64_t(i + 1),
+                uint64_t(type.alignment));
+
+            WorldMajorColumn &col = worldMajorColumns.insert(i,
+                WorldMajorColumn {
+                    .mem = VirtualRegion(start_offset + uint64_t(num_worlds) *
+                        uint64_t(rows_per_world) * uint64_t(type.numBytes),
+                        0, 1),
+                    .numBytesPerRow = type.numBytes,
+                });
+
+            lazily_committed = col.mem.commitLazily() && lazily_committed;
+            column_bases[i] = (char *)col.mem.ptr() + start_offset;
+        }
+
+        if (!lazily_committed) {
+            numCommittedRows = HeapArray<uint32_t>(num_worlds);
+            for (CountT i = 0; i < num_worlds; i++) {
+                numCommittedRows[i] = 0;
+            }
+        }
+
         new (&tbls) HeapArray<Table>(num_worlds);
 
         for (CountT i = 0; i < num_worlds; i++) {
-            tbls.emplace(i, types.data(), types.size(), 0);
+            InlineArray<void *, Table::maxColumns> world_columns;
+            for (CountT j = 0; j < num_columns; j++) {
+                world_columns[j] = column_bases[j] + uint64_t(i) *
+                    uint64_t(rows_per_world) * uint64_t(types[j].numBytes);
+            }
+
+            tbls.emplace(i, types.data(), types.size(), rows_per_world,
+                         world_columns.data());
         }
     } else {
         new (&fixed) Fixed {
             Table(types.data(), types.size(),
+                  max_num_per_world * num_worlds,
                   max_num_per_world * num_worlds),
             HeapArray<int32_t>(num_worlds),
         };
@@ -239,6 +701,36 @@ StateManager::TableStorage::~TableStorage()
     }
 }
 
+void StateManager::TableStorage::commitRows(uint32_t world_id,
+                                            CountT num_rows)
+{
+    CountT num_committed_rows = numCommittedRows[world_id];
+    CountT new_num_committed = std::min(
+        std::max(num_rows, num_committed_rows * 2), rowsPerWorld);
+
+    Table &tbl = tbls[world_id];
+    for (CountT i = 0; i < worldMajorColumns.size(); i++) {
+        WorldMajorColumn &col = worldMajorColumns[i];
+        uint64_t chunk_size = col.mem.chunkSize();
+        uint64_t world_offset =
+            uint64_t((char *)tbl.data(i) - (char *)col.mem.ptr());
+
+        // Worlds aren't chunk aligned, so neighboring worlds can share a
+        // boundary chunk. Committing it again is a no-op (see
+        // VirtualRegion::commitChunks).
+        uint64_t start_chunk = (world_offset +
+            uint64_t(num_committed_rows) * col.numBytesPerRow) / chunk_size;
+        uint64_t end_chunk = utils::divideRoundUp(world_offset +
+            uint64_t(new_num_committed) * col.numBytesPerRow, chunk_size);
+
+        if (end_chunk > start_chunk) {
+            col.mem.commitChunks(start_chunk, end_chunk - start_chunk);
+        }
+    }
+
+    numCommittedRows[world_id] = uint32_t(new_num_committed);
+}
+
 #else
 StateManager::TableStorage::TableStorage(Span<TypeInfo> types)
     : tbl(types.data(), types.size(), 0)
@@ -254,6 +746,7 @@ struct StateManager::ArchetypeStore::Init {
     CountT maxNumEntities;
 #ifdef MADRONA_MW_MODE
     CountT numWorlds;
+    CountT rowsPerWorld;
 #endif
 };
 
@@ -261,7 +754,8 @@ StateManager::ArchetypeStore::ArchetypeStore(Init &&init)
     : componentOffset(init.componentOffset),
       numComponents(init.numComponents),
       tblStorage(init.types
-                 MADRONA_MW_COND(, init.numWorlds, init.maxNumEntities)),
+                 MADRONA_MW_COND(, init.numWorlds, init.maxNumEntities,
+                                 init.rowsPerWorld)),
       columnLookup(init.lookupInputs.data(), init.lookupInputs.size())
 {}
 
@@ -434,124 +928,94 @@ void StateManager::registerArchetype(uint32_t id, Span<ComponentID> components,
         Span(type_infos.data(), num_total_components),
         Span(lookup_input.data(), num_user_components),
         max_num_entities,
-        MADRONA_MW_COND(num_worlds_,)
+        MADRONA_MW_COND(num_worlds_, max_rows_per_world_,)
     });
 }
 
-void * StateManager::exportColumn(uint32_t archetype_id, uint32_t component_id)
+int32_t StateManager::getArchetypeColumnIndex(uint32_t archetype_id,
+                                              uint32_t component_id)
 {
-    auto &archetype = *archetype_stores_[archetype_id];
-    uint32_t col_idx;
-
     if (component_id == componentID<Entity>().id) {
-        col_idx = 0;
+        return 0;
     }
 #ifdef MADRONA_MW_MODE
     else if (component_id == componentID<WorldID>().id) {
-        col_idx = 1;
+        return 1;
     }
 #endif
     else {
-        col_idx = *archetype.columnLookup.lookup(component_id);
+        return int32_t(*archetype_stores_[archetype_id]->columnLookup.lookup(
+            component_id));
     }
+}
 
+uint32_t StateManager::getArchetypeColumnBytesPerRow(uint32_t archetype_id,
+                                                     int32_t column_idx)
+{
+    uint32_t component_id;
+    if (column_idx == 0) {
+        component_id = componentID<Entity>().id;
+    }
 #ifdef MADRONA_MW_MODE
-    if (archetype.tblStorage.maxNumPerWorld == 0) {
-
-        uint32_t num_bytes_per_row = component_infos_[component_id]->numBytes;
-        uint64_t map_size = 1'000'000'000 * num_bytes_per_row;
-
-        VirtualRegion mem(map_size, 0, 1);
-        void *export_buffer = mem.ptr();
-
-        export_jobs_.push_back(ExportJob {
-            .archetypeIdx = archetype_id,
-            .columnIdx = col_idx,
-            .numBytesPerRow = num_bytes_per_row,
-            .numMappedChunks = 0,
-            .mem = std::move(mem),
-        });
-
-        return export_buffer;
-    } else {
-        return archetype.tblStorage.fixed.tbl.data(col_idx);
+    else if (column_idx == 1) {
+        component_id = componentID<WorldID>().id;
     }
-#else
-    return archetype.tblStorage.tbl.data(col_idx);
 #endif
+    else {
+        auto &archetype = *archetype_stores_[archetype_id];
+        component_id = archetype_components_[archetype.componentOffset +
+            column_idx - user_component_offset_].id;
+    }
+
+    return component_infos_[component_id]->numBytes;
 }
 
-void StateManager::copyInExportedColumns()
+void * StateManager::exportColumn(uint32_t archetype_id, uint32_t component_id)
 {
-#ifdef MADRONA_MW_MODE
-    for (ExportJob &export_job : export_jobs_) {
-        auto &archetype = *archetype_stores_[export_job.archetypeIdx];
-
-        CountT cumulative_copied_rows = 0;
-        for (Table &tbl : archetype.tblStorage.tbls) {
-            CountT num_rows = tbl.numRows();
-
-            if (num_rows == 0) {
-                continue;
-            }
+    auto &archetype = *archetype_stores_[archetype_id];
+    uint32_t col_idx = getArchetypeColumnIndex(archetype_id, component_id);
 
-            CountT tbl_start = cumulative_copied_rows;
+#ifdef MADRONA_MW_MODE
+    uint32_t num_bytes_per_row = component_infos_[component_id]->numBytes;
+    TableStorage &tbl_storage = archetype.tblStorage;
+
+    void *exported;
+    CountT rows_per_world;
+    if (tbl_storage.maxNumPerWorld == 0) {
+        // World 0's slice is the start of the world-major column
+        exported = tbl_storage.tbls[0].data(col_idx);
+        rows_per_world = tbl_storage.rowsPerWorld;
+    } else {
+        exported = tbl_storage.fixed.tbl.data(col_idx);
+        rows_per_world = tbl_storage.maxNumPerWorld;
+    }
 
-            cumulative_copied_rows += num_rows;
+    export_infos_.push_back(ExportInfo {
+        .ptr = exported,
+        .archetypeID = archetype_id,
+        .numBytesPerRow = num_bytes_per_row,
+        .rowsPerWorld = rows_per_world,
+    });
 
-            memcpy(tbl.data(export_job.columnIdx),
-                   (char *)export_job.mem.ptr() +
-                       tbl_start * export_job.numBytesPerRow,
-                   export_job.numBytesPerRow * num_rows);
-        }
-    }
+    return exported;
+#else
+    return archetype.tblStorage.tbl.data(col_idx);
 #endif
 }
 
-void StateManager::copyOutExportedColumns()
-{
 #ifdef MADRONA_MW_MODE
-    for (ExportJob &export_job : export_jobs_) {
-        auto &archetype = *archetype_stores_[export_job.archetypeIdx];
-
-        CountT cumulative_copied_rows = 0;
-        for (Table &tbl : archetype.tblStorage.tbls) {
-            CountT num_rows = tbl.numRows();
-
-            if (num_rows == 0) {
-                continue;
-            }
-
-            CountT tbl_start = cumulative_copied_rows;
-            cumulative_copied_rows += num_rows;
-
-            uint64_t num_mapped_chunks = export_job.numMappedChunks;
-            uint64_t num_mapped_bytes =
-                 num_mapped_chunks * export_job.mem.chunkSize();
-
-            uint64_t num_needed_bytes = (uint64_t)cumulative_copied_rows *
-                (uint64_t)export_job.numBytesPerRow;
-
-            if (num_needed_bytes > num_mapped_bytes) {
-                uint64_t new_num_mapped_bytes =
-                    std::max(num_mapped_bytes * 2, num_needed_bytes);
-
-                uint64_t new_num_chunks = utils::divideRoundUp(
-                    new_num_mapped_bytes, export_job.mem.chunkSize());
-
-                export_job.mem.commitChunks(num_mapped_chunks,
-                    new_num_chunks - num_mapped_chunks);
-                export_job.numMappedChunks = new_num_chunks;
-            }
-
-            memcpy((char *)export_job.mem.ptr() +
-                       tbl_start * export_job.numBytesPerRow,
-                   tbl.data(export_job.columnIdx),
-                   export_job.numBytesPerRow * num_rows);
+const StateManager::ExportInfo * StateManager::getExportInfo(
+    void *exported) const
+{
+    for (const ExportInfo &info : export_infos_) {
+        if (info.ptr == exported) {
+            return &info;
         }
     }
-#endif
+
+    return nullptr;
 }
+#endif
 
 void StateManager::clear(MADRONA_MW_COND(uint32_t world_id,)
                          StateCache &cache, uint32_t archetype_id,
@@ -576,6 +1040,7 @@ void * StateManager::tmpAlloc(MADRONA_MW_COND(uint32_t world_id,)
                               uint64_t num_bytes)
 {
 #ifdef MADRONA_MW_MODE
+    std::lock_guard lock(world_locks_[world_id]);
     return tmp_allocators_[world_id].alloc(num_bytes);
 #else
     return tmp_allocator_.alloc(num_bytes);
@@ -15,12 +15,17 @@ TaskGraphBuilder::TaskGraphBuilder(const WorkerInit &init)
 #endif
       staged_(0),
       node_datas_(0),
+      data_destructors_(0),
       all_dependencies_(0)
 {}
 
 TaskGraphNodeID TaskGraphBuilder::registerNode(
     uint32_t data_idx,
     void (*fn)(NodeBase *, Context *, TaskGraph *),
+    void (*invocations_fn)(NodeBase *, Context *, TaskGraph *,
+                           CountT, CountT),
+    CountT (*count_fn)(NodeBase *, TaskGraph *),
+    const char *name,
     Span<const TaskGraphNodeID> dependencies,
     Optional<TaskGraphNodeID> parent_node)
 {
@@ -33,8 +38,14 @@ TaskGraphNodeID TaskGraphBuilder::registerNode(
     staged_.push_back(StagedNode {
         .node = {
             .fn = fn,
+            .invocationsFn = invocations_fn,
+            .countFn = count_fn,
+            .name = name,
             .dataIDX = data_idx,
             .numChildren = 0,
+            .numDependencies = uint32_t(dependencies.size()),
+            .dependentsOffset = 0,
+            .numDependents = 0,
         },
         .parentID = parent_node.has_value() ? int32_t(parent_node->id) : -1,
         .dependencyOffset = uint32_t(dependency_offset),
@@ -53,13 +64,16 @@ TaskGraph TaskGraphBuilder::build()
     HeapArray<TaskGraph::Node> sorted_nodes(staged_.size());
     HeapArray<bool> queued(staged_.size());
     HeapArray<int32_t> num_children(staged_.size());
+    HeapArray<uint32_t> sorted_idxs(staged_.size());
 
     int32_t sorted_idx = 0;
-    auto enqueueInSorted = [&](const TaskGraph::Node &node) {
-        new (&sorted_nodes[sorted_idx++]) TaskGraph::Node(node);
+    auto enqueueInSorted = [&](CountT staged_idx) {
+        sorted_idxs[staged_idx] = uint32_t(sorted_idx);
+        new (&sorted_nodes[sorted_idx++]) TaskGraph::Node(
+            staged_[staged_idx].node);
     };
 
-    enqueueInSorted(staged_[0].node);
+    enqueueInSorted(0);
 
     queued[0] = true;
 
@@ -99,38 +113,130 @@ TaskGraph TaskGraphBuilder::build()
 
         if (dependencies_satisfied) {
             queued[cur_node_idx] = true;
-            enqueueInSorted(cur_staged.node);
+            enqueueInSorted(cur_node_idx);
             num_remaining_nodes--;
         }
     }
 
+    // Invert the dependency lists so the backend can find the nodes
+    // unblocked by each finished node.
+    for (CountT i = 0; i < staged_.size(); i++) {
+        const StagedNode &staged = staged_[i];
+        for (CountT dep_offset = 0;
+             dep_offset < (CountT)staged.numDependencies;
+             dep_offset++) {
+            uint32_t dep_node_idx =
+                all_dependencies_[staged.dependencyOffset + dep_offset].id;
+            sorted_nodes[sorted_idxs[dep_node_idx]].numDependents += 1;
+        }
+    }
+
+    HeapArray<uint32_t> dependents(all_dependencies_.size());
+    {
+        uint32_t cur_offset = 0;
+        for (TaskGraph::Node &node : sorted_nodes) {
+            node.dependentsOffset = cur_offset;
+            cur_offset += node.numDependents;
+            node.numDependents = 0;
+        }
+    }
+
+    for (CountT i = 0; i < staged_.size(); i++) {
+        const StagedNode &staged = staged_[i];
+        for (CountT dep_offset = 0;
+             dep_offset < (CountT)staged.numDependencies;
+             dep_offset++) {
+            uint32_t dep_node_idx =
+                all_dependencies_[staged.dependencyOffset + dep_offset].id;
+            TaskGraph::Node &dep_node = sorted_nodes[sorted_idxs[dep_node_idx]];
+
+            dependents[dep_node.dependentsOffset + dep_node.numDependents++] =
+                sorted_idxs[i];
+        }
+    }
+
+    // The node datas are relocated into the TaskGraph, which takes over
+    // destroying them
     HeapArray<TaskGraph::NodeData> data_cpy(node_datas_.size());
     memcpy(data_cpy.data(), node_datas_.data(),
            node_datas_.size() * sizeof(TaskGraph::NodeData));
 
+    HeapArray<void (*)(NodeBase *)> destructors_cpy(node_datas_.size());
+    for (CountT i = 0; i < node_datas_.size(); i++) {
+        destructors_cpy[i] = data_destructors_[i];
+    }
+
     return TaskGraph(state_mgr_, state_cache_, MADRONA_MW_COND(world_id_,)
-        std::move(sorted_nodes), std::move(data_cpy));
+        std::move(sorted_nodes), std::move(data_cpy),
+        std::move(destructors_cpy), std::move(dependents));
+}
+
+TaskGraphManager::TaskGraphManager(const WorkerInit &init)
+    : init_(&init),
+      builders_(0)
+{}
+
+TaskGraphBuilder & TaskGraphManager::init(uint32_t graph_id)
+{
+    while ((CountT)graph_id >= builders_.size()) {
+        builders_.push_back(Optional<TaskGraphBuilder>::none());
+    }
+
+    Optional<TaskGraphBuilder> &builder = builders_[graph_id];
+    if (builder.has_value()) {
+        FATAL("Taskgraph %u initialized twice", graph_id);
+    }
+
+    return builder.emplace(*init_);
+}
+
+HeapArray<TaskGraph> TaskGraphManager::build()
+{
+    HeapArray<TaskGraph> taskgraphs(builders_.size());
+
+    for (CountT i = 0; i < builders_.size(); i++) {
+        if (!builders_[i].has_value()) {
+            FATAL("Taskgraph %ld was never initialized", (long)i);
+        }
+
+        new (&taskgraphs[i]) TaskGraph(builders_[i]->build());
+    }
+
+    return taskgraphs;
 }
 
 TaskGraph::TaskGraph(StateManager *state_mgr,
                      StateCache *state_cache,
                      MADRONA_MW_COND(uint32_t world_id,) 
                      HeapArray<Node> &&sorted_nodes,
-                     HeapArray<NodeData> &&node_datas)
+                     HeapArray<NodeData> &&node_datas,
+                     HeapArray<void (*)(NodeBase *)> &&data_destructors,
+                     HeapArray<uint32_t> &&dependents)
     : state_mgr_(state_mgr),
       state_cache_(state_cache),
 #ifdef MADRONA_MW_MODE
       cur_world_id_(world_id),
 #endif
       sorted_nodes_(std::move(sorted_nodes)),
-      node_datas_(std::move(node_datas))
+      node_datas_(std::move(node_datas)),
+      data_destructors_(std::move(data_destructors)),
+      dependents_(std::move(dependents))
 {}
 
+TaskGraph::~TaskGraph()
+{
+    for (CountT i = 0; i < node_datas_.size(); i++) {
+        if (data_destructors_[i] != nullptr) {
+            data_destructors_[i](
+                (NodeBase *)&node_datas_[i].userData[0]);
+        }
+    }
+}
+
 void TaskGraph::run(Context *ctx)
 {
-    for (const Node &node : sorted_nodes_) {
-        node.fn((NodeBase *)(&node_datas_[node.dataIDX].userData[0]),
-                ctx, this);
+    for (CountT i = 0; i < sorted_nodes_.size(); i++) {
+        runNode(ctx, i);
     }
 }
 
@@ -139,6 +245,12 @@ void TaskGraph::resetTmpAlloc()
     state_mgr_->resetTmpAlloc(MADRONA_MW_COND(cur_world_id_));
 }
 
+void TaskGraph::applyTransactions()
+{
+    state_mgr_->applyTransactions(MADRONA_MW_COND(cur_world_id_,)
+                                  *state_cache_);
+}
+
 TaskGraphNodeID ResetTmpAllocNode::addToGraph(
     StateManager &,
     TaskGraphBuilder &builder,
@@ -147,4 +259,12 @@ TaskGraphNodeID ResetTmpAllocNode::addToGraph(
     return builder.addDefaultNode<ResetTmpAllocNode>(dependencies);
 }
 
+TaskGraphNodeID ApplyTransactionsNode::addToGraph(
+    StateManager &,
+    TaskGraphBuilder &builder,
+    Span<const TaskGraphNodeID> dependencies)
+{
+    return builder.addDefaultNode<ApplyTransactionsNode>(dependencies);
+}
+
 }
@@ -1,29 +1,203 @@
 #include <madrona/mw_cpu.hpp>
 #include "../core/worker_init.hpp"
 
+#include <madrona/optional.hpp>
+#include <madrona/virtual.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+
 #if defined(MADRONA_LINUX) or defined(MADRONA_MACOS)
 #include <unistd.h>
+#endif
+
+#if defined(MADRONA_LINUX)
+#include <cctype>
+#include <dirent.h>
 #elif defined(MADRONA_WINDOWS)
 #include <windows.h>
 #endif
 
 namespace madrona {
 
+namespace {
+
+enum class WorkerCtrl : int32_t {
+    Exit = -1,
+    Run = 1,
+};
+
+// Scheduling state for one node of one world's taskgraph during
+// ThreadPoolExecutor::runTaskGraphs
+struct NodeState {
+    uint32_t worldIdx;
+    uint32_t nodeIdx;
+    CountT numInvocations;
+    uint32_t numChunks;
+    AtomicU32 numPendingDependencies;
+    AtomicU32 numFinishedChunks;
+};
+
+// A contiguous range of chunks [begin, end) of one node, or a range of
+// jobs when stateIdx is jobsStateIdx
+struct WorkItem {
+    uint32_t stateIdx;
+    uint32_t begin;
+    uint32_t end;
+};
+
+constexpr uint32_t jobsStateIdx = ~0_u32;
+
+// Per worker deque of work items. The owning worker takes chunks one at a
+// time from the back, idle workers steal half of the item at the front.
+// Items are only added by the owner: each node is enqueued once per run,
+// plus one stolen item when the queue is empty, so the ring never holds
+// more than numNodes + 1 items.
+struct alignas(MADRONA_CACHE_LINE) WorkerQueue {
+    SpinLock lock;
+    uint32_t head;
+    // Written under lock, but read without it to skip empty victims
+    AtomicU32 numItems;
+    HeapArray<WorkItem> ring;
+
+    // Only touched by the owning worker
+    uint64_t numChunks;
+    uint64_t numSteals;
+    uint64_t idleNanoseconds;
+};
+
+// One timed node chunk, job or whole run, for writeChromeTrace
+struct TraceEvent {
+    // TaskGraph::nodeName, nullptr for jobs and runs
+    const char *name;
+    uint64_t startNs;
+    uint64_t endNs;
+    // ~0 for jobs and runs
+    uint32_t worldIdx;
+    // Node index, job index or ~0 for runs
+    uint32_t idx;
+    // Invocations in the chunk, or worlds / jobs in the run
+    uint64_t count;
+};
+
+// Ring buffer of the most recent events recorded by one thread
+struct alignas(MADRONA_CACHE_LINE) TraceBuffer {
+    HeapArray<TraceEvent> events;
+    uint64_t numRecorded;
+};
+
+// Copy of an exported buffer with the same layout, handed out by
+// getExported when exports are double buffered
+struct ExportSnapshot {
+    const StateManager::ExportInfo *info;
+    VirtualRegion mem;
+    // Per world, only used if the region can't be committed lazily and
+    // world slices start on chunk boundaries. ~0 if already committed.
+    HeapArray<uint64_t> numCommittedChunks;
+};
+
+}
+
 struct ThreadPoolExecutor::Impl {
+    struct SnapshotJobData {
+        Impl *impl;
+        uint32_t worldIdx;
+    };
+
+    // Parallel nodes aren't split into chunks smaller than this
+    static constexpr CountT minInvocationsPerChunk = 32;
+    // Target number of outstanding chunks per worker across all worlds
+    static constexpr CountT chunksPerWorker = 4;
+    // Failed attempts to find work before an idle worker parks
+    static constexpr CountT numIdleSpins = 64;
+
     HeapArray<std::thread> workers;
-    alignas(MADRONA_CACHE_LINE) AtomicI32 workerWakeup;
+    HeapArray<WorkerQueue> queues;
+    HeapArray<WorkerStats> workerStats;
+    // Workers ordered by NUMA node. Contiguous ranges of worlds (or jobs)
+    // are assigned to consecutive workers in this order.
+    HeapArray<uint32_t> placementOrder;
+    // For each worker, the other workers in the order they are stolen
+    // from: workers on the same NUMA node first.
+    HeapArray<uint32_t> stealOrder;
+
+    WorkerCtrl workerCtrl;
+    alignas(MADRONA_CACHE_LINE) AtomicU32 workerGeneration;
     alignas(MADRONA_CACHE_LINE) AtomicI32 mainWakeup;
+    alignas(MADRONA_CACHE_LINE) AtomicU32 numActiveWorkers;
+    // Nodes (or jobs) that haven't finished in the current run
+    alignas(MADRONA_CACHE_LINE) AtomicU32 numRemaining;
+    // Bumped whenever work is pushed or the run finishes. Parked workers
+    // wait on it, see workLoop.
+    alignas(MADRONA_CACHE_LINE) AtomicU32 workEpoch;
+    alignas(MADRONA_CACHE_LINE) AtomicU32 numParkedWorkers;
+
     ThreadPoolExecutor::Job *currentJobs;
-    uint32_t numJobs;
-    alignas(MADRONA_CACHE_LINE) AtomicU32 nextJob;
-    alignas(MADRONA_CACHE_LINE) AtomicU32 numFinished;
+
+    TaskGraph **currentGraphs;
+    Context **currentCtxs;
+    uint32_t maxChunksPerNode;
+    HeapArray<NodeState> nodeStates;
+    HeapArray<uint32_t> worldNodeOffsets;
+
+    // Set between runTaskGraphsAsync and wait
+    bool running;
+    // IDs of the worlds in the last taskgraph run (all worlds before the
+    // first run), so only those worlds' exports are copied
+    HeapArray<uint32_t> runWorldIDs;
+    CountT numRunWorlds;
+
     StateManager stateMgr;
     HeapArray<StateCache> stateCaches;
     HeapArray<void *> exportPtrs;
 
+    // One per worker plus one for the runs on the main thread, empty if
+    // tracing is disabled
+    HeapArray<TraceBuffer> traceBuffers;
+    std::chrono::steady_clock::time_point traceEpoch;
+    uint64_t runStartNs;
+    // Worlds or jobs in the current run
+    uint64_t numRunItems;
+
+    bool doubleBufferExports;
+    HeapArray<Optional<ExportSnapshot>> exportSnapshots;
+    HeapArray<SnapshotJobData> snapshotJobData;
+    HeapArray<Job> snapshotJobs;
+    // Direction of the copy done by the snapshot jobs
+    bool copySnapshotsToLive;
+
     static Impl * make(const ThreadPoolExecutor::Config &cfg);
     ~Impl();
+    void wakeWorkers(WorkerCtrl ctrl);
+    void resetQueues(uint32_t capacity);
+    inline uint64_t traceTimestamp() const;
+    inline void recordTrace(CountT buffer_idx, const TraceEvent &event);
+    void writeChromeTrace(const char *path) const;
+    void startWorkers();
+    void waitForWorkers();
     void run(Job *jobs, CountT num_jobs);
+    void runTaskGraphsAsync(TaskGraph **taskgraphs, Context **ctxs,
+                            CountT num_worlds);
+    void wait();
+    void initExportSnapshots();
+    void snapshotExports();
+    void applyExportSnapshots();
+    void runSnapshotJobs(bool to_live);
+    void copyWorldExports(uint32_t world_idx, bool to_live);
+    inline void wakeParkedWorkers();
+    inline bool hasQueuedWork() const;
+    inline void pushItem(CountT worker_idx, WorkItem item);
+    inline bool popChunk(CountT worker_idx, WorkItem *chunk);
+    inline bool stealChunk(CountT worker_idx, WorkItem *chunk);
+    void enqueueNode(CountT worker_idx, uint32_t state_idx);
+    void finishNode(CountT worker_idx, uint32_t state_idx);
+    void runNodeChunk(CountT worker_idx, uint32_t state_idx,
+                      uint32_t chunk_idx);
+    void workLoop(CountT worker_idx);
     void workerThread(CountT worker_id);
 };
 
@@ -55,33 +229,90 @@ static CountT getNumCores()
 #endif
 }
 
-static inline void pinThread([[maybe_unused]] CountT worker_id)
+#ifdef MADRONA_LINUX
+// Worker i is pinned to the i'th CPU in the process' affinity mask.
+// This is needed in case there was already cpu masking via
+// a different call to setaffinity or via cgroup (SLURM)
+static int getWorkerCPU(const cpu_set_t &cpu_set, CountT worker_id)
+{
+    for (CountT thread_idx = 0, available_threads = 0;
+         thread_idx < (CountT)CPU_SETSIZE; thread_idx++) {
+        if (CPU_ISSET(thread_idx, &cpu_set)) {
+            if ((available_threads++) == worker_id) {
+                return int(thread_idx);
+            }
+        }
+    }
+
+    return -1;
+}
+
+// sysfs links each CPU to its NUMA node as cpuN/nodeM. Non-NUMA
+// kernels don't create the link, so everything ends up on node 0.
+static int32_t getCPUNUMANode(int cpu)
 {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR *dir = opendir(path);
+    if (dir == nullptr) {
+        return 0;
+    }
+
+    int32_t node = 0;
+    while (struct dirent *entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "node", 4) == 0 &&
+                isdigit(entry->d_name[4])) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+
+    closedir(dir);
+
+    return node;
+}
+#endif
+
+// NUMA node each worker runs on once pinned by pinThread
+static HeapArray<int32_t> getWorkerNUMANodes(CountT num_workers)
+{
+    HeapArray<int32_t> nodes(num_workers);
+
 #ifdef MADRONA_LINUX
     cpu_set_t cpu_set;
     pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
-
     const int max_threads = CPU_COUNT(&cpu_set);
 
-    if (worker_id > max_threads) [[unlikely]] {
-        FATAL("Tried setting thread affinity to %d when %d is max",
-              worker_id, max_threads);
+    for (CountT i = 0; i < num_workers; i++) {
+        nodes[i] = getCPUNUMANode(
+            getWorkerCPU(cpu_set, i % std::max(max_threads, 1)));
+    }
+#else
+    for (CountT i = 0; i < num_workers; i++) {
+        nodes[i] = 0;
     }
+#endif
+
+    return nodes;
+}
+
+static inline void pinThread([[maybe_unused]] CountT worker_id)
+{
+#ifdef MADRONA_LINUX
+    cpu_set_t cpu_set;
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+
+    const int max_threads = CPU_COUNT(&cpu_set);
 
     cpu_set_t worker_set;
     CPU_ZERO(&worker_set);
-    
-    // This is needed in case there was already cpu masking via
-    // a different call to setaffinity or via cgroup (SLURM)
-    for (CountT thread_idx = 0, available_threads = 0;
-         thread_idx < (CountT)CPU_SETSIZE; thread_idx++) {
-        if (CPU_ISSET(thread_idx, &cpu_set)) {
-            if ((available_threads++) == worker_id) {
-                CPU_SET(thread_idx, &worker_set);
 
-                break;
-            }
-        }
+    // With more workers than CPUs the workers share them round robin, the
+    // same assignment getWorkerNUMANodes assumes
+    int cpu = getWorkerCPU(cpu_set, worker_id % std::max(max_threads, 1));
+    if (cpu != -1) {
+        CPU_SET(cpu, &worker_set);
     }
 
     int res = pthread_setaffinity_np(pthread_self(),
@@ -97,25 +328,106 @@ static inline void pinThread([[maybe_unused]] CountT worker_id)
 ThreadPoolExecutor::Impl * ThreadPoolExecutor::Impl::make(
     const ThreadPoolExecutor::Config &cfg)
 {
+    CountT num_workers = cfg.numWorkers == 0 ? getNumCores() : cfg.numWorkers;
+
     Impl *impl = new Impl {
-        .workers = HeapArray<std::thread>(
-            cfg.numWorkers == 0 ? getNumCores() : cfg.numWorkers),
-        .workerWakeup = 0,
+        .workers = HeapArray<std::thread>(num_workers),
+        .queues = HeapArray<WorkerQueue>(num_workers),
+        .workerStats = HeapArray<WorkerStats>(num_workers),
+        .placementOrder = HeapArray<uint32_t>(num_workers),
+        .stealOrder = HeapArray<uint32_t>(num_workers * (num_workers - 1)),
+        .workerCtrl = WorkerCtrl::Run,
+        .workerGeneration = 0,
         .mainWakeup = 0,
+        .numActiveWorkers = 0,
+        .numRemaining = 0,
+        .workEpoch = 0,
+        .numParkedWorkers = 0,
         .currentJobs = nullptr,
-        .numJobs = 0,
-        .nextJob = 0,
-        .numFinished = 0,
-        .stateMgr = StateManager(cfg.numWorlds),
+        .currentGraphs = nullptr,
+        .currentCtxs = nullptr,
+        .maxChunksPerNode = 1,
+        .nodeStates = HeapArray<NodeState>(0),
+        .worldNodeOffsets = HeapArray<uint32_t>(0),
+        .running = false,
+        .runWorldIDs = HeapArray<uint32_t>(cfg.numWorlds),
+        .numRunWorlds = CountT(cfg.numWorlds),
+        .stateMgr = StateManager(cfg.numWorlds,
+                                 cfg.maxRowsPerWorld),
         .stateCaches = HeapArray<StateCache>(cfg.numWorlds),
         .exportPtrs = HeapArray<void *>(cfg.numExportedBuffers),
+        .traceBuffers = HeapArray<TraceBuffer>(
+            cfg.numTraceEventsPerWorker > 0 ? num_workers + 1 : 0),
+        .traceEpoch = std::chrono::steady_clock::now(),
+        .runStartNs = 0,
+        .numRunItems = 0,
+        .doubleBufferExports = cfg.doubleBufferExports,
+        .exportSnapshots = HeapArray<Optional<ExportSnapshot>>(
+            cfg.numExportedBuffers),
+        .snapshotJobData = HeapArray<SnapshotJobData>(0),
+        .snapshotJobs = HeapArray<Job>(0),
+        .copySnapshotsToLive = false,
     };
 
+    for (CountT i = 0; i < impl->traceBuffers.size(); i++) {
+        new (&impl->traceBuffers[i]) TraceBuffer {
+            .events = HeapArray<TraceEvent>(cfg.numTraceEventsPerWorker),
+            .numRecorded = 0,
+        };
+    }
+
+    for (CountT i = 0; i < (CountT)cfg.numExportedBuffers; i++) {
+        impl->exportPtrs[i] = nullptr;
+        Optional<ExportSnapshot>::noneAt(&impl->exportSnapshots[i]);
+    }
+
     for (CountT i = 0; i < (CountT)cfg.numWorlds; i++) {
         impl->stateCaches.emplace(i);
+        impl->runWorldIDs[i] = uint32_t(i);
+    }
+
+    for (CountT i = 0; i < num_workers; i++) {
+        new (&impl->queues[i]) WorkerQueue {
+            .lock = {},
+            .head = 0,
+            .numItems = 0,
+            .ring = HeapArray<WorkItem>(1),
+            .numChunks = 0,
+            .numSteals = 0,
+            .idleNanoseconds = 0,
+        };
+
+        impl->workerStats[i] = {};
     }
 
-    for (CountT i = 0; i < impl->workers.size(); i++) {
+    HeapArray<int32_t> numa_nodes = getWorkerNUMANodes(num_workers);
+
+    for (CountT i = 0; i < num_workers; i++) {
+        impl->placementOrder[i] = uint32_t(i);
+    }
+
+    std::stable_sort(impl->placementOrder.begin(), impl->placementOrder.end(),
+        [&numa_nodes](uint32_t a, uint32_t b) {
+            return numa_nodes[a] < numa_nodes[b];
+        });
+
+    // Each worker starts scanning at its right neighbor, so idle workers
+    // don't all contend on the same victim
+    for (CountT i = 0; i < num_workers; i++) {
+        uint32_t *victims = impl->stealOrder.data() + i * (num_workers - 1);
+
+        CountT num_victims = 0;
+        for (CountT j = 1; j < num_workers; j++) {
+            victims[num_victims++] = uint32_t((i + j) % num_workers);
+        }
+
+        std::stable_partition(victims, victims + num_victims,
+            [&numa_nodes, i](uint32_t victim) {
+                return numa_nodes[victim] == numa_nodes[i];
+            });
+    }
+
+    for (CountT i = 0; i < num_workers; i++) {
         impl->workers.emplace(i, [](Impl *impl, CountT i) {
             impl->workerThread(i);
         }, impl, i);
@@ -132,8 +444,9 @@ ThreadPoolExecutor::ThreadPoolExecutor(ThreadPoolExecutor &&o) = default;
 
 ThreadPoolExecutor::Impl::~Impl()
 {
-    workerWakeup.store_release(-1);
-    workerWakeup.notify_all();
+    wait();
+
+    wakeWorkers(WorkerCtrl::Exit);
 
     for (CountT i = 0; i < workers.size(); i++) {
         workers[i].join();
@@ -142,21 +455,680 @@ ThreadPoolExecutor::Impl::~Impl()
 
 ThreadPoolExecutor::~ThreadPoolExecutor() = default;
 
-void ThreadPoolExecutor::Impl::run(Job *jobs, CountT num_jobs)
+void ThreadPoolExecutor::Impl::wakeWorkers(WorkerCtrl ctrl)
 {
-    stateMgr.copyInExportedColumns();
+    workerCtrl = ctrl;
+    numActiveWorkers.store_relaxed(uint32_t(workers.size()));
 
-    currentJobs = jobs;
-    numJobs = uint32_t(num_jobs);
-    nextJob.store_relaxed(0);
-    numFinished.store_relaxed(0);
-    workerWakeup.store_release(1);
-    workerWakeup.notify_all();
+    workerGeneration.fetch_add_release(1);
+    workerGeneration.notify_all();
+}
 
+// Only safe while the workers are asleep
+void ThreadPoolExecutor::Impl::resetQueues(uint32_t capacity)
+{
+    for (WorkerQueue &queue : queues) {
+        if (queue.ring.size() < capacity) {
+            queue.ring = HeapArray<WorkItem>(capacity);
+        }
+
+        queue.head = 0;
+        queue.numItems.store_relaxed(0);
+    }
+}
+
+uint64_t ThreadPoolExecutor::Impl::traceTimestamp() const
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - traceEpoch).count());
+}
+
+void ThreadPoolExecutor::Impl::recordTrace(CountT buffer_idx,
+                                           const TraceEvent &event)
+{
+    TraceBuffer &buffer = traceBuffers[buffer_idx];
+    CountT capacity = buffer.events.size();
+
+    buffer.events[CountT(buffer.numRecorded % uint64_t(capacity))] = event;
+    buffer.numRecorded += 1;
+}
+
+// Node names are compiler generated signatures of
+// TaskGraphBuilder::nodeFnName, keep only the node function
+static std::string_view traceNodeName(const char *signature)
+{
+    std::string_view name(signature);
+
+    // GCC & clang: "... [with auto fn = &Node::run]" or "... [fn = ...]"
+    size_t start = name.find("fn = &");
+    size_t end = name.rfind(']');
+    if (start != name.npos && end != name.npos && end > start) {
+        return name.substr(start + 6, end - start - 6);
+    }
+
+    // MSVC: "... nodeFnName<&Node::run>(void)"
+    start = name.find("nodeFnName<&");
+    end = name.rfind(">(void)");
+    if (start != name.npos && end != name.npos && end > start) {
+        return name.substr(start + 12, end - start - 12);
+    }
+
+    return name;
+}
+
+static void writeTraceString(FILE *file, std::string_view str)
+{
+    fputc('"', file);
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+// Writes the Chrome trace event format (also loaded by Perfetto): one
+// complete ("X") event per recorded chunk, job or run, with one track per
+// worker plus one for the main thread.
+void ThreadPoolExecutor::Impl::writeChromeTrace(const char *path) const
+{
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) {
+        FATAL("Failed to open trace file %s", path);
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    CountT num_workers = workers.size();
+    bool first = true;
+    for (CountT buffer_idx = 0; buffer_idx < traceBuffers.size();
+         buffer_idx++) {
+        bool is_main = buffer_idx == num_workers;
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":0,\"tid\":%ld,\"args\":{\"name\":",
+                first ? "" : ",\n", (long)buffer_idx);
+        if (is_main) {
+            fprintf(file, "\"main\"}}");
+        } else {
+            fprintf(file, "\"worker %ld\"}}", (long)buffer_idx);
+        }
+        first = false;
+
+        const TraceBuffer &buffer = traceBuffers[buffer_idx];
+        uint64_t capacity = uint64_t(buffer.events.size());
+        uint64_t num_events = std::min(buffer.numRecorded, capacity);
+        uint64_t first_event = buffer.numRecorded - num_events;
+
+        for (uint64_t i = first_event; i < buffer.numRecorded; i++) {
+            const TraceEvent &event = buffer.events[CountT(i % capacity)];
+
+            fprintf(file, ",\n{\"name\":");
+            if (event.name != nullptr) {
+                writeTraceString(file, traceNodeName(event.name));
+            } else if (is_main) {
+                fprintf(file, "\"run\"");
+            } else {
+                fprintf(file, "\"job\"");
+            }
+
+            fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\","
+                    "\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%ld,"
+                    "\"args\":{",
+                    is_main ? "run" : (event.name ? "node" : "job"),
+                    double(event.startNs) / 1000.0,
+                    double(event.endNs - event.startNs) / 1000.0,
+                    (long)buffer_idx);
+
+            if (is_main) {
+                fprintf(file, "\"count\":%lu}}",
+                        (unsigned long)event.count);
+            } else if (event.name != nullptr) {
+                fprintf(file, "\"world\":%u,\"node\":%u,"
+                        "\"invocations\":%lu}}",
+                        event.worldIdx, event.idx,
+                        (unsigned long)event.count);
+            } else {
+                fprintf(file, "\"job\":%u}}", event.idx);
+            }
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
+
+void ThreadPoolExecutor::Impl::startWorkers()
+{
+    if (traceBuffers.size() > 0) {
+        runStartNs = traceTimestamp();
+    }
+
+    running = true;
+    wakeWorkers(WorkerCtrl::Run);
+}
+
+// Every worker takes part in every run, and main only wakes up once all of
+// them have left workLoop. Otherwise a worker still polling the queues
+// could pick up items from the next run while main resets them.
+void ThreadPoolExecutor::Impl::waitForWorkers()
+{
     mainWakeup.wait<sync::acquire>(0);
     mainWakeup.store_relaxed(0);
 
-    stateMgr.copyOutExportedColumns();
+    running = false;
+
+    if (traceBuffers.size() > 0) {
+        recordTrace(workers.size(), TraceEvent {
+            .name = nullptr,
+            .startNs = runStartNs,
+            .endNs = traceTimestamp(),
+            .worldIdx = ~0_u32,
+            .idx = ~0_u32,
+            .count = numRunItems,
+        });
+    }
+}
+
+void ThreadPoolExecutor::Impl::run(Job *jobs, CountT num_jobs)
+{
+    assert(!running);
+
+    if (num_jobs == 0) {
+        return;
+    }
+
+    currentJobs = jobs;
+    numRemaining.store_relaxed(uint32_t(num_jobs));
+    numRunItems = uint64_t(num_jobs);
+
+    resetQueues(2);
+
+    CountT num_workers = workers.size();
+    for (CountT i = 0; i < num_workers; i++) {
+        uint32_t begin = uint32_t(num_jobs * i / num_workers);
+        uint32_t end = uint32_t(num_jobs * (i + 1) / num_workers);
+
+        if (begin != end) {
+            pushItem(placementOrder[i], WorkItem {
+                .stateIdx = jobsStateIdx,
+                .begin = begin,
+                .end = end,
+            });
+        }
+    }
+
+    startWorkers();
+    waitForWorkers();
+}
+
+void ThreadPoolExecutor::Impl::runTaskGraphsAsync(TaskGraph **taskgraphs,
+                                                  Context **ctxs,
+                                                  CountT num_worlds)
+{
+    assert(!running);
+
+    CountT total_num_nodes = 0;
+    for (CountT i = 0; i < num_worlds; i++) {
+        total_num_nodes += taskgraphs[i]->numNodes();
+    }
+
+    if (total_num_nodes == 0) {
+        return;
+    }
+
+    if (nodeStates.size() < total_num_nodes) {
+        nodeStates = HeapArray<NodeState>(total_num_nodes);
+    }
+
+    if (worldNodeOffsets.size() < num_worlds) {
+        worldNodeOffsets = HeapArray<uint32_t>(num_worlds);
+    }
+
+    currentGraphs = taskgraphs;
+    currentCtxs = ctxs;
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        runWorldIDs[i] = ctxs[i]->worldID().idx;
+    }
+    numRunWorlds = num_worlds;
+
+    if (doubleBufferExports) {
+        applyExportSnapshots();
+    }
+
+    numRunItems = uint64_t(num_worlds);
+
+    // Runs may only cover a subset of the worlds, so the chunking adapts
+    // to the number of worlds actually running
+    maxChunksPerNode = uint32_t(std::max(utils::divideRoundUp(
+        workers.size() * chunksPerWorker, num_worlds), CountT(1)));
+
+    uint32_t cur_offset = 0;
+    for (CountT world_idx = 0; world_idx < num_worlds; world_idx++) {
+        TaskGraph &taskgraph = *taskgraphs[world_idx];
+        worldNodeOffsets[world_idx] = cur_offset;
+
+        for (CountT node_idx = 0; node_idx < taskgraph.numNodes();
+             node_idx++) {
+            new (&nodeStates[cur_offset++]) NodeState {
+                .worldIdx = uint32_t(world_idx),
+                .nodeIdx = uint32_t(node_idx),
+                .numInvocations = 0,
+                .numChunks = 0,
+                .numPendingDependencies =
+                    taskgraph.numDependencies(node_idx),
+                .numFinishedChunks = 0,
+            };
+        }
+    }
+
+    resetQueues(uint32_t(total_num_nodes) + 1);
+    numRemaining.store_relaxed(uint32_t(total_num_nodes));
+
+    // Worlds are split into contiguous ranges, one per worker, so each
+    // worker starts on worlds whose ECS data is adjacent in memory and
+    // neighboring ranges stay on the same NUMA node. Dependents are
+    // enqueued on the worker that finished their last dependency.
+    CountT num_workers = workers.size();
+    for (CountT world_idx = 0; world_idx < num_worlds; world_idx++) {
+        TaskGraph &taskgraph = *taskgraphs[world_idx];
+        uint32_t world_offset = worldNodeOffsets[world_idx];
+        CountT worker_idx =
+            placementOrder[world_idx * num_workers / num_worlds];
+
+        for (CountT node_idx = 0; node_idx < taskgraph.numNodes();
+             node_idx++) {
+            if (taskgraph.numDependencies(node_idx) == 0) {
+                enqueueNode(worker_idx, world_offset + uint32_t(node_idx));
+            }
+        }
+    }
+
+    startWorkers();
+}
+
+void ThreadPoolExecutor::Impl::wait()
+{
+    if (!running) {
+        return;
+    }
+
+    waitForWorkers();
+
+    if (doubleBufferExports) {
+        snapshotExports();
+    }
+}
+
+// The snapshots are created on first use, since exportPtrs is only filled
+// in by registerTypes.
+void ThreadPoolExecutor::Impl::initExportSnapshots()
+{
+    CountT num_worlds = stateCaches.size();
+
+    for (CountT slot = 0; slot < exportPtrs.size(); slot++) {
+        const StateManager::ExportInfo *info =
+            stateMgr.getExportInfo(exportPtrs[slot]);
+        if (info == nullptr) {
+            continue;
+        }
+
+        uint64_t num_world_bytes =
+            uint64_t(info->rowsPerWorld) * info->numBytesPerRow;
+
+        VirtualRegion mem(uint64_t(num_worlds) * num_world_bytes, 0, 1);
+        HeapArray<uint64_t> num_committed_chunks(num_worlds);
+
+        // Like the ECS tables, commit the whole region as one mapping
+        // when the OS backs pages on first touch. Otherwise commit per
+        // world as rows are copied, or all at once if world slices
+        // don't start on chunk boundaries.
+        uint64_t chunk_size = mem.chunkSize();
+        bool lazily_committed = mem.commitLazily();
+        bool commit_per_world = !lazily_committed &&
+            num_world_bytes % chunk_size == 0;
+
+        if (!lazily_committed && !commit_per_world) {
+            mem.commitChunks(0, utils::divideRoundUp(
+                uint64_t(num_worlds) * num_world_bytes, chunk_size));
+        }
+
+        for (CountT i = 0; i < num_worlds; i++) {
+            num_committed_chunks[i] = commit_per_world ? 0 : ~0_u64;
+        }
+
+        Optional<ExportSnapshot>::makeAt(&exportSnapshots[slot],
+            ExportSnapshot {
+                .info = info,
+                .mem = std::move(mem),
+                .numCommittedChunks = std::move(num_committed_chunks),
+            });
+    }
+
+    snapshotJobData = HeapArray<SnapshotJobData>(num_worlds);
+    snapshotJobs = HeapArray<Job>(num_worlds);
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        snapshotJobData[i] = SnapshotJobData {
+            .impl = this,
+            .worldIdx = 0,
+        };
+
+        snapshotJobs[i] = Job {
+            .fn = [](void *data) {
+                auto &job_data = *(SnapshotJobData *)data;
+                job_data.impl->copyWorldExports(job_data.worldIdx,
+                    job_data.impl->copySnapshotsToLive);
+            },
+            .data = &snapshotJobData[i],
+        };
+    }
+}
+
+// Copies the live exported data of the worlds in runWorldIDs into the
+// snapshot buffers handed out by getExported, one job per world.
+void ThreadPoolExecutor::Impl::snapshotExports()
+{
+    if (snapshotJobs.size() == 0) {
+        initExportSnapshots();
+    }
+
+    runSnapshotJobs(false);
+}
+
+// Reverse of snapshotExports: copies the snapshot buffers of the worlds in
+// runWorldIDs back into the live columns before they run, so values the
+// caller wrote through getExported (actions, resets) reach the worlds.
+void ThreadPoolExecutor::Impl::applyExportSnapshots()
+{
+    if (snapshotJobs.size() == 0) {
+        return;
+    }
+
+    runSnapshotJobs(true);
+}
+
+void ThreadPoolExecutor::Impl::runSnapshotJobs(bool to_live)
+{
+    for (CountT i = 0; i < numRunWorlds; i++) {
+        snapshotJobData[i].worldIdx = runWorldIDs[i];
+    }
+
+    copySnapshotsToLive = to_live;
+    run(snapshotJobs.data(), numRunWorlds);
+}
+
+void ThreadPoolExecutor::Impl::copyWorldExports(uint32_t world_idx,
+                                                bool to_live)
+{
+    for (Optional<ExportSnapshot> &snapshot : exportSnapshots) {
+        if (!snapshot.has_value()) {
+            continue;
+        }
+
+        const StateManager::ExportInfo &info = *snapshot->info;
+
+        uint64_t world_offset = uint64_t(world_idx) *
+            uint64_t(info.rowsPerWorld) * info.numBytesPerRow;
+        uint64_t num_bytes = uint64_t(stateMgr.numArchetypeRows(
+            world_idx, info.archetypeID)) * info.numBytesPerRow;
+
+        uint64_t &num_committed = snapshot->numCommittedChunks[world_idx];
+        if (num_committed != ~0_u64) {
+            uint64_t chunk_size = snapshot->mem.chunkSize();
+            uint64_t num_chunks = utils::divideRoundUp(num_bytes, chunk_size);
+
+            if (num_chunks > num_committed) {
+                snapshot->mem.commitChunks(
+                    world_offset / chunk_size + num_committed,
+                    num_chunks - num_committed);
+                num_committed = num_chunks;
+            }
+        }
+
+        char *snapshot_world = (char *)snapshot->mem.ptr() + world_offset;
+        char *live_world = (char *)info.ptr + world_offset;
+
+        if (to_live) {
+            memcpy(live_world, snapshot_world, num_bytes);
+        } else {
+            memcpy(snapshot_world, live_world, num_bytes);
+        }
+    }
+}
+
+// Pairs with the park sequence in workLoop: the epoch bump and the
+// numParkedWorkers check are seq_cst so either the parking worker sees the
+// new epoch (and rechecks the queues), or this sees the worker as parked
+// and wakes it.
+void ThreadPoolExecutor::Impl::wakeParkedWorkers()
+{
+    workEpoch.fetch_add<sync::seq_cst>(1);
+
+    if (numParkedWorkers.load<sync::seq_cst>() > 0) {
+        workEpoch.notify_all();
+    }
+}
+
+bool ThreadPoolExecutor::Impl::hasQueuedWork() const
+{
+    for (const WorkerQueue &queue : queues) {
+        if (queue.numItems.load_relaxed() > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPoolExecutor::Impl::pushItem(CountT worker_idx, WorkItem item)
+{
+    WorkerQueue &queue = queues[worker_idx];
+    uint32_t capacity = uint32_t(queue.ring.size());
+
+    {
+        std::lock_guard lock(queue.lock);
+
+        uint32_t num_items = queue.numItems.load_relaxed();
+        assert(num_items < capacity);
+
+        queue.ring[(queue.head + num_items) % capacity] = item;
+        queue.numItems.store_relaxed(num_items + 1);
+    }
+
+    wakeParkedWorkers();
+}
+
+bool ThreadPoolExecutor::Impl::popChunk(CountT worker_idx, WorkItem *chunk)
+{
+    WorkerQueue &queue = queues[worker_idx];
+    uint32_t capacity = uint32_t(queue.ring.size());
+
+    std::lock_guard lock(queue.lock);
+
+    uint32_t num_items = queue.numItems.load_relaxed();
+    if (num_items == 0) {
+        return false;
+    }
+
+    WorkItem &item = queue.ring[(queue.head + num_items - 1) % capacity];
+
+    *chunk = WorkItem {
+        .stateIdx = item.stateIdx,
+        .begin = item.begin,
+        .end = item.begin + 1,
+    };
+
+    if (++item.begin == item.end) {
+        queue.numItems.store_relaxed(num_items - 1);
+    }
+
+    return true;
+}
+
+bool ThreadPoolExecutor::Impl::stealChunk(CountT worker_idx, WorkItem *chunk)
+{
+    CountT num_victims = workers.size() - 1;
+    const uint32_t *victims = stealOrder.data() + worker_idx * num_victims;
+
+    for (CountT i = 0; i < num_victims; i++) {
+        WorkerQueue &victim = queues[victims[i]];
+
+        if (victim.numItems.load_relaxed() == 0) {
+            continue;
+        }
+
+        WorkItem stolen;
+        {
+            std::lock_guard lock(victim.lock);
+
+            uint32_t num_items = victim.numItems.load_relaxed();
+            if (num_items == 0) {
+                continue;
+            }
+
+            // Take the upper half of the oldest item, which for nodes
+            // enqueued from finishNode is the one the victim will get to
+            // last.
+            WorkItem &item = victim.ring[victim.head];
+            uint32_t split = item.begin + (item.end - item.begin) / 2;
+
+            stolen = WorkItem {
+                .stateIdx = item.stateIdx,
+                .begin = split,
+                .end = item.end,
+            };
+
+            if (split == item.begin) {
+                victim.head = (victim.head + 1) % uint32_t(victim.ring.size());
+                victim.numItems.store_relaxed(num_items - 1);
+            } else {
+                item.end = split;
+            }
+        }
+
+        queues[worker_idx].numSteals += 1;
+
+        *chunk = WorkItem {
+            .stateIdx = stolen.stateIdx,
+            .begin = stolen.begin,
+            .end = stolen.begin + 1,
+        };
+
+        if (stolen.end - stolen.begin > 1) {
+            stolen.begin += 1;
+            pushItem(worker_idx, stolen);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPoolExecutor::Impl::enqueueNode(CountT worker_idx,
+                                           uint32_t state_idx)
+{
+    NodeState &state = nodeStates[state_idx];
+    TaskGraph &taskgraph = *currentGraphs[state.worldIdx];
+
+    if (taskgraph.isParallelNode(state.nodeIdx)) {
+        // The invocation count can only be computed once all dependencies
+        // have finished, since they may have created or destroyed entities
+        CountT num_invocations = taskgraph.numInvocations(state.nodeIdx);
+
+        CountT num_chunks = std::clamp(
+            utils::divideRoundUp(num_invocations, minInvocationsPerChunk),
+            CountT(1), CountT(maxChunksPerNode));
+
+        state.numInvocations = num_invocations;
+        state.numChunks = uint32_t(num_chunks);
+    } else {
+        state.numInvocations = 1;
+        state.numChunks = 1;
+    }
+
+    pushItem(worker_idx, WorkItem {
+        .stateIdx = state_idx,
+        .begin = 0,
+        .end = state.numChunks,
+    });
+}
+
+void ThreadPoolExecutor::Impl::finishNode(CountT worker_idx,
+                                          uint32_t state_idx)
+{
+    NodeState &state = nodeStates[state_idx];
+    TaskGraph &taskgraph = *currentGraphs[state.worldIdx];
+    uint32_t world_offset = worldNodeOffsets[state.worldIdx];
+
+    // Dependents must be enqueued before decrementing numRemaining,
+    // otherwise workers could observe empty queues & no remaining nodes
+    for (uint32_t dependent_idx : taskgraph.dependents(state.nodeIdx)) {
+        uint32_t dependent_state_idx = world_offset + dependent_idx;
+        uint32_t prev_pending = nodeStates[dependent_state_idx].
+            numPendingDependencies.fetch_sub_acq_rel(1);
+
+        if (prev_pending == 1) {
+            enqueueNode(worker_idx, dependent_state_idx);
+        }
+    }
+
+    if (numRemaining.fetch_sub_acq_rel(1) == 1) {
+        wakeParkedWorkers();
+    }
+}
+
+void ThreadPoolExecutor::Impl::runNodeChunk(CountT worker_idx,
+                                            uint32_t state_idx,
+                                            uint32_t chunk_idx)
+{
+    NodeState &state = nodeStates[state_idx];
+    TaskGraph &taskgraph = *currentGraphs[state.worldIdx];
+    Context *ctx = currentCtxs[state.worldIdx];
+
+    uint32_t num_chunks = state.numChunks;
+
+    bool tracing = traceBuffers.size() > 0;
+    uint64_t start_ns = tracing ? traceTimestamp() : 0;
+
+    CountT num_invocations;
+    if (taskgraph.isParallelNode(state.nodeIdx)) {
+        CountT chunk_start =
+            state.numInvocations * chunk_idx / num_chunks;
+        CountT chunk_end =
+            state.numInvocations * (chunk_idx + 1) / num_chunks;
+        num_invocations = chunk_end - chunk_start;
+
+        taskgraph.runNodeInvocations(ctx, state.nodeIdx,
+            chunk_start, num_invocations);
+    } else {
+        num_invocations = 1;
+
+        taskgraph.runNode(ctx, state.nodeIdx);
+    }
+
+    if (tracing) {
+        recordTrace(worker_idx, TraceEvent {
+            .name = taskgraph.nodeName(state.nodeIdx),
+            .startNs = start_ns,
+            .endNs = traceTimestamp(),
+            .worldIdx = runWorldIDs[state.worldIdx],
+            .idx = state.nodeIdx,
+            .count = uint64_t(num_invocations),
+        });
+    }
+
+    // acq_rel so the thread finishing the node has seen the effects
+    // of all other chunks before unblocking dependents. num_chunks was
+    // read before the increment: once the last chunk is counted another
+    // worker may already be running finishNode.
+    uint32_t prev_finished = state.numFinishedChunks.fetch_add_acq_rel(1);
+    if (prev_finished == num_chunks - 1) {
+        finishNode(worker_idx, state_idx);
+    }
 }
 
 void ThreadPoolExecutor::run(Job *jobs, CountT num_jobs)
@@ -164,11 +1136,61 @@ void ThreadPoolExecutor::run(Job *jobs, CountT num_jobs)
     impl_->run(jobs, num_jobs);
 }
 
+void ThreadPoolExecutor::runTaskGraphs(TaskGraph **taskgraphs,
+                                       Context **ctxs,
+                                       CountT num_worlds)
+{
+    impl_->runTaskGraphsAsync(taskgraphs, ctxs, num_worlds);
+    impl_->wait();
+}
+
+void ThreadPoolExecutor::runTaskGraphsAsync(TaskGraph **taskgraphs,
+                                            Context **ctxs,
+                                            CountT num_worlds)
+{
+    impl_->runTaskGraphsAsync(taskgraphs, ctxs, num_worlds);
+}
+
+void ThreadPoolExecutor::wait()
+{
+    impl_->wait();
+}
+
 void * ThreadPoolExecutor::getExported(CountT slot) const
 {
+    const Optional<ExportSnapshot> &snapshot = impl_->exportSnapshots[slot];
+    if (snapshot.has_value()) {
+        return snapshot->mem.ptr();
+    }
+
     return impl_->exportPtrs[slot];
 }
 
+CountT ThreadPoolExecutor::getExportedRowsPerWorld(CountT slot) const
+{
+    const StateManager::ExportInfo *info =
+        impl_->stateMgr.getExportInfo(impl_->exportPtrs[slot]);
+    assert(info != nullptr);
+
+    return info->rowsPerWorld;
+}
+
+void ThreadPoolExecutor::writeChromeTrace(const char *path) const
+{
+    if (impl_->traceBuffers.size() == 0) {
+        FATAL("Tracing is disabled, set Config::numTraceEventsPerWorker");
+    }
+
+    impl_->writeChromeTrace(path);
+}
+
+Span<const ThreadPoolExecutor::WorkerStats>
+    ThreadPoolExecutor::getWorkerStats() const
+{
+    return Span<const WorkerStats>(impl_->workerStats.data(),
+                                   impl_->workerStats.size());
+}
+
 void ThreadPoolExecutor::initializeContexts(
     Context & (*init_fn)(void *, const WorkerInit &, CountT),
     void *init_data, CountT num_worlds)
@@ -184,54 +1206,148 @@ void ThreadPoolExecutor::initializeContexts(
     }
 }
 
-ECSRegistry ThreadPoolExecutor::getECSRegistry()
+void ThreadPoolExecutor::snapshotExports()
 {
-    return ECSRegistry(&impl_->stateMgr, impl_->exportPtrs.data());
+    if (impl_->doubleBufferExports) {
+        impl_->snapshotExports();
+    }
 }
 
-void ThreadPoolExecutor::initExport()
+ECSRegistry ThreadPoolExecutor::getECSRegistry()
 {
-    impl_->stateMgr.copyOutExportedColumns();
+    return ECSRegistry(&impl_->stateMgr, impl_->exportPtrs.data());
 }
 
-void ThreadPoolExecutor::Impl::workerThread(CountT worker_id)
+void ThreadPoolExecutor::Impl::workLoop(CountT worker_idx)
 {
-    pinThread(worker_id);
+    using Clock = std::chrono::steady_clock;
+
+    WorkerQueue &queue = queues[worker_idx];
+    queue.numChunks = 0;
+    queue.numSteals = 0;
+    queue.idleNanoseconds = 0;
+
+    // Finished jobs are only subtracted from numRemaining once the
+    // worker's own queue runs dry, rather than contending on it per job
+    uint32_t num_unflushed_jobs = 0;
+
+    bool idle = false;
+    Clock::time_point idle_start;
+    CountT num_failed_attempts = 0;
 
     while (true) {
-        workerWakeup.wait<sync::relaxed>(0);
-        int32_t ctrl = workerWakeup.load_acquire();
+        WorkItem chunk;
+        bool found = popChunk(worker_idx, &chunk);
 
-        if (ctrl == 0) {
-            continue;
-        } else if (ctrl == -1) {
-            break;
+        if (!found) {
+            if (num_unflushed_jobs > 0) {
+                uint32_t prev_remaining =
+                    numRemaining.fetch_sub_acq_rel(num_unflushed_jobs);
+                if (prev_remaining == num_unflushed_jobs) {
+                    wakeParkedWorkers();
+                }
+                num_unflushed_jobs = 0;
+            }
+
+            found = stealChunk(worker_idx, &chunk);
         }
 
-        while (true) {
-            uint32_t job_idx = nextJob.fetch_add_relaxed(1);
+        if (!found) {
+            if (!idle) {
+                idle = true;
+                idle_start = Clock::now();
+            }
+
+            if (numRemaining.load_acquire() == 0) {
+                break;
+            }
 
-            if (job_idx == numJobs) {
-                workerWakeup.store_relaxed(0);
+            if (++num_failed_attempts < numIdleSpins) {
+                std::this_thread::yield();
+                continue;
             }
 
-            assert(job_idx < 0xFFFF'FFFF);
+            // Park until work is pushed or the run finishes. The epoch is
+            // read after announcing the park, and the queues are checked
+            // again after that, see wakeParkedWorkers.
+            numParkedWorkers.fetch_add<sync::seq_cst>(1);
+            uint32_t epoch = workEpoch.load<sync::seq_cst>();
 
-            if (job_idx >= numJobs) {
-                break;
+            if (!hasQueuedWork() && numRemaining.load_acquire() != 0) {
+                workEpoch.wait<sync::acquire>(epoch);
             }
 
-            currentJobs[job_idx].fn(currentJobs[job_idx].data);
+            numParkedWorkers.fetch_sub_release(1);
+            num_failed_attempts = 0;
+            continue;
+        }
+
+        num_failed_attempts = 0;
+
+        if (idle) {
+            idle = false;
+            queue.idleNanoseconds += uint64_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - idle_start).count());
+        }
+
+        queue.numChunks += 1;
+
+        if (chunk.stateIdx == jobsStateIdx) {
+            bool tracing = traceBuffers.size() > 0;
+            uint64_t start_ns = tracing ? traceTimestamp() : 0;
 
-            // This has to be acq_rel so the finishing thread has seen
-            // all the other threads' effects
-            uint32_t prev_finished =
-                numFinished.fetch_add_acq_rel(1);
+            currentJobs[chunk.begin].fn(currentJobs[chunk.begin].data);
+            num_unflushed_jobs += 1;
 
-            if (prev_finished == numJobs - 1) {
-                mainWakeup.store_release(1);
-                mainWakeup.notify_one();
+            if (tracing) {
+                recordTrace(worker_idx, TraceEvent {
+                    .name = nullptr,
+                    .startNs = start_ns,
+                    .endNs = traceTimestamp(),
+                    .worldIdx = ~0_u32,
+                    .idx = chunk.begin,
+                    .count = 1,
+                });
             }
+        } else {
+            runNodeChunk(worker_idx, chunk.stateIdx, chunk.begin);
+        }
+    }
+
+    if (idle) {
+        queue.idleNanoseconds += uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - idle_start).count());
+    }
+
+    workerStats[worker_idx] = WorkerStats {
+        .numChunks = queue.numChunks,
+        .numSteals = queue.numSteals,
+        .idleNanoseconds = queue.idleNanoseconds,
+    };
+}
+
+void ThreadPoolExecutor::Impl::workerThread(CountT worker_id)
+{
+    pinThread(worker_id);
+
+    uint32_t generation = 0;
+    while (true) {
+        workerGeneration.wait<sync::relaxed>(generation);
+        generation = workerGeneration.load_acquire();
+
+        if (workerCtrl == WorkerCtrl::Exit) {
+            break;
+        }
+
+        workLoop(worker_id);
+
+        // acq_rel so main has seen the effects of every worker
+        uint32_t prev_active = numActiveWorkers.fetch_sub_acq_rel(1);
+        if (prev_active == 1) {
+            mainWakeup.store_release(1);
+            mainWakeup.notify_one();
         }
     }
 }
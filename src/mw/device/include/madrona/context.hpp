@@ -23,6 +23,9 @@ public:
     template <typename ArchetypeT>
     Loc makeTemporary();
 
+    template <typename ArchetypeT>
+    Loc makeTemporaries(CountT num_temporaries);
+
     inline void destroyEntity(Entity e);
 
     inline Loc loc(Entity e) const;
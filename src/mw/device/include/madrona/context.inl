@@ -31,6 +31,13 @@ Loc Context::makeTemporary()
     return state_mgr->makeTemporary<ArchetypeT>(world_id_);
 }
 
+template <typename ArchetypeT>
+Loc Context::makeTemporaries(CountT num_temporaries)
+{
+    StateManager *state_mgr = mwGPU::getStateManager();
+    return state_mgr->makeTemporaries<ArchetypeT>(world_id_, num_temporaries);
+}
+
 void Context::destroyEntity(Entity e)
 {
     return mwGPU::getStateManager()->destroyEntityNow(e);
@@ -128,6 +128,9 @@ public:
     template <typename ArchetypeT>
     Loc makeTemporary(WorldID world_id);
 
+    template <typename ArchetypeT>
+    Loc makeTemporaries(WorldID world_id, CountT num_temporaries);
+
     template <typename ArchetypeT>
     void clearTemporaries();
 
@@ -218,6 +221,8 @@ private:
 
     Entity makeEntityNow(WorldID world_id, uint32_t archetype_id);
     Loc makeTemporary(WorldID world_id, uint32_t archetype_id);
+    Loc makeTemporaries(WorldID world_id, uint32_t archetype_id,
+                        CountT num_temporaries);
 
     struct ArchetypeStore {
         ArchetypeStore(uint32_t offset, uint32_t num_user_components,
@@ -216,6 +216,14 @@ Loc StateManager::makeTemporary(WorldID world_id)
     return makeTemporary(world_id, archetype_id);
 }
 
+template <typename ArchetypeT>
+Loc StateManager::makeTemporaries(WorldID world_id, CountT num_temporaries)
+{
+    uint32_t archetype_id = TypeTracker::typeID<ArchetypeT>();
+
+    return makeTemporaries(world_id, archetype_id, num_temporaries);
+}
+
 template <typename ArchetypeT>
 void StateManager::clearTemporaries()
 {
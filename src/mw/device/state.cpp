@@ -21,53 +21,58 @@ Table::Table()
       growLock()
 {}
 
+// Returns once tbl.mappedRows > row. The check and every update of
+// mappedRows happen under growLock, and mappedRows only ever increases, so
+// a caller that reserved rows up to row can't observe a smaller value
+// afterwards, even when other threads grow the table concurrently.
 static MADRONA_NO_INLINE void growTable(Table &tbl, int32_t row)
 {
     using namespace mwGPU;
 
-    tbl.growLock.lock();
+    assert(row < (int32_t)Table::maxRowsPerTable);
 
-    if (tbl.mappedRows > row) {
-        tbl.growLock.unlock();
-        return;
-    }
+    tbl.growLock.lock();
 
     HostAllocator *alloc = getHostAllocator();
-    
-    int32_t new_num_rows = tbl.mappedRows * 2;
 
-    if (new_num_rows - tbl.mappedRows > 500'000) {
-        new_num_rows = tbl.mappedRows + 500'000;
-    }
+    // Each step at most doubles the table (capped at 500K rows), so large
+    // batches may need several steps
+    while (tbl.mappedRows <= row) {
+        int32_t new_num_rows = tbl.mappedRows * 2;
 
-    int32_t min_mapped_rows = Table::maxRowsPerTable;
-    for (int32_t i = 0; i < tbl.numColumns; i++) {
-        void *column_base = tbl.columns[i];
-        uint64_t column_bytes_per_row = tbl.columnSizes[i];
-        uint64_t cur_mapped_bytes = tbl.columnMappedBytes[i];
+        if (new_num_rows - tbl.mappedRows > 500'000) {
+            new_num_rows = tbl.mappedRows + 500'000;
+        }
 
-        int32_t cur_max_rows = cur_mapped_bytes / column_bytes_per_row;
+        int32_t min_mapped_rows = Table::maxRowsPerTable;
+        for (int32_t i = 0; i < tbl.numColumns; i++) {
+            void *column_base = tbl.columns[i];
+            uint64_t column_bytes_per_row = tbl.columnSizes[i];
+            uint64_t cur_mapped_bytes = tbl.columnMappedBytes[i];
 
-        if (cur_max_rows >= new_num_rows) {
-            min_mapped_rows = min(cur_max_rows, min_mapped_rows);
-            continue;
-        }
+            int32_t cur_max_rows = cur_mapped_bytes / column_bytes_per_row;
 
-        uint64_t new_mapped_bytes = column_bytes_per_row * new_num_rows;
-        new_mapped_bytes = alloc->roundUpAlloc(new_mapped_bytes);
+            if (cur_max_rows >= new_num_rows) {
+                min_mapped_rows = min(cur_max_rows, min_mapped_rows);
+                continue;
+            }
 
-        uint64_t mapped_bytes_diff = new_mapped_bytes - cur_mapped_bytes;
-        void *grow_base = (char *)column_base + cur_mapped_bytes;
-        alloc->mapMemory(grow_base, mapped_bytes_diff);
+            uint64_t new_mapped_bytes = column_bytes_per_row * new_num_rows;
+            new_mapped_bytes = alloc->roundUpAlloc(new_mapped_bytes);
 
-        int32_t new_max_rows = new_mapped_bytes / column_bytes_per_row;
-        min_mapped_rows = min(new_max_rows, min_mapped_rows);
+            uint64_t mapped_bytes_diff = new_mapped_bytes - cur_mapped_bytes;
+            void *grow_base = (char *)column_base + cur_mapped_bytes;
+            alloc->mapMemory(grow_base, mapped_bytes_diff);
+
+            int32_t new_max_rows = new_mapped_bytes / column_bytes_per_row;
+            min_mapped_rows = min(new_max_rows, min_mapped_rows);
+
+            tbl.columnMappedBytes[i] = new_mapped_bytes;
+        }
 
-        tbl.columnMappedBytes[i] = new_mapped_bytes;
+        tbl.mappedRows = min_mapped_rows;
     }
 
-    tbl.mappedRows = min_mapped_rows;
-    
     tbl.growLock.unlock();
 }
 
@@ -406,6 +411,31 @@ Loc StateManager::makeTemporary(WorldID world_id,
     return loc;
 }
 
+Loc StateManager::makeTemporaries(WorldID world_id,
+                                  uint32_t archetype_id,
+                                  CountT num_temporaries)
+{
+    Table &tbl = archetypes_[archetype_id]->tbl;
+
+    int32_t base_row = tbl.numRows.fetch_add_relaxed(
+        int32_t(num_temporaries));
+    int32_t last_row = base_row + int32_t(num_temporaries) - 1;
+
+    if (last_row >= tbl.mappedRows) {
+        growTable(tbl, last_row);
+    }
+
+    WorldID *world_column = (WorldID *)tbl.columns[1];
+    for (int32_t i = 0; i < int32_t(num_temporaries); i++) {
+        world_column[base_row + i] = world_id;
+    }
+
+    return Loc {
+        archetype_id,
+        base_row,
+    };
+}
+
 void StateManager::destroyEntityNow(Entity e)
 {
     EntityStore::EntitySlot &entity_slot =
@@ -11,7 +11,8 @@ using namespace math;
 BVH::BVH(const ObjectManager *obj_mgr,
          CountT max_leaves,
          float leaf_velocity_expansion,
-         float leaf_accel_expansion)
+         float leaf_accel_expansion,
+         BuildMethod build_method)
     : nodes_((Node *)rawAlloc(sizeof(Node) *
                             numInternalNodes(max_leaves))),
       num_nodes_(0),
@@ -20,15 +21,29 @@ BVH::BVH(const ObjectManager *obj_mgr,
       obj_mgr_(obj_mgr), // FIXME, get rid of this
       leaf_obj_ids_((ObjectID *)
                        rawAlloc(sizeof(ObjectID) * max_leaves)),
+      leaf_filters_((CollisionFilter *)
+                       rawAlloc(sizeof(CollisionFilter) * max_leaves)),
       leaf_aabbs_((AABB *)rawAlloc(sizeof(AABB) * max_leaves)),
       leaf_transforms_(
           (LeafTransform *)rawAlloc(sizeof(LeafTransform) * max_leaves)),
       leaf_parents_((uint32_t *)rawAlloc(sizeof(uint32_t) * max_leaves)),
       sorted_leaves_((int32_t *)rawAlloc(sizeof(int32_t) * max_leaves)),
+      node_info_((NodeInfo *)rawAlloc(sizeof(NodeInfo) *
+                                      numInternalNodes(max_leaves))),
+      free_nodes_((int32_t *)rawAlloc(sizeof(int32_t) *
+                                      numInternalNodes(max_leaves))),
+      num_free_nodes_(0),
       num_leaves_(0),
       num_allocated_leaves_(max_leaves),
+      released_leaves_((int32_t *)rawAlloc(sizeof(int32_t) * max_leaves)),
+      num_released_leaves_(0),
+      free_leaves_((int32_t *)rawAlloc(sizeof(int32_t) * max_leaves)),
+      num_free_leaves_(0),
+      pending_leaves_((int32_t *)rawAlloc(sizeof(int32_t) * max_leaves)),
+      num_pending_leaves_(0),
       leaf_velocity_expansion_(leaf_velocity_expansion),
       leaf_accel_expansion_(leaf_accel_expansion),
+      build_method_(build_method),
       force_rebuild_(false)
 {}
 
@@ -41,12 +56,236 @@ CountT BVH::numInternalNodes(CountT num_leaves) const
                     // 1 or 2 children
 }
 
+int32_t BVH::midpointSplit(int32_t base, int32_t num_elems)
+{
+    auto get_center = [this, base](int32_t offset) {
+        AABB aabb = leaf_aabbs_[sorted_leaves_[base + offset]];
+
+        return (aabb.pMin + aabb.pMax) / 2.f;
+    };
+
+    Vector3 center_min {
+        FLT_MAX,
+        FLT_MAX,
+        FLT_MAX,
+    };
+
+    Vector3 center_max {
+        -FLT_MAX,
+        -FLT_MAX,
+        -FLT_MAX,
+    };
+
+    for (int i = 0; i < num_elems; i++) {
+        const Vector3 &center = get_center(i);
+        center_min = Vector3::min(center_min, center);
+        center_max = Vector3::max(center_max, center);
+    }
+
+    auto split = [&](auto get_component) {
+        float split_val = 0.5f * (get_component(center_min) +
+                                  get_component(center_max));
+
+        int start = 0;
+        int end = num_elems;
+
+        while (start < end) {
+            while (start < end &&
+                   get_component(get_center(start)) < split_val) {
+                ++start;
+            }
+
+            while (start < end && get_component(
+                    get_center(end - 1)) >= split_val) {
+                --end;
+            }
+
+            if (start < end) {
+                std::swap(sorted_leaves_[base + start],
+                          sorted_leaves_[base + end - 1]);
+                ++start;
+                --end;
+            }
+        }
+
+        if (start > 0 && start < num_elems) {
+            return start;
+        } else {
+            return num_elems / 2;
+        }
+    };
+
+    Vector3 center_diff = center_max - center_min;
+    if (center_diff.x > center_diff.y &&
+        center_diff.x > center_diff.z) {
+        return split([](Vector3 v) {
+            return v.x;
+        });
+    } else if (center_diff.y > center_diff.x &&
+               center_diff.y > center_diff.z) {
+        return split([](Vector3 v) {
+            return v.y;
+        });
+    } else {
+        return split([](Vector3 v) {
+            return v.z;
+        });
+    }
+}
+
+int32_t BVH::binnedSAHSplit(int32_t base, int32_t num_elems)
+{
+    constexpr int32_t num_bins = 16;
+
+    if (num_elems <= 2) {
+        return num_elems / 2;
+    }
+
+    auto get_center = [this, base](int32_t offset) {
+        AABB aabb = leaf_aabbs_[sorted_leaves_[base + offset]];
+
+        return (aabb.pMin + aabb.pMax) / 2.f;
+    };
+
+    Vector3 center_min {
+        FLT_MAX,
+        FLT_MAX,
+        FLT_MAX,
+    };
+
+    Vector3 center_max {
+        -FLT_MAX,
+        -FLT_MAX,
+        -FLT_MAX,
+    };
+
+    for (int32_t i = 0; i < num_elems; i++) {
+        const Vector3 &center = get_center(i);
+        center_min = Vector3::min(center_min, center);
+        center_max = Vector3::max(center_max, center);
+    }
+
+    struct Bin {
+        AABB aabb;
+        int32_t numLeaves;
+    };
+
+    auto get_bin = [&](Vector3 center, int32_t axis, float bin_scale) {
+        int32_t bin_idx =
+            int32_t((center[axis] - center_min[axis]) * bin_scale);
+        return std::min(bin_idx, num_bins - 1);
+    };
+
+    float best_cost = FLT_MAX;
+    int32_t best_axis = -1;
+    int32_t best_split_bin = -1;
+
+    for (int32_t axis = 0; axis < 3; axis++) {
+        float extent = center_max[axis] - center_min[axis];
+        if (extent <= 0.f) {
+            continue;
+        }
+
+        float bin_scale = float(num_bins) / extent;
+
+        Bin bins[num_bins];
+        for (int32_t i = 0; i < num_bins; i++) {
+            bins[i].aabb = AABB::invalid();
+            bins[i].numLeaves = 0;
+        }
+
+        for (int32_t i = 0; i < num_elems; i++) {
+            AABB leaf_aabb = leaf_aabbs_[sorted_leaves_[base + i]];
+            Bin &bin = bins[get_bin(get_center(i), axis, bin_scale)];
+
+            bin.aabb = AABB::merge(bin.aabb, leaf_aabb);
+            bin.numLeaves += 1;
+        }
+
+        // Sweep from the right to get the cost of everything at or above
+        // each split plane, then sweep from the left to evaluate each plane
+        float right_costs[num_bins];
+        int32_t right_counts[num_bins];
+        {
+            AABB right_aabb = AABB::invalid();
+            int32_t right_count = 0;
+            for (int32_t i = num_bins - 1; i > 0; i--) {
+                right_aabb = AABB::merge(right_aabb, bins[i].aabb);
+                right_count += bins[i].numLeaves;
+
+                right_costs[i] = right_count == 0 ? 0.f :
+                    right_aabb.surfaceArea() * float(right_count);
+                right_counts[i] = right_count;
+            }
+        }
+
+        AABB left_aabb = AABB::invalid();
+        int32_t left_count = 0;
+        for (int32_t i = 1; i < num_bins; i++) {
+            left_aabb = AABB::merge(left_aabb, bins[i - 1].aabb);
+            left_count += bins[i - 1].numLeaves;
+
+            if (left_count == 0 || right_counts[i] == 0) {
+                continue;
+            }
+
+            float cost = left_aabb.surfaceArea() * float(left_count) +
+                right_costs[i];
+
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split_bin = i;
+            }
+        }
+    }
+
+    // All centers coincide, nothing to split on
+    if (best_axis == -1) {
+        return num_elems / 2;
+    }
+
+    float bin_scale = float(num_bins) /
+        (center_max[best_axis] - center_min[best_axis]);
+
+    int32_t start = 0;
+    int32_t end = num_elems;
+    while (start < end) {
+        if (get_bin(get_center(start), best_axis, bin_scale) <
+                best_split_bin) {
+            ++start;
+        } else {
+            --end;
+            std::swap(sorted_leaves_[base + start],
+                      sorted_leaves_[base + end]);
+        }
+    }
+
+    return start;
+}
+
 void BVH::rebuild()
 {
-    int32_t num_internal_nodes = numInternalNodes(num_leaves_.load_relaxed());
-    num_nodes_ = num_internal_nodes;
-    assert(num_nodes_ <= num_allocated_nodes_);
+    // Gather the leaves that haven't been removed
+    int32_t num_reserved_leaves = num_leaves_.load_relaxed();
+    int32_t num_leaves = 0;
+    for (int32_t i = 0; i < num_reserved_leaves; i++) {
+        if (leaf_entities_[i] != Entity::none()) {
+            sorted_leaves_[num_leaves++] = i;
+        }
+    }
+    num_pending_leaves_.store_relaxed(0);
 
+    num_nodes_ = 0;
+    num_free_nodes_ = 0;
+
+    buildSubtree(sentinel_, num_leaves);
+}
+
+// Builds a tree over sorted_leaves_[0, num_leaves) and links its root into
+// the first free slot of parent_idx (if parent_idx isn't sentinel_)
+void BVH::buildSubtree(int32_t parent_idx, int32_t num_leaves)
+{
     struct StackEntry {
         int32_t nodeID;
         int32_t parentID;
@@ -57,19 +296,18 @@ void BVH::rebuild()
     StackEntry stack[128];
     stack[0] = StackEntry {
         sentinel_,
-        sentinel_,
+        parent_idx,
         0,
-        int32_t(num_leaves_.load_relaxed()),
+        num_leaves,
     };
 
-    int32_t cur_node_offset = 0;
     CountT stack_size = 1;
 
     while (stack_size > 0) {
         StackEntry &entry = stack[stack_size - 1];
         int32_t node_id;
         if (entry.numObjs <= 4) {
-            node_id = cur_node_offset++;
+            node_id = allocNode();
 
             Node &node = nodes_[node_id];
             node.parentID = entry.parentID;
@@ -100,7 +338,7 @@ void BVH::rebuild()
                 }
             }
         } else if (entry.nodeID == sentinel_) {
-            node_id = cur_node_offset++;
+            node_id = allocNode();
             // Record the node id in the stack entry for when this entry
             // is reprocessed
             entry.nodeID = node_id;
@@ -111,92 +349,27 @@ void BVH::rebuild()
             }
             node.parentID = entry.parentID;
 
-            // midpoint sort items
-            auto midpoint_split = [this](
-                    int32_t base, int32_t num_elems) {
-
-                auto get_center = [this, base](int32_t offset) {
-                    AABB aabb = leaf_aabbs_[sorted_leaves_[base + offset]];
+            // Every level of the tree takes up to 4 more stack entries.
+            // Once the tree gets deep (SAH splits can be very uneven)
+            // fall back to midpoint splits so the stack can't overflow.
+            bool use_sah = build_method_ == BuildMethod::BinnedSAH &&
+                stack_size < 64;
 
-                    return (aabb.pMin + aabb.pMax) / 2.f;
-                };
-
-                Vector3 center_min {
-                    FLT_MAX,
-                    FLT_MAX,
-                    FLT_MAX,
-                };
-
-                Vector3 center_max {
-                    -FLT_MAX,
-                    -FLT_MAX,
-                    -FLT_MAX,
-                };
-
-                for (int i = 0; i < num_elems; i++) {
-                    const Vector3 &center = get_center(i);
-                    center_min = Vector3::min(center_min, center);
-                    center_max = Vector3::max(center_max, center);
-                }
-
-                auto split = [&](auto get_component) {
-                    float split_val = 0.5f * (get_component(center_min) +
-                                              get_component(center_max));
-
-                    int start = 0;
-                    int end = num_elems;
-
-                    while (start < end) {
-                        while (start < end &&
-                               get_component(get_center(start)) < split_val) {
-                            ++start;
-                        }
-
-                        while (start < end && get_component(
-                                get_center(end - 1)) >= split_val) {
-                            --end;
-                        }
-
-                        if (start < end) {
-                            std::swap(sorted_leaves_[base + start],
-                                      sorted_leaves_[base + end - 1]);
-                            ++start;
-                            --end;
-                        }
-                    }
-
-                    if (start > 0 && start < num_elems) {
-                        return start;
-                    } else {
-                        return num_elems / 2;
-                    }
-                };
-
-                Vector3 center_diff = center_max - center_min;
-                if (center_diff.x > center_diff.y &&
-                    center_diff.x > center_diff.z) {
-                    return split([](Vector3 v) {
-                        return v.x;
-                    });
-                } else if (center_diff.y > center_diff.x &&
-                           center_diff.y > center_diff.z) {
-                    return split([](Vector3 v) {
-                        return v.y;
-                    });
+            auto split = [this, use_sah](int32_t base, int32_t num_elems) {
+                if (use_sah) {
+                    return binnedSAHSplit(base, num_elems);
                 } else {
-                    return split([](Vector3 v) {
-                        return v.z;
-                    });
+                    return midpointSplit(base, num_elems);
                 }
             };
 
-            int32_t second_split = midpoint_split(entry.offset, entry.numObjs);
+            // Build the 4 wide node out of 3 binary splits
+            int32_t second_split = split(entry.offset, entry.numObjs);
             int32_t num_h1 = second_split;
             int32_t num_h2 = entry.numObjs - second_split;
 
-            int32_t first_split = midpoint_split(entry.offset, num_h1);
-            int32_t third_split =
-                midpoint_split(entry.offset + second_split, num_h2);
+            int32_t first_split = split(entry.offset, num_h1);
+            int32_t third_split = split(entry.offset + second_split, num_h2);
 
             // Setup stack to recurse into fourths. Put fourths on stack in
             // reverse order to preserve left-right depth first ordering
@@ -478,7 +651,6 @@ void BVH::updateLeafPosition(LeafID leaf_id,
         rot,
         scale,
     };
-    sorted_leaves_[leaf_id.id] = leaf_id.id;
 }
 
 AABB BVH::expandLeaf(LeafID leaf_id,
@@ -546,7 +718,11 @@ MADRONA_ALWAYS_INLINE static inline float atomicMaxF(float *addr, float value)
 
 void BVH::refitLeaf(LeafID leaf_id, const AABB &leaf_aabb)
 {
+    // Leaves reserved since the last updateTree() aren't linked in yet
     uint32_t leaf_parent = leaf_parents_[leaf_id.id];
+    if (leaf_parent == unlinked_leaf_) {
+        return;
+    }
 
     int32_t node_idx = int32_t(leaf_parent >> 2_u32);
     int32_t sub_idx = int32_t(leaf_parent & 3);
@@ -643,13 +819,482 @@ void BVH::refitLeaf(LeafID leaf_id, const AABB &leaf_aabb)
     }
 }
 
+void BVH::removeLeaf(LeafID leaf_id)
+{
+    assert(leaf_entities_[leaf_id.id] != Entity::none());
+    leaf_entities_[leaf_id.id] = Entity::none();
+
+    // Leaves reserved since the last updateTree() aren't linked in yet
+    uint32_t leaf_parent = leaf_parents_[leaf_id.id];
+    if (leaf_parent != unlinked_leaf_) {
+        int32_t node_idx = int32_t(leaf_parent >> 2_u32);
+        int32_t sub_idx = int32_t(leaf_parent & 3);
+
+        // Bounds are left alone, they're shrunk by the next updateTree()
+        nodes_[node_idx].clearChild(sub_idx);
+        leaf_parents_[leaf_id.id] = unlinked_leaf_;
+    }
+
+    // Each live ID is released at most once, so this can't overflow
+    int32_t release_idx = num_released_leaves_.fetch_add_relaxed(1);
+    released_leaves_[release_idx] = leaf_id.id;
+}
+
+int32_t BVH::allocNode()
+{
+    int32_t node_idx;
+    if (num_free_nodes_ > 0) {
+        node_idx = free_nodes_[--num_free_nodes_];
+    } else {
+        node_idx = int32_t(num_nodes_++);
+        assert(num_nodes_ <= num_allocated_nodes_);
+    }
+
+    node_info_[node_idx] = NodeInfo {
+        .height = 0,
+        .sah = 0.f,
+        .builtQuality = -1.f,
+        .degraded = false,
+    };
+
+    return node_idx;
+}
+
+void BVH::setChildParent(int32_t child, int32_t parent_idx, CountT slot)
+{
+    if (child & 0x80000000) {
+        leaf_parents_[child & ~0x80000000] =
+            ((uint32_t)parent_idx << 2) | (uint32_t)slot;
+    } else {
+        nodes_[child].parentID = parent_idx;
+    }
+}
+
+bool BVH::insertLeaf(int32_t leaf_idx)
+{
+    AABB leaf_aabb = leaf_aabbs_[leaf_idx];
+
+    int32_t node_idx = 0;
+    int32_t depth = 0;
+    while (true) {
+        Node &node = nodes_[node_idx];
+
+        CountT free_slot = -1;
+        for (CountT i = 0; i < 4; i++) {
+            if (!node.hasChild(i)) {
+                free_slot = i;
+                break;
+            }
+        }
+
+        if (free_slot != -1) {
+            node.setLeaf(free_slot, leaf_idx);
+            node.setChildAABB(free_slot, leaf_aabb);
+            leaf_parents_[leaf_idx] =
+                ((uint32_t)node_idx << 2) | (uint32_t)free_slot;
+
+            int32_t child_idx = node_idx;
+            int32_t parent_idx = node.parentID;
+            while (parent_idx != sentinel_) {
+                Node &parent = nodes_[parent_idx];
+                for (CountT i = 0; i < 4; i++) {
+                    if (parent.children[i] == child_idx) {
+                        parent.setChildAABB(i, AABB::merge(
+                            parent.childAABB(i), leaf_aabb));
+                        break;
+                    }
+                }
+
+                child_idx = parent_idx;
+                parent_idx = parent.parentID;
+            }
+
+            return true;
+        }
+
+        // Descend into the child whose surface area grows the least
+        CountT best_child = 0;
+        float best_growth = FLT_MAX;
+        float best_area = FLT_MAX;
+        for (CountT i = 0; i < 4; i++) {
+            AABB child_aabb = node.childAABB(i);
+            float area = child_aabb.surfaceArea();
+            float growth =
+                AABB::merge(child_aabb, leaf_aabb).surfaceArea() - area;
+
+            if (growth < best_growth ||
+                    (growth == best_growth && area < best_area)) {
+                best_child = i;
+                best_growth = growth;
+                best_area = area;
+            }
+        }
+
+        if (!node.isLeaf(best_child)) {
+            node_idx = node.children[best_child];
+            depth += 1;
+            continue;
+        }
+
+        // Push the leaf that's in the way down into a new node, the new
+        // leaf goes next to it on the next iteration
+        if (depth + 1 >= max_incremental_depth_ ||
+                numAvailableNodes() == 0) {
+            return false;
+        }
+
+        int32_t new_node_idx = allocNode();
+        Node &new_node = nodes_[new_node_idx];
+        new_node.parentID = node_idx;
+        for (CountT i = 0; i < 4; i++) {
+            new_node.clearChild(i);
+            new_node.setChildAABB(i, AABB::invalid());
+        }
+
+        int32_t displaced_leaf = node.leafIDX(best_child);
+        new_node.setLeaf(0, displaced_leaf);
+        new_node.setChildAABB(0, node.childAABB(best_child));
+        setChildParent(node.children[best_child], new_node_idx, 0);
+
+        node.setInternal(best_child, new_node_idx);
+
+        node_idx = new_node_idx;
+        depth += 1;
+    }
+}
+
+void BVH::refitAndRotate()
+{
+    // Post order traversal: recompute every node's child bounds exactly from
+    // its children (refitLeaf only ever grows them), drop children that no
+    // longer contain any leaves and then try to improve the node with a
+    // single rotation.
+    struct StackEntry {
+        int32_t nodeID;
+        int32_t depth;
+        bool childrenDone;
+    };
+
+    StackEntry stack[128];
+    stack[0] = { 0, 0, false };
+    CountT stack_size = 1;
+
+    auto getNodeAABB = [this](int32_t node_idx) {
+        const Node &node = nodes_[node_idx];
+
+        AABB aabb = AABB::invalid();
+        for (CountT i = 0; i < 4; i++) {
+            if (node.hasChild(i)) {
+                aabb = AABB::merge(aabb, node.childAABB(i));
+            }
+        }
+
+        return aabb;
+    };
+
+    auto getChildHeight = [this](const Node &node, CountT child) {
+        return node.isLeaf(child) ?
+            0 : node_info_[node.children[child]].height;
+    };
+
+    auto getNodeHeight = [&](int32_t node_idx) {
+        const Node &node = nodes_[node_idx];
+
+        int32_t height = 0;
+        for (CountT i = 0; i < 4; i++) {
+            if (node.hasChild(i)) {
+                height = std::max(height, getChildHeight(node, i));
+            }
+        }
+
+        return height + 1;
+    };
+
+    // Leaf bounds are the same no matter how the tree is built, so only
+    // the internal nodes count towards the SAH cost
+    auto getNodeSAH = [this](int32_t node_idx) {
+        const Node &node = nodes_[node_idx];
+
+        float sah = 0.f;
+        for (CountT i = 0; i < 4; i++) {
+            if (node.hasChild(i) && !node.isLeaf(i)) {
+                sah += node.childAABB(i).surfaceArea() +
+                    node_info_[node.children[i]].sah;
+            }
+        }
+
+        return sah;
+    };
+
+    while (stack_size > 0) {
+        StackEntry &entry = stack[stack_size - 1];
+        int32_t node_idx = entry.nodeID;
+        int32_t depth = entry.depth;
+        Node &node = nodes_[node_idx];
+
+        if (!entry.childrenDone) {
+            entry.childrenDone = true;
+
+            for (CountT i = 0; i < 4; i++) {
+                if (node.hasChild(i) && !node.isLeaf(i)) {
+                    stack[stack_size++] = {
+                        node.children[i],
+                        depth + 1,
+                        false,
+                    };
+                }
+            }
+
+            continue;
+        }
+
+        stack_size -= 1;
+
+        CountT num_children = 0;
+        for (CountT i = 0; i < 4; i++) {
+            if (!node.hasChild(i)) {
+                continue;
+            }
+
+            AABB child_aabb;
+            if (node.isLeaf(i)) {
+                child_aabb = leaf_aabbs_[node.leafIDX(i)];
+            } else {
+                int32_t child_idx = node.children[i];
+                if (node_info_[child_idx].height == 0) {
+                    // Every leaf below this child has been removed
+                    node.clearChild(i);
+                    node.setChildAABB(i, AABB::invalid());
+                    free_nodes_[num_free_nodes_++] = child_idx;
+                    continue;
+                }
+
+                child_aabb = getNodeAABB(child_idx);
+            }
+
+            node.setChildAABB(i, child_aabb);
+            num_children += 1;
+        }
+
+        NodeInfo &info = node_info_[node_idx];
+
+        if (num_children == 0) {
+            info.height = 0;
+            info.sah = 0.f;
+            info.degraded = false;
+            continue;
+        }
+
+        // Find the swap between a child of this node and a grandchild that
+        // shrinks the grandchild's parent the most. Only that parent's
+        // bounds change, so the gain is exactly its reduction in area.
+        float best_gain = 0.f;
+        CountT best_parent_slot = -1;
+        CountT best_child_slot = -1;
+        CountT best_grandchild_slot = -1;
+
+        for (CountT i = 0; i < 4; i++) {
+            if (!node.hasChild(i) || node.isLeaf(i)) {
+                continue;
+            }
+
+            const Node &child = nodes_[node.children[i]];
+            float child_area = node.childAABB(i).surfaceArea();
+
+            for (CountT j = 0; j < 4; j++) {
+                if (j == i || !node.hasChild(j)) {
+                    continue;
+                }
+
+                // The swapped in subtree moves down a level
+                if (depth + 1 + getChildHeight(node, j) >
+                        max_incremental_depth_) {
+                    continue;
+                }
+
+                for (CountT k = 0; k < 4; k++) {
+                    if (!child.hasChild(k)) {
+                        continue;
+                    }
+
+                    AABB swapped_aabb = node.childAABB(j);
+                    for (CountT m = 0; m < 4; m++) {
+                        if (m != k && child.hasChild(m)) {
+                            swapped_aabb = AABB::merge(swapped_aabb,
+                                                       child.childAABB(m));
+                        }
+                    }
+
+                    float gain = child_area - swapped_aabb.surfaceArea();
+                    if (gain > best_gain) {
+                        best_gain = gain;
+                        best_parent_slot = i;
+                        best_child_slot = j;
+                        best_grandchild_slot = k;
+                    }
+                }
+            }
+        }
+
+        if (best_parent_slot != -1) {
+            int32_t child_idx = node.children[best_parent_slot];
+            Node &child = nodes_[child_idx];
+
+            int32_t moved_down = node.children[best_child_slot];
+            AABB moved_down_aabb = node.childAABB(best_child_slot);
+            int32_t moved_up = child.children[best_grandchild_slot];
+            AABB moved_up_aabb = child.childAABB(best_grandchild_slot);
+
+            node.children[best_child_slot] = moved_up;
+            node.setChildAABB(best_child_slot, moved_up_aabb);
+            setChildParent(moved_up, node_idx, best_child_slot);
+
+            child.children[best_grandchild_slot] = moved_down;
+            child.setChildAABB(best_grandchild_slot, moved_down_aabb);
+            setChildParent(moved_down, child_idx, best_grandchild_slot);
+
+            node.setChildAABB(best_parent_slot, getNodeAABB(child_idx));
+            node_info_[child_idx].height = getNodeHeight(child_idx);
+            node_info_[child_idx].sah = getNodeSAH(child_idx);
+        }
+
+        info.height = getNodeHeight(node_idx);
+
+        float sah = getNodeSAH(node_idx);
+        float area = getNodeAABB(node_idx).surfaceArea();
+        float quality = area > 0.f ? sah / area : 0.f;
+
+        // First update since this node was built
+        if (info.builtQuality < 0.f) {
+            info.builtQuality = quality;
+        }
+
+        info.sah = sah;
+        info.degraded = quality > max_sah_degradation_ * info.builtQuality;
+    }
+}
+
+bool BVH::rebuildSubtree(int32_t parent_idx, CountT slot)
+{
+    Node &parent = nodes_[parent_idx];
+    int32_t subtree_root = parent.children[slot];
+
+    // Gather the subtree's leaves and hand its nodes back to the
+    // allocator. sorted_leaves_ is only used as scratch space for builds.
+    CountT prev_num_free_nodes = num_free_nodes_;
+    int32_t num_leaves = 0;
+
+    int32_t stack[128];
+    stack[0] = subtree_root;
+    CountT stack_size = 1;
+
+    while (stack_size > 0) {
+        int32_t node_idx = stack[--stack_size];
+        const Node &node = nodes_[node_idx];
+        free_nodes_[num_free_nodes_++] = node_idx;
+
+        for (CountT i = 0; i < 4; i++) {
+            if (!node.hasChild(i)) {
+                continue;
+            }
+
+            if (node.isLeaf(i)) {
+                sorted_leaves_[num_leaves++] = node.leafIDX(i);
+            } else {
+                stack[stack_size++] = node.children[i];
+            }
+        }
+    }
+
+    if (numAvailableNodes() < numInternalNodes(num_leaves)) {
+        num_free_nodes_ = prev_num_free_nodes;
+        return false;
+    }
+
+    parent.clearChild(slot);
+    buildSubtree(parent_idx, num_leaves);
+
+    return true;
+}
+
+bool BVH::rebuildDegradedSubtrees()
+{
+    if (node_info_[0].degraded) {
+        return false;
+    }
+
+    // Rebuild the topmost degraded subtrees, which also fixes any
+    // degraded nodes underneath them
+    int32_t stack[128];
+    stack[0] = 0;
+    CountT stack_size = 1;
+
+    while (stack_size > 0) {
+        int32_t node_idx = stack[--stack_size];
+        const Node &node = nodes_[node_idx];
+
+        for (CountT i = 0; i < 4; i++) {
+            if (!node.hasChild(i) || node.isLeaf(i)) {
+                continue;
+            }
+
+            int32_t child_idx = node.children[i];
+            const NodeInfo &child_info = node_info_[child_idx];
+
+            if (child_info.degraded) {
+                if (!rebuildSubtree(node_idx, i)) {
+                    return false;
+                }
+            } else if (child_info.builtQuality >= 0.f) {
+                // Skip subtrees that were just built
+                stack[stack_size++] = child_idx;
+            }
+        }
+    }
+
+    return true;
+}
+
 void BVH::updateTree()
 {
+    // Hand out the leaf IDs removed since the last update again. Waiting
+    // until now keeps an ID from being reused within a step.
+    int32_t num_free = std::max(num_free_leaves_.load_relaxed(), 0);
+    int32_t num_released = num_released_leaves_.load_relaxed();
+    for (int32_t i = 0; i < num_released; i++) {
+        free_leaves_[num_free++] = released_leaves_[i];
+    }
+    num_free_leaves_.store_relaxed(num_free);
+    num_released_leaves_.store_relaxed(0);
+
     if (force_rebuild_) {
         force_rebuild_ = false;
         rebuild();
+        return;
+    }
+
+    // Link in leaves reserved since the last update. Fall back to a full
+    // rebuild if the tree has run out of nodes or gotten too deep.
+    int32_t num_pending = num_pending_leaves_.load_relaxed();
+    for (int32_t i = 0; i < num_pending; i++) {
+        int32_t leaf_idx = pending_leaves_[i];
+
+        if (leaf_entities_[leaf_idx] == Entity::none()) {
+            continue;
+        }
+
+        if (!insertLeaf(leaf_idx)) {
+            rebuild();
+            return;
+        }
+    }
+    num_pending_leaves_.store_relaxed(0);
+
+    refitAndRotate();
+
+    if (!rebuildDegradedSubtrees()) {
+        rebuild();
     }
-    //rebuild();
 }
 
 Entity BVH::traceRay(Vector3 o,
@@ -672,41 +1317,28 @@ Entity BVH::traceRay(Vector3 o,
     while (stack_size > 0) { 
         int32_t node_idx = stack[--stack_size];
         const Node &node = nodes_[node_idx];
-        for (int i = 0; i < 4; i++) {
-            if (!node.hasChild(i)) {
-                continue; // Technically this could be break?
-            };
 
-            madrona::math::AABB child_aabb {
-                /* .pMin = */ {
-                    node.minX[i],
-                    node.minY[i],
-                    node.minZ[i],
-                },
-                /* .pMax = */ {
-                    node.maxX[i],
-                    node.maxY[i],
-                    node.maxZ[i],
-                },
-            };
+        uint32_t hit_mask = node.rayIntersectMask(o, inv_d, 0.f, t_max);
+        for (int i = 0; i < 4; i++) {
+            if ((hit_mask & (1 << i)) == 0) {
+                continue;
+            }
 
-            if (child_aabb.rayIntersects(o, inv_d, 0.f, t_max)) {
-                if (node.isLeaf(i)) {
-                    int32_t leaf_idx = node.leafIDX(i);
-                    
-                    float hit_t;
-                    Vector3 leaf_hit_normal;
-                    bool leaf_hit = traceRayIntoLeaf(
-                        leaf_idx, o, d, 0.f, t_max, &hit_t, &leaf_hit_normal);
-
-                    if (leaf_hit) {
-                        t_max = hit_t;
-                        closest_hit_entity = leaf_entities_[leaf_idx];
-                        closest_hit_normal = leaf_hit_normal;
-                    }
-                } else {
-                    stack[stack_size++] = node.children[i];
+            if (node.isLeaf(i)) {
+                int32_t leaf_idx = node.leafIDX(i);
+                
+                float hit_t;
+                Vector3 leaf_hit_normal;
+                bool leaf_hit = traceRayIntoLeaf(
+                    leaf_idx, o, d, 0.f, t_max, &hit_t, &leaf_hit_normal);
+
+                if (leaf_hit) {
+                    t_max = hit_t;
+                    closest_hit_entity = leaf_entities_[leaf_idx];
+                    closest_hit_normal = leaf_hit_normal;
                 }
+            } else {
+                stack[stack_size++] = node.children[i];
             }
         }
     }
@@ -720,6 +1352,135 @@ Entity BVH::traceRay(Vector3 o,
     return closest_hit_entity;
 }
 
+void BVH::traceRays(Span<const Ray> rays, Span<RayHit> hits)
+{
+    if (hits.size() < rays.size()) {
+        FATAL("BVH::traceRays: %ld hits for %ld rays",
+              (long)hits.size(), (long)rays.size());
+    }
+
+    for (CountT packet_offset = 0; packet_offset < rays.size();
+         packet_offset += ray_packet_size_) {
+        CountT num_packet_rays =
+            std::min(rays.size() - packet_offset, ray_packet_size_);
+
+        traceRayPacket(rays.data() + packet_offset,
+                       hits.data() + packet_offset,
+                       num_packet_rays);
+    }
+}
+
+void BVH::traceRayPacket(const Ray *rays, RayHit *hits, CountT num_rays)
+{
+    Diag3x3 inv_ds[ray_packet_size_];
+    for (CountT i = 0; i < num_rays; i++) {
+        inv_ds[i] = Diag3x3::fromVec(rays[i].d).inv();
+    }
+
+    // The rays in a coherent packet mostly agree on which children are
+    // closer, so the first ray's direction picks the order children are
+    // visited in for the whole packet.
+    Vector3 order_dir = rays[0].d;
+
+    struct StackEntry {
+        int32_t nodeID;
+        uint32_t rayMask;
+    };
+
+    StackEntry stack[128];
+    stack[0] = {
+        0,
+        num_rays == 32 ? 0xFFFF'FFFF_u32 : (1_u32 << num_rays) - 1,
+    };
+    CountT stack_size = 1;
+
+    while (stack_size > 0) {
+        StackEntry entry = stack[--stack_size];
+        const Node &node = nodes_[entry.nodeID];
+
+        // Which rays of the packet reach each child. Uses each ray's
+        // current closest hit, so rays that have hit something closer
+        // since this node was pushed drop out here.
+        uint32_t child_rays[4] = { 0, 0, 0, 0 };
+        for (CountT r = 0; r < num_rays; r++) {
+            if ((entry.rayMask & (1_u32 << r)) == 0) {
+                continue;
+            }
+
+            uint32_t hit_mask = node.rayIntersectMask(
+                rays[r].o, inv_ds[r], 0.f, hits[r].t);
+
+            for (CountT i = 0; i < 4; i++) {
+                if (hit_mask & (1 << i)) {
+                    child_rays[i] |= 1_u32 << r;
+                }
+            }
+        }
+
+        // Sort children near to far along the packet direction
+        CountT order[4] = { 0, 1, 2, 3 };
+        float child_dists[4];
+        for (CountT i = 0; i < 4; i++) {
+            AABB child_aabb = node.childAABB(i);
+            child_dists[i] =
+                dot((child_aabb.pMin + child_aabb.pMax) / 2.f, order_dir);
+        }
+
+        for (CountT i = 1; i < 4; i++) {
+            CountT cur = order[i];
+            CountT j = i;
+            for (; j > 0 && child_dists[order[j - 1]] > child_dists[cur];
+                 j--) {
+                order[j] = order[j - 1];
+            }
+            order[j] = cur;
+        }
+
+        // Trace leaves immediately, nearest first, so their hits cull the
+        // farther children. Internal nodes are pushed far to near so the
+        // nearest is popped next.
+        for (CountT k = 0; k < 4; k++) {
+            CountT i = order[k];
+            if (child_rays[i] == 0 || !node.isLeaf(i)) {
+                continue;
+            }
+
+            int32_t leaf_idx = node.leafIDX(i);
+            for (CountT r = 0; r < num_rays; r++) {
+                if ((child_rays[i] & (1_u32 << r)) == 0) {
+                    continue;
+                }
+
+                RayHit &hit = hits[r];
+
+                float hit_t;
+                Vector3 hit_normal;
+                bool leaf_hit = traceRayIntoLeaf(
+                    leaf_idx, rays[r].o, rays[r].d, 0.f, hit.t,
+                    &hit_t, &hit_normal);
+
+                if (leaf_hit) {
+                    hit.entity = leaf_entities_[leaf_idx];
+                    hit.t = hit_t;
+                    hit.normal = hit_normal;
+                }
+            }
+        }
+
+        for (CountT k = 3; k >= 0; k--) {
+            CountT i = order[k];
+            if (child_rays[i] == 0 || node.isLeaf(i)) {
+                continue;
+            }
+
+            stack[stack_size++] = {
+                node.children[i],
+                child_rays[i],
+            };
+        }
+    }
+}
+
 static inline bool traceRayIntoPlane(
     Vector3 ray_o, Vector3 ray_d,
     float t_min, float t_max,
@@ -895,12 +1656,30 @@ inline void updateLeafPositionsEntry(
     const Rotation &rot,
     const Scale &scale,
     const ObjectID &obj_id,
-    const Velocity &vel)
+    const Velocity &vel,
+    ResponseType response_type)
 {
-    BVH &bvh = ctx.singleton<BVH>();
     ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
     AABB obj_aabb = obj_mgr.rigidBodyAABBs[obj_id.idx];
 
+    if (isStaticLeaf(leaf_id, response_type)) {
+        // Static leaves are only rewritten right before the static tree
+        // is rebuilt
+        StaticBVH &static_bvh = ctx.singleton<StaticBVH>();
+        if (static_bvh.rebuildPending()) {
+            static_bvh.updateLeafPosition(leaf_id, pos, rot, scale,
+                                          Vector3::zero(), obj_aabb);
+        }
+
+        return;
+    }
+
+    // Sleeping bodies haven't moved
+    if (ctx.singleton<SleepData>().isAsleep(leaf_id)) {
+        return;
+    }
+
+    BVH &bvh = ctx.singleton<BVH>();
     bvh.updateLeafPosition(leaf_id, pos, rot, scale, vel.linear, obj_aabb);
 }
 
@@ -920,8 +1699,25 @@ inline void updateBVHEntry(Context &, BVH &bvh)
     bvh.updateTree();
 }
 
-inline void refitEntry(Context &ctx, LeafID leaf_id)
+inline void updateStaticBVHEntry(Context &, StaticBVH &static_bvh)
+{
+    // Statics don't move, so unlike the dynamic tree there is nothing to
+    // maintain between rebuilds
+    if (static_bvh.rebuildPending()) {
+        static_bvh.updateTree();
+    }
+}
+
+inline void refitEntry(Context &ctx,
+                       LeafID leaf_id,
+                       ResponseType response_type)
 {
+    // The static tree is exact after its rebuild and never refit
+    if (isStaticLeaf(leaf_id, response_type) ||
+            ctx.singleton<SleepData>().isAsleep(leaf_id)) {
+        return;
+    }
+
     BVH &bvh = ctx.singleton<BVH>();
     bvh.refitLeaf(leaf_id, bvh.getLeafAABB(leaf_id));
 }
@@ -929,66 +1725,114 @@ inline void refitEntry(Context &ctx, LeafID leaf_id)
 inline void findOverlappingEntry(
     Context &ctx,
     const Entity &e,
-    LeafID leaf_id)
+    LeafID leaf_id,
+    ResponseType response_type)
 {
+    // Static bodies never start a query: dynamic leaves find them through
+    // the static tree, and static vs static pairs are never needed.
+    if (isStaticLeaf(leaf_id, response_type)) {
+        return;
+    }
+
+    // Sleeping bodies don't query either: pairs with awake bodies are
+    // emitted from the awake side, and sleeping vs sleeping or static
+    // pairs can't produce any motion.
+    const SleepData &sleep = ctx.singleton<SleepData>();
+    if (sleep.isAsleep(leaf_id)) {
+        return;
+    }
+
     BVH &bvh = ctx.singleton<BVH>();
+    const StaticBVH &static_bvh = ctx.singleton<StaticBVH>();
     ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
+    const CollisionExclusions &exclusions =
+        ctx.singleton<CollisionExclusions>();
 
-    // FIXME: should have a flag for passing this
-    // directly into the system
     Loc a_loc = ctx.loc(e);
-    bool a_is_static = 
-        ctx.getDirect<ResponseType>(Cols::ResponseType, a_loc) ==
-        ResponseType::Static;
-
     ObjectID a_obj = ctx.getDirect<ObjectID>(Cols::ObjectID, a_loc);
 
     CountT a_num_prims = obj_mgr.rigidBodyPrimitiveCounts[a_obj.idx];
 
+    // Candidates are staged here and copied into the table in batches, so
+    // the table only grows (and the world is only locked) once per batch
+    // rather than once per primitive pair
+    constexpr CountT max_staged_candidates = 64;
+    CandidateCollision staged_candidates[max_staged_candidates];
+    CountT num_staged_candidates = 0;
+
+    auto flushCandidates = [&]() {
+        if (num_staged_candidates == 0) {
+            return;
+        }
+
+        Loc base_loc = ctx.makeTemporaries<CandidateTemporary>(
+            num_staged_candidates);
+        CandidateCollision *candidates = &ctx.getDirect<CandidateCollision>(
+            Cols::CandidateCollision, base_loc);
+
+        for (CountT i = 0; i < num_staged_candidates; i++) {
+            candidates[i] = staged_candidates[i];
+        }
+
+        num_staged_candidates = 0;
+    };
+
+    auto emitCandidates = [&](Entity overlapping_entity) {
+        if (exclusions.contains(e, overlapping_entity)) {
+            return;
+        }
+
+        Loc b_loc = ctx.loc(overlapping_entity);
+
+        // We don't expand the primitive AABBs by movement (only object
+        // AABBs) so we just unconditionally emit narrowphase checks
+        // between each pair of primitives in the entity. Narrowphase
+        // will check transformed AABBs.
+        
+        ObjectID b_obj = ctx.getDirect<ObjectID>(Cols::ObjectID, b_loc);
+        CountT b_num_prims =
+            obj_mgr.rigidBodyPrimitiveCounts[b_obj.idx];
+
+        CountT total_narrowphase_checks = a_num_prims * b_num_prims;
+
+        for (CountT prim_check_idx = 0;
+             prim_check_idx < total_narrowphase_checks;
+             prim_check_idx++) {
+            CountT a_prim_idx = prim_check_idx / b_num_prims;
+            CountT b_prim_idx = prim_check_idx % b_num_prims;
+
+            if (num_staged_candidates == max_staged_candidates) {
+                flushCandidates();
+            }
+
+            staged_candidates[num_staged_candidates++] = CandidateCollision {
+                .a = a_loc,
+                .b = b_loc,
+                .aPrim = uint32_t(a_prim_idx),
+                .bPrim = uint32_t(b_prim_idx),
+            };
+        }
+    };
+
     bvh.findOverlapsForLeaf(leaf_id, [&](Entity overlapping_entity) {
         if (e.id < overlapping_entity.id) {
-            Loc b_loc = ctx.loc(overlapping_entity);
-
-            // FIXME: Change this so static objects are kept in a separate BVH
-            // and this check can be removed.
-            if (a_is_static &&
-                ctx.getDirect<ResponseType>(Cols::ResponseType, b_loc) ==
-                    ResponseType::Static) {
-                return;
-            }
+            emitCandidates(overlapping_entity);
+            return;
+        }
 
-            // We don't expand the primitive AABBs by movement (only object
-            // AABBs) so we just unconditionally emit narrowphase checks
-            // between each pair of primitives in the entity. Narrowphase
-            // will check transformed AABBs.
-            
-            ObjectID b_obj = ctx.getDirect<ObjectID>(Cols::ObjectID, b_loc);
-            CountT b_num_prims =
-                obj_mgr.rigidBodyPrimitiveCounts[b_obj.idx];
-
-            // FIXME: would be nice to be able to make N temporaries all at
-            // once
-            
-            CountT total_narrowphase_checks = a_num_prims * b_num_prims;
-
-            for (CountT prim_check_idx = 0;
-                 prim_check_idx < total_narrowphase_checks;
-                 prim_check_idx++) {
-                CountT a_prim_idx = prim_check_idx / b_num_prims;
-                CountT b_prim_idx = prim_check_idx % b_num_prims;
-
-                Loc candidate_loc = ctx.makeTemporary<CandidateTemporary>();
-                CandidateCollision &candidate =
-                    ctx.getDirect<CandidateCollision>(
-                        Cols::CandidateCollision, candidate_loc);
-
-                candidate.a = a_loc;
-                candidate.b = b_loc;
-                candidate.aPrim = a_prim_idx;
-                candidate.bPrim = b_prim_idx;
-            }
+        LeafID overlapping_leaf = ctx.getDirect<LeafID>(
+            Cols::LeafID, ctx.loc(overlapping_entity));
+        if (sleep.isAsleep(overlapping_leaf)) {
+            emitCandidates(overlapping_entity);
         }
     });
+
+    // Only dynamic leaves query the static tree, so every
+    // dynamic vs static pair is emitted exactly once
+    static_bvh.findOverlaps(bvh.getLeafAABB(leaf_id),
+                            bvh.getLeafFilter(leaf_id), emitCandidates);
+
+    flushCandidates();
 }
 
 TaskGraphNodeID setupBVHTasks(
@@ -1002,15 +1846,21 @@ TaskGraphNodeID setupBVHTasks(
             Rotation,
             Scale,
             ObjectID,
-            Velocity>>(deps);
+            Velocity,
+            ResponseType>>(deps);
 
     auto bvh_update = builder.addToGraph<ParallelForNode<Context,
         broadphase::updateBVHEntry, broadphase::BVH>>({update_leaves});
 
+    auto static_bvh_update = builder.addToGraph<ParallelForNode<Context,
+        broadphase::updateStaticBVHEntry, broadphase::StaticBVH>>(
+            {update_leaves});
+
     // FIXME Unfortunately need to call refit here, because update
     // won't necessarily do anything
     auto refit = builder.addToGraph<ParallelForNode<Context,
-        broadphase::refitEntry, broadphase::LeafID>>({bvh_update});
+        broadphase::refitEntry, broadphase::LeafID, ResponseType>>(
+            {bvh_update, static_bvh_update});
 
     return refit;
 }
@@ -1020,7 +1870,8 @@ TaskGraphNodeID setupPreIntegrationTasks(
     Span<const TaskGraphNodeID> deps)
 {
     auto find_overlapping = builder.addToGraph<ParallelForNode<Context,
-        broadphase::findOverlappingEntry, Entity, LeafID>>(deps);
+        broadphase::findOverlappingEntry, Entity, LeafID, ResponseType>>(
+            deps);
 
     return find_overlapping;
 }
@@ -1042,10 +1893,12 @@ TaskGraphNodeID setupPostIntegrationTasks(
             Rotation,
             Scale,
             ObjectID,
-            Velocity>>(deps);
+            Velocity,
+            ResponseType>>(deps);
 
     auto refit = builder.addToGraph<ParallelForNode<Context,
-        broadphase::refitEntry, broadphase::LeafID>>({update_leaves});
+        broadphase::refitEntry, broadphase::LeafID, ResponseType>>(
+            {update_leaves});
 
     return refit;
 }
@@ -87,6 +87,8 @@ private:
 #undef MADRONA_GPU_COND
 #define MADRONA_GPU_COND(...)
 
+#include "narrowphase_impl.hpp"
+
 namespace madrona::phys::narrowphase {
 
 using namespace base;
@@ -102,32 +104,7 @@ enum class NarrowphaseTest : uint32_t {
     HullPlane = 6,
 };
 
-struct FaceQuery {
-    float separation;
-    CountT faceIdx;
-    Plane plane;
-};
-
-struct EdgeQuery {
-    float separation;
-    math::Vector3 normal;
-    int32_t edgeIdxA;
-    int32_t edgeIdxB;
-};
-
-struct HullState {
-    HalfEdgeMesh mesh;
-    Vector3 center;
-};
-
-struct Manifold {
-    math::Vector3 contactPoints[4];
-    float penetrationDepths[4];
-    int32_t numContactPoints;
-    math::Vector3 normal;
-};
-
-static HullState makeHullState(
+HullState makeHullState(
     MADRONA_GPU_COND(const int32_t mwgpu_lane_id,)
     const geometry::HalfEdgeMesh &mesh,
     Vector3 translation,
@@ -315,9 +292,10 @@ static float getHullDistanceFromPlane(
     return min_dot_n - plane.d;
 }
 
-static FaceQuery queryFaceDirections(
+FaceQuery queryFaceDirections(
     MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
-    const HullState &a, const HullState &b)
+    const HullState &a, const HullState &b,
+    float margin)
 {
     Plane max_face_plane;
     CountT max_dist_face = -1;
@@ -334,7 +312,7 @@ static FaceQuery queryFaceDirections(
             max_dist_face = face_idx;
             max_face_plane = plane;
 
-            if (max_dist > 0) {
+            if (max_dist > margin) {
                 break;
             }
         }
@@ -440,9 +418,10 @@ static inline EdgeTestResult edgeDistance(
     };
 }
 
-static EdgeQuery queryEdgeDirections(
+EdgeQuery queryEdgeDirections(
     MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
-    const HullState &a, const HullState &b)
+    const HullState &a, const HullState &b,
+    float margin)
 {
     Vector3 normal {};
     int edgeAMaxDistance = 0;
@@ -499,7 +478,7 @@ static EdgeQuery queryEdgeDirections(
             edgeBMaxDistance = he_b_idx;
         }
 
-        if (__ballot_sync(mwGPU::allActive, maxDistance > 0) != 0) {
+        if (__ballot_sync(mwGPU::allActive, maxDistance > margin) != 0) {
             break;
         }
     }
@@ -531,7 +510,7 @@ static EdgeQuery queryEdgeDirections(
                 edgeAMaxDistance = he_idx_a;
                 edgeBMaxDistance = he_idx_b;
 
-                if (maxDistance > 0) {
+                if (maxDistance > margin) {
                     // FIXME: this goto probably kills autovectorization
                     goto early_out;
                 }
@@ -630,29 +609,15 @@ static inline CountT clipPolygon(Vector3 *dst_vertices,
     return num_new_vertices;
 }
 
-struct SATResult {
-    enum class Type : uint32_t {
-        None,
-        Plane,
-        Face,
-        Edge,
-    };
-
-    Type type;
-    Vector3 normal;
-    float planeDOrSeparation;
-    uint32_t refFaceIdxOrEdgeIdxA;
-    uint32_t incidentFaceIdxOrEdgeIdxB;
-};
-
-static inline SATResult doSAT(MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
-                              const HullState &a, const HullState &b)
+SATResult doSAT(MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
+                const HullState &a, const HullState &b,
+                float margin)
 {
     PROF_START(sat_face_ctr, narrowphaseSATFaceClocks);
 
     FaceQuery faceQueryA =
-        queryFaceDirections(MADRONA_GPU_COND(mwgpu_lane_id,) a, b);
-    if (faceQueryA.separation > 0.0f) {
+        queryFaceDirections(MADRONA_GPU_COND(mwgpu_lane_id,) a, b, margin);
+    if (faceQueryA.separation > margin) {
         // There is a separating axis - no collision
         SATResult result;
         result.type = SATResult::Type::None;
@@ -661,8 +626,8 @@ static inline SATResult doSAT(MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
     }
 
     FaceQuery faceQueryB =
-        queryFaceDirections(MADRONA_GPU_COND(mwgpu_lane_id,) b, a);
-    if (faceQueryB.separation > 0.0f) {
+        queryFaceDirections(MADRONA_GPU_COND(mwgpu_lane_id,) b, a, margin);
+    if (faceQueryB.separation > margin) {
         // There is a separating axis - no collision
         SATResult result;
         result.type = SATResult::Type::None;
@@ -674,8 +639,8 @@ static inline SATResult doSAT(MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
     PROF_START(sat_edge_ctr, narrowphaseSATEdgeClocks);
 
     EdgeQuery edgeQuery =
-        queryEdgeDirections(MADRONA_GPU_COND(mwgpu_lane_id,) a, b);
-    if (edgeQuery.separation > 0.0f) {
+        queryEdgeDirections(MADRONA_GPU_COND(mwgpu_lane_id,) a, b, margin);
+    if (edgeQuery.separation > margin) {
         // There is a separating axis - no collision
         SATResult result;
         result.type = SATResult::Type::None;
@@ -727,15 +692,585 @@ static inline SATResult doSAT(MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
     }
 }
 
+#ifndef MADRONA_GPU_MODE
+// Hill climbs from the root vertex of start_hedge to the vertex of mesh
+// furthest along dir. Returns a half edge rooted at that vertex so the next
+// query in a similar direction can start from there.
+static inline uint32_t hullSupportHedge(const HalfEdgeMesh &mesh,
+                                        Vector3 dir,
+                                        uint32_t start_hedge)
+{
+    uint32_t cur_hedge = start_hedge;
+    float cur_dot =
+        dot(mesh.vertices[mesh.halfEdges[cur_hedge].rootVertex], dir);
+
+    bool improved;
+    do {
+        improved = false;
+
+        // Walk the outgoing half edges of the current vertex, moving to the
+        // first neighbor that is strictly further along dir
+        uint32_t ring_hedge = cur_hedge;
+        do {
+            uint32_t next_hedge = mesh.halfEdges[ring_hedge].next;
+            Vector3 neighbor =
+                mesh.vertices[mesh.halfEdges[next_hedge].rootVertex];
+            float neighbor_dot = dot(neighbor, dir);
+
+            if (neighbor_dot > cur_dot) {
+                cur_dot = neighbor_dot;
+                cur_hedge = next_hedge;
+                improved = true;
+                break;
+            }
+
+            ring_hedge = mesh.halfEdges[mesh.twinIDX(ring_hedge)].next;
+        } while (ring_hedge != cur_hedge);
+    } while (improved);
+
+    return cur_hedge;
+}
+
+// Support point of the Minkowski difference a - b along dir. a_hedge and
+// b_hedge carry the hill climbing start points between queries.
+static inline Vector3 minkowskiSupport(const HullState &a,
+                                       const HullState &b,
+                                       Vector3 dir,
+                                       uint32_t &a_hedge,
+                                       uint32_t &b_hedge)
+{
+    a_hedge = hullSupportHedge(a.mesh, dir, a_hedge);
+    b_hedge = hullSupportHedge(b.mesh, -dir, b_hedge);
+
+    return a.mesh.vertices[a.mesh.halfEdges[a_hedge].rootVertex] -
+        b.mesh.vertices[b.mesh.halfEdges[b_hedge].rootVertex];
+}
+
+// The closest point functions below return the point of the simplex
+// closest to the origin and reduce the simplex to the smallest sub simplex
+// containing that point. See Ericson, Real-Time Collision Detection, 5.1.
+static inline Vector3 closestOnSegment(Vector3 *simplex, CountT &num_verts)
+{
+    Vector3 a = simplex[0];
+    Vector3 b = simplex[1];
+    Vector3 ab = b - a;
+
+    float t = -dot(a, ab);
+    if (t <= 0.f) {
+        num_verts = 1;
+        return a;
+    }
+
+    float denom = dot(ab, ab);
+    if (t >= denom) {
+        simplex[0] = b;
+        num_verts = 1;
+        return b;
+    }
+
+    return a + (t / denom) * ab;
+}
+
+static inline Vector3 closestOnTriangle(Vector3 *simplex, CountT &num_verts)
+{
+    Vector3 a = simplex[0];
+    Vector3 b = simplex[1];
+    Vector3 c = simplex[2];
+
+    Vector3 ab = b - a;
+    Vector3 ac = c - a;
+
+    float d1 = -dot(ab, a);
+    float d2 = -dot(ac, a);
+    if (d1 <= 0.f && d2 <= 0.f) {
+        num_verts = 1;
+        return a;
+    }
+
+    float d3 = -dot(ab, b);
+    float d4 = -dot(ac, b);
+    if (d3 >= 0.f && d4 <= d3) {
+        simplex[0] = b;
+        num_verts = 1;
+        return b;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) {
+        num_verts = 2;
+        return a + (d1 / (d1 - d3)) * ab;
+    }
+
+    float d5 = -dot(ab, c);
+    float d6 = -dot(ac, c);
+    if (d6 >= 0.f && d5 <= d6) {
+        simplex[0] = c;
+        num_verts = 1;
+        return c;
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) {
+        simplex[1] = c;
+        num_verts = 2;
+        return a + (d2 / (d2 - d6)) * ac;
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f) {
+        simplex[0] = c;
+        num_verts = 2;
+        return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+    }
+
+    float denom = 1.f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Returns false when the origin is inside the tetrahedron
+static inline bool closestOnTetrahedron(Vector3 *simplex, CountT &num_verts,
+                                        Vector3 *closest)
+{
+    constexpr CountT face_verts[4][4] = {
+        { 0, 1, 2, 3 },
+        { 0, 2, 3, 1 },
+        { 0, 3, 1, 2 },
+        { 1, 3, 2, 0 },
+    };
+
+    float min_dist2 = FLT_MAX;
+    bool origin_outside = false;
+    Vector3 best_simplex[3];
+    CountT best_num_verts = 0;
+
+    for (CountT i = 0; i < 4; i++) {
+        Vector3 a = simplex[face_verts[i][0]];
+        Vector3 b = simplex[face_verts[i][1]];
+        Vector3 c = simplex[face_verts[i][2]];
+        Vector3 d = simplex[face_verts[i][3]];
+
+        Vector3 n = cross(b - a, c - a);
+        float sign_origin = -dot(a, n);
+        float sign_d = dot(d - a, n);
+
+        if (sign_origin * sign_d >= 0.f) {
+            continue;
+        }
+
+        origin_outside = true;
+
+        Vector3 face_simplex[3] = { a, b, c };
+        CountT face_num_verts = 3;
+        Vector3 face_closest = closestOnTriangle(face_simplex, face_num_verts);
+
+        float dist2 = face_closest.length2();
+        if (dist2 < min_dist2) {
+            min_dist2 = dist2;
+            *closest = face_closest;
+            for (CountT j = 0; j < face_num_verts; j++) {
+                best_simplex[j] = face_simplex[j];
+            }
+            best_num_verts = face_num_verts;
+        }
+    }
+
+    if (!origin_outside) {
+        return false;
+    }
+
+    for (CountT i = 0; i < best_num_verts; i++) {
+        simplex[i] = best_simplex[i];
+    }
+    num_verts = best_num_verts;
+
+    return true;
+}
+
+struct EPAFace {
+    uint32_t verts[3];
+    Vector3 normal;
+    float dist;
+    bool obsolete;
+};
+
+static inline bool makeEPAFace(const Vector3 *verts, uint32_t a, uint32_t b,
+                               uint32_t c, EPAFace *face)
+{
+    Vector3 n = cross(verts[b] - verts[a], verts[c] - verts[a]);
+    float n_len = n.length();
+    if (n_len < 1e-12f) {
+        return false;
+    }
+
+    n /= n_len;
+
+    face->verts[0] = a;
+    face->verts[1] = b;
+    face->verts[2] = c;
+    face->normal = n;
+    face->dist = dot(n, verts[a]);
+    face->obsolete = false;
+
+    return true;
+}
+
+// Expands the tetrahedron left by GJK, which contains the origin, until the
+// face of the Minkowski difference closest to the origin is found
+static inline GJKResult runEPA(const HullState &a, const HullState &b,
+                               const Vector3 *tetrahedron,
+                               uint32_t a_hedge, uint32_t b_hedge)
+{
+    GJKResult failed;
+    failed.type = GJKResult::Type::Failed;
+
+    Vector3 verts[gjk::maxPolytopeVertices];
+    EPAFace faces[gjk::maxPolytopeFaces];
+    CountT num_verts = 4;
+    CountT num_faces = 0;
+
+    for (CountT i = 0; i < 4; i++) {
+        verts[i] = tetrahedron[i];
+    }
+
+    constexpr uint32_t tet_faces[4][3] = {
+        { 0, 1, 2 },
+        { 0, 3, 1 },
+        { 0, 2, 3 },
+        { 1, 3, 2 },
+    };
+
+    for (CountT i = 0; i < 4; i++) {
+        EPAFace &face = faces[num_faces++];
+        if (!makeEPAFace(verts, tet_faces[i][0], tet_faces[i][1],
+                         tet_faces[i][2], &face)) {
+            return failed;
+        }
+
+        // The origin is inside the tetrahedron, so outward facing normals
+        // have a non negative distance
+        if (face.dist < 0.f) {
+            std::swap(face.verts[1], face.verts[2]);
+            face.normal = -face.normal;
+            face.dist = -face.dist;
+        }
+    }
+
+    for (CountT iter = 0; iter < gjk::maxIterations; iter++) {
+        CountT closest_idx = -1;
+        float closest_dist = FLT_MAX;
+        for (CountT i = 0; i < num_faces; i++) {
+            if (!faces[i].obsolete && faces[i].dist < closest_dist) {
+                closest_dist = faces[i].dist;
+                closest_idx = i;
+            }
+        }
+
+        if (closest_idx == -1) {
+            return failed;
+        }
+
+        const EPAFace closest = faces[closest_idx];
+
+        Vector3 w = minkowskiSupport(a, b, closest.normal, a_hedge, b_hedge);
+        float w_dist = dot(w, closest.normal);
+
+        bool converged = w_dist - closest.dist < gjk::epaTolerance;
+        if (converged || num_verts == gjk::maxPolytopeVertices) {
+            GJKResult result;
+            result.type = GJKResult::Type::Touching;
+            // The closest face of a - b is where a reaches furthest past b,
+            // so its outward normal already points from a towards b
+            result.normal = closest.normal;
+            result.separation = -closest.dist;
+            result.aHedge = a_hedge;
+            result.bHedge = b_hedge;
+
+            return result;
+        }
+
+        uint32_t w_idx = (uint32_t)num_verts;
+        verts[num_verts++] = w;
+
+        // Remove every face visible from w and collect the horizon: edges of
+        // removed faces whose twin face was kept
+        uint32_t horizon[gjk::maxHorizonEdges][2];
+        CountT num_horizon = 0;
+        for (CountT i = 0; i < num_faces; i++) {
+            EPAFace &face = faces[i];
+            if (face.obsolete ||
+                    dot(face.normal, w - verts[face.verts[0]]) <= 0.f) {
+                continue;
+            }
+
+            face.obsolete = true;
+
+            for (CountT j = 0; j < 3; j++) {
+                uint32_t e0 = face.verts[j];
+                uint32_t e1 = face.verts[(j + 1) % 3];
+
+                bool shared = false;
+                for (CountT k = 0; k < num_horizon; k++) {
+                    if (horizon[k][0] == e1 && horizon[k][1] == e0) {
+                        horizon[k][0] = horizon[num_horizon - 1][0];
+                        horizon[k][1] = horizon[num_horizon - 1][1];
+                        num_horizon--;
+                        shared = true;
+                        break;
+                    }
+                }
+
+                if (!shared) {
+                    if (num_horizon == gjk::maxHorizonEdges) {
+                        return failed;
+                    }
+
+                    horizon[num_horizon][0] = e0;
+                    horizon[num_horizon][1] = e1;
+                    num_horizon++;
+                }
+            }
+        }
+
+        // Compact out the removed faces before adding new ones
+        CountT num_kept = 0;
+        for (CountT i = 0; i < num_faces; i++) {
+            if (!faces[i].obsolete) {
+                faces[num_kept++] = faces[i];
+            }
+        }
+        num_faces = num_kept;
+
+        if (num_faces + num_horizon > gjk::maxPolytopeFaces) {
+            return failed;
+        }
+
+        for (CountT i = 0; i < num_horizon; i++) {
+            if (!makeEPAFace(verts, horizon[i][0], horizon[i][1], w_idx,
+                             &faces[num_faces++])) {
+                return failed;
+            }
+        }
+    }
+
+    return failed;
+}
+
+GJKResult runGJK(const HullState &a, const HullState &b, float margin)
+{
+    GJKResult failed;
+    failed.type = GJKResult::Type::Failed;
+
+    uint32_t a_hedge = 0;
+    uint32_t b_hedge = 0;
+
+    Vector3 simplex[4];
+    CountT num_verts = 0;
+
+    Vector3 v = a.center - b.center;
+    if (v.length2() == 0.f) {
+        v = Vector3 { 1, 0, 0 };
+    }
+
+    for (CountT iter = 0; iter < gjk::maxIterations; iter++) {
+        Vector3 w = minkowskiSupport(a, b, -v, a_hedge, b_hedge);
+
+        float v_len2 = v.length2();
+        float v_dot_w = dot(v, w);
+
+        // w is the point of a - b furthest along -v, so dot(v, w) / |v| is
+        // a lower bound on the distance between the hulls
+        if (v_dot_w > 0.f && v_dot_w * v_dot_w > margin * margin * v_len2) {
+            GJKResult result;
+            result.type = GJKResult::Type::Separated;
+
+            return result;
+        }
+
+        // No progress towards the origin: v is the closest point of a - b
+        if (v_len2 - v_dot_w <= 1e-5f * v_len2) {
+            break;
+        }
+
+        simplex[num_verts++] = w;
+
+        switch (num_verts) {
+        case 1: v = w; break;
+        case 2: v = closestOnSegment(simplex, num_verts); break;
+        case 3: v = closestOnTriangle(simplex, num_verts); break;
+        case 4: {
+            if (!closestOnTetrahedron(simplex, num_verts, &v)) {
+                return runEPA(a, b, simplex, a_hedge, b_hedge);
+            }
+        } break;
+        default: MADRONA_UNREACHABLE();
+        }
+
+        // The origin is on the boundary of a degenerate simplex. EPA needs a
+        // full tetrahedron, so leave this pair to SAT.
+        if (v.length2() < 1e-12f) {
+            return failed;
+        }
+    }
+
+    float dist = v.length();
+    if (dist > margin) {
+        GJKResult result;
+        result.type = GJKResult::Type::Separated;
+
+        return result;
+    }
+
+    // Refresh the support half edges along the final direction for contact
+    // generation
+    minkowskiSupport(a, b, -v, a_hedge, b_hedge);
+
+    GJKResult result;
+    result.type = GJKResult::Type::Touching;
+    result.normal = -v / dist;
+    result.separation = dist;
+    result.aHedge = a_hedge;
+    result.bHedge = b_hedge;
+
+    return result;
+}
+
+static inline CountT findMostAlignedFace(const HalfEdgeMesh &mesh,
+                                         Vector3 dir)
+{
+    float max_dot = -FLT_MAX;
+    CountT max_face = 0;
+    for (CountT face_idx = 0; face_idx < (CountT)mesh.numFaces; face_idx++) {
+        float face_dot = dot(mesh.facePlanes[face_idx].normal, dir);
+        if (face_dot > max_dot) {
+            max_dot = face_dot;
+            max_face = face_idx;
+        }
+    }
+
+    return max_face;
+}
+
+// Separation of other_mesh along the face plane, as in queryFaceDirections.
+// support_hedge is a hill climbing start point near the deepest vertex.
+static inline float faceSeparation(Plane plane,
+                                   const HalfEdgeMesh &other_mesh,
+                                   uint32_t support_hedge)
+{
+    support_hedge =
+        hullSupportHedge(other_mesh, -plane.normal, support_hedge);
+    Vector3 support =
+        other_mesh.vertices[other_mesh.halfEdges[support_hedge].rootVertex];
+
+    return dot(plane.normal, support) - plane.d;
+}
+
+// Of the edges leaving the root vertex of support_hedge, returns the one
+// closest to perpendicular to normal. Like doSAT, the edge is identified by
+// its even half edge so contact feature IDs match between the two paths.
+static inline uint32_t findSupportEdge(const HalfEdgeMesh &mesh,
+                                       uint32_t support_hedge,
+                                       Vector3 normal)
+{
+    Vector3 root = mesh.vertices[mesh.halfEdges[support_hedge].rootVertex];
+
+    float min_cos = FLT_MAX;
+    uint32_t min_hedge = support_hedge;
+
+    uint32_t ring_hedge = support_hedge;
+    do {
+        uint32_t next_hedge = mesh.halfEdges[ring_hedge].next;
+        Vector3 dir =
+            mesh.vertices[mesh.halfEdges[next_hedge].rootVertex] - root;
+
+        float cos = fabsf(dot(dir, normal)) / dir.length();
+        if (cos < min_cos) {
+            min_cos = cos;
+            min_hedge = ring_hedge;
+        }
+
+        ring_hedge = mesh.halfEdges[mesh.twinIDX(ring_hedge)].next;
+    } while (ring_hedge != support_hedge);
+
+    return mesh.edgeToHalfEdge(min_hedge / 2);
+}
+
+SATResult doGJK(const HullState &a, const HullState &b, float margin)
+{
+    GJKResult gjk_result = runGJK(a, b, margin);
+
+    if (gjk_result.type == GJKResult::Type::Separated) {
+        SATResult result;
+        result.type = SATResult::Type::None;
+
+        return result;
+    }
+
+    if (gjk_result.type == GJKResult::Type::Failed) {
+        return doSAT(a, b, margin);
+    }
+
+    Vector3 normal = gjk_result.normal;
+
+    CountT a_face_idx = findMostAlignedFace(a.mesh, normal);
+    CountT b_face_idx = findMostAlignedFace(b.mesh, -normal);
+
+    float a_face_separation = faceSeparation(
+        a.mesh.facePlanes[a_face_idx], b.mesh, gjk_result.bHedge);
+    float b_face_separation = faceSeparation(
+        b.mesh.facePlanes[b_face_idx], a.mesh, gjk_result.aHedge);
+
+    float min_face_separation =
+        gjk_result.separation - gjk::faceContactTolerance;
+    if (fmaxf(a_face_separation, b_face_separation) >= min_face_separation) {
+        bool a_is_ref = a_face_separation >= b_face_separation;
+
+        const HullState &ref_hull = a_is_ref ? a : b;
+        const HullState &incident_hull = a_is_ref ? b : a;
+        CountT ref_face_idx = a_is_ref ? a_face_idx : b_face_idx;
+        Plane ref_plane = ref_hull.mesh.facePlanes[ref_face_idx];
+
+        CountT incident_face_idx =
+            findIncidentFace(incident_hull, ref_plane.normal);
+
+        SATResult result;
+        result.type = SATResult::Type::Face;
+        result.normal = ref_plane.normal;
+        result.planeDOrSeparation = ref_plane.d;
+        uint32_t mask;
+        if (a_is_ref) {
+            mask = 0_u32;
+        } else {
+            mask = 1_u32 << 31_u32;
+        }
+        result.refFaceIdxOrEdgeIdxA = uint32_t(ref_face_idx) | mask;
+        result.incidentFaceIdxOrEdgeIdxB = uint32_t(incident_face_idx);
+
+        return result;
+    }
+
+    SATResult result;
+    result.type = SATResult::Type::Edge;
+    result.normal = normal;
+    result.planeDOrSeparation = gjk_result.separation;
+    result.refFaceIdxOrEdgeIdxA =
+        findSupportEdge(a.mesh, gjk_result.aHedge, normal);
+    result.incidentFaceIdxOrEdgeIdxB =
+        findSupportEdge(b.mesh, gjk_result.bHedge, -normal);
+
+    return result;
+}
+#endif
+
 SATResult doSATPlane(MADRONA_GPU_COND(const int32_t mwgpu_lane_id,)
-                     const Plane &plane, const HullState &h)
+                     const Plane &plane, const HullState &h,
+                     float margin)
 {
     PROF_START(sat_plane_ctr, narrowphaseSATPlaneClocks);
 
     float separation = getHullDistanceFromPlane(
         MADRONA_GPU_COND(mwgpu_lane_id,) plane, h);
 
-    if (separation > 0.0f) {
+    if (separation > margin) {
         SATResult result;
         result.type = SATResult::Type::None;
 
@@ -863,21 +1398,21 @@ static Manifold buildFaceContactManifold(
     return manifold;
 }
 
-MADRONA_ALWAYS_INLINE static inline Manifold createFaceContact(
-                                  Plane ref_plane,
-                                  int32_t ref_face_idx,
-                                  int32_t incident_face_idx,
-                                  const Vector3 *ref_vertices,
-                                  const Vector3 *other_vertices,
-                                  const HalfEdge *ref_hedges,
-                                  const HalfEdge *other_hedges,
-                                  const uint32_t *ref_face_hedges,
-                                  const uint32_t *other_face_hedges,
-                                  void *tmp_buf1, void *tmp_buf2,
+Manifold createFaceContact(Plane ref_plane,
+                           int32_t ref_face_idx,
+                           int32_t incident_face_idx,
+                           const Vector3 *ref_vertices,
+                           const Vector3 *other_vertices,
+                           const HalfEdge *ref_hedges,
+                           const HalfEdge *other_hedges,
+                           const uint32_t *ref_face_hedges,
+                           const uint32_t *other_face_hedges,
+                           void *tmp_buf1, void *tmp_buf2,
 #ifdef MADRONA_GPU_MODE
-                                  Mat3x4 ref_txfm, Mat3x4 other_txfm,
+                           Mat3x4 ref_txfm, Mat3x4 other_txfm,
 #endif
-                                  Vector3 world_offset, Quat to_world_frame)
+                           float margin,
+                           Vector3 world_offset, Quat to_world_frame)
 {
     // Collect incident vertices: FIXME should have face indices
     Vector3 *incident_vertices_tmp = (Vector3 *)tmp_buf1;
@@ -950,15 +1485,16 @@ MADRONA_ALWAYS_INLINE static inline Manifold createFaceContact(
 
     // clipping_input has the result due to the final swap
 
-    // Filter clipping_input to ones below ref_plane and save penetration depth
+    // Filter clipping_input to ones below ref_plane (or within margin above
+    // it) and save penetration depth
     float *penetration_depths = (float *)clipping_dst;
 
     CountT num_below_plane = 0;
     for (CountT i = 0; i < num_clipped_vertices; ++i) {
         Vector3 vertex = clipping_input[i];
-        if (float d = getDistanceFromPlane(ref_plane, vertex); d < 0.0f) {
+        if (float d = getDistanceFromPlane(ref_plane, vertex); d < margin) {
             // Project the point onto the reference plane
-            // (d guaranteed to be negative)
+            // (d only positive for speculative contacts)
             clipping_input[num_below_plane] = vertex - d * ref_plane.normal;
             penetration_depths[num_below_plane] = -d;
 
@@ -981,6 +1517,7 @@ static Manifold createFacePlaneContact(Plane plane,
 #ifdef MADRONA_GPU_MODE
                                        Mat3x4 hull_txfm,
 #endif
+                                       float margin,
                                        Vector3 world_offset,
                                        Quat to_world_frame)
 {
@@ -999,9 +1536,9 @@ static Manifold createFacePlaneContact(Plane plane,
             vertex = hull_txfm.txfmPoint(vertex);
 #endif
 
-            if (float d = getDistanceFromPlane(plane, vertex); d < 0.0f) {
+            if (float d = getDistanceFromPlane(plane, vertex); d < margin) {
                 // Project the point onto the reference plane
-                // (d guaranteed to be negative)
+                // (d only positive for speculative contacts)
                 contacts_tmp[num_incident_vertices] =
                     vertex - d * plane.normal;
                 penetration_depths_tmp[num_incident_vertices] = -d;
@@ -1088,20 +1625,20 @@ static Manifold createEdgeContact(Segment segA,
     return manifold;
 }
 
-static Manifold createEdgeContact(Vector3 normal,
-                                  float separation,
-                                  int32_t hedge_idx_a,
-                                  int32_t hedge_idx_b,
-                                  const Vector3 *a_vertices,
-                                  const Vector3 *b_vertices,
-                                  const HalfEdge *a_hedges,
-                                  const HalfEdge *b_hedges,
+Manifold createEdgeContact(Vector3 normal,
+                           float separation,
+                           int32_t hedge_idx_a,
+                           int32_t hedge_idx_b,
+                           const Vector3 *a_vertices,
+                           const Vector3 *b_vertices,
+                           const HalfEdge *a_hedges,
+                           const HalfEdge *b_hedges,
 #ifdef MADRONA_GPU_MODE
-                                  Vector3 a_pos, Quat a_rot, Diag3x3 a_scale,
-                                  Vector3 b_pos, Quat b_rot, Diag3x3 b_scale,
+                           Vector3 a_pos, Quat a_rot, Diag3x3 a_scale,
+                           Vector3 b_pos, Quat b_rot, Diag3x3 b_scale,
 #endif
-                                  Vector3 world_offset,
-                                  Quat to_world_frame)
+                           Vector3 world_offset,
+                           Quat to_world_frame)
 {
     Segment segA = getEdgeSegment(a_vertices, a_hedges,
                                   a_hedges[hedge_idx_a]);
@@ -1137,7 +1674,9 @@ static inline void addContactsToSolver(
 static inline void addManifoldToSolver(
     SolverData &solver_data,
     Manifold manifold,
-    Loc ref_loc, Loc other_loc)
+    Loc ref_loc, Loc other_loc,
+    ContactID contact_id,
+    bool speculative)
 {
     PROF_START(save_contacts_ctr, narrowphaseSaveContactsClocks);
 
@@ -1158,6 +1697,8 @@ static inline void addManifoldToSolver(
         manifold.numContactPoints,
         manifold.normal,
         {},
+        contact_id,
+        speculative,
     }});
 }
 
@@ -1189,7 +1730,8 @@ MADRONA_ALWAYS_INLINE static inline NarrowphaseResult narrowphaseDispatch(
     CountT max_num_tmp_vertices,
     CountT max_num_tmp_faces,
     Vector3 *txfm_vertex_buffer,
-    Plane *txfm_face_buffer)
+    Plane *txfm_face_buffer,
+    float margin)
 {
     PROF_START(switch_body_ctr, narrowphaseSwitchClocks);
 
@@ -1252,8 +1794,14 @@ MADRONA_ALWAYS_INLINE static inline NarrowphaseResult narrowphaseDispatch(
 
         PROF_END(txfm_hull_ctr);
 
-        const SATResult sat = doSAT(MADRONA_GPU_COND(mwgpu_lane_id,)
-            a_hull_state, b_hull_state);
+#ifdef MADRONA_GPU_MODE
+        const SATResult sat = doSAT(mwgpu_lane_id,
+            a_hull_state, b_hull_state, margin);
+#else
+        const SATResult sat = useGJK(a_he_mesh, b_he_mesh) ?
+            doGJK(a_hull_state, b_hull_state, margin) :
+            doSAT(a_hull_state, b_hull_state, margin);
+#endif
 
         return NarrowphaseResult {
             sat,
@@ -1351,7 +1899,7 @@ MADRONA_ALWAYS_INLINE static inline NarrowphaseResult narrowphaseDispatch(
         };
 
         const SATResult sat = doSATPlane(
-            MADRONA_GPU_COND(mwgpu_lane_id,) plane, a_hull_state);
+            MADRONA_GPU_COND(mwgpu_lane_id,) plane, a_hull_state, margin);
 
         return NarrowphaseResult {
             sat,
@@ -1372,16 +1920,24 @@ MADRONA_ALWAYS_INLINE static inline void generateContacts(
     SolverData &solver,
     NarrowphaseResult narrowphase_result,
     Loc a_loc, Loc b_loc,
+    uint32_t a_prim_idx, uint32_t b_prim_idx,
 #ifdef MADRONA_GPU_MODE
     Vector3 a_pos, Quat a_rot, Diag3x3 a_scale,
     Vector3 b_pos, Quat b_rot, Diag3x3 b_scale,
 #endif
+    float margin,
     void *thread_tmp_storage_a, void *thread_tmp_storage_b)
 {
     Manifold manifold;
     Loc ref_loc;
     Loc other_loc;
 
+    // The SAT type goes in the top bits of refFeature so e.g. face 3 vs
+    // edge 3 don't alias in the contact cache
+    const uint32_t feature_type =
+        uint32_t(narrowphase_result.sat.type) << 30;
+    ContactID contact_id;
+
     switch (narrowphase_result.sat.type) {
     case SATResult::Type::None: {
         return;
@@ -1391,6 +1947,13 @@ MADRONA_ALWAYS_INLINE static inline void generateContacts(
         ref_loc = b_loc;
         other_loc = a_loc;
 
+        contact_id = ContactID {
+            .refPrim = b_prim_idx,
+            .altPrim = a_prim_idx,
+            .refFeature = feature_type,
+            .altFeature = narrowphase_result.sat.incidentFaceIdxOrEdgeIdxB,
+        };
+
 #ifdef MADRONA_GPU_MODE
         Mat3x4 hull_txfm = Mat3x4::fromTRS(a_pos, a_rot, a_scale);
 #endif
@@ -1412,6 +1975,7 @@ MADRONA_ALWAYS_INLINE static inline void generateContacts(
 #ifdef MADRONA_GPU_MODE
             hull_txfm,
 #endif
+            margin,
             { 0, 0, 0, },
             { 1, 0, 0, 0 });
     } break;
@@ -1436,6 +2000,13 @@ MADRONA_ALWAYS_INLINE static inline void generateContacts(
         uint32_t ref_face_idx = ref_face_idx_and_ref_mask & 0x7FFF'FFFF;
         bool a_is_ref = ref_face_idx == ref_face_idx_and_ref_mask;
 
+        contact_id = ContactID {
+            .refPrim = a_is_ref ? a_prim_idx : b_prim_idx,
+            .altPrim = a_is_ref ? b_prim_idx : a_prim_idx,
+            .refFeature = feature_type | ref_face_idx,
+            .altFeature = incident_face_idx,
+        };
+
         if (a_is_ref) {
             ref_loc = a_loc;
             other_loc = b_loc;
@@ -1485,6 +2056,7 @@ MADRONA_ALWAYS_INLINE static inline void generateContacts(
             ref_txfm,
             other_txfm,
 #endif
+            margin,
             { 0, 0, 0, },
             { 1, 0, 0, 0 });
     } break;
@@ -1493,6 +2065,14 @@ MADRONA_ALWAYS_INLINE static inline void generateContacts(
         ref_loc = a_loc;
         other_loc = b_loc;
 
+        contact_id = ContactID {
+            .refPrim = a_prim_idx,
+            .altPrim = b_prim_idx,
+            .refFeature = feature_type |
+                narrowphase_result.sat.refFaceIdxOrEdgeIdxA,
+            .altFeature = narrowphase_result.sat.incidentFaceIdxOrEdgeIdxB,
+        };
+
         // Create edge contact
         manifold = createEdgeContact(
             narrowphase_result.sat.normal,
@@ -1513,8 +2093,56 @@ MADRONA_ALWAYS_INLINE static inline void generateContacts(
     }
 
     if (manifold.numContactPoints > 0) {
-        addManifoldToSolver(solver, manifold, ref_loc, other_loc);
+        addManifoldToSolver(solver, manifold, ref_loc, other_loc,
+                            contact_id, margin > 0.f);
+    }
+}
+
+// Smallest half extent of the primitive, used to decide when a pair moves
+// fast enough within a substep to need speculative contacts. Planes are
+// infinitely thick.
+static inline float primitiveThickness(const CollisionPrimitive *prim,
+                                       const AABB &obj_aabb,
+                                       Diag3x3 scale)
+{
+    if (prim->type == CollisionPrimitive::Type::Plane) {
+        return FLT_MAX;
     }
+
+    Vector3 extent = 0.5f * (obj_aabb.pMax - obj_aabb.pMin);
+
+    return fminf(fminf(extent.x * fabsf(scale.d0),
+                       extent.y * fabsf(scale.d1)),
+                 extent.z * fabsf(scale.d2));
+}
+
+// Upper bound on how far any point of the primitive moved due to the
+// body's rotation from prev_rot to rot (the chord swept at the primitive's
+// bounding radius)
+static inline float primitiveRotationSweep(const CollisionPrimitive *prim,
+                                           const AABB &obj_aabb,
+                                           Diag3x3 scale,
+                                           Quat prev_rot, Quat rot)
+{
+    if (prim->type == CollisionPrimitive::Type::Plane) {
+        return 0.f;
+    }
+
+    Vector3 max_corner {
+        fmaxf(fabsf(obj_aabb.pMin.x), fabsf(obj_aabb.pMax.x)) *
+            fabsf(scale.d0),
+        fmaxf(fabsf(obj_aabb.pMin.y), fabsf(obj_aabb.pMax.y)) *
+            fabsf(scale.d1),
+        fmaxf(fabsf(obj_aabb.pMin.z), fabsf(obj_aabb.pMax.z)) *
+            fabsf(scale.d2),
+    };
+
+    // |cos(theta / 2)| of the rotation between the two orientations
+    float cos_half = fabsf(prev_rot.w * rot.w + prev_rot.x * rot.x +
+                           prev_rot.y * rot.y + prev_rot.z * rot.z);
+    float sin_half = sqrtf(fmaxf(0.f, 1.f - cos_half * cos_half));
+
+    return 2.f * sin_half * max_corner.length();
 }
 
 static inline void runNarrowphase(
@@ -1597,20 +2225,61 @@ static inline void runNarrowphase(
         std::swap(raw_type_a, raw_type_b);
     }
 
-    const Vector3 a_pos = ctx.getDirect<Position>(Cols::Position, a_loc);
-    const Vector3 b_pos = ctx.getDirect<Position>(Cols::Position, b_loc);
-    const Quat a_rot = ctx.getDirect<Rotation>(Cols::Rotation, a_loc);
-    const Quat b_rot = ctx.getDirect<Rotation>(Cols::Rotation, b_loc);
+    Vector3 a_pos = ctx.getDirect<Position>(Cols::Position, a_loc);
+    Vector3 b_pos = ctx.getDirect<Position>(Cols::Position, b_loc);
+    Quat a_rot = ctx.getDirect<Rotation>(Cols::Rotation, a_loc);
+    Quat b_rot = ctx.getDirect<Rotation>(Cols::Rotation, b_loc);
     const Diag3x3 a_scale(ctx.getDirect<Scale>(Cols::Scale, a_loc));
     const Diag3x3 b_scale(ctx.getDirect<Scale>(Cols::Scale, b_loc));
 
+    const AABB a_obj_aabb = obj_mgr.primitiveAABBs[a_prim_idx];
+    const AABB b_obj_aabb = obj_mgr.primitiveAABBs[b_prim_idx];
+
+    // Pairs that closed in by a large fraction of their size during this
+    // substep could have passed through each other entirely. Collide those
+    // at their start of substep poses instead, keeping features up to the
+    // distance they could have closed (margin) as speculative contacts.
+    // The solver then only pushes back the part of the motion that would
+    // actually interpenetrate. Broadphase candidates already cover the whole
+    // step's motion through expandAABBWithMotion.
+    float margin = 0.f;
     {
-        AABB a_obj_aabb = obj_mgr.primitiveAABBs[a_prim_idx];
-        AABB b_obj_aabb = obj_mgr.primitiveAABBs[b_prim_idx];
+        const SolverData &solver_data = ctx.singleton<SolverData>();
+
+        const auto &a_prev = ctx.getDirect<solver::SubstepPrevState>(
+            Cols::SubstepPrevState, a_loc);
+        const auto &b_prev = ctx.getDirect<solver::SubstepPrevState>(
+            Cols::SubstepPrevState, b_loc);
+
+        Vector3 rel_displacement = (a_pos - a_prev.prevPosition) -
+            (b_pos - b_prev.prevPosition);
+
+        float motion = rel_displacement.length() +
+            primitiveRotationSweep(a_prim, a_obj_aabb, a_scale,
+                                   a_prev.prevRotation, a_rot) +
+            primitiveRotationSweep(b_prim, b_obj_aabb, b_scale,
+                                   b_prev.prevRotation, b_rot);
+
+        float thickness = fminf(
+            primitiveThickness(a_prim, a_obj_aabb, a_scale),
+            primitiveThickness(b_prim, b_obj_aabb, b_scale));
+
+        if (motion > solver_data.speculativeMotionThreshold * thickness) {
+            a_pos = a_prev.prevPosition;
+            a_rot = a_prev.prevRotation;
+            b_pos = b_prev.prevPosition;
+            b_rot = b_prev.prevRotation;
+            margin = motion;
+        }
+    }
 
+    {
         AABB a_world_aabb = a_obj_aabb.applyTRS(a_pos, a_rot, a_scale);
         AABB b_world_aabb = b_obj_aabb.applyTRS(b_pos, b_rot, b_scale);
 
+        a_world_aabb.pMin -= Vector3 { margin, margin, margin };
+        a_world_aabb.pMax += Vector3 { margin, margin, margin };
+
         if (!a_world_aabb.overlaps(b_world_aabb)) {
 #ifdef MADRONA_GPU_MODE
             lane_active = false;
@@ -1694,6 +2363,8 @@ static inline void runNarrowphase(
         auto warp_b_prim = (CollisionPrimitive *)__shfl_sync(mwGPU::allActive,
             (uint64_t)b_prim, leader_idx);
 
+        float warp_margin = __shfl_sync(mwGPU::allActive, margin, leader_idx);
+
         NarrowphaseResult warp_result = narrowphaseDispatch(
             mwgpu_lane_id,
             warp_test_type,
@@ -1702,7 +2373,8 @@ static inline void runNarrowphase(
             warp_a_scale, warp_b_scale,
             warp_a_prim, warp_b_prim,
             max_num_tmp_vertices, max_num_tmp_faces,
-            smem_vertices_buffer, smem_faces_buffer);
+            smem_vertices_buffer, smem_faces_buffer,
+            warp_margin);
 
         if (mwgpu_lane_id == leader_idx) {
             thread_result = warp_result;
@@ -1722,8 +2394,10 @@ static inline void runNarrowphase(
 
     if (lane_active) {
         generateContacts(solver, thread_result, a_loc, b_loc,
+                         a_prim_idx, b_prim_idx,
                          a_pos, a_rot, a_scale,
                          b_pos, b_rot, b_scale,
+                         margin,
                          tmp_faces_buffer,
                          tmp_faces_buffer + max_num_tmp_faces / 2);
     }
@@ -1735,11 +2409,14 @@ static inline void runNarrowphase(
         a_scale, b_scale,
         a_prim, b_prim,
         max_num_tmp_vertices, max_num_tmp_faces,
-        tmp_vertices_buffer, tmp_faces_buffer);
+        tmp_vertices_buffer, tmp_faces_buffer,
+        margin);
 
     SolverData &solver = ctx.singleton<SolverData>();
 
     generateContacts(solver, result, a_loc, b_loc,
+                     a_prim_idx, b_prim_idx,
+                     margin,
                      tmp_faces_buffer,
                      tmp_faces_buffer + max_num_tmp_faces / 2);
 #endif
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <madrona/physics.hpp>
+
+// Hull vs hull queries and contact generation used by the narrowphase,
+// exposed so they can be tested without running the task graph.
+// narrowphase.cpp always compiles these without MADRONA_GPU_MODE (see the
+// top of that file), so the GPU only parameters below are never present.
+
+namespace madrona::phys::narrowphase {
+
+// A hull's mesh with vertices and face planes moved into world space
+struct HullState {
+    geometry::HalfEdgeMesh mesh;
+    math::Vector3 center;
+};
+
+struct FaceQuery {
+    float separation;
+    CountT faceIdx;
+    geometry::Plane plane;
+};
+
+struct EdgeQuery {
+    float separation;
+    math::Vector3 normal;
+    int32_t edgeIdxA;
+    int32_t edgeIdxB;
+};
+
+struct Manifold {
+    math::Vector3 contactPoints[4];
+    float penetrationDepths[4];
+    int32_t numContactPoints;
+    math::Vector3 normal;
+};
+
+struct SATResult {
+    enum class Type : uint32_t {
+        None,
+        Plane,
+        Face,
+        Edge,
+    };
+
+    Type type;
+    math::Vector3 normal;
+    float planeDOrSeparation;
+    uint32_t refFaceIdxOrEdgeIdxA;
+    uint32_t incidentFaceIdxOrEdgeIdxB;
+};
+
+// Transforms mesh into dst_vertices and dst_planes, which must hold
+// mesh.numVertices and mesh.numFaces entries
+HullState makeHullState(
+    MADRONA_GPU_COND(const int32_t mwgpu_lane_id,)
+    const geometry::HalfEdgeMesh &mesh,
+    math::Vector3 translation,
+    math::Quat rotation,
+    math::Diag3x3 scale,
+    math::Vector3 *dst_vertices,
+    geometry::Plane *dst_planes);
+
+// Face of a that b is furthest in front of, stopping at the first face
+// that separates them by more than margin
+FaceQuery queryFaceDirections(
+    MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
+    const HullState &a, const HullState &b,
+    float margin);
+
+// Pair of edges (one from each hull) with the largest separation along
+// their cross product
+EdgeQuery queryEdgeDirections(
+    MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
+    const HullState &a, const HullState &b,
+    float margin);
+
+// Hulls separated by at most margin are still reported as touching, with
+// a positive separation, for speculative contacts
+SATResult doSAT(MADRONA_GPU_COND(int32_t mwgpu_lane_id,)
+                const HullState &a, const HullState &b,
+                float margin);
+
+SATResult doSATPlane(MADRONA_GPU_COND(const int32_t mwgpu_lane_id,)
+                     const geometry::Plane &plane, const HullState &h,
+                     float margin);
+
+#ifndef MADRONA_GPU_MODE
+// GJK / EPA path for detailed hulls. doSAT tests every pair of edges, which
+// quickly dominates the narrowphase as hull complexity grows, so hull pairs
+// with at least gjk::minEdgePairs edge pairs find the separating or
+// penetration direction with GJK (and EPA when overlapping) instead. The
+// support functions hill climb across the half edge mesh adjacency rather
+// than scanning every vertex. The final direction is converted back into a
+// SATResult so both paths share contact generation. The GPU backend keeps
+// the warp parallel SAT.
+namespace gjk {
+// From benchmarking randomly posed pairs of boxes, prisms and spheres with
+// 12 to 552 edges: SAT is slightly faster for box vs box (144 edge pairs),
+// GJK is already ahead for an 8 sided prism vs box (288 edge pairs) and
+// wins by roughly 80x at 552 vs 552 edges.
+inline constexpr uint32_t minEdgePairs = 256;
+inline constexpr CountT maxIterations = 128;
+inline constexpr CountT maxPolytopeVertices = 128;
+inline constexpr CountT maxPolytopeFaces = 256;
+inline constexpr CountT maxHorizonEdges = 96;
+inline constexpr float epaTolerance = 1e-4f;
+// A hull face whose separation is within this distance of the GJK / EPA
+// separation makes a face contact rather than an edge contact, matching the
+// axis doSAT would pick
+inline constexpr float faceContactTolerance = 1e-3f;
+}
+
+struct GJKResult {
+    enum class Type : uint32_t {
+        Separated,
+        Touching,
+        Failed,
+    };
+
+    Type type;
+    // Points from a towards b
+    math::Vector3 normal;
+    // Positive distance between the hulls, or negative penetration depth
+    float separation;
+    // Support half edges of a along normal and of b along -normal
+    uint32_t aHedge;
+    uint32_t bHedge;
+};
+
+inline bool useGJK(const geometry::HalfEdgeMesh &a,
+                   const geometry::HalfEdgeMesh &b)
+{
+    return a.numEdges() * b.numEdges() >= gjk::minEdgePairs;
+}
+
+GJKResult runGJK(const HullState &a, const HullState &b, float margin);
+
+// Same result conventions as doSAT
+SATResult doGJK(const HullState &a, const HullState &b, float margin);
+#endif
+
+// tmp_buf1 and tmp_buf2 are clipping scratch space, each must fit the
+// incident face's vertices plus one Vector3 per reference face edge
+Manifold createFaceContact(geometry::Plane ref_plane,
+                           int32_t ref_face_idx,
+                           int32_t incident_face_idx,
+                           const math::Vector3 *ref_vertices,
+                           const math::Vector3 *other_vertices,
+                           const geometry::HalfEdge *ref_hedges,
+                           const geometry::HalfEdge *other_hedges,
+                           const uint32_t *ref_face_hedges,
+                           const uint32_t *other_face_hedges,
+                           void *tmp_buf1, void *tmp_buf2,
+#ifdef MADRONA_GPU_MODE
+                           math::Mat3x4 ref_txfm, math::Mat3x4 other_txfm,
+#endif
+                           float margin,
+                           math::Vector3 world_offset,
+                           math::Quat to_world_frame);
+
+Manifold createEdgeContact(math::Vector3 normal,
+                           float separation,
+                           int32_t hedge_idx_a,
+                           int32_t hedge_idx_b,
+                           const math::Vector3 *a_vertices,
+                           const math::Vector3 *b_vertices,
+                           const geometry::HalfEdge *a_hedges,
+                           const geometry::HalfEdge *b_hedges,
+#ifdef MADRONA_GPU_MODE
+                           math::Vector3 a_pos, math::Quat a_rot,
+                           math::Diag3x3 a_scale,
+                           math::Vector3 b_pos, math::Quat b_rot,
+                           math::Diag3x3 b_scale,
+#endif
+                           math::Vector3 world_offset,
+                           math::Quat to_world_frame);
+
+}
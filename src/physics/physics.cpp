@@ -3,29 +3,381 @@
 
 #include "physics_impl.hpp"
 
+#ifndef MADRONA_GPU_MODE
+#include "solver_simd.hpp"
+#endif
+
 namespace madrona::phys {
 
 using namespace base;
 using namespace math;
 
+static inline uint32_t hashContactKey(Entity ref, Entity alt, ContactID id)
+{
+    const uint32_t words[] {
+        (uint32_t)ref.id, ref.gen,
+        (uint32_t)alt.id, alt.gen,
+        id.refPrim, id.altPrim,
+        id.refFeature, id.altFeature,
+    };
+
+    // FNV-1a over the key followed by a murmur3 finalizer to spread the bits
+    uint32_t h = 2166136261u;
+    for (uint32_t w : words) {
+        h = (h ^ w) * 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85eb'ca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2'ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static inline bool contactKeyMatches(const ContactCache::Entry &entry,
+                                     Entity ref, Entity alt, ContactID id)
+{
+    return entry.ref == ref && entry.alt == alt &&
+        entry.id.refPrim == id.refPrim && entry.id.altPrim == id.altPrim &&
+        entry.id.refFeature == id.refFeature &&
+        entry.id.altFeature == id.altFeature;
+}
+
+ContactCache::ContactCache(CountT max_contacts)
+    : entries(),
+      // Keep the load factor at or below 1/2 so linear probing stays short
+      capacity(utils::int32NextPow2(
+          uint32_t(max_contacts > 0 ? max_contacts * 2 : 2))),
+      readIdx(0),
+      generation(1)
+{
+    for (CountT i = 0; i < 2; i++) {
+        entries[i] = (Entry *)rawAlloc(sizeof(Entry) * capacity);
+
+        for (CountT j = 0; j < (CountT)capacity; j++) {
+            entries[i][j].generation = 0;
+        }
+    }
+}
+
+const ContactCache::Entry * ContactCache::lookup(
+    Entity ref, Entity alt, ContactID id) const
+{
+    const Entry *table = entries[readIdx];
+    uint32_t mask = capacity - 1;
+
+    for (uint32_t slot = hashContactKey(ref, alt, id) & mask;;
+         slot = (slot + 1) & mask) {
+        const Entry &entry = table[slot];
+        if (entry.generation != generation) {
+            return nullptr;
+        }
+
+        if (contactKeyMatches(entry, ref, alt, id)) {
+            return &entry;
+        }
+    }
+}
+
+void ContactCache::insert(Entity ref, Entity alt, ContactID id,
+                          int32_t num_points,
+                          const Vector3 *local_points,
+                          const float *lambdas)
+{
+    Entry *table = entries[readIdx ^ 1];
+    uint32_t mask = capacity - 1;
+    uint32_t write_generation = generation + 1;
+
+    uint32_t slot = hashContactKey(ref, alt, id) & mask;
+    while (table[slot].generation == write_generation &&
+           !contactKeyMatches(table[slot], ref, alt, id)) {
+        slot = (slot + 1) & mask;
+    }
+
+    Entry &entry = table[slot];
+    entry.ref = ref;
+    entry.alt = alt;
+    entry.id = id;
+    entry.generation = write_generation;
+    entry.numPoints = num_points;
+
+    for (CountT i = 0; i < num_points; i++) {
+        entry.localPoints[i] = local_points[i];
+        entry.lambdaN[i] = lambdas[i];
+    }
+}
+
+void ContactCache::swap()
+{
+    readIdx ^= 1;
+    generation += 1;
+}
+
+void ContactCache::clear()
+{
+    // Skipping a generation invalidates both tables at once
+    generation += 2;
+}
+
+static inline uint32_t hashEntityPair(Entity a, Entity b)
+{
+    const uint32_t words[] {
+        (uint32_t)a.id, a.gen,
+        (uint32_t)b.id, b.gen,
+    };
+
+    // Same mixing as hashContactKey
+    uint32_t h = 2166136261u;
+    for (uint32_t w : words) {
+        h = (h ^ w) * 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85eb'ca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2'ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static inline void orderEntityPair(Entity &a, Entity &b)
+{
+    if (b.id < a.id) {
+        std::swap(a, b);
+    }
+}
+
+CollisionExclusions::CollisionExclusions(CountT max_pairs)
+    : entries(),
+      // Keep the load factor at or below 1/2 so linear probing stays short
+      capacity(utils::int32NextPow2(
+          uint32_t(max_pairs > 0 ? max_pairs * 2 : 2))),
+      numOccupied(0),
+      numExcluded(0)
+{
+    entries = (Entry *)rawAlloc(sizeof(Entry) * capacity);
+    clear();
+}
+
+bool CollisionExclusions::containsSlow(Entity a, Entity b) const
+{
+    orderEntityPair(a, b);
+    uint32_t mask = capacity - 1;
+
+    uint32_t slot = hashEntityPair(a, b) & mask;
+    for (uint32_t i = 0; i < capacity; i++) {
+        const Entry &entry = entries[slot];
+        if (entry.state == SlotState::Empty) {
+            return false;
+        }
+
+        if (entry.state == SlotState::Used &&
+                entry.a == a && entry.b == b) {
+            return true;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return false;
+}
+
+void CollisionExclusions::add(Entity a, Entity b)
+{
+    if (containsSlow(a, b)) {
+        return;
+    }
+
+    if (numExcluded >= capacity / 2) {
+        FATAL("CollisionExclusions: out of space for excluded pairs (max %u)",
+              capacity / 2);
+    }
+
+    orderEntityPair(a, b);
+    uint32_t mask = capacity - 1;
+
+    // Terminates, at most half the slots are Used
+    auto findSlot = [&]() {
+        uint32_t slot = hashEntityPair(a, b) & mask;
+        while (entries[slot].state == SlotState::Used) {
+            slot = (slot + 1) & mask;
+        }
+
+        return slot;
+    };
+
+    uint32_t slot = findSlot();
+    if (entries[slot].state == SlotState::Empty) {
+        if (numOccupied + 1 > capacity / 2) {
+            dropTombstones();
+            slot = findSlot();
+        }
+
+        numOccupied += 1;
+    }
+
+    Entry &entry = entries[slot];
+    entry.a = a;
+    entry.b = b;
+    entry.state = SlotState::Used;
+    numExcluded += 1;
+}
+
+void CollisionExclusions::remove(Entity a, Entity b)
+{
+    orderEntityPair(a, b);
+    uint32_t mask = capacity - 1;
+
+    uint32_t slot = hashEntityPair(a, b) & mask;
+    for (uint32_t i = 0; i < capacity; i++) {
+        Entry &entry = entries[slot];
+        if (entry.state == SlotState::Empty) {
+            return;
+        }
+
+        if (entry.state == SlotState::Used &&
+                entry.a == a && entry.b == b) {
+            entry.state = SlotState::Removed;
+            numExcluded -= 1;
+            return;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+}
+
+// Turns tombstones back into empty slots, then reinserts every pair in
+// slot order starting after a slot that was already empty. No probe
+// sequence wraps past that slot, so each pair only moves back toward its
+// home slot and the pairs placed before it stay reachable.
+void CollisionExclusions::dropTombstones()
+{
+    uint32_t mask = capacity - 1;
+
+    // numOccupied <= capacity / 2, so there is always an empty slot
+    uint32_t start = 0;
+    while (entries[start].state != SlotState::Empty) {
+        start += 1;
+    }
+
+    for (CountT i = 0; i < (CountT)capacity; i++) {
+        if (entries[i].state == SlotState::Removed) {
+            entries[i].state = SlotState::Empty;
+        }
+    }
+
+    for (uint32_t i = 1; i <= capacity; i++) {
+        uint32_t cur = (start + i) & mask;
+        if (entries[cur].state != SlotState::Used) {
+            continue;
+        }
+
+        Entry moved = entries[cur];
+        entries[cur].state = SlotState::Empty;
+
+        uint32_t slot = hashEntityPair(moved.a, moved.b) & mask;
+        while (entries[slot].state == SlotState::Used) {
+            slot = (slot + 1) & mask;
+        }
+
+        entries[slot] = moved;
+    }
+
+    numOccupied = numExcluded;
+}
+
+void CollisionExclusions::clear()
+{
+    for (CountT i = 0; i < (CountT)capacity; i++) {
+        entries[i].state = SlotState::Empty;
+    }
+
+    numOccupied = 0;
+    numExcluded = 0;
+}
+
+SleepData::SleepData(CountT max_bodies)
+    : bodies((Body *)rawAlloc(sizeof(Body) * max_bodies)),
+      maxBodies(max_bodies),
+      energyThreshold(0.5f * 0.05f * 0.05f),
+      timeToSleep(0.5f)
+{
+    for (CountT i = 0; i < max_bodies; i++) {
+        resetBody(int32_t(i));
+    }
+}
+
+void SleepData::resetBody(int32_t idx)
+{
+    bodies[idx] = Body {
+        .restTime = 0.f,
+        .islandRestTime = 0.f,
+        .island = idx,
+        .asleep = false,
+        .wakeRequested = false,
+        .wakeIsland = false,
+    };
+}
+
+int32_t SleepData::findIsland(int32_t idx)
+{
+    // Path halving
+    while (bodies[idx].island != idx) {
+        bodies[idx].island = bodies[bodies[idx].island].island;
+        idx = bodies[idx].island;
+    }
+
+    return idx;
+}
+
+void SleepData::mergeIslands(int32_t a, int32_t b)
+{
+    int32_t a_root = findIsland(a);
+    int32_t b_root = findIsland(b);
+
+    if (a_root < b_root) {
+        bodies[b_root].island = a_root;
+    } else if (b_root < a_root) {
+        bodies[a_root].island = b_root;
+    }
+}
+
 SolverData::SolverData(CountT max_contacts_per_step,
                        CountT max_joint_constraints,
+                       CountT max_bodies,
                        float delta_t,
                        CountT num_substeps,
                        Vector3 gravity)
     : contacts((Contact *)rawAlloc(
           sizeof(Contact) * max_contacts_per_step)),
       numContacts(0),
+      contactCache(max_contacts_per_step),
       jointConstraints((JointConstraint *)rawAlloc(
           sizeof(JointConstraint) * max_joint_constraints)),
       numJointConstraints(0),
+      batchItems((int32_t *)rawAlloc(sizeof(int32_t) *
+          (max_contacts_per_step + max_joint_constraints))),
+      colorOffsets {},
+      itemColors((uint8_t *)rawAlloc(sizeof(uint8_t) *
+          (max_contacts_per_step + max_joint_constraints))),
+      bodyColorMasks((uint32_t *)rawAlloc(sizeof(uint32_t) * max_bodies)),
       maxContacts(max_contacts_per_step),
       deltaT(delta_t),
       h(delta_t / (float)num_substeps),
       g(gravity),
       gMagnitude(gravity.length()),
-      restitutionThreshold(2.f * gMagnitude * h)
-{}
+      restitutionThreshold(2.f * gMagnitude * h),
+      speculativeMotionThreshold(0.5f),
+      warmStartContacts(true)
+{
+    // colorConstraints leaves every mask it touches zeroed for the next pass
+    for (CountT i = 0; i < max_bodies; i++) {
+        bodyColorMasks[i] = 0;
+    }
+}
 
 inline void collectConstraintsSystem(Context &ctx,
                                      JointConstraint &constraint)
@@ -56,6 +408,75 @@ static inline Vector3 multDiag(Vector3 diag, Vector3 v)
     };
 }
 
+// Kinetic energy per unit mass, so a single sleep threshold works for both
+// light and heavy bodies. Locked rotation axes (zero inverse inertia)
+// contribute nothing.
+static inline float kineticEnergyPerMass(
+    float inv_m, Vector3 inv_I, Vector3 v, Vector3 omega, Quat q)
+{
+    Vector3 I_per_m {
+        (inv_I.x == 0.f) ? 0.f : inv_m / inv_I.x,
+        (inv_I.y == 0.f) ? 0.f : inv_m / inv_I.y,
+        (inv_I.z == 0.f) ? 0.f : inv_m / inv_I.z,
+    };
+
+    Vector3 omega_local = q.inv().rotateVec(omega);
+
+    return 0.5f * (v.length2() +
+        dot(omega_local, multDiag(I_per_m, omega_local)));
+}
+
+// Sleeping bodies are solved as if they were static until the wake pass at
+// the start of the next step actually wakes them.
+static inline ResponseType solverResponseType(Context &ctx,
+                                              const SleepData &sleep,
+                                              Loc loc,
+                                              ResponseType response_type)
+{
+    broadphase::LeafID leaf_id =
+        ctx.getDirect<broadphase::LeafID>(Cols::LeafID, loc);
+
+    if (broadphase::isStaticLeaf(leaf_id, response_type)) {
+        return response_type;
+    }
+
+    return sleep.isAsleep(leaf_id) ? ResponseType::Static : response_type;
+}
+
+// Records a contact or joint between two bodies in the island graph. An
+// awake body touching a sleeping one requests a wake for the sleeper.
+static inline void linkBodies(Context &ctx,
+                              SleepData &sleep,
+                              Loc l1, Loc l2,
+                              ResponseType resp_type1,
+                              ResponseType resp_type2)
+{
+    broadphase::LeafID leaf1 =
+        ctx.getDirect<broadphase::LeafID>(Cols::LeafID, l1);
+    broadphase::LeafID leaf2 =
+        ctx.getDirect<broadphase::LeafID>(Cols::LeafID, l2);
+
+    if (broadphase::isStaticLeaf(leaf1, resp_type1) ||
+            broadphase::isStaticLeaf(leaf2, resp_type2)) {
+        return;
+    }
+
+    int32_t idx1 = leaf1.id;
+    int32_t idx2 = leaf2.id;
+
+    SleepData::Body &body1 = sleep.bodies[idx1];
+    SleepData::Body &body2 = sleep.bodies[idx2];
+
+    if (body1.asleep != body2.asleep) {
+        (body1.asleep ? body1 : body2).wakeRequested = true;
+    } else if (!body1.asleep &&
+               resp_type1 == ResponseType::Dynamic &&
+               resp_type2 == ResponseType::Dynamic) {
+        // Kinematic bodies act like statics and don't join islands
+        sleep.mergeIslands(idx1, idx2);
+    }
+}
+
 [[maybe_unused]] static inline Vector3 computeEnergy(
     float inv_m, Vector3 inv_I, Vector3 v, Vector3 omega, Quat q)
 {
@@ -92,7 +513,8 @@ inline void substepRigidBodies(Context &ctx,
                                ExternalTorque &ext_torque,
                                SubstepPrevState &prev_state,
                                PreSolvePositional &presolve_pos,
-                               PreSolveVelocity &presolve_vel)
+                               PreSolveVelocity &presolve_vel,
+                               const broadphase::LeafID &leaf_id)
 {
     Vector3 x = pos;
     Quat q = rot;
@@ -100,7 +522,11 @@ inline void substepRigidBodies(Context &ctx,
     Vector3 v = vel.linear;
     Vector3 omega = vel.angular;
 
-    if (response_type == ResponseType::Static) {
+    // Sleeping bodies hold still exactly like statics
+    bool asleep = !broadphase::isStaticLeaf(leaf_id, response_type) &&
+        ctx.singleton<SleepData>().isAsleep(leaf_id);
+
+    if (response_type == ResponseType::Static || asleep) {
         // FIXME: currently presolve_pos and prev_state need to be set every
         // frame even for static objects. A better solution would be on
         // creation / making a non-static object static, these variables are
@@ -303,6 +729,35 @@ void applyAngularUpdate(
     q2 = (q2 - q2_update * q2).normalize();
 }
 
+// Reapplies the normal correction a contact point needed in the previous
+// substep. Runs for every contact before the position solve, see
+// warmStartPositionsForItem.
+MADRONA_ALWAYS_INLINE static inline void applyContactWarmStart(
+    Vector3 &x1, Vector3 &x2,
+    Quat &q1, Quat &q2,
+    float inv_m1, float inv_m2,
+    Vector3 inv_I1, Vector3 inv_I2,
+    Vector3 r1, Vector3 r2,
+    Vector3 n_world,
+    float lambda_n_warm)
+{
+    Vector3 n_local1 = q1.inv().rotateVec(n_world);
+    Vector3 n_local2 = q2.inv().rotateVec(n_world);
+
+    Vector3 rot_axis_local1 = multDiag(inv_I1, cross(r1, n_local1));
+    Vector3 rot_axis_local2 = multDiag(inv_I2, cross(r2, n_local2));
+
+    applyPositionalUpdate(
+        x1, x2,
+        q1, q2,
+        rot_axis_local1, rot_axis_local2,
+        inv_m1, inv_m2,
+        n_world, lambda_n_warm);
+}
+
+// *lambda_n holds the normal lambda already applied to this point by the
+// warm start and is updated to the point's total for the substep, which
+// bounds static friction here and dynamic friction in the velocity solve.
 MADRONA_ALWAYS_INLINE static inline void handleContactConstraint(
     Vector3 &x1, Vector3 &x2,
     Quat &q1, Quat &q2,
@@ -312,7 +767,7 @@ MADRONA_ALWAYS_INLINE static inline void handleContactConstraint(
     Vector3 r1, Vector3 r2,
     Vector3 n_world,
     float avg_mu_s,
-    float *lambda_n_out,
+    float *lambda_n,
     float *lambda_t_out)
 {
     Vector3 p1 = q1.rotateVec(r1) + x1;
@@ -320,19 +775,39 @@ MADRONA_ALWAYS_INLINE static inline void handleContactConstraint(
 
     float d = dot(p1 - p2, n_world);
 
-    if (d <= 0) {
+    // Separated points still need solving if the warm start pushed them
+    // apart, so that push can be taken back
+    if (d <= 0 && *lambda_n == 0.f) {
         return;
     }
 
-    float lambda_n = applyPositionalUpdate(
+    Vector3 n_local1 = q1.inv().rotateVec(n_world);
+    Vector3 n_local2 = q2.inv().rotateVec(n_world);
+
+    Vector3 torque_axis_local1 = cross(r1, n_local1);
+    Vector3 torque_axis_local2 = cross(r2, n_local2);
+
+    Vector3 rot_axis_local1 = multDiag(inv_I1, torque_axis_local1);
+    Vector3 rot_axis_local2 = multDiag(inv_I2, torque_axis_local2);
+
+    float delta_lambda_n = computePositionalLambda(
+        torque_axis_local1, torque_axis_local2,
+        rot_axis_local1, rot_axis_local2,
+        inv_m1, inv_m2,
+        d, 0);
+
+    // Contacts can only push the bodies apart: if the warm start
+    // overshot, pull back by at most the warm started amount.
+    delta_lambda_n = fminf(delta_lambda_n, -*lambda_n);
+
+    applyPositionalUpdate(
         x1, x2,
         q1, q2,
-        r1, r2,
+        rot_axis_local1, rot_axis_local2,
         inv_m1, inv_m2,
-        inv_I1, inv_I2,
-        n_world,
-        d, 0);
-    *lambda_n_out = lambda_n;
+        n_world, delta_lambda_n);
+
+    *lambda_n += delta_lambda_n;
      
     Vector3 x1_prev = prev1.prevPosition;
     Quat q1_prev = prev1.prevRotation;
@@ -372,7 +847,7 @@ MADRONA_ALWAYS_INLINE static inline void handleContactConstraint(
             friction_rot_axis_local1, friction_rot_axis_local2,
             inv_m1, inv_m2,
             tangential_magnitude, 0);
-        float lambda_threshold = lambda_n * avg_mu_s;
+        float lambda_threshold = *lambda_n * avg_mu_s;
 
         if (lambda_t > lambda_threshold) {
             *lambda_t_out = lambda_t;
@@ -387,9 +862,25 @@ MADRONA_ALWAYS_INLINE static inline void handleContactConstraint(
     }
 }
 
+// Pose a body had when the contact's points were generated: the start of
+// substep pose for speculative contacts, the integrated pose otherwise
+static inline PreSolvePositional getContactGenerationPose(
+    Context &ctx,
+    const Contact &contact,
+    Loc loc)
+{
+    if (contact.speculative) {
+        const SubstepPrevState &prev = ctx.getDirect<SubstepPrevState>(
+            Cols::SubstepPrevState, loc);
+        return { prev.prevPosition, prev.prevRotation };
+    }
+
+    return ctx.getDirect<PreSolvePositional>(Cols::PreSolvePositional, loc);
+}
+
 MADRONA_ALWAYS_INLINE static inline std::pair<Vector3, Vector3>
-getLocalSpaceContacts(const PreSolvePositional &presolve_pos1,
-                      const PreSolvePositional &presolve_pos2,
+getLocalSpaceContacts(const PreSolvePositional &pose1,
+                      const PreSolvePositional &pose2,
                       const Contact &contact,
                       CountT point_idx)
 {
@@ -400,17 +891,46 @@ getLocalSpaceContacts(const PreSolvePositional &presolve_pos1,
         contact1 - contact.normal * penetration_depth;
 
     // Transform the contact points into local space for a & b
-    Vector3 r1 = presolve_pos1.q.inv().rotateVec(contact1 - presolve_pos1.x);
-    Vector3 r2 = presolve_pos2.q.inv().rotateVec(contact2 - presolve_pos2.x);
+    Vector3 r1 = pose1.q.inv().rotateVec(contact1 - pose1.x);
+    Vector3 r2 = pose2.q.inv().rotateVec(contact2 - pose2.x);
 
     return { r1, r2 };
 }
 
+// Normal lambda of the cached point closest to r1, if one is close enough
+static inline float findWarmStartLambda(const ContactCache::Entry *cached,
+                                        Vector3 r1)
+{
+    float lambda_n_warm = 0.f;
+    if (cached == nullptr) {
+        return lambda_n_warm;
+    }
+
+    constexpr float max_dist2 = ContactCache::pointMatchDistance *
+        ContactCache::pointMatchDistance;
+
+    float closest_dist2 = max_dist2;
+    for (CountT j = 0; j < cached->numPoints; j++) {
+        float dist2 = (cached->localPoints[j] - r1).length2();
+        if (dist2 < closest_dist2) {
+            closest_dist2 = dist2;
+            lambda_n_warm = cached->lambdaN[j];
+        }
+    }
+
+    return lambda_n_warm;
+}
+
 // For now, this function assumes both a & b are dynamic objects.
 // FIXME: Need to add dynamic / static variant or handle missing the velocity
 // component for static objects.
+// With warm_start set this applies each point's cached normal lambda and
+// stores it in lambdas, otherwise it solves the points starting from those
+// lambdas.
+template <bool warm_start>
 static inline void handleContact(Context &ctx,
                                  ObjectManager &obj_mgr,
+                                 const SolverData &solver,
                                  Contact contact,
                                  float *lambdas)
 {
@@ -425,10 +945,10 @@ static inline void handleContact(Context &ctx,
     SubstepPrevState prev2 = ctx.getDirect<SubstepPrevState>(
         Cols::SubstepPrevState, contact.alt);
 
-    PreSolvePositional presolve_pos1 = ctx.getDirect<PreSolvePositional>(
-        Cols::PreSolvePositional, contact.ref);
-    PreSolvePositional presolve_pos2 = ctx.getDirect<PreSolvePositional>(
-        Cols::PreSolvePositional, contact.alt);
+    PreSolvePositional contact_pose1 =
+        getContactGenerationPose(ctx, contact, contact.ref);
+    PreSolvePositional contact_pose2 =
+        getContactGenerationPose(ctx, contact, contact.alt);
 
     ObjectID obj_id1 = ctx.getDirect<ObjectID>(
         Cols::ObjectID, contact.ref);
@@ -454,6 +974,10 @@ static inline void handleContact(Context &ctx,
     Vector3 inv_I1 = metadata1.mass.invInertiaTensor;
     Vector3 inv_I2 = metadata2.mass.invInertiaTensor;
 
+    const SleepData &sleep = ctx.singleton<SleepData>();
+    resp_type1 = solverResponseType(ctx, sleep, contact.ref, resp_type1);
+    resp_type2 = solverResponseType(ctx, sleep, contact.alt, resp_type2);
+
     if (resp_type1 == ResponseType::Static) {
         inv_m1 = 0.f;
         inv_I1 = Vector3::zero();
@@ -469,80 +993,398 @@ static inline void handleContact(Context &ctx,
 
     float avg_mu_s = 0.5f * (mu_s1 + mu_s2);
 
+    const ContactCache::Entry *cached = nullptr;
+    if (warm_start && solver.warmStartContacts) {
+        Entity e1 = ctx.getDirect<Entity>(Cols::Entity, contact.ref);
+        Entity e2 = ctx.getDirect<Entity>(Cols::Entity, contact.alt);
+
+        cached = solver.contactCache.lookup(e1, e2, contact.id);
+    }
+
 #pragma unroll
     for (CountT i = 0; i < 4; i++) {
         if (i >= contact.numPoints) continue;
 
         auto [r1, r2] =
-            getLocalSpaceContacts(presolve_pos1, presolve_pos2, contact, i);
-
-        float lambda_n = 0.f;
-        float lambda_t = 0.f;
-
-        handleContactConstraint(x1, x2,
-                                q1, q2,
-                                prev1, prev2,
-                                inv_m1, inv_m2,
-                                inv_I1, inv_I2,
-                                r1, r2,
-                                contact.normal,
-                                avg_mu_s,
-                                &lambda_n,
-                                &lambda_t);
+            getLocalSpaceContacts(contact_pose1, contact_pose2, contact, i);
+
+        if constexpr (warm_start) {
+            float lambda_n_warm = findWarmStartLambda(cached, r1);
+
+            if (lambda_n_warm < 0.f) {
+                applyContactWarmStart(x1, x2,
+                                      q1, q2,
+                                      inv_m1, inv_m2,
+                                      inv_I1, inv_I2,
+                                      r1, r2,
+                                      contact.normal,
+                                      lambda_n_warm);
+            }
 
-        lambdas[i] = lambda_n;
+            lambdas[i] = lambda_n_warm;
+        } else {
+            float lambda_t = 0.f;
+
+            handleContactConstraint(x1, x2,
+                                    q1, q2,
+                                    prev1, prev2,
+                                    inv_m1, inv_m2,
+                                    inv_I1, inv_I2,
+                                    r1, r2,
+                                    contact.normal,
+                                    avg_mu_s,
+                                    &lambdas[i],
+                                    &lambda_t);
+        }
     }
 
-    *x1_ptr = x1;
-    *x2_ptr = x2;
+    // Static bodies may be shared by constraints solved in parallel, so
+    // only write back bodies the solver is allowed to move
+    if (resp_type1 != ResponseType::Static) {
+        *x1_ptr = x1;
+        *q1_ptr = q1;
+    }
 
-    *q1_ptr = q1;
-    *q2_ptr = q2;
+    if (resp_type2 != ResponseType::Static) {
+        *x2_ptr = x2;
+        *q2_ptr = q2;
+    }
 }
 
-static void applyJointOrientationConstraint(
-    Quat &q1, Quat &q2,
-    Quat attach_q1, Quat attach_q2,
-    Vector3 inv_I1, Vector3 inv_I2)
+#ifndef MADRONA_GPU_MODE
+// The functions below are SoA versions of the above for
+// simd::laneWidth contacts at once. They must stay in sync with the scalar
+// path, which is still used on the GPU and for the overflow color batch.
+MADRONA_ALWAYS_INLINE static inline void applyPositionalUpdate(
+    simd::Mask4 mask,
+    simd::Vector3x4 &x1, simd::Vector3x4 &x2,
+    simd::Quat4 &q1, simd::Quat4 &q2,
+    simd::Vector3x4 rot_axis_local1, simd::Vector3x4 rot_axis_local2,
+    simd::Float4 inv_m1, simd::Float4 inv_m2,
+    simd::Vector3x4 n,
+    simd::Float4 delta_lambda)
 {
-    Quat orientation1 = (q1 * attach_q1).normalize();
-    Quat orientation2 = (q2 * attach_q2).normalize();
+    using namespace simd;
 
-    Quat diff = orientation1 * orientation2.inv();
+    Vector3x4 new_x1 = x1 + (delta_lambda * inv_m1) * n;
+    Vector3x4 new_x2 = x2 - (delta_lambda * inv_m2) * n;
 
-    Vector3 delta_q =
-        2.f * math::Vector3 { diff.x, diff.y, diff.z };
-    float delta_q_magnitude = delta_q.length();
+    Float4 half_lambda = Float4(0.5f) * delta_lambda;
 
-    if (delta_q_magnitude > 0) {
-        delta_q /= delta_q_magnitude;
-        Vector3 delta_q_local1 = q1.inv().rotateVec(delta_q);
-        Vector3 delta_q_local2 = q2.inv().rotateVec(delta_q);
+    Vector3x4 q1_update_angular =
+        q1.rotateVec(half_lambda * rot_axis_local1);
+    Vector3x4 q2_update_angular =
+        q2.rotateVec(half_lambda * rot_axis_local2);
 
-        auto [update_q1, update_q2] = computeAngularUpdate(
-            q1, q2,
-            inv_I1, inv_I2,
-            delta_q_local1, delta_q_local2,
-            delta_q_magnitude, 0);
+    Quat4 new_q1 = q1 + Quat4::fromAngularVec(q1_update_angular) * q1;
+    Quat4 new_q2 = q2 - Quat4::fromAngularVec(q2_update_angular) * q2;
 
-        applyAngularUpdate(q1, q2, update_q1, update_q2);
-    }
+    x1 = select(mask, new_x1, x1);
+    x2 = select(mask, new_x2, x2);
+    q1 = select(mask, new_q1.normalize(), q1);
+    q2 = select(mask, new_q2.normalize(), q2);
 }
 
-static void applyJointAxisConstraint(
-    Quat &q1, Quat &q2,
-    Vector3 axis1_local, Vector3 axis2_local,
-    Vector3 inv_I1, Vector3 inv_I2)
+// Kept out of line: inlined into the per point loop of handleContactLanes
+// the SoA state no longer fits in registers and most of the gain is lost.
+MADRONA_NO_INLINE static simd::Float4 handleContactConstraint(
+    simd::Mask4 active,
+    simd::Vector3x4 &x1, simd::Vector3x4 &x2,
+    simd::Quat4 &q1, simd::Quat4 &q2,
+    simd::Vector3x4 x1_prev, simd::Vector3x4 x2_prev,
+    simd::Quat4 q1_prev, simd::Quat4 q2_prev,
+    simd::Float4 inv_m1, simd::Float4 inv_m2,
+    simd::Vector3x4 inv_I1, simd::Vector3x4 inv_I2,
+    simd::Vector3x4 r1, simd::Vector3x4 r2,
+    simd::Vector3x4 n_world,
+    simd::Float4 avg_mu_s,
+    simd::Float4 lambda_n)
 {
-    Vector3 axis1 = q1.rotateVec(axis1_local);
-    Vector3 axis2 = q2.rotateVec(axis2_local);
+    using namespace simd;
 
-    Vector3 delta_q = cross(axis1, axis2);
-    float delta_q_magnitude = delta_q.length();
-    
-    if (delta_q_magnitude > 0) {
-        delta_q /= delta_q_magnitude;
-        Vector3 delta_q_local1 = q1.inv().rotateVec(delta_q);
+    Vector3x4 p1 = q1.rotateVec(r1) + x1;
+    Vector3x4 p2 = q2.rotateVec(r2) + x2;
+
+    Float4 d = dot(p1 - p2, n_world);
+
+    active = active & ((d > Float4(0.f)) | (lambda_n != Float4(0.f)));
+    if (!any(active)) {
+        return lambda_n;
+    }
+
+    Vector3x4 n_local1 = q1.inv().rotateVec(n_world);
+    Vector3x4 n_local2 = q2.inv().rotateVec(n_world);
+
+    Vector3x4 torque_axis_local1 = cross(r1, n_local1);
+    Vector3x4 torque_axis_local2 = cross(r2, n_local2);
+
+    Vector3x4 rot_axis_local1 = multDiag(inv_I1, torque_axis_local1);
+    Vector3x4 rot_axis_local2 = multDiag(inv_I2, torque_axis_local2);
+
+    Float4 w1 = inv_m1 + dot(torque_axis_local1, rot_axis_local1);
+    Float4 w2 = inv_m2 + dot(torque_axis_local2, rot_axis_local2);
+
+    Float4 delta_lambda_n = min(-d / (w1 + w2), -lambda_n);
+
+    applyPositionalUpdate(
+        active,
+        x1, x2,
+        q1, q2,
+        rot_axis_local1, rot_axis_local2,
+        inv_m1, inv_m2,
+        n_world, delta_lambda_n);
+
+    lambda_n = select(active, lambda_n + delta_lambda_n, lambda_n);
+
+    Vector3x4 p1_hat = q1_prev.rotateVec(r1) + x1_prev;
+    Vector3x4 p2_hat = q2_prev.rotateVec(r2) + x2_prev;
+
+    p1 = q1.rotateVec(r1) + x1;
+    p2 = q2.rotateVec(r2) + x2;
+
+    Vector3x4 delta_p = (p1 - p1_hat) - (p2 - p2_hat);
+    Vector3x4 delta_p_t = delta_p - dot(delta_p, n_world) * n_world;
+
+    Float4 tangential_magnitude = length(delta_p_t);
+
+    Mask4 friction = active & (tangential_magnitude > Float4(0.f));
+    if (!any(friction)) {
+        return lambda_n;
+    }
+
+    Vector3x4 t_world = delta_p_t / tangential_magnitude;
+    Vector3x4 t_local1 = q1.inv().rotateVec(t_world);
+    Vector3x4 t_local2 = q2.inv().rotateVec(t_world);
+
+    Vector3x4 friction_torque_axis_local1 = cross(r1, t_local1);
+    Vector3x4 friction_torque_axis_local2 = cross(r2, t_local2);
+
+    Vector3x4 friction_rot_axis_local1 =
+        multDiag(inv_I1, friction_torque_axis_local1);
+    Vector3x4 friction_rot_axis_local2 =
+        multDiag(inv_I2, friction_torque_axis_local2);
+
+    Float4 friction_w1 = inv_m1 +
+        dot(friction_torque_axis_local1, friction_rot_axis_local1);
+    Float4 friction_w2 = inv_m2 +
+        dot(friction_torque_axis_local2, friction_rot_axis_local2);
+
+    Float4 lambda_t = -tangential_magnitude / (friction_w1 + friction_w2);
+
+    friction = friction & (lambda_t > lambda_n * avg_mu_s);
+
+    applyPositionalUpdate(
+        friction,
+        x1, x2,
+        q1, q2,
+        friction_rot_axis_local1, friction_rot_axis_local2,
+        inv_m1, inv_m2,
+        t_world, lambda_t);
+
+    return lambda_n;
+}
+
+// Gathers up to simd::laneWidth contacts that share no non-static body into
+// SoA lanes, solves them point by point and scatters the results back.
+static inline void handleContactLanes(Context &ctx,
+                                      ObjectManager &obj_mgr,
+                                      SolverData &solver,
+                                      const int32_t *contact_idxs,
+                                      CountT num_lanes)
+{
+    using namespace simd;
+
+    const SleepData &sleep = ctx.singleton<SleepData>();
+
+    Position *x_ptrs[2][laneWidth];
+    Rotation *q_ptrs[2][laneWidth];
+    bool writeback[2][laneWidth];
+
+    Vector3 xs[2][laneWidth];
+    Quat qs[2][laneWidth];
+    Vector3 x_prevs[2][laneWidth];
+    Quat q_prevs[2][laneWidth];
+    float inv_ms[2][laneWidth];
+    Vector3 inv_Is[2][laneWidth];
+    Vector3 normals[laneWidth];
+    float avg_mu_s[laneWidth];
+
+    Vector3 r1s[4][laneWidth];
+    Vector3 r2s[4][laneWidth];
+    float lambda_n_starts[4][laneWidth];
+    uint32_t point_lanes[4] = {};
+
+    for (CountT lane = 0; lane < laneWidth; lane++) {
+        // Unused lanes repeat the first contact with all of its points
+        // masked off
+        bool used = lane < num_lanes;
+        const Contact &contact =
+            solver.contacts[contact_idxs[used ? lane : 0]];
+
+        Loc locs[2] = { contact.ref, contact.alt };
+        float mu_s_sum = 0.f;
+
+        for (CountT b = 0; b < 2; b++) {
+            Loc loc = locs[b];
+
+            x_ptrs[b][lane] = &ctx.getDirect<Position>(Cols::Position, loc);
+            q_ptrs[b][lane] = &ctx.getDirect<Rotation>(Cols::Rotation, loc);
+
+            const SubstepPrevState &prev = ctx.getDirect<SubstepPrevState>(
+                Cols::SubstepPrevState, loc);
+
+            ObjectID obj_id = ctx.getDirect<ObjectID>(Cols::ObjectID, loc);
+            const RigidBodyMetadata &metadata = obj_mgr.metadata[obj_id.idx];
+
+            ResponseType resp_type = solverResponseType(ctx, sleep, loc,
+                ctx.getDirect<ResponseType>(Cols::ResponseType, loc));
+            bool is_static = resp_type == ResponseType::Static;
+
+            xs[b][lane] = *x_ptrs[b][lane];
+            qs[b][lane] = *q_ptrs[b][lane];
+            x_prevs[b][lane] = prev.prevPosition;
+            q_prevs[b][lane] = prev.prevRotation;
+            inv_ms[b][lane] = is_static ? 0.f : metadata.mass.invMass;
+            inv_Is[b][lane] = is_static ?
+                Vector3::zero() : metadata.mass.invInertiaTensor;
+            writeback[b][lane] = used && !is_static;
+
+            mu_s_sum += metadata.friction.muS;
+        }
+
+        normals[lane] = contact.normal;
+        avg_mu_s[lane] = 0.5f * mu_s_sum;
+
+        PreSolvePositional contact_pose1 =
+            getContactGenerationPose(ctx, contact, contact.ref);
+        PreSolvePositional contact_pose2 =
+            getContactGenerationPose(ctx, contact, contact.alt);
+
+        for (CountT i = 0; i < 4; i++) {
+            if (!used || i >= contact.numPoints) {
+                r1s[i][lane] = Vector3::zero();
+                r2s[i][lane] = Vector3::zero();
+                lambda_n_starts[i][lane] = 0.f;
+                continue;
+            }
+
+            auto [r1, r2] =
+                getLocalSpaceContacts(contact_pose1, contact_pose2, contact, i);
+
+            r1s[i][lane] = r1;
+            r2s[i][lane] = r2;
+            lambda_n_starts[i][lane] = contact.lambdaN[i];
+            point_lanes[i] |= 1_u32 << lane;
+        }
+    }
+
+    Vector3x4 x1 = Vector3x4::gather(xs[0]);
+    Vector3x4 x2 = Vector3x4::gather(xs[1]);
+    Quat4 q1 = Quat4::gather(qs[0]);
+    Quat4 q2 = Quat4::gather(qs[1]);
+
+    Vector3x4 x1_prev = Vector3x4::gather(x_prevs[0]);
+    Vector3x4 x2_prev = Vector3x4::gather(x_prevs[1]);
+    Quat4 q1_prev = Quat4::gather(q_prevs[0]);
+    Quat4 q2_prev = Quat4::gather(q_prevs[1]);
+
+    Float4 inv_m1 = Float4::load(inv_ms[0]);
+    Float4 inv_m2 = Float4::load(inv_ms[1]);
+    Vector3x4 inv_I1 = Vector3x4::gather(inv_Is[0]);
+    Vector3x4 inv_I2 = Vector3x4::gather(inv_Is[1]);
+
+    Vector3x4 n_world = Vector3x4::gather(normals);
+    Float4 mu_s = Float4::load(avg_mu_s);
+
+    for (CountT i = 0; i < 4; i++) {
+        // Points are packed, no lane has a point past the first empty slot
+        if (point_lanes[i] == 0) {
+            break;
+        }
+
+        Float4 lambda_n = handleContactConstraint(
+            laneMask(point_lanes[i]),
+            x1, x2,
+            q1, q2,
+            x1_prev, x2_prev,
+            q1_prev, q2_prev,
+            inv_m1, inv_m2,
+            inv_I1, inv_I2,
+            Vector3x4::gather(r1s[i]), Vector3x4::gather(r2s[i]),
+            n_world,
+            mu_s,
+            Float4::load(lambda_n_starts[i]));
+
+        float lambda_ns[laneWidth];
+        lambda_n.store(lambda_ns);
+
+        for (CountT lane = 0; lane < num_lanes; lane++) {
+            if ((point_lanes[i] & (1_u32 << lane)) != 0) {
+                solver.contacts[contact_idxs[lane]].lambdaN[i] =
+                    lambda_ns[lane];
+            }
+        }
+    }
+
+    x1.scatter(xs[0]);
+    x2.scatter(xs[1]);
+    q1.scatter(qs[0]);
+    q2.scatter(qs[1]);
+
+    for (CountT lane = 0; lane < num_lanes; lane++) {
+        for (CountT b = 0; b < 2; b++) {
+            if (writeback[b][lane]) {
+                *x_ptrs[b][lane] = xs[b][lane];
+                *q_ptrs[b][lane] = qs[b][lane];
+            }
+        }
+    }
+}
+#endif
+
+static void applyJointOrientationConstraint(
+    Quat &q1, Quat &q2,
+    Quat attach_q1, Quat attach_q2,
+    Vector3 inv_I1, Vector3 inv_I2)
+{
+    Quat orientation1 = (q1 * attach_q1).normalize();
+    Quat orientation2 = (q2 * attach_q2).normalize();
+
+    Quat diff = orientation1 * orientation2.inv();
+
+    Vector3 delta_q =
+        2.f * math::Vector3 { diff.x, diff.y, diff.z };
+    float delta_q_magnitude = delta_q.length();
+
+    if (delta_q_magnitude > 0) {
+        delta_q /= delta_q_magnitude;
+        Vector3 delta_q_local1 = q1.inv().rotateVec(delta_q);
+        Vector3 delta_q_local2 = q2.inv().rotateVec(delta_q);
+
+        auto [update_q1, update_q2] = computeAngularUpdate(
+            q1, q2,
+            inv_I1, inv_I2,
+            delta_q_local1, delta_q_local2,
+            delta_q_magnitude, 0);
+
+        applyAngularUpdate(q1, q2, update_q1, update_q2);
+    }
+}
+
+static void applyJointAxisConstraint(
+    Quat &q1, Quat &q2,
+    Vector3 axis1_local, Vector3 axis2_local,
+    Vector3 inv_I1, Vector3 inv_I2)
+{
+    Vector3 axis1 = q1.rotateVec(axis1_local);
+    Vector3 axis2 = q2.rotateVec(axis2_local);
+
+    Vector3 delta_q = cross(axis1, axis2);
+    float delta_q_magnitude = delta_q.length();
+    
+    if (delta_q_magnitude > 0) {
+        delta_q /= delta_q_magnitude;
+        Vector3 delta_q_local1 = q1.inv().rotateVec(delta_q);
         Vector3 delta_q_local2 = q2.inv().rotateVec(delta_q);
 
         auto [update_q1, update_q2] = computeAngularUpdate(
@@ -573,6 +1415,17 @@ inline void handleJointConstraint(Context &ctx,
         Cols::ResponseType, l1);
     ResponseType resp_type2 = ctx.getDirect<ResponseType>(
         Cols::ResponseType, l2);
+
+    const SleepData &sleep = ctx.singleton<SleepData>();
+    resp_type1 = solverResponseType(ctx, sleep, l1, resp_type1);
+    resp_type2 = solverResponseType(ctx, sleep, l2, resp_type2);
+
+    // Nothing can move if both ends are asleep (or static)
+    if (resp_type1 == ResponseType::Static &&
+            resp_type2 == ResponseType::Static) {
+        return;
+    }
+
     ObjectID obj_id1 = ctx.getDirect<ObjectID>(Cols::ObjectID, l1);
     ObjectID obj_id2 = ctx.getDirect<ObjectID>(Cols::ObjectID, l2);
 
@@ -662,30 +1515,258 @@ inline void handleJointConstraint(Context &ctx,
             pos_correction, pos_correction_magnitude, 0);
     }
 
-    *x1_ptr = x1;
-    *x2_ptr = x2;
-    *q1_ptr = q1;
-    *q2_ptr = q2;
+    if (resp_type1 != ResponseType::Static) {
+        *x1_ptr = x1;
+        *q1_ptr = q1;
+    }
+
+    if (resp_type2 != ResponseType::Static) {
+        *x2_ptr = x2;
+        *q2_ptr = q2;
+    }
+}
+
+// Index of the body's color mask, or -1 for static bodies. The solver never
+// writes static bodies, so any number of constraints in a batch may share
+// one.
+static inline int32_t colorBodyIdx(Context &ctx, Loc loc,
+                                   ResponseType response_type)
+{
+    broadphase::LeafID leaf_id =
+        ctx.getDirect<broadphase::LeafID>(Cols::LeafID, loc);
+
+    if (broadphase::isStaticLeaf(leaf_id, response_type)) {
+        return -1;
+    }
+
+    return leaf_id.id;
+}
+
+static inline uint32_t assignColor(SolverData &solver,
+                                   int32_t body_idx1,
+                                   int32_t body_idx2)
+{
+    uint32_t used = 0;
+    if (body_idx1 != -1) {
+        used |= solver.bodyColorMasks[body_idx1];
+    }
+    if (body_idx2 != -1) {
+        used |= solver.bodyColorMasks[body_idx2];
+    }
+
+    uint32_t color = 0;
+    while (color < SolverData::maxColors && (used & (1_u32 << color))) {
+        color++;
+    }
+
+    // Out of colors: the constraint goes in the serial overflow batch
+    if (color == SolverData::maxColors) {
+        return color;
+    }
+
+    if (body_idx1 != -1) {
+        solver.bodyColorMasks[body_idx1] |= 1_u32 << color;
+    }
+    if (body_idx2 != -1) {
+        solver.bodyColorMasks[body_idx2] |= 1_u32 << color;
+    }
+
+    return color;
+}
+
+// Greedily colors this substep's contacts and joints so that no two
+// constraints of the same color share a non-static body, then groups them
+// into batches by color. Also records the constraint graph for island
+// detection, since this is the only serial pass over all constraints.
+void colorConstraints(Context &ctx, SolverData &solver)
+{
+    SleepData &sleep = ctx.singleton<SleepData>();
+
+    CountT num_contacts = solver.numContacts.load_relaxed();
+    CountT num_joints = solver.numJointConstraints.load_relaxed();
+    CountT num_items = num_contacts + num_joints;
+
+    auto getBodies = [&](CountT item_idx, Loc *l1, Loc *l2) {
+        if (item_idx < num_contacts) {
+            *l1 = solver.contacts[item_idx].ref;
+            *l2 = solver.contacts[item_idx].alt;
+        } else {
+            const JointConstraint &joint =
+                solver.jointConstraints[item_idx - num_contacts];
+            *l1 = ctx.loc(joint.e1);
+            *l2 = ctx.loc(joint.e2);
+        }
+    };
+
+    int32_t color_counts[SolverData::maxColors + 1] = {};
+    for (CountT i = 0; i < num_items; i++) {
+        Loc l1, l2;
+        getBodies(i, &l1, &l2);
+
+        ResponseType resp_type1 =
+            ctx.getDirect<ResponseType>(Cols::ResponseType, l1);
+        ResponseType resp_type2 =
+            ctx.getDirect<ResponseType>(Cols::ResponseType, l2);
+
+        linkBodies(ctx, sleep, l1, l2, resp_type1, resp_type2);
+
+        uint32_t color = assignColor(solver,
+            colorBodyIdx(ctx, l1, resp_type1),
+            colorBodyIdx(ctx, l2, resp_type2));
+
+        solver.itemColors[i] = uint8_t(color);
+        color_counts[color] += 1;
+    }
+
+    int32_t cursors[SolverData::maxColors + 1];
+    int32_t offset = 0;
+    for (CountT c = 0; c <= SolverData::maxColors; c++) {
+        solver.colorOffsets[c] = offset;
+        cursors[c] = offset;
+        offset += color_counts[c];
+    }
+    solver.colorOffsets[SolverData::maxColors + 1] = offset;
+
+    for (CountT i = 0; i < num_items; i++) {
+        int32_t item = i < num_contacts ?
+            int32_t(i) : ~int32_t(i - num_contacts);
+        solver.batchItems[cursors[solver.itemColors[i]]++] = item;
+
+        Loc l1, l2;
+        getBodies(i, &l1, &l2);
+
+        int32_t body_idx1 = colorBodyIdx(ctx, l1,
+            ctx.getDirect<ResponseType>(Cols::ResponseType, l1));
+        int32_t body_idx2 = colorBodyIdx(ctx, l2,
+            ctx.getDirect<ResponseType>(Cols::ResponseType, l2));
+
+        if (body_idx1 != -1) {
+            solver.bodyColorMasks[body_idx1] = 0;
+        }
+        if (body_idx2 != -1) {
+            solver.bodyColorMasks[body_idx2] = 0;
+        }
+    }
+}
+
+// Reapplies the normal lambdas persistent contacts needed in the previous
+// substep before any contact is solved, so the Gauss-Seidel sweep that
+// follows starts from roughly the previous solution across the whole
+// stack rather than correcting one contact at a time from scratch. Every
+// contact's lambdaN starts the position solve from here.
+static inline void warmStartPositionsForItem(Context &ctx,
+                                             ObjectManager &obj_mgr,
+                                             SolverData &solver,
+                                             int32_t item)
+{
+    if (item >= 0) {
+        Contact &contact = solver.contacts[item];
+        handleContact<true>(ctx, obj_mgr, solver, contact, contact.lambdaN);
+    }
+}
+
+#ifndef MADRONA_GPU_MODE
+// The warm start is a single update per point, so it doesn't have a SoA
+// version
+static inline void warmStartPositionsForLanes(Context &ctx,
+                                              ObjectManager &obj_mgr,
+                                              SolverData &solver,
+                                              const int32_t *items,
+                                              CountT num_items)
+{
+    for (CountT i = 0; i < num_items; i++) {
+        warmStartPositionsForItem(ctx, obj_mgr, solver, items[i]);
+    }
+}
+#endif
+
+inline void warmStartPositions(Context &ctx, SolverData &solver)
+{
+    ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
+
+    CountT num_items = solver.colorOffsets[SolverData::maxColors + 1];
+    for (CountT i = 0; i < num_items; i++) {
+        warmStartPositionsForItem(ctx, obj_mgr, solver, solver.batchItems[i]);
+    }
+}
+
+void solvePositionsForItem(Context &ctx,
+                           ObjectManager &obj_mgr,
+                           SolverData &solver,
+                           int32_t item)
+{
+    if (item >= 0) {
+        Contact &contact = solver.contacts[item];
+        handleContact<false>(ctx, obj_mgr, solver, contact, contact.lambdaN);
+    } else {
+        handleJointConstraint(ctx, solver.jointConstraints[~item]);
+    }
+}
+
+#ifndef MADRONA_GPU_MODE
+// Solves up to simd::laneWidth items of one color batch. Contacts go
+// through the SoA kernel, joints are solved one at a time.
+void solvePositionsForLanes(Context &ctx,
+                            ObjectManager &obj_mgr,
+                            SolverData &solver,
+                            const int32_t *items,
+                            CountT num_items)
+{
+    int32_t contact_idxs[simd::laneWidth];
+    CountT num_contacts = 0;
+
+    for (CountT i = 0; i < num_items; i++) {
+        if (items[i] >= 0) {
+            contact_idxs[num_contacts++] = items[i];
+        } else {
+            handleJointConstraint(ctx, solver.jointConstraints[~items[i]]);
+        }
+    }
+
+    if (num_contacts > 0) {
+        handleContactLanes(ctx, obj_mgr, solver, contact_idxs, num_contacts);
+    }
 }
+#endif
 
 inline void solvePositions(Context &ctx, SolverData &solver)
 {
     ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
 
-    CountT num_contacts = solver.numContacts.load_relaxed();
+    CountT num_items = solver.colorOffsets[SolverData::maxColors + 1];
+    for (CountT i = 0; i < num_items; i++) {
+        solvePositionsForItem(ctx, obj_mgr, solver, solver.batchItems[i]);
+    }
+}
+
+inline void finishPositionSolve(Context &ctx, SolverData &solver)
+{
+    ContactCache &contact_cache = solver.contactCache;
 
+    CountT num_contacts = solver.numContacts.load_relaxed();
     for (CountT i = 0; i < num_contacts; i++) {
-        Contact contact = solver.contacts[i];
-        handleContact(ctx, obj_mgr, contact, solver.contacts[i].lambdaN);
-    }
+        const Contact &contact = solver.contacts[i];
+
+        PreSolvePositional contact_pose1 =
+            getContactGenerationPose(ctx, contact, contact.ref);
+        PreSolvePositional contact_pose2 =
+            getContactGenerationPose(ctx, contact, contact.alt);
 
-    CountT num_joint_constraints = solver.numJointConstraints.load_relaxed();
+        Vector3 r1_locals[4];
+        for (CountT j = 0; j < contact.numPoints; j++) {
+            r1_locals[j] = getLocalSpaceContacts(
+                contact_pose1, contact_pose2, contact, j).first;
+        }
 
-    for (CountT i = 0; i < num_joint_constraints; i++) {
-        JointConstraint joint_constraint = solver.jointConstraints[i];
-        handleJointConstraint(ctx, joint_constraint);
+        contact_cache.insert(
+            ctx.getDirect<Entity>(Cols::Entity, contact.ref),
+            ctx.getDirect<Entity>(Cols::Entity, contact.alt),
+            contact.id, contact.numPoints, r1_locals, contact.lambdaN);
     }
 
+    // Lambdas written this substep become next substep's warm start
+    contact_cache.swap();
+
     solver.numJointConstraints.store_relaxed(0);
 }
 
@@ -898,6 +1979,11 @@ static inline void solveVelocitiesForContact(Context &ctx,
     PreSolvePositional presolve_pos2 =  ctx.getDirect<PreSolvePositional>(
         Cols::PreSolvePositional, contact.alt);
 
+    PreSolvePositional contact_pose1 =
+        getContactGenerationPose(ctx, contact, contact.ref);
+    PreSolvePositional contact_pose2 =
+        getContactGenerationPose(ctx, contact, contact.alt);
+
     PreSolveVelocity presolve_vel1 =
         ctx.getDirect<PreSolveVelocity>(Cols::PreSolveVelocity, contact.ref);
     PreSolveVelocity presolve_vel2 =
@@ -911,6 +1997,10 @@ static inline void solveVelocitiesForContact(Context &ctx,
     ResponseType resp_type2 = ctx.getDirect<ResponseType>(
         Cols::ResponseType, contact.alt);
 
+    const SleepData &sleep = ctx.singleton<SleepData>();
+    resp_type1 = solverResponseType(ctx, sleep, contact.ref, resp_type1);
+    resp_type2 = solverResponseType(ctx, sleep, contact.alt, resp_type2);
+
     RigidBodyMetadata metadata1 = obj_mgr.metadata[obj_id1.idx];
     RigidBodyMetadata metadata2 = obj_mgr.metadata[obj_id2.idx];
 
@@ -942,6 +2032,8 @@ static inline void solveVelocitiesForContact(Context &ctx,
     Vector3 restitution_torque2_locals[4];
 
     float vn_bars[4];
+    float lambda_ns[4];
+    CountT num_points = 0;
 
 #pragma unroll
     for (CountT i = 0; i < 4; i++) {
@@ -949,8 +2041,14 @@ static inline void solveVelocitiesForContact(Context &ctx,
             continue;
         }
 
+        // Speculative points the position solve never had to push apart
+        // didn't touch this substep, so they mustn't bounce or brake
+        if (contact.speculative && contact.lambdaN[i] == 0.f) {
+            continue;
+        }
+
         auto [r1, r2] = getLocalSpaceContacts(
-            presolve_pos1, presolve_pos2, contact, i);
+            contact_pose1, contact_pose2, contact, i);
     
         Vector3 r1_presolve = presolve_pos1.q.rotateVec(r1);
         Vector3 r2_presolve = presolve_pos2.q.rotateVec(r2);
@@ -970,14 +2068,18 @@ static inline void solveVelocitiesForContact(Context &ctx,
         Vector3 restitution_torque_axis_local2 =
             cross(r2, q2.inv().rotateVec(contact.normal));
 
-        r1_locals[i] = r1;
-        r2_locals[i] = r2;
-        r1_worlds[i] = r1_world;
-        r2_worlds[i] = r2_world;
-        restitution_torque1_locals[i] = restitution_torque_axis_local1;
-        restitution_torque2_locals[i] = restitution_torque_axis_local2;
-
-        vn_bars[i] = vn_bar;
+        r1_locals[num_points] = r1;
+        r2_locals[num_points] = r2;
+        r1_worlds[num_points] = r1_world;
+        r2_worlds[num_points] = r2_world;
+        restitution_torque1_locals[num_points] =
+            restitution_torque_axis_local1;
+        restitution_torque2_locals[num_points] =
+            restitution_torque_axis_local2;
+
+        vn_bars[num_points] = vn_bar;
+        lambda_ns[num_points] = contact.lambdaN[i];
+        num_points += 1;
     }
 
     for (CountT restitution_iters = 0; restitution_iters < 2;
@@ -992,7 +2094,7 @@ static inline void solveVelocitiesForContact(Context &ctx,
             restitution_threshold,
             r1_worlds, r2_worlds,
             restitution_torque1_locals, restitution_torque2_locals,
-            vn_bars, contact.numPoints);
+            vn_bars, num_points);
     }
 
     applyFrictionVelocityUpdate(
@@ -1005,27 +2107,640 @@ static inline void solveVelocitiesForContact(Context &ctx,
         mu_d, h,
         r1_locals, r2_locals,
         r1_worlds, r2_worlds,
-        contact.lambdaN, contact.numPoints);
+        lambda_ns, num_points);
+
+    if (resp_type1 != ResponseType::Static) {
+        *v1_out = Velocity { v1, omega1 };
+    }
+
+    if (resp_type2 != ResponseType::Static) {
+        *v2_out = Velocity { v2, omega2 };
+    }
+}
 
-    *v1_out = Velocity { v1, omega1 };
-    *v2_out = Velocity { v2, omega2 };
+#ifndef MADRONA_GPU_MODE
+MADRONA_ALWAYS_INLINE static inline simd::Vector3x4 computeRelativeVelocity(
+    simd::Vector3x4 v1, simd::Vector3x4 v2,
+    simd::Vector3x4 omega1, simd::Vector3x4 omega2,
+    simd::Vector3x4 dir1, simd::Vector3x4 dir2)
+{
+    return (v1 + cross(omega1, dir1)) - (v2 + cross(omega2, dir2));
 }
 
+MADRONA_ALWAYS_INLINE static inline void applyVelocityUpdate(
+    simd::Mask4 mask,
+    simd::Vector3x4 &v1, simd::Vector3x4 &v2,
+    simd::Vector3x4 &omega1, simd::Vector3x4 &omega2,
+    simd::Quat4 q1, simd::Quat4 q2,
+    simd::Vector3x4 torque_axis1, simd::Vector3x4 torque_axis2,
+    simd::Float4 inv_m1, simd::Float4 inv_m2,
+    simd::Vector3x4 inv_I1, simd::Vector3x4 inv_I2,
+    simd::Vector3x4 delta_v,
+    simd::Float4 delta_v_magnitude)
+{
+    using namespace simd;
+
+    Vector3x4 rot_axis1 = multDiag(inv_I1, torque_axis1);
+    Vector3x4 rot_axis2 = multDiag(inv_I2, torque_axis2);
+
+    Float4 w1 = inv_m1 + dot(torque_axis1, rot_axis1);
+    Float4 w2 = inv_m2 + dot(torque_axis2, rot_axis2);
+
+    delta_v_magnitude = delta_v_magnitude * (Float4(1.f) / (w1 + w2));
+
+    Vector3x4 new_v1 = v1 + (delta_v_magnitude * inv_m1) * delta_v;
+    Vector3x4 new_v2 = v2 - (delta_v_magnitude * inv_m2) * delta_v;
+
+    Vector3x4 new_omega1 =
+        omega1 + q1.rotateVec(delta_v_magnitude * rot_axis1);
+    Vector3x4 new_omega2 =
+        omega2 - q2.rotateVec(delta_v_magnitude * rot_axis2);
+
+    v1 = select(mask, new_v1, v1);
+    v2 = select(mask, new_v2, v2);
+    omega1 = select(mask, new_omega1, omega1);
+    omega2 = select(mask, new_omega2, omega2);
+}
+
+MADRONA_NO_INLINE static void applyFrictionVelocityUpdate(
+    simd::Vector3x4 &v1, simd::Vector3x4 &v2,
+    simd::Vector3x4 &omega1, simd::Vector3x4 &omega2,
+    simd::Quat4 q1, simd::Quat4 q2,
+    simd::Float4 inv_m1, simd::Float4 inv_m2,
+    simd::Vector3x4 inv_I1, simd::Vector3x4 inv_I2,
+    simd::Vector3x4 n,
+    simd::Float4 mu_d, float h,
+    const simd::Vector3x4 *r1_locals, const simd::Vector3x4 *r2_locals,
+    const simd::Vector3x4 *r1_worlds, const simd::Vector3x4 *r2_worlds,
+    const simd::Float4 *lambdas,
+    const simd::Mask4 *point_masks,
+    CountT num_points)
+{
+    using namespace simd;
+
+    for (CountT i = 0; i < num_points; i++) {
+        Vector3x4 v = computeRelativeVelocity(
+            v1, v2, omega1, omega2, r1_worlds[i], r2_worlds[i]);
+
+        Float4 dynamic_friction_magnitude =
+            mu_d * abs(lambdas[i]) / Float4(h);
+
+        Float4 vn = dot(n, v);
+        Vector3x4 vt = v - vn * n;
+
+        Float4 vt_len = length(vt);
+
+        Mask4 friction = point_masks[i] &
+            (vt_len != Float4(0.f)) &
+            (dynamic_friction_magnitude != Float4(0.f));
+        if (!any(friction)) {
+            continue;
+        }
+
+        Float4 corrected_magnitude = -min(vt_len, dynamic_friction_magnitude);
+
+        Vector3x4 delta_world = vt / vt_len;
+
+        Vector3x4 delta1_local = q1.inv().rotateVec(delta_world);
+        Vector3x4 delta2_local = q2.inv().rotateVec(delta_world);
+
+        applyVelocityUpdate(
+            friction,
+            v1, v2,
+            omega1, omega2,
+            q1, q2,
+            cross(r1_locals[i], delta1_local),
+            cross(r2_locals[i], delta2_local),
+            inv_m1, inv_m2,
+            inv_I1, inv_I2,
+            delta_world, corrected_magnitude);
+    }
+}
+
+MADRONA_NO_INLINE static void applyRestitutionVelocityUpdate(
+    simd::Vector3x4 &v1, simd::Vector3x4 &v2,
+    simd::Vector3x4 &omega1, simd::Vector3x4 &omega2,
+    simd::Quat4 q1, simd::Quat4 q2,
+    simd::Float4 inv_m1, simd::Float4 inv_m2,
+    simd::Vector3x4 inv_I1, simd::Vector3x4 inv_I2,
+    simd::Vector3x4 n,
+    float restitution_threshold,
+    const simd::Vector3x4 *r1_worlds,
+    const simd::Vector3x4 *r2_worlds,
+    const simd::Vector3x4 *restitution_torques1_local,
+    const simd::Vector3x4 *restitution_torques2_local,
+    const simd::Float4 *vn_bars,
+    const simd::Mask4 *point_masks,
+    CountT num_points)
+{
+    using namespace simd;
+
+    for (CountT i = 0; i < num_points; i++) {
+        Vector3x4 v = computeRelativeVelocity(
+            v1, v2, omega1, omega2, r1_worlds[i], r2_worlds[i]);
+
+        Float4 vn = dot(n, v);
+
+        Float4 e = select(abs(vn_bars[i]) <= Float4(restitution_threshold),
+                          Float4(0.f), Float4(0.3f)); // FIXME
+
+        Float4 restitution_magnitude =
+            min(-e * vn_bars[i], Float4(0.f)) - vn;
+
+        applyVelocityUpdate(
+            point_masks[i],
+            v1, v2,
+            omega1, omega2,
+            q1, q2,
+            restitution_torques1_local[i], restitution_torques2_local[i],
+            inv_m1, inv_m2,
+            inv_I1, inv_I2,
+            n, restitution_magnitude);
+    }
+}
+
+// SoA version of solveVelocitiesForContact, see handleContactLanes
+static inline void solveVelocitiesForContactLanes(
+    Context &ctx,
+    ObjectManager &obj_mgr,
+    SolverData &solver,
+    const int32_t *contact_idxs,
+    CountT num_lanes)
+{
+    using namespace simd;
+
+    const SleepData &sleep = ctx.singleton<SleepData>();
+
+    Velocity *vel_ptrs[2][laneWidth];
+    bool writeback[2][laneWidth];
+
+    Vector3 vs[2][laneWidth];
+    Vector3 omegas[2][laneWidth];
+    Quat qs[2][laneWidth];
+    Quat presolve_qs[2][laneWidth];
+    Vector3 presolve_vs[2][laneWidth];
+    Vector3 presolve_omegas[2][laneWidth];
+    float inv_ms[2][laneWidth];
+    Vector3 inv_Is[2][laneWidth];
+    Vector3 normals[laneWidth];
+    float avg_mu_d[laneWidth];
+
+    Vector3 r1s[4][laneWidth];
+    Vector3 r2s[4][laneWidth];
+    float lambda_ns[4][laneWidth];
+    uint32_t point_lanes[4] = {};
+
+    for (CountT lane = 0; lane < laneWidth; lane++) {
+        bool used = lane < num_lanes;
+        const Contact &contact =
+            solver.contacts[contact_idxs[used ? lane : 0]];
+
+        Loc locs[2] = { contact.ref, contact.alt };
+        float mu_d_sum = 0.f;
+
+        for (CountT b = 0; b < 2; b++) {
+            Loc loc = locs[b];
+
+            vel_ptrs[b][lane] = &ctx.getDirect<Velocity>(Cols::Velocity, loc);
+
+            const PreSolveVelocity &presolve_vel =
+                ctx.getDirect<PreSolveVelocity>(Cols::PreSolveVelocity, loc);
+
+            ObjectID obj_id = ctx.getDirect<ObjectID>(Cols::ObjectID, loc);
+            const RigidBodyMetadata &metadata = obj_mgr.metadata[obj_id.idx];
+
+            ResponseType resp_type = solverResponseType(ctx, sleep, loc,
+                ctx.getDirect<ResponseType>(Cols::ResponseType, loc));
+            bool is_static = resp_type == ResponseType::Static;
+
+            vs[b][lane] = vel_ptrs[b][lane]->linear;
+            omegas[b][lane] = vel_ptrs[b][lane]->angular;
+            qs[b][lane] = ctx.getDirect<Rotation>(Cols::Rotation, loc);
+            presolve_qs[b][lane] = ctx.getDirect<PreSolvePositional>(
+                Cols::PreSolvePositional, loc).q;
+            presolve_vs[b][lane] = presolve_vel.v;
+            presolve_omegas[b][lane] = presolve_vel.omega;
+            inv_ms[b][lane] = is_static ? 0.f : metadata.mass.invMass;
+            inv_Is[b][lane] = is_static ?
+                Vector3::zero() : metadata.mass.invInertiaTensor;
+            writeback[b][lane] = used && !is_static;
+
+            mu_d_sum += metadata.friction.muD;
+        }
+
+        normals[lane] = contact.normal;
+        avg_mu_d[lane] = 0.5f * mu_d_sum;
+
+        PreSolvePositional contact_pose1 =
+            getContactGenerationPose(ctx, contact, contact.ref);
+        PreSolvePositional contact_pose2 =
+            getContactGenerationPose(ctx, contact, contact.alt);
+
+        for (CountT i = 0; i < 4; i++) {
+            // See solveVelocitiesForContact for skipped speculative points
+            if (!used || i >= contact.numPoints ||
+                    (contact.speculative && contact.lambdaN[i] == 0.f)) {
+                r1s[i][lane] = Vector3::zero();
+                r2s[i][lane] = Vector3::zero();
+                lambda_ns[i][lane] = 0.f;
+                continue;
+            }
+
+            auto [r1, r2] =
+                getLocalSpaceContacts(contact_pose1, contact_pose2, contact, i);
+
+            r1s[i][lane] = r1;
+            r2s[i][lane] = r2;
+            lambda_ns[i][lane] = contact.lambdaN[i];
+            point_lanes[i] |= 1_u32 << lane;
+        }
+    }
+
+    Vector3x4 v1 = Vector3x4::gather(vs[0]);
+    Vector3x4 v2 = Vector3x4::gather(vs[1]);
+    Vector3x4 omega1 = Vector3x4::gather(omegas[0]);
+    Vector3x4 omega2 = Vector3x4::gather(omegas[1]);
+    Quat4 q1 = Quat4::gather(qs[0]);
+    Quat4 q2 = Quat4::gather(qs[1]);
+
+    Float4 inv_m1 = Float4::load(inv_ms[0]);
+    Float4 inv_m2 = Float4::load(inv_ms[1]);
+    Vector3x4 inv_I1 = Vector3x4::gather(inv_Is[0]);
+    Vector3x4 inv_I2 = Vector3x4::gather(inv_Is[1]);
+
+    Vector3x4 n = Vector3x4::gather(normals);
+    Float4 mu_d = Float4::load(avg_mu_d);
+
+    // Skipped speculative points can leave gaps, so this is one past the
+    // last point used by any lane
+    CountT num_points = 4;
+    while (num_points > 0 && point_lanes[num_points - 1] == 0) {
+        num_points--;
+    }
+
+    Vector3x4 r1_locals[4];
+    Vector3x4 r2_locals[4];
+    Vector3x4 r1_worlds[4];
+    Vector3x4 r2_worlds[4];
+    Vector3x4 restitution_torque1_locals[4];
+    Vector3x4 restitution_torque2_locals[4];
+    Float4 vn_bars[4];
+
+    {
+        Quat4 presolve_q1 = Quat4::gather(presolve_qs[0]);
+        Quat4 presolve_q2 = Quat4::gather(presolve_qs[1]);
+        Vector3x4 presolve_v1 = Vector3x4::gather(presolve_vs[0]);
+        Vector3x4 presolve_v2 = Vector3x4::gather(presolve_vs[1]);
+        Vector3x4 presolve_omega1 = Vector3x4::gather(presolve_omegas[0]);
+        Vector3x4 presolve_omega2 = Vector3x4::gather(presolve_omegas[1]);
+
+        Vector3x4 n_local1 = q1.inv().rotateVec(n);
+        Vector3x4 n_local2 = q2.inv().rotateVec(n);
+
+        for (CountT i = 0; i < num_points; i++) {
+            Vector3x4 r1 = Vector3x4::gather(r1s[i]);
+            Vector3x4 r2 = Vector3x4::gather(r2s[i]);
+
+            Vector3x4 v_bar = computeRelativeVelocity(
+                presolve_v1, presolve_v2,
+                presolve_omega1, presolve_omega2,
+                presolve_q1.rotateVec(r1), presolve_q2.rotateVec(r2));
+
+            r1_locals[i] = r1;
+            r2_locals[i] = r2;
+            r1_worlds[i] = q1.rotateVec(r1);
+            r2_worlds[i] = q2.rotateVec(r2);
+            restitution_torque1_locals[i] = cross(r1, n_local1);
+            restitution_torque2_locals[i] = cross(r2, n_local2);
+            vn_bars[i] = dot(n, v_bar);
+        }
+    }
+
+    Mask4 point_masks[4];
+    Float4 lambdas[4];
+    for (CountT i = 0; i < num_points; i++) {
+        point_masks[i] = laneMask(point_lanes[i]);
+        lambdas[i] = Float4::load(lambda_ns[i]);
+    }
+
+    for (CountT restitution_iters = 0; restitution_iters < 2;
+         restitution_iters++) {
+        applyRestitutionVelocityUpdate(
+            v1, v2,
+            omega1, omega2,
+            q1, q2,
+            inv_m1, inv_m2,
+            inv_I1, inv_I2,
+            n,
+            solver.restitutionThreshold,
+            r1_worlds, r2_worlds,
+            restitution_torque1_locals, restitution_torque2_locals,
+            vn_bars, point_masks, num_points);
+    }
+
+    applyFrictionVelocityUpdate(
+        v1, v2,
+        omega1, omega2,
+        q1, q2,
+        inv_m1, inv_m2,
+        inv_I1, inv_I2,
+        n,
+        mu_d, solver.h,
+        r1_locals, r2_locals,
+        r1_worlds, r2_worlds,
+        lambdas, point_masks, num_points);
+
+    v1.scatter(vs[0]);
+    v2.scatter(vs[1]);
+    omega1.scatter(omegas[0]);
+    omega2.scatter(omegas[1]);
+
+    for (CountT lane = 0; lane < num_lanes; lane++) {
+        for (CountT b = 0; b < 2; b++) {
+            if (writeback[b][lane]) {
+                *vel_ptrs[b][lane] = Velocity { vs[b][lane], omegas[b][lane] };
+            }
+        }
+    }
+}
+#endif
+
+void solveVelocitiesForItem(Context &ctx,
+                            ObjectManager &obj_mgr,
+                            SolverData &solver,
+                            int32_t item)
+{
+    // Joints only have a positional pass
+    if (item < 0) {
+        return;
+    }
+
+    solveVelocitiesForContact(ctx, obj_mgr, solver.contacts[item],
+                              solver.h, solver.restitutionThreshold);
+}
+
+#ifndef MADRONA_GPU_MODE
+void solveVelocitiesForLanes(Context &ctx,
+                             ObjectManager &obj_mgr,
+                             SolverData &solver,
+                             const int32_t *items,
+                             CountT num_items)
+{
+    int32_t contact_idxs[simd::laneWidth];
+    CountT num_contacts = 0;
+
+    for (CountT i = 0; i < num_items; i++) {
+        if (items[i] >= 0) {
+            contact_idxs[num_contacts++] = items[i];
+        }
+    }
+
+    if (num_contacts > 0) {
+        solveVelocitiesForContactLanes(ctx, obj_mgr, solver,
+                                       contact_idxs, num_contacts);
+    }
+}
+#endif
+
 inline void solveVelocities(Context &ctx, SolverData &solver)
 {
     ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
 
-    CountT num_contacts = solver.numContacts.load_relaxed();
-
-    for (CountT i = 0; i < num_contacts; i++) {
-        const Contact &contact = solver.contacts[i];
-        solveVelocitiesForContact(ctx, obj_mgr, contact, solver.h,
-                                  solver.restitutionThreshold);
+    CountT num_items = solver.colorOffsets[SolverData::maxColors + 1];
+    for (CountT i = 0; i < num_items; i++) {
+        solveVelocitiesForItem(ctx, obj_mgr, solver, solver.batchItems[i]);
     }
+}
 
+inline void finishVelocitySolve(Context &, SolverData &solver)
+{
     solver.numContacts.store_relaxed(0);
 }
 
+#ifndef MADRONA_GPU_MODE
+// Solves one color batch. Constraints in a batch share no non-static body,
+// so each invocation solves simd::laneWidth of them together and the
+// backend is free to split the batch across worker threads. The final
+// batch holds the constraints that didn't fit in maxColors; they may share
+// bodies, so it is solved item by item as a single serial invocation.
+template <auto item_fn, auto lanes_fn>
+class SolveBatchNode : public NodeBase {
+public:
+    SolveBatchNode(int32_t color)
+        : color_(color)
+    {}
+
+    CountT numInvocations(TaskGraph &taskgraph)
+    {
+        SolverData &solver = taskgraph.getSingleton<SolverData>();
+        CountT num_items =
+            solver.colorOffsets[color_ + 1] - solver.colorOffsets[color_];
+
+        if (color_ == SolverData::maxColors) {
+            return num_items > 0 ? 1 : 0;
+        }
+
+        return (num_items + simd::laneWidth - 1) / simd::laneWidth;
+    }
+
+    void runInvocations(Context &ctx, TaskGraph &,
+                        CountT invocation_offset, CountT num_invocations)
+    {
+        SolverData &solver = ctx.singleton<SolverData>();
+        ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
+
+        CountT batch_start = solver.colorOffsets[color_];
+        CountT batch_end = solver.colorOffsets[color_ + 1];
+
+        if (color_ == SolverData::maxColors) {
+            for (CountT i = batch_start; i < batch_end; i++) {
+                item_fn(ctx, obj_mgr, solver, solver.batchItems[i]);
+            }
+
+            return;
+        }
+
+        CountT start = batch_start + invocation_offset * simd::laneWidth;
+        CountT end = std::min(
+            start + num_invocations * simd::laneWidth, batch_end);
+
+        for (CountT i = start; i < end; i += simd::laneWidth) {
+            lanes_fn(ctx, obj_mgr, solver, &solver.batchItems[i],
+                     std::min(simd::laneWidth, end - i));
+        }
+    }
+
+private:
+    int32_t color_;
+};
+
+template <auto item_fn, auto lanes_fn>
+static TaskGraphNodeID addSolveBatchNodes(TaskGraphBuilder &builder,
+                                          TaskGraphNodeID dep)
+{
+    // Batches run back to back, each one only once the previous finished
+    for (int32_t c = 0; c <= (int32_t)SolverData::maxColors; c++) {
+        dep = builder.addDynamicCountNode<SolveBatchNode<item_fn, lanes_fn>>(
+            {dep}, c);
+    }
+
+    return dep;
+}
+#endif
+
+// Runs before the broadphase so woken bodies are refit and paired this
+// step. Sleeping bodies that were given a velocity or an external force
+// since the last step wake themselves.
+inline void checkSleepingBodies(Context &ctx,
+                                const broadphase::LeafID &leaf_id,
+                                ResponseType response_type,
+                                const Velocity &vel,
+                                const ExternalForce &ext_force,
+                                const ExternalTorque &ext_torque)
+{
+    if (broadphase::isStaticLeaf(leaf_id, response_type)) {
+        return;
+    }
+
+    SleepData::Body &body = ctx.singleton<SleepData>().bodies[leaf_id.id];
+    if (!body.asleep) {
+        return;
+    }
+
+    if (vel.linear.length2() > 0.f || vel.angular.length2() > 0.f ||
+            ext_force.length2() > 0.f || ext_torque.length2() > 0.f) {
+        body.wakeRequested = true;
+    }
+}
+
+inline void wakeIslands(Context &ctx, SleepData &sleep)
+{
+    int32_t num_bodies = ctx.singleton<broadphase::BVH>().numLeaves();
+
+    for (int32_t i = 0; i < num_bodies; i++) {
+        SleepData::Body &body = sleep.bodies[i];
+        if (body.asleep && body.wakeRequested) {
+            sleep.bodies[body.island].wakeIsland = true;
+        }
+    }
+
+    for (int32_t i = 0; i < num_bodies; i++) {
+        SleepData::Body &body = sleep.bodies[i];
+        if (body.asleep && sleep.bodies[body.island].wakeIsland) {
+            body.asleep = false;
+            body.restTime = 0.f;
+        }
+    }
+
+    for (int32_t i = 0; i < num_bodies; i++) {
+        SleepData::Body &body = sleep.bodies[i];
+        if (!body.asleep) {
+            body.island = i;
+        }
+
+        body.wakeRequested = false;
+        body.wakeIsland = false;
+    }
+}
+
+inline void updateRestTime(Context &ctx,
+                           const broadphase::LeafID &leaf_id,
+                           ResponseType response_type,
+                           const ObjectID &obj_id,
+                           const Rotation &rot,
+                           const Velocity &vel)
+{
+    if (broadphase::isStaticLeaf(leaf_id, response_type)) {
+        return;
+    }
+
+    SleepData &sleep = ctx.singleton<SleepData>();
+    SleepData::Body &body = sleep.bodies[leaf_id.id];
+
+    // Kinematic bodies never sleep. linkBodies leaves them out of islands,
+    // but like any awake body they wake sleeping bodies they touch.
+    if (response_type != ResponseType::Dynamic) {
+        body.restTime = 0.f;
+        return;
+    }
+
+    if (body.asleep) {
+        return;
+    }
+
+    const SolverData &solver = ctx.singleton<SolverData>();
+    const ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
+    const RigidBodyMetadata &metadata = obj_mgr.metadata[obj_id.idx];
+
+    float energy = kineticEnergyPerMass(
+        metadata.mass.invMass, metadata.mass.invInertiaTensor,
+        vel.linear, vel.angular, rot);
+
+    if (energy < sleep.energyThreshold) {
+        body.restTime += solver.deltaT;
+    } else {
+        body.restTime = 0.f;
+    }
+}
+
+// An island falls asleep once every body in it has been at rest for
+// timeToSleep. The union-find built by the solver over this step's
+// contacts and joints is reset for the next step afterwards.
+inline void updateIslands(Context &ctx, SleepData &sleep)
+{
+    int32_t num_bodies = ctx.singleton<broadphase::BVH>().numLeaves();
+
+    for (int32_t i = 0; i < num_bodies; i++) {
+        sleep.bodies[i].islandRestTime = FLT_MAX;
+    }
+
+    for (int32_t i = 0; i < num_bodies; i++) {
+        SleepData::Body &body = sleep.bodies[i];
+        if (body.asleep) {
+            continue;
+        }
+
+        SleepData::Body &root = sleep.bodies[sleep.findIsland(i)];
+        root.islandRestTime = fminf(root.islandRestTime, body.restTime);
+    }
+
+    for (int32_t i = 0; i < num_bodies; i++) {
+        SleepData::Body &body = sleep.bodies[i];
+        if (body.asleep) {
+            continue;
+        }
+
+        int32_t island = sleep.findIsland(i);
+        if (sleep.bodies[island].islandRestTime >= sleep.timeToSleep) {
+            body.asleep = true;
+            body.island = island;
+        }
+    }
+
+    for (int32_t i = 0; i < num_bodies; i++) {
+        SleepData::Body &body = sleep.bodies[i];
+        if (!body.asleep) {
+            body.island = i;
+        }
+    }
+}
+
+// Bodies that just fell asleep still carry their small resting velocity,
+// which would immediately wake them in checkSleepingBodies.
+inline void clearSleepingVelocities(Context &ctx,
+                                    const broadphase::LeafID &leaf_id,
+                                    ResponseType response_type,
+                                    Velocity &vel)
+{
+    if (broadphase::isStaticLeaf(leaf_id, response_type) ||
+            !ctx.singleton<SleepData>().isAsleep(leaf_id)) {
+        return;
+    }
+
+    vel.linear = Vector3::zero();
+    vel.angular = Vector3::zero();
+}
+
 }
 
 void RigidBodyPhysicsSystem::init(Context &ctx,
@@ -1035,7 +2750,9 @@ void RigidBodyPhysicsSystem::init(Context &ctx,
                                   math::Vector3 gravity,
                                   CountT max_dynamic_objects,
                                   CountT max_contacts_per_world,
-                                  CountT max_joint_constraints_per_world)
+                                  CountT max_joint_constraints_per_world,
+                                  CountT max_static_objects,
+                                  broadphase::BuildMethod bvh_build_method)
 {
     broadphase::BVH &bvh = ctx.singleton<broadphase::BVH>();
 
@@ -1044,13 +2761,36 @@ void RigidBodyPhysicsSystem::init(Context &ctx,
     constexpr float max_inst_accel = 100.f;
     new (&bvh) broadphase::BVH(
         obj_mgr, max_dynamic_objects, 2.f * delta_t,
-        max_inst_accel * delta_t * delta_t);
+        max_inst_accel * delta_t * delta_t, bvh_build_method);
+    bvh.rebuildOnUpdate();
+
+    // Static leaves don't move, so they don't need any expansion. Before
+    // statics had their own tree they counted against max_dynamic_objects,
+    // so keep that as the default limit.
+    if (max_static_objects == 0) {
+        max_static_objects = max_dynamic_objects;
+    }
+
+    broadphase::StaticBVH &static_bvh =
+        ctx.singleton<broadphase::StaticBVH>();
+    new (&static_bvh) broadphase::StaticBVH(
+        obj_mgr, max_static_objects, 0.f, 0.f, bvh_build_method);
+    static_bvh.rebuildOnUpdate();
 
     SolverData &solver = ctx.singleton<SolverData>();
     new (&solver) SolverData(max_contacts_per_world, 
                              max_joint_constraints_per_world,
+                             max_dynamic_objects,
                              delta_t, num_substeps, gravity);
 
+    SleepData &sleep = ctx.singleton<SleepData>();
+    new (&sleep) SleepData(max_dynamic_objects);
+
+    // Room for every dynamic body to be excluded from a couple of others,
+    // e.g. its neighbors in a chain of links
+    CollisionExclusions &exclusions = ctx.singleton<CollisionExclusions>();
+    new (&exclusions) CollisionExclusions(2 * max_dynamic_objects);
+
     ObjectData &objs = ctx.singleton<ObjectData>();
     new (&objs) ObjectData { obj_mgr };
 }
@@ -1060,13 +2800,190 @@ void RigidBodyPhysicsSystem::reset(Context &ctx)
     broadphase::BVH &bvh = ctx.singleton<broadphase::BVH>();
     bvh.rebuildOnUpdate();
     bvh.clearLeaves();
+
+    broadphase::StaticBVH &static_bvh =
+        ctx.singleton<broadphase::StaticBVH>();
+    static_bvh.rebuildOnUpdate();
+    static_bvh.clearLeaves();
+
+    ctx.singleton<SolverData>().contactCache.clear();
+    ctx.singleton<CollisionExclusions>().clear();
+
+    SleepData &sleep = ctx.singleton<SleepData>();
+    for (CountT i = 0; i < sleep.maxBodies; i++) {
+        sleep.resetBody(int32_t(i));
+    }
 }
 
-broadphase::LeafID RigidBodyPhysicsSystem::registerEntity(Context &ctx,
-                                                          Entity e,
-                                                          ObjectID obj_id)
+broadphase::LeafID RigidBodyPhysicsSystem::registerEntity(
+    Context &ctx,
+    Entity e,
+    ObjectID obj_id,
+    ResponseType response_type)
 {
-    return ctx.singleton<broadphase::BVH>().reserveLeaf(e, obj_id);
+    if (response_type == ResponseType::Static) {
+        broadphase::StaticBVH &static_bvh =
+            ctx.singleton<broadphase::StaticBVH>();
+        static_bvh.rebuildOnUpdate();
+
+        return static_bvh.reserveLeaf(e, obj_id);
+    }
+
+    broadphase::LeafID leaf_id =
+        ctx.singleton<broadphase::BVH>().reserveLeaf(e, obj_id);
+    ctx.singleton<SleepData>().resetBody(leaf_id.id);
+
+    return leaf_id;
+}
+
+void RigidBodyPhysicsSystem::unregisterEntity(Context &ctx,
+                                              broadphase::LeafID leaf_id,
+                                              ResponseType response_type)
+{
+    if (broadphase::isStaticLeaf(leaf_id, response_type)) {
+        ctx.singleton<broadphase::StaticBVH>().removeLeaf(leaf_id);
+    } else {
+        ctx.singleton<broadphase::BVH>().removeLeaf(leaf_id);
+
+        // The rest of a sleeping island may have been resting on this body,
+        // so wake it at the start of the next step. Until then the body
+        // keeps its place in the island, which matters if it is the root.
+        // Its ID isn't handed out again before the next updateTree(),
+        // which runs after wakeIslands, and registerEntity resets it.
+        SleepData &sleep = ctx.singleton<SleepData>();
+        if (sleep.bodies[leaf_id.id].asleep) {
+            sleep.bodies[leaf_id.id].wakeRequested = true;
+        } else {
+            sleep.resetBody(leaf_id.id);
+        }
+    }
+}
+
+void RigidBodyPhysicsSystem::markStaticBodiesModified(Context &ctx)
+{
+    ctx.singleton<broadphase::StaticBVH>().rebuildOnUpdate();
+}
+
+void RigidBodyPhysicsSystem::configureSleep(Context &ctx,
+                                            float energy_threshold,
+                                            float time_to_sleep)
+{
+    SleepData &sleep = ctx.singleton<SleepData>();
+    sleep.energyThreshold = energy_threshold;
+    sleep.timeToSleep = time_to_sleep;
+}
+
+void RigidBodyPhysicsSystem::configureSpeculativeContacts(
+    Context &ctx,
+    float motion_threshold)
+{
+    ctx.singleton<SolverData>().speculativeMotionThreshold = motion_threshold;
+}
+
+void RigidBodyPhysicsSystem::configureContactWarmStart(Context &ctx,
+                                                       bool enabled)
+{
+    ctx.singleton<SolverData>().warmStartContacts = enabled;
+}
+
+void RigidBodyPhysicsSystem::setCollisionFilter(
+    Context &ctx,
+    broadphase::LeafID leaf_id,
+    ResponseType response_type,
+    CollisionFilter filter)
+{
+    if (broadphase::isStaticLeaf(leaf_id, response_type)) {
+        ctx.singleton<broadphase::StaticBVH>().setLeafFilter(leaf_id, filter);
+    } else {
+        ctx.singleton<broadphase::BVH>().setLeafFilter(leaf_id, filter);
+    }
+}
+
+void RigidBodyPhysicsSystem::disableCollisions(Context &ctx,
+                                               Entity a,
+                                               Entity b)
+{
+    ctx.singleton<CollisionExclusions>().add(a, b);
+}
+
+void RigidBodyPhysicsSystem::enableCollisions(Context &ctx,
+                                              Entity a,
+                                              Entity b)
+{
+    ctx.singleton<CollisionExclusions>().remove(a, b);
+}
+
+void RigidBodyPhysicsSystem::wakeBody(Context &ctx,
+                                      broadphase::LeafID leaf_id)
+{
+    // Static bodies never sleep
+    if (leaf_id.isStatic) {
+        return;
+    }
+
+    ctx.singleton<SleepData>().bodies[leaf_id.id].wakeRequested = true;
+}
+
+bool RigidBodyPhysicsSystem::isBodyAsleep(Context &ctx,
+                                          broadphase::LeafID leaf_id)
+{
+    return !leaf_id.isStatic && ctx.singleton<SleepData>().isAsleep(leaf_id);
+}
+
+Entity RigidBodyPhysicsSystem::traceRay(Context &ctx,
+                                        math::Vector3 o,
+                                        math::Vector3 d,
+                                        float *out_hit_t,
+                                        math::Vector3 *out_hit_normal,
+                                        float t_max)
+{
+    // Trace the static tree first so its hit distance bounds the dynamic
+    // traversal
+    float static_hit_t;
+    Vector3 static_hit_normal;
+    Entity static_hit = ctx.singleton<broadphase::StaticBVH>().traceRay(
+        o, d, &static_hit_t, &static_hit_normal, t_max);
+
+    if (static_hit != Entity::none()) {
+        t_max = static_hit_t;
+    }
+
+    Entity dynamic_hit = ctx.singleton<broadphase::BVH>().traceRay(
+        o, d, out_hit_t, out_hit_normal, t_max);
+
+    if (dynamic_hit != Entity::none()) {
+        return dynamic_hit;
+    }
+
+    if (static_hit != Entity::none()) {
+        *out_hit_t = static_hit_t;
+        *out_hit_normal = static_hit_normal;
+    }
+
+    return static_hit;
+}
+
+void RigidBodyPhysicsSystem::traceRays(Context &ctx,
+                                       Span<const Ray> rays,
+                                       Span<RayHit> hits,
+                                       float t_max)
+{
+    if (hits.size() < rays.size()) {
+        FATAL("RigidBodyPhysicsSystem::traceRays: %ld hits for %ld rays",
+              (long)hits.size(), (long)rays.size());
+    }
+
+    for (CountT i = 0; i < rays.size(); i++) {
+        hits[i] = RayHit {
+            .entity = Entity::none(),
+            .t = t_max,
+            .normal = Vector3::zero(),
+        };
+    }
+
+    // Static hits bound the dynamic traversal, same as traceRay
+    ctx.singleton<broadphase::StaticBVH>().traceRays(rays, hits);
+    ctx.singleton<broadphase::BVH>().traceRays(rays, hits);
 }
 
 bool RigidBodyPhysicsSystem::checkEntityAABBOverlap(
@@ -1169,6 +3086,7 @@ void RigidBodyPhysicsSystem::registerTypes(ECSRegistry &registry)
 {
     registry.registerComponent<broadphase::LeafID>();
     registry.registerSingleton<broadphase::BVH>();
+    registry.registerSingleton<broadphase::StaticBVH>();
 
     registry.registerComponent<ExternalForce>();
     registry.registerComponent<ExternalTorque>();
@@ -1189,6 +3107,8 @@ void RigidBodyPhysicsSystem::registerTypes(ECSRegistry &registry)
     registry.registerArchetype<ConstraintData>();
 
     registry.registerSingleton<SolverData>();
+    registry.registerSingleton<SleepData>();
+    registry.registerSingleton<CollisionExclusions>();
     registry.registerSingleton<ObjectData>();
 
 }
@@ -1256,7 +3176,14 @@ TaskGraphNodeID RigidBodyPhysicsSystem::setupBroadphaseTasks(
     TaskGraphBuilder &builder,
     Span<const TaskGraphNodeID> deps)
 {
-    return broadphase::setupBVHTasks(builder, deps);
+    auto check_sleeping = builder.addToGraph<ParallelForNode<Context,
+        solver::checkSleepingBodies, broadphase::LeafID, ResponseType,
+        Velocity, ExternalForce, ExternalTorque>>(deps);
+
+    auto wake_islands = builder.addToGraph<ParallelForNode<Context,
+        solver::wakeIslands, SleepData>>({check_sleeping});
+
+    return broadphase::setupBVHTasks(builder, {wake_islands});
 }
 
 TaskGraphNodeID RigidBodyPhysicsSystem::setupSubstepTasks(
@@ -1277,22 +3204,52 @@ TaskGraphNodeID RigidBodyPhysicsSystem::setupSubstepTasks(
             solver::substepRigidBodies, Position, Rotation, Velocity, ObjectID,
             ResponseType, ExternalForce, ExternalTorque,
             solver::SubstepPrevState, solver::PreSolvePositional,
-            solver::PreSolveVelocity>>({cur_node});
+            solver::PreSolveVelocity, broadphase::LeafID>>({cur_node});
 
         auto run_narrowphase = narrowphase::setupTasks(builder, {rgb_update});
 
-        auto solve_pos = builder.addToGraph<ParallelForNode<Context,
-            solver::solvePositions, SolverData>>(
+        auto color_constraints = builder.addToGraph<ParallelForNode<Context,
+            solver::colorConstraints, SolverData>>(
                 {run_narrowphase, collect_constraints});
 
+#ifdef MADRONA_GPU_MODE
+        // FIXME: batches are only solved in parallel on the CPU backend,
+        // the GPU backend still solves each world on a single thread
+        auto warm_start = builder.addToGraph<ParallelForNode<Context,
+            solver::warmStartPositions, SolverData>>({color_constraints});
+
+        auto solve_pos = builder.addToGraph<ParallelForNode<Context,
+            solver::solvePositions, SolverData>>({warm_start});
+#else
+        auto warm_start = solver::addSolveBatchNodes<
+            solver::warmStartPositionsForItem,
+            solver::warmStartPositionsForLanes>(builder, color_constraints);
+
+        auto solve_pos = solver::addSolveBatchNodes<
+            solver::solvePositionsForItem, solver::solvePositionsForLanes>(
+                builder, warm_start);
+#endif
+
+        auto finish_pos = builder.addToGraph<ParallelForNode<Context,
+            solver::finishPositionSolve, SolverData>>({solve_pos});
+
         auto vel_set = builder.addToGraph<ParallelForNode<Context,
             solver::setVelocities, Position, Rotation,
-            solver::SubstepPrevState, Velocity>>({solve_pos});
+            solver::SubstepPrevState, Velocity>>({finish_pos});
 
+#ifdef MADRONA_GPU_MODE
         auto solve_vel = builder.addToGraph<ParallelForNode<Context,
             solver::solveVelocities, SolverData>>({vel_set});
+#else
+        auto solve_vel = solver::addSolveBatchNodes<
+            solver::solveVelocitiesForItem, solver::solveVelocitiesForLanes>(
+                builder, vel_set);
+#endif
+
+        auto finish_vel = builder.addToGraph<ParallelForNode<Context,
+            solver::finishVelocitySolve, SolverData>>({solve_vel});
 
-        cur_node = builder.addToGraph<ResetTmpAllocNode>({solve_vel});
+        cur_node = builder.addToGraph<ResetTmpAllocNode>({finish_vel});
 
 #if 0
         cur_node = builder.addToGraph<ParallelForNode<Context,
@@ -1303,8 +3260,19 @@ TaskGraphNodeID RigidBodyPhysicsSystem::setupSubstepTasks(
 #endif
     }
 
+    auto update_rest_time = builder.addToGraph<ParallelForNode<Context,
+        solver::updateRestTime, broadphase::LeafID, ResponseType, ObjectID,
+        Rotation, Velocity>>({cur_node});
+
+    auto update_islands = builder.addToGraph<ParallelForNode<Context,
+        solver::updateIslands, SleepData>>({update_rest_time});
+
+    auto clear_sleeping_velocities = builder.addToGraph<ParallelForNode<
+        Context, solver::clearSleepingVelocities, broadphase::LeafID,
+        ResponseType, Velocity>>({update_islands});
+
     auto clear_candidates = builder.addToGraph<
-        ClearTmpNode<CandidateTemporary>>({cur_node});
+        ClearTmpNode<CandidateTemporary>>({clear_sleeping_velocities});
 
     auto broadphase_post =
         broadphase::setupPostIntegrationTasks(builder, {clear_candidates});
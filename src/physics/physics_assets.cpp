@@ -5,6 +5,21 @@
 #include <madrona/cuda_utils.hpp>
 #endif
 
+#if defined(__linux__) or defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
 #include <unordered_map>
 
 namespace madrona::phys {
@@ -13,6 +28,7 @@ using namespace math;
 using SourceCollisionPrimitive = PhysicsLoader::SourceCollisionPrimitive;
 using SourceCollisionObject = PhysicsLoader::SourceCollisionObject;
 using ImportedRigidBodies = PhysicsLoader::ImportedRigidBodies;
+using HullSimplification = PhysicsLoader::HullSimplification;
 
 #ifndef MADRONA_CUDA_SUPPORT
 [[noreturn]] static void noCUDA()
@@ -935,6 +951,743 @@ static inline HalfEdgeMesh buildHalfEdgeMesh(
     };
 }
 
+namespace {
+
+struct SimplifyPlane {
+    Vector3 normal;
+    float area;
+    bool removed;
+};
+
+// Convex polytope stored as a list of polygons, used to rebuild a hull from
+// its bounding planes
+struct ClipPolytope {
+    DynArray<Vector3> vertices;
+    DynArray<uint32_t> faceCounts;
+    DynArray<Plane> facePlanes;
+    // Index of the bounding plane each face lies on. Faces left over from
+    // the initial box are 0xFFFF'FFFF.
+    DynArray<uint32_t> facePlaneIDs;
+};
+
+struct WeldedPolytope {
+    DynArray<Vector3> positions;
+    DynArray<uint32_t> indices;
+    DynArray<uint32_t> faceCounts;
+    DynArray<Plane> facePlanes;
+};
+
+}
+
+static ClipPolytope makeEmptyPolytope(CountT num_faces)
+{
+    return ClipPolytope {
+        .vertices = DynArray<Vector3>(num_faces * 4),
+        .faceCounts = DynArray<uint32_t>(num_faces),
+        .facePlanes = DynArray<Plane>(num_faces),
+        .facePlaneIDs = DynArray<uint32_t>(num_faces),
+    };
+}
+
+static ClipPolytope makeBoxPolytope(const AABB &aabb)
+{
+    ClipPolytope box = makeEmptyPolytope(6);
+
+    auto corner = [&aabb](uint32_t i) {
+        return Vector3 {
+            (i & 1) ? aabb.pMax.x : aabb.pMin.x,
+            (i & 2) ? aabb.pMax.y : aabb.pMin.y,
+            (i & 4) ? aabb.pMax.z : aabb.pMin.z,
+        };
+    };
+
+    // Counter clockwise when viewed from outside the box
+    constexpr uint32_t face_corners[6][4] = {
+        { 0, 4, 6, 2 },
+        { 1, 3, 7, 5 },
+        { 0, 1, 5, 4 },
+        { 2, 6, 7, 3 },
+        { 0, 2, 3, 1 },
+        { 4, 5, 7, 6 },
+    };
+
+    const Plane face_planes[6] = {
+        { Vector3 { -1, 0, 0 }, -aabb.pMin.x },
+        { Vector3 { 1, 0, 0 }, aabb.pMax.x },
+        { Vector3 { 0, -1, 0 }, -aabb.pMin.y },
+        { Vector3 { 0, 1, 0 }, aabb.pMax.y },
+        { Vector3 { 0, 0, -1 }, -aabb.pMin.z },
+        { Vector3 { 0, 0, 1 }, aabb.pMax.z },
+    };
+
+    for (CountT face_idx = 0; face_idx < 6; face_idx++) {
+        for (uint32_t corner_idx : face_corners[face_idx]) {
+            box.vertices.push_back(corner(corner_idx));
+        }
+
+        box.faceCounts.push_back(4);
+        box.facePlanes.push_back(face_planes[face_idx]);
+        box.facePlaneIDs.push_back(0xFFFF'FFFF);
+    }
+
+    return box;
+}
+
+// Keeps the part of poly behind plane and closes the cut with a new face on
+// the plane. Returns false, leaving out untouched, if no part of poly is in
+// front of the plane or the cut can't be closed.
+static bool clipPolytope(const ClipPolytope &poly,
+                         Plane plane,
+                         uint32_t plane_id,
+                         float epsilon,
+                         ClipPolytope *out)
+{
+    bool clips = false;
+    for (Vector3 v : poly.vertices) {
+        if (distToPlane(plane, v) > epsilon) {
+            clips = true;
+            break;
+        }
+    }
+
+    if (!clips) {
+        return false;
+    }
+
+    ClipPolytope clipped = makeEmptyPolytope(poly.faceCounts.size() + 1);
+
+    // Edges of the clipped faces that lie on the plane. The new face is made
+    // of these edges reversed, which keeps every edge paired with its twin.
+    DynArray<Vector3> cut_edges(32);
+
+    DynArray<bool> on_plane(16);
+
+    CountT face_offset = 0;
+    for (CountT face_idx = 0; face_idx < poly.faceCounts.size();
+         face_idx++) {
+        const CountT num_face_verts = poly.faceCounts[face_idx];
+        const Vector3 *face_verts = &poly.vertices[face_offset];
+        face_offset += num_face_verts;
+
+        const CountT out_offset = clipped.vertices.size();
+        on_plane.clear();
+
+        // Sutherland-Hodgman, see clipPolygon in narrowphase.cpp. Vertices
+        // within epsilon of the plane are kept as is rather than creating
+        // near duplicate intersection points.
+        Vector3 v1 = face_verts[num_face_verts - 1];
+        float d1 = distToPlane(plane, v1);
+        for (CountT i = 0; i < num_face_verts; i++) {
+            Vector3 v2 = face_verts[i];
+            float d2 = distToPlane(plane, v2);
+
+            if ((d1 > epsilon && d2 < -epsilon) ||
+                    (d1 < -epsilon && d2 > epsilon)) {
+                clipped.vertices.push_back(
+                    v1 + (d1 / (d1 - d2)) * (v2 - v1));
+                on_plane.push_back(true);
+            }
+
+            if (d2 <= epsilon) {
+                clipped.vertices.push_back(v2);
+                on_plane.push_back(d2 >= -epsilon);
+            }
+
+            v1 = v2;
+            d1 = d2;
+        }
+
+        const CountT num_out_verts = clipped.vertices.size() - out_offset;
+
+        bool all_on_plane = true;
+        for (bool v_on_plane : on_plane) {
+            all_on_plane = all_on_plane && v_on_plane;
+        }
+
+        // Faces clipped down to an edge or lying on the plane are replaced
+        // by the new face
+        if (num_out_verts < 3 || all_on_plane) {
+            while (clipped.vertices.size() > out_offset) {
+                clipped.vertices.pop_back();
+            }
+
+            continue;
+        }
+
+        for (CountT i = 0; i < num_out_verts; i++) {
+            CountT j = (i + 1) % num_out_verts;
+            if (on_plane[i] && on_plane[j]) {
+                cut_edges.push_back(clipped.vertices[out_offset + j]);
+                cut_edges.push_back(clipped.vertices[out_offset + i]);
+            }
+        }
+
+        clipped.faceCounts.push_back(uint32_t(num_out_verts));
+        clipped.facePlanes.push_back(poly.facePlanes[face_idx]);
+        clipped.facePlaneIDs.push_back(poly.facePlaneIDs[face_idx]);
+    }
+
+    // Chain the reversed cut edges into the new face
+    const CountT num_cut_edges = cut_edges.size() / 2;
+    if (num_cut_edges < 3) {
+        return false;
+    }
+
+    const CountT cap_offset = clipped.vertices.size();
+    CountT cur_edge = 0;
+    for (CountT i = 0; i < num_cut_edges; i++) {
+        clipped.vertices.push_back(cut_edges[2 * cur_edge]);
+
+        Vector3 edge_end = cut_edges[2 * cur_edge + 1];
+
+        CountT next_edge = -1;
+        for (CountT j = 0; j < num_cut_edges; j++) {
+            if ((cut_edges[2 * j] - edge_end).length2() <=
+                    epsilon * epsilon) {
+                next_edge = j;
+                break;
+            }
+        }
+
+        if (next_edge == -1) {
+            return false;
+        }
+
+        cur_edge = next_edge;
+    }
+
+    // The walk must come back to the start after visiting every edge once
+    if (cur_edge != 0) {
+        return false;
+    }
+
+    clipped.faceCounts.push_back(
+        uint32_t(clipped.vertices.size() - cap_offset));
+    clipped.facePlanes.push_back(plane);
+    clipped.facePlaneIDs.push_back(plane_id);
+
+    *out = std::move(clipped);
+
+    return true;
+}
+
+// Merges nearby polygon vertices into a shared vertex list. Returns none
+// if the welded polygons don't form a closed two manifold.
+static Optional<WeldedPolytope> weldPolytope(const ClipPolytope &poly,
+                                             float weld_epsilon)
+{
+    WeldedPolytope welded {
+        .positions = DynArray<Vector3>(poly.vertices.size()),
+        .indices = DynArray<uint32_t>(poly.vertices.size()),
+        .faceCounts = DynArray<uint32_t>(poly.faceCounts.size()),
+        .facePlanes = DynArray<Plane>(poly.faceCounts.size()),
+    };
+
+    auto findOrAddVert = [&welded, weld_epsilon](Vector3 v) {
+        for (CountT i = 0; i < welded.positions.size(); i++) {
+            if ((welded.positions[i] - v).length2() <=
+                    weld_epsilon * weld_epsilon) {
+                return uint32_t(i);
+            }
+        }
+
+        welded.positions.push_back(v);
+        return uint32_t(welded.positions.size() - 1);
+    };
+
+    CountT face_offset = 0;
+    for (CountT face_idx = 0; face_idx < poly.faceCounts.size();
+         face_idx++) {
+        const CountT num_face_verts = poly.faceCounts[face_idx];
+        const CountT out_offset = welded.indices.size();
+
+        for (CountT i = 0; i < num_face_verts; i++) {
+            uint32_t vert_idx =
+                findOrAddVert(poly.vertices[face_offset + i]);
+
+            if (welded.indices.size() == out_offset ||
+                    welded.indices.back() != vert_idx) {
+                welded.indices.push_back(vert_idx);
+            }
+        }
+        face_offset += num_face_verts;
+
+        while (welded.indices.size() - out_offset > 1 &&
+               welded.indices.back() == welded.indices[out_offset]) {
+            welded.indices.pop_back();
+        }
+
+        if (welded.indices.size() - out_offset < 3) {
+            while (welded.indices.size() > out_offset) {
+                welded.indices.pop_back();
+            }
+
+            continue;
+        }
+
+        welded.faceCounts.push_back(
+            uint32_t(welded.indices.size() - out_offset));
+        welded.facePlanes.push_back(poly.facePlanes[face_idx]);
+    }
+
+    // Every directed edge must appear exactly once, along with its twin
+    std::unordered_map<uint64_t, uint32_t> edge_counts;
+    auto makeEdgeID = [](uint32_t a_idx, uint32_t b_idx) {
+        return ((uint64_t)a_idx << 32) | (uint64_t)b_idx;
+    };
+
+    face_offset = 0;
+    for (uint32_t num_face_verts : welded.faceCounts) {
+        for (CountT i = 0; i < (CountT)num_face_verts; i++) {
+            uint32_t a_idx = welded.indices[face_offset + i];
+            uint32_t b_idx =
+                welded.indices[face_offset + (i + 1) % num_face_verts];
+
+            if (edge_counts[makeEdgeID(a_idx, b_idx)]++ != 0) {
+                return Optional<WeldedPolytope>::none();
+            }
+        }
+        face_offset += num_face_verts;
+    }
+
+    for (auto [edge_id, count] : edge_counts) {
+        uint64_t twin_id = (edge_id << 32) | (edge_id >> 32);
+        if (edge_counts.find(twin_id) == edge_counts.end()) {
+            return Optional<WeldedPolytope>::none();
+        }
+    }
+
+    if (welded.faceCounts.size() < 4) {
+        return Optional<WeldedPolytope>::none();
+    }
+
+    return Optional<WeldedPolytope>::make(std::move(welded));
+}
+
+// Distance from v to the closest point of the source hull, 0 inside it
+static float distanceToHull(const HalfEdgeMesh &src, Vector3 v)
+{
+    float max_plane_dist = -FLT_MAX;
+    for (CountT face_idx = 0; face_idx < (CountT)src.numFaces; face_idx++) {
+        max_plane_dist = fmaxf(max_plane_dist,
+                               distToPlane(src.facePlanes[face_idx], v));
+    }
+
+    if (max_plane_dist <= 0.f) {
+        return 0.f;
+    }
+
+    // The closest point is either inside a face or on one of its edges
+    float min_dist2 = FLT_MAX;
+    for (CountT face_idx = 0; face_idx < (CountT)src.numFaces; face_idx++) {
+        Plane plane = src.facePlanes[face_idx];
+        bool over_face = true;
+
+        uint32_t start_hedge = src.faceBaseHalfEdges[face_idx];
+        uint32_t cur_hedge = start_hedge;
+        do {
+            const HalfEdge &hedge = src.halfEdges[cur_hedge];
+            Vector3 a = src.vertices[hedge.rootVertex];
+            Vector3 b = src.vertices[src.halfEdges[hedge.next].rootVertex];
+            Vector3 ab = b - a;
+
+            if (dot(cross(ab, plane.normal), v - a) > 0.f) {
+                over_face = false;
+            }
+
+            float t = 0.f;
+            float ab_len2 = ab.length2();
+            if (ab_len2 > 0.f) {
+                t = std::clamp(dot(v - a, ab) / ab_len2, 0.f, 1.f);
+            }
+            min_dist2 = fminf(min_dist2, (a + t * ab - v).length2());
+
+            cur_hedge = hedge.next;
+        } while (cur_hedge != start_hedge);
+
+        if (over_face) {
+            float plane_dist = distToPlane(plane, v);
+            min_dist2 = fminf(min_dist2, plane_dist * plane_dist);
+        }
+    }
+
+    return sqrtf(min_dist2);
+}
+
+// How far verts extend beyond the source hull
+static float distanceOutsideHull(const HalfEdgeMesh &src,
+                                 const DynArray<Vector3> &verts)
+{
+    float max_dist = 0.f;
+    for (Vector3 v : verts) {
+        max_dist = fmaxf(max_dist, distanceToHull(src, v));
+    }
+
+    return max_dist;
+}
+
+// Finds the two planes with the smallest area weighted angle between them
+static std::pair<CountT, CountT> findClosestPlanes(
+    const DynArray<SimplifyPlane> &planes)
+{
+    float min_cost = FLT_MAX;
+    CountT min_i = 0, min_j = 1;
+    for (CountT i = 0; i < planes.size(); i++) {
+        for (CountT j = i + 1; j < planes.size(); j++) {
+            float cost = (1.f - dot(planes[i].normal, planes[j].normal)) *
+                fminf(planes[i].area, planes[j].area);
+
+            if (cost < min_cost) {
+                min_cost = cost;
+                min_i = i;
+                min_j = j;
+            }
+        }
+    }
+
+    return { min_i, min_j };
+}
+
+// Merges plane j into plane i
+static void mergePlanes(DynArray<SimplifyPlane> &planes, CountT i, CountT j)
+{
+    SimplifyPlane &a = planes[i];
+    const SimplifyPlane &b = planes[j];
+
+    Vector3 merged = a.area * a.normal + b.area * b.normal;
+    if (merged.length2() > 0.f) {
+        a.normal = normalize(merged);
+    }
+    a.area += b.area;
+
+    planes[j] = planes.back();
+    planes.pop_back();
+}
+
+// Rebuilds a hull from a reduced set of face planes, each pushed out to the
+// furthest source vertex so the source hull stays inside. Merging stops
+// short of the budgets rather than grow the hull by more than
+// maxMergeDistance. Returns src unchanged if it is already within budget or
+// the reduced planes don't produce a valid hull. Otherwise src is freed.
+static HalfEdgeMesh simplifyHull(HalfEdgeMesh src,
+                                 const HullSimplification &simplification)
+{
+    const uint32_t max_faces = simplification.maxFaces == 0 ?
+        0xFFFF'FFFF : std::max(simplification.maxFaces, 4_u32);
+    const uint32_t max_verts = simplification.maxVertices == 0 ?
+        0xFFFF'FFFF : std::max(simplification.maxVertices, 4_u32);
+
+    bool over_budget =
+        src.numFaces > max_faces || src.numVertices > max_verts;
+    if (!over_budget && simplification.mergeAngle <= 0.f &&
+            simplification.clusterDistance <= 0.f) {
+        return src;
+    }
+
+    Span<const Vector3> src_verts(src.vertices, src.numVertices);
+
+    AABB src_aabb = AABB::invalid();
+    for (Vector3 v : src_verts) {
+        src_aabb.expand(v);
+    }
+
+    Vector3 src_extent = src_aabb.pMax - src_aabb.pMin;
+    float max_extent = fmaxf(src_extent.x, fmaxf(src_extent.y, src_extent.z));
+
+    // Much larger than computePlaneEpsilon, since many nearly coincident
+    // planes meet at the vertices of finely tessellated hulls
+    const float epsilon =
+        1e-5f * (src_extent.x + src_extent.y + src_extent.z);
+
+    // Clipping starts from a box well outside the hull. Faces of this box
+    // only survive if the planes stop bounding the hull, in which case the
+    // result is rejected.
+    AABB clip_bounds = src_aabb;
+    clip_bounds.pMin -= Vector3 { max_extent, max_extent, max_extent };
+    clip_bounds.pMax += Vector3 { max_extent, max_extent, max_extent };
+
+    auto boundingPlane = [src_verts](Vector3 n) {
+        float d = -FLT_MAX;
+        for (Vector3 v : src_verts) {
+            d = fmaxf(d, dot(n, v));
+        }
+
+        return Plane { n, d };
+    };
+
+    DynArray<SimplifyPlane> planes(src.numFaces);
+    for (CountT face_idx = 0; face_idx < (CountT)src.numFaces; face_idx++) {
+        // Newell normal, whose length is twice the face area
+        Vector3 area_normal = Vector3::zero();
+        uint32_t start_hedge = src.faceBaseHalfEdges[face_idx];
+        uint32_t cur_hedge = start_hedge;
+        do {
+            const HalfEdge &hedge = src.halfEdges[cur_hedge];
+            Vector3 a = src.vertices[hedge.rootVertex];
+            Vector3 b = src.vertices[src.halfEdges[hedge.next].rootVertex];
+            area_normal += cross(a, b);
+
+            cur_hedge = hedge.next;
+        } while (cur_hedge != start_hedge);
+
+        planes.push_back({
+            .normal = src.facePlanes[face_idx].normal,
+            .area = 0.5f * area_normal.length(),
+            .removed = false,
+        });
+    }
+
+    if (simplification.mergeAngle > 0.f) {
+        const float merge_cos = cosf(simplification.mergeAngle);
+
+        std::sort(planes.begin(), planes.end(),
+                  [](const SimplifyPlane &a, const SimplifyPlane &b) {
+            return a.area > b.area;
+        });
+
+        DynArray<SimplifyPlane> merged(planes.size());
+        for (const SimplifyPlane &plane : planes) {
+            SimplifyPlane *merge_target = nullptr;
+            for (SimplifyPlane &candidate : merged) {
+                if (dot(candidate.normal, plane.normal) >= merge_cos) {
+                    merge_target = &candidate;
+                    break;
+                }
+            }
+
+            if (merge_target == nullptr) {
+                merged.push_back(plane);
+                continue;
+            }
+
+            Vector3 merged_normal = merge_target->area * merge_target->normal +
+                plane.area * plane.normal;
+            if (merged_normal.length2() > 0.f) {
+                merge_target->normal = normalize(merged_normal);
+            }
+            merge_target->area += plane.area;
+        }
+
+        planes = std::move(merged);
+    }
+
+    auto buildPolytope = [&]() {
+        ClipPolytope poly = makeBoxPolytope(clip_bounds);
+        ClipPolytope tmp = makeEmptyPolytope(0);
+
+        for (CountT i = 0; i < planes.size(); i++) {
+            if (planes[i].removed) {
+                continue;
+            }
+
+            if (clipPolytope(poly, boundingPlane(planes[i].normal),
+                             uint32_t(i), epsilon, &tmp)) {
+                std::swap(poly, tmp);
+            }
+        }
+
+        return poly;
+    };
+
+    auto isBounded = [](const ClipPolytope &poly) {
+        for (uint32_t plane_id : poly.facePlaneIDs) {
+            if (plane_id == 0xFFFF'FFFF) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    if (simplification.clusterDistance > 0.f) {
+        ClipPolytope poly = buildPolytope();
+
+        // Collapse faces smaller than the cluster distance, smallest first
+        DynArray<std::pair<float, uint32_t>> small_faces(
+            poly.faceCounts.size());
+
+        CountT face_offset = 0;
+        for (CountT face_idx = 0; face_idx < poly.faceCounts.size();
+             face_idx++) {
+            const CountT num_face_verts = poly.faceCounts[face_idx];
+            const Vector3 *face_verts = &poly.vertices[face_offset];
+            face_offset += num_face_verts;
+
+            float diameter2 = 0.f;
+            for (CountT i = 0; i < num_face_verts; i++) {
+                for (CountT j = i + 1; j < num_face_verts; j++) {
+                    diameter2 = fmaxf(diameter2,
+                        (face_verts[i] - face_verts[j]).length2());
+                }
+            }
+
+            uint32_t plane_id = poly.facePlaneIDs[face_idx];
+            if (plane_id != 0xFFFF'FFFF && diameter2 <
+                    simplification.clusterDistance *
+                    simplification.clusterDistance) {
+                small_faces.push_back({ diameter2, plane_id });
+            }
+        }
+
+        std::sort(small_faces.begin(), small_faces.end());
+
+        for (auto [diameter2, plane_id] : small_faces) {
+            planes[plane_id].removed = true;
+
+            ClipPolytope collapsed = buildPolytope();
+            if (!isBounded(collapsed) ||
+                    distanceOutsideHull(src, collapsed.vertices) >
+                    simplification.clusterDistance) {
+                planes[plane_id].removed = false;
+            }
+        }
+
+        CountT num_kept = 0;
+        for (CountT i = 0; i < planes.size(); i++) {
+            if (!planes[i].removed) {
+                planes[num_kept++] = planes[i];
+            }
+        }
+
+        while (planes.size() > num_kept) {
+            planes.pop_back();
+        }
+    }
+
+    auto rebuild = [&]() {
+        ClipPolytope poly = buildPolytope();
+        if (!isBounded(poly)) {
+            return Optional<WeldedPolytope>::none();
+        }
+
+        return weldPolytope(poly, epsilon);
+    };
+
+    // Merged planes are pushed out to the furthest source vertex, which for
+    // coarse budgets on round hulls can grow the hull a lot
+    const float max_merge_distance = max_extent *
+        (simplification.maxMergeDistance > 0.f ?
+            simplification.maxMergeDistance : 0.1f);
+
+    DynArray<SimplifyPlane> unmerged_planes(planes.size());
+    for (const SimplifyPlane &plane : planes) {
+        unmerged_planes.push_back(plane);
+    }
+
+    // Merging planes in bulk is much cheaper than rebuilding the hull after
+    // every merge. The greedy merge order only depends on the planes, so it
+    // is recorded as far as it has been needed and replayed to merge down
+    // to any number of planes.
+    DynArray<std::pair<CountT, CountT>> merge_order(unmerged_planes.size());
+    DynArray<SimplifyPlane> most_merged(unmerged_planes.size());
+    for (const SimplifyPlane &plane : unmerged_planes) {
+        most_merged.push_back(plane);
+    }
+
+    // Returns none if the merged planes don't produce a valid hull or grow
+    // it by more than max_merge_distance
+    auto mergeTo = [&](CountT target_num_planes) {
+        target_num_planes = std::max(target_num_planes, CountT(4));
+        CountT num_merges = unmerged_planes.size() > target_num_planes ?
+            unmerged_planes.size() - target_num_planes : 0;
+
+        while (merge_order.size() < num_merges) {
+            auto [i, j] = findClosestPlanes(most_merged);
+            mergePlanes(most_merged, i, j);
+            merge_order.push_back({ i, j });
+        }
+
+        planes.clear();
+        for (const SimplifyPlane &plane : unmerged_planes) {
+            planes.push_back(plane);
+        }
+
+        for (CountT merge_idx = 0; merge_idx < num_merges; merge_idx++) {
+            auto [i, j] = merge_order[merge_idx];
+            mergePlanes(planes, i, j);
+        }
+
+        Optional<WeldedPolytope> welded = rebuild();
+        if (welded.has_value() && num_merges > 0 &&
+                distanceOutsideHull(src, welded->positions) >
+                max_merge_distance) {
+            return Optional<WeldedPolytope>::none();
+        }
+
+        return welded;
+    };
+
+    Optional<WeldedPolytope> result = Optional<WeldedPolytope>::none();
+
+    // Given that num_planes produced result and max_failed_num_planes
+    // didn't, finds the fewest planes in between that still work
+    auto bisectNumPlanes = [&](CountT max_failed_num_planes,
+                               CountT num_planes) {
+        while (num_planes - max_failed_num_planes > 1) {
+            CountT mid_num_planes = (max_failed_num_planes + num_planes) / 2;
+
+            Optional<WeldedPolytope> welded = mergeTo(mid_num_planes);
+            if (welded.has_value()) {
+                result.emplace(std::move(*welded));
+                num_planes = mid_num_planes;
+            } else {
+                max_failed_num_planes = mid_num_planes;
+            }
+        }
+
+        return num_planes;
+    };
+
+    // First merge straight down to the face budget, retrying from more
+    // planes while merging fails. Doubling can overshoot, so then bisect
+    // back towards the budget.
+    CountT num_planes = std::min((CountT)max_faces, unmerged_planes.size());
+    CountT max_failed_num_planes = num_planes - 1;
+    while (true) {
+        Optional<WeldedPolytope> welded = mergeTo(num_planes);
+        if (welded.has_value()) {
+            result.emplace(std::move(*welded));
+            break;
+        }
+
+        if (num_planes >= unmerged_planes.size()) {
+            return src;
+        }
+
+        max_failed_num_planes = num_planes;
+        num_planes = std::min(num_planes * 2, unmerged_planes.size());
+    }
+
+    num_planes = bisectNumPlanes(max_failed_num_planes, num_planes);
+
+    // Then keep merging until the vertex budget is met. Simple polytopes
+    // have about 2F - 4 vertices, which gives the first target.
+    while (result->positions.size() > (CountT)max_verts && num_planes > 4) {
+        CountT vert_budget_num_planes =
+            std::max(((CountT)max_verts + 4) / 2, CountT(4));
+        CountT target_num_planes =
+            std::min(num_planes - 1, vert_budget_num_planes);
+
+        Optional<WeldedPolytope> welded = mergeTo(target_num_planes);
+        if (!welded.has_value()) {
+            bisectNumPlanes(target_num_planes, num_planes);
+            break;
+        }
+
+        result.emplace(std::move(*welded));
+        num_planes = target_num_planes;
+    }
+
+    HalfEdgeMesh simplified = buildHalfEdgeMesh(
+        result->positions.data(), result->positions.size(),
+        result->indices.data(), result->faceCounts.data(),
+        result->facePlanes.data(), result->faceCounts.size());
+
+    freeHalfEdgeMesh(src);
+
+    return simplified;
+}
+
 namespace {
 struct MassProperties {
     Diag3x3 inertiaTensor;
@@ -1324,7 +2077,8 @@ static bool setupHullPrimitive(const SourceCollisionPrimitive &src_prim,
                                CountT *total_num_halfedges,
                                CountT *total_num_faces,
                                CountT *total_num_vertices,
-                               bool build_hull)
+                               bool build_hull,
+                               const HullSimplification &simplification)
 {
     const imp::SourceMesh *src_mesh = src_prim.hullInput.mesh;
 
@@ -1367,12 +2121,15 @@ static bool setupHullPrimitive(const SourceCollisionPrimitive &src_prim,
         freeBuildData(hull_data);
     }
 
+    final_he_mesh = simplifyHull(final_he_mesh, simplification);
+
     out_prim->hull.halfEdgeMesh = final_he_mesh;
 
-    AABB mesh_aabb = AABB::point(src_mesh->positions[0]);
-    for (CountT vert_idx = 1; vert_idx < (CountT)src_mesh->numVertices;
+    // Simplification can grow the hull beyond the source mesh
+    AABB mesh_aabb = AABB::point(final_he_mesh.vertices[0]);
+    for (CountT vert_idx = 1; vert_idx < (CountT)final_he_mesh.numVertices;
          vert_idx++) {
-        mesh_aabb.expand(src_mesh->positions[vert_idx]);
+        mesh_aabb.expand(final_he_mesh.vertices[vert_idx]);
     }
     *out_aabb = mesh_aabb;
 
@@ -1386,7 +2143,8 @@ static bool setupHullPrimitive(const SourceCollisionPrimitive &src_prim,
 Optional<PhysicsLoader::ImportedRigidBodies> PhysicsLoader::importRigidBodyData(
     const SourceCollisionObject *collision_objs,
     CountT num_objects,
-    bool build_hulls)
+    bool build_hulls,
+    const HullSimplification &hull_simplification)
 {
     using namespace math;
     using Type = CollisionPrimitive::Type;
@@ -1435,7 +2193,7 @@ Optional<PhysicsLoader::ImportedRigidBodies> PhysicsLoader::importRigidBodyData(
             case Type::Hull: {
                 bool valid_hull = setupHullPrimitive(src_prim, out_prim,
                     &prim_aabb, &total_num_halfedges, &total_num_faces,
-                    &total_num_vertices, build_hulls);
+                    &total_num_vertices, build_hulls, hull_simplification);
 
                 // FIXME: error reporting
                 if (!valid_hull) {
@@ -1510,6 +2268,526 @@ Optional<PhysicsLoader::ImportedRigidBodies> PhysicsLoader::importRigidBodyData(
     };
 }
 
+namespace {
+
+// Cooked blob layout: CookedHeader followed by one array per
+// CookedArray, each starting at a cookedAlignment boundary. Bump
+// cookedVersion whenever the layout of any serialized type changes.
+constexpr uint32_t cookedMagic = 0x5948504d; // "MPHY"
+constexpr uint32_t cookedVersion = 1;
+constexpr int64_t cookedAlignment = 64;
+
+enum CookedArray : uint32_t {
+    CookedMetadatas,
+    CookedObjectAABBs,
+    CookedPrimOffsets,
+    CookedPrimCounts,
+    CookedPrimitives,
+    CookedPrimitiveAABBs,
+    CookedHalfEdges,
+    CookedFaceBaseHEs,
+    CookedFacePlanes,
+    CookedPositions,
+    NumCookedArrays,
+};
+
+struct CookedHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t numBytes;
+    uint32_t primitiveSize;
+    uint32_t metadataSize;
+    uint32_t numObjects;
+    uint32_t numPrimitives;
+    uint32_t numHalfEdges;
+    uint32_t numFaces;
+    uint32_t numVertices;
+    uint64_t arrayOffsets[NumCookedArrays];
+};
+
+// FNV-1a
+struct SourceHasher {
+    uint64_t hash = 0xcbf2'9ce4'8422'2325;
+
+    void addBytes(const void *data, size_t num_bytes)
+    {
+        const uint8_t *bytes = (const uint8_t *)data;
+        for (size_t i = 0; i < num_bytes; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100'0000'01b3;
+        }
+    }
+
+    template <typename T>
+    void add(const T &v)
+    {
+        addBytes(&v, sizeof(T));
+    }
+};
+
+struct MappedFile {
+    const void *data;
+    CountT numBytes;
+};
+
+}
+
+template <typename T>
+static T * encodeCookedOffset(CountT offset)
+{
+    return (T *)(uintptr_t)offset;
+}
+
+template <typename T>
+static CountT decodeCookedOffset(const T *ptr)
+{
+    return (CountT)(uintptr_t)ptr;
+}
+
+template <typename T>
+static const T * cookedArray(const void *blob, const CookedHeader &header,
+                             CookedArray arr)
+{
+    return (const T *)((const char *)blob + header.arrayOffsets[arr]);
+}
+
+// The array bounds are checked against the header before this. Everything
+// loadObjects indexes with is checked here: object primitive ranges,
+// primitive types, each hull's ranges in the merged hull arrays and the
+// hull local indices stored in its half edges, so a corrupted blob is
+// rejected instead of read out of bounds.
+static bool validateCookedContents(const void *blob,
+                                   const CookedHeader &header)
+{
+    using Type = CollisionPrimitive::Type;
+
+    const uint32_t *prim_offsets =
+        cookedArray<uint32_t>(blob, header, CookedPrimOffsets);
+    const uint32_t *prim_counts =
+        cookedArray<uint32_t>(blob, header, CookedPrimCounts);
+
+    for (CountT i = 0; i < (CountT)header.numObjects; i++) {
+        if ((uint64_t)prim_offsets[i] + prim_counts[i] >
+                header.numPrimitives) {
+            return false;
+        }
+    }
+
+    const CollisionPrimitive *prims =
+        cookedArray<CollisionPrimitive>(blob, header, CookedPrimitives);
+    const HalfEdge *all_hedges =
+        cookedArray<HalfEdge>(blob, header, CookedHalfEdges);
+    const uint32_t *all_face_base_hes =
+        cookedArray<uint32_t>(blob, header, CookedFaceBaseHEs);
+
+    auto rangeInBounds = [](CountT offset, uint32_t count, uint32_t total) {
+        return offset >= 0 && (uint64_t)offset + count <= total;
+    };
+
+    for (CountT i = 0; i < (CountT)header.numPrimitives; i++) {
+        const CollisionPrimitive &prim = prims[i];
+
+        switch (prim.type) {
+        case Type::Sphere:
+        case Type::Plane: {
+        } break;
+        case Type::Hull: {
+            const HalfEdgeMesh &he_mesh = prim.hull.halfEdgeMesh;
+            CountT hedge_offset = decodeCookedOffset(he_mesh.halfEdges);
+            CountT face_offset = decodeCookedOffset(he_mesh.facePlanes);
+            CountT vert_offset = decodeCookedOffset(he_mesh.vertices);
+
+            // Half edges are stored in twin pairs
+            if (he_mesh.numHalfEdges % 2 != 0 ||
+                    decodeCookedOffset(he_mesh.faceBaseHalfEdges) !=
+                        face_offset ||
+                    !rangeInBounds(hedge_offset, he_mesh.numHalfEdges,
+                                   header.numHalfEdges) ||
+                    !rangeInBounds(face_offset, he_mesh.numFaces,
+                                   header.numFaces) ||
+                    !rangeInBounds(vert_offset, he_mesh.numVertices,
+                                   header.numVertices)) {
+                return false;
+            }
+
+            const HalfEdge *hedges = all_hedges + hedge_offset;
+            for (CountT j = 0; j < (CountT)he_mesh.numHalfEdges; j++) {
+                const HalfEdge &hedge = hedges[j];
+                if (hedge.next >= he_mesh.numHalfEdges ||
+                        hedge.rootVertex >= he_mesh.numVertices ||
+                        hedge.face >= he_mesh.numFaces) {
+                    return false;
+                }
+            }
+
+            const uint32_t *face_base_hes = all_face_base_hes + face_offset;
+            for (CountT j = 0; j < (CountT)he_mesh.numFaces; j++) {
+                if (face_base_hes[j] >= he_mesh.numHalfEdges) {
+                    return false;
+                }
+            }
+        } break;
+        default: {
+            return false;
+        } break;
+        }
+    }
+
+    return true;
+}
+
+static Optional<MappedFile> mapCookedFile(const char *path)
+{
+#if defined(__linux__) or defined(__APPLE__)
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return Optional<MappedFile>::none();
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return Optional<MappedFile>::none();
+    }
+
+    void *data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE,
+                      fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return Optional<MappedFile>::none();
+    }
+
+    return MappedFile {
+        .data = data,
+        .numBytes = (CountT)file_stat.st_size,
+    };
+#elif defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return Optional<MappedFile>::none();
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return Optional<MappedFile>::none();
+    }
+
+    HANDLE mapping =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return Optional<MappedFile>::none();
+    }
+
+    // The view keeps the mapping alive
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == nullptr) {
+        return Optional<MappedFile>::none();
+    }
+
+    return MappedFile {
+        .data = data,
+        .numBytes = (CountT)file_size.QuadPart,
+    };
+#else
+    STATIC_UNIMPLEMENTED();
+#endif
+}
+
+static uint64_t currentProcessID()
+{
+#if defined(__linux__) or defined(__APPLE__)
+    return (uint64_t)getpid();
+#elif defined(_WIN32)
+    return (uint64_t)GetCurrentProcessId();
+#else
+    STATIC_UNIMPLEMENTED();
+#endif
+}
+
+static void unmapCookedFile(const MappedFile &mapped)
+{
+#if defined(__linux__) or defined(__APPLE__)
+    munmap((void *)mapped.data, mapped.numBytes);
+#elif defined(_WIN32)
+    UnmapViewOfFile(mapped.data);
+#else
+    STATIC_UNIMPLEMENTED();
+#endif
+}
+
+uint64_t PhysicsLoader::hashSourceObjects(
+    const SourceCollisionObject *collision_objs,
+    CountT num_objects,
+    bool build_hulls,
+    const HullSimplification &hull_simplification)
+{
+    using Type = CollisionPrimitive::Type;
+
+    SourceHasher hasher;
+    hasher.add(num_objects);
+    hasher.add(build_hulls);
+    hasher.add(hull_simplification.maxFaces);
+    hasher.add(hull_simplification.maxVertices);
+    hasher.add(hull_simplification.mergeAngle);
+    hasher.add(hull_simplification.clusterDistance);
+    hasher.add(hull_simplification.maxMergeDistance);
+
+    for (CountT obj_idx = 0; obj_idx < num_objects; obj_idx++) {
+        const SourceCollisionObject &collision_obj = collision_objs[obj_idx];
+
+        hasher.add(collision_obj.invMass);
+        hasher.add(collision_obj.friction.muS);
+        hasher.add(collision_obj.friction.muD);
+        hasher.add(collision_obj.prims.size());
+
+        for (const SourceCollisionPrimitive &src_prim : collision_obj.prims) {
+            hasher.add(src_prim.type);
+
+            switch (src_prim.type) {
+            case Type::Sphere: {
+                hasher.add(src_prim.sphere.radius);
+            } break;
+            case Type::Plane: {
+            } break;
+            case Type::Hull: {
+                const imp::SourceMesh *mesh = src_prim.hullInput.mesh;
+
+                hasher.add(mesh->numVertices);
+                hasher.add(mesh->numFaces);
+                hasher.addBytes(mesh->positions,
+                                sizeof(Vector3) * mesh->numVertices);
+
+                CountT num_indices;
+                if (mesh->faceCounts) {
+                    hasher.addBytes(mesh->faceCounts,
+                                    sizeof(uint32_t) * mesh->numFaces);
+
+                    num_indices = 0;
+                    for (CountT i = 0; i < (CountT)mesh->numFaces; i++) {
+                        num_indices += mesh->faceCounts[i];
+                    }
+                } else {
+                    num_indices = (CountT)mesh->numFaces * 3;
+                }
+
+                if (mesh->indices) {
+                    hasher.addBytes(mesh->indices,
+                                    sizeof(uint32_t) * num_indices);
+                }
+            } break;
+            }
+        }
+    }
+
+    return hasher.hash;
+}
+
+HeapArray<char> PhysicsLoader::cookRigidBodies(
+    const ImportedRigidBodies &imported,
+    uint64_t source_hash)
+{
+    const auto &hull_data = imported.hullData;
+
+    int64_t chunk_sizes[NumCookedArrays + 1] = {
+        (int64_t)sizeof(CookedHeader),
+        (int64_t)sizeof(RigidBodyMetadata) * imported.metadatas.size(),
+        (int64_t)sizeof(AABB) * imported.objectAABBs.size(),
+        (int64_t)sizeof(uint32_t) * imported.primOffsets.size(),
+        (int64_t)sizeof(uint32_t) * imported.primCounts.size(),
+        (int64_t)sizeof(CollisionPrimitive) *
+            imported.collisionPrimitives.size(),
+        (int64_t)sizeof(AABB) * imported.primitiveAABBs.size(),
+        (int64_t)sizeof(HalfEdge) * hull_data.halfEdges.size(),
+        (int64_t)sizeof(uint32_t) * hull_data.faceBaseHEs.size(),
+        (int64_t)sizeof(Plane) * hull_data.facePlanes.size(),
+        (int64_t)sizeof(Vector3) * hull_data.positions.size(),
+    };
+
+    int64_t array_offsets[NumCookedArrays];
+    int64_t num_bytes = utils::computeBufferOffsets(
+        chunk_sizes, array_offsets, cookedAlignment);
+
+    // Zero everything so padding is deterministic
+    HeapArray<char> blob(num_bytes);
+    memset(blob.data(), 0, num_bytes);
+
+    CookedHeader header {};
+    header.magic = cookedMagic;
+    header.version = cookedVersion;
+    header.sourceHash = source_hash;
+    header.numBytes = (uint64_t)num_bytes;
+    header.primitiveSize = sizeof(CollisionPrimitive);
+    header.metadataSize = sizeof(RigidBodyMetadata);
+    header.numObjects = (uint32_t)imported.metadatas.size();
+    header.numPrimitives = (uint32_t)imported.collisionPrimitives.size();
+    header.numHalfEdges = (uint32_t)hull_data.halfEdges.size();
+    header.numFaces = (uint32_t)hull_data.facePlanes.size();
+    header.numVertices = (uint32_t)hull_data.positions.size();
+    for (CountT i = 0; i < NumCookedArrays; i++) {
+        header.arrayOffsets[i] = (uint64_t)array_offsets[i];
+    }
+    memcpy(blob.data(), &header, sizeof(CookedHeader));
+
+    auto copyArray = [&](CookedArray arr, const auto &src) {
+        if (src.size() == 0) {
+            return;
+        }
+
+        memcpy(blob.data() + array_offsets[arr], src.data(),
+               sizeof(src[0]) * src.size());
+    };
+
+    copyArray(CookedMetadatas, imported.metadatas);
+    copyArray(CookedObjectAABBs, imported.objectAABBs);
+    copyArray(CookedPrimOffsets, imported.primOffsets);
+    copyArray(CookedPrimCounts, imported.primCounts);
+    copyArray(CookedPrimitives, imported.collisionPrimitives);
+    copyArray(CookedPrimitiveAABBs, imported.primitiveAABBs);
+    copyArray(CookedHalfEdges, hull_data.halfEdges);
+    copyArray(CookedFaceBaseHEs, hull_data.faceBaseHEs);
+    copyArray(CookedFacePlanes, hull_data.facePlanes);
+    copyArray(CookedPositions, hull_data.positions);
+
+    // Make the blob relocatable: hull pointers become offsets into the
+    // merged hull arrays.
+    auto prims_out = (CollisionPrimitive *)(
+        blob.data() + array_offsets[CookedPrimitives]);
+    for (CountT i = 0; i < header.numPrimitives; i++) {
+        CollisionPrimitive &cur_prim = prims_out[i];
+        if (cur_prim.type != CollisionPrimitive::Type::Hull) continue;
+
+        HalfEdgeMesh &he_mesh = cur_prim.hull.halfEdgeMesh;
+        CountT hedge_offset = he_mesh.halfEdges - hull_data.halfEdges.data();
+        CountT face_offset = he_mesh.facePlanes - hull_data.facePlanes.data();
+        CountT vert_offset = he_mesh.vertices - hull_data.positions.data();
+
+        he_mesh.halfEdges = encodeCookedOffset<HalfEdge>(hedge_offset);
+        he_mesh.faceBaseHalfEdges = encodeCookedOffset<uint32_t>(face_offset);
+        he_mesh.facePlanes = encodeCookedOffset<Plane>(face_offset);
+        he_mesh.vertices = encodeCookedOffset<Vector3>(vert_offset);
+    }
+
+    return blob;
+}
+
+static bool writeCookedBlob(const char *path, const HeapArray<char> &blob)
+{
+    // Write to a temporary file and rename over path, so concurrently
+    // starting processes never map a partially written blob. The temporary
+    // name is unique per writer so concurrent cookers don't write into
+    // each other's file.
+    std::string tmp_path = std::string(path) + ".tmp." +
+        std::to_string(currentProcessID()) + "." +
+        std::to_string(std::random_device()());
+
+    std::error_code err;
+    {
+        std::ofstream cooked_file(tmp_path,
+                                  std::ios::binary | std::ios::trunc);
+        if (!cooked_file.is_open()) {
+            return false;
+        }
+
+        cooked_file.write(blob.data(), blob.size());
+        cooked_file.close();
+        if (cooked_file.fail()) {
+            std::filesystem::remove(tmp_path, err);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tmp_path, path, err);
+    if (err) {
+        std::error_code remove_err;
+        std::filesystem::remove(tmp_path, remove_err);
+        return false;
+    }
+
+    return true;
+}
+
+bool PhysicsLoader::writeCookedRigidBodies(
+    const char *path,
+    const ImportedRigidBodies &imported,
+    uint64_t source_hash)
+{
+    return writeCookedBlob(path, cookRigidBodies(imported, source_hash));
+}
+
+Optional<PhysicsLoader::CookedRigidBodies>
+    PhysicsLoader::readCookedRigidBodies(
+        const void *blob,
+        CountT num_bytes,
+        uint64_t source_hash)
+{
+    if (num_bytes < (CountT)sizeof(CookedHeader) ||
+            (uintptr_t)blob % alignof(CollisionPrimitive) != 0) {
+        return Optional<CookedRigidBodies>::none();
+    }
+
+    CookedHeader header;
+    memcpy(&header, blob, sizeof(CookedHeader));
+
+    if (header.magic != cookedMagic ||
+            header.version != cookedVersion ||
+            header.primitiveSize != sizeof(CollisionPrimitive) ||
+            header.metadataSize != sizeof(RigidBodyMetadata) ||
+            header.sourceHash != source_hash ||
+            header.numBytes != (uint64_t)num_bytes) {
+        return Optional<CookedRigidBodies>::none();
+    }
+
+    uint64_t array_sizes[NumCookedArrays] = {
+        sizeof(RigidBodyMetadata) * header.numObjects,
+        sizeof(AABB) * header.numObjects,
+        sizeof(uint32_t) * header.numObjects,
+        sizeof(uint32_t) * header.numObjects,
+        sizeof(CollisionPrimitive) * header.numPrimitives,
+        sizeof(AABB) * header.numPrimitives,
+        sizeof(HalfEdge) * header.numHalfEdges,
+        sizeof(uint32_t) * header.numFaces,
+        sizeof(Plane) * header.numFaces,
+        sizeof(Vector3) * header.numVertices,
+    };
+
+    for (CountT i = 0; i < NumCookedArrays; i++) {
+        uint64_t offset = header.arrayOffsets[i];
+        if (offset % cookedAlignment != 0 || offset > header.numBytes ||
+                array_sizes[i] > header.numBytes - offset) {
+            return Optional<CookedRigidBodies>::none();
+        }
+    }
+
+    if (!validateCookedContents(blob, header)) {
+        return Optional<CookedRigidBodies>::none();
+    }
+
+    return CookedRigidBodies {
+        .metadatas = cookedArray<RigidBodyMetadata>(blob, header, CookedMetadatas),
+        .objectAABBs = cookedArray<AABB>(blob, header, CookedObjectAABBs),
+        .primOffsets = cookedArray<uint32_t>(blob, header, CookedPrimOffsets),
+        .primCounts = cookedArray<uint32_t>(blob, header, CookedPrimCounts),
+        .numObjects = header.numObjects,
+        .collisionPrimitives =
+            cookedArray<CollisionPrimitive>(blob, header, CookedPrimitives),
+        .primitiveAABBs = cookedArray<AABB>(blob, header, CookedPrimitiveAABBs),
+        .numPrimitives = header.numPrimitives,
+        .halfEdges = cookedArray<HalfEdge>(blob, header, CookedHalfEdges),
+        .numHalfEdges = header.numHalfEdges,
+        .faceBaseHEs = cookedArray<uint32_t>(blob, header, CookedFaceBaseHEs),
+        .facePlanes = cookedArray<Plane>(blob, header, CookedFacePlanes),
+        .numFaces = header.numFaces,
+        .positions = cookedArray<Vector3>(blob, header, CookedPositions),
+        .numVertices = header.numVertices,
+    };
+}
+
 CountT PhysicsLoader::loadObjects(
     const RigidBodyMetadata *metadatas,
     const math::AABB *obj_aabbs,
@@ -1526,6 +2804,41 @@ CountT PhysicsLoader::loadObjects(
     CountT total_num_hull_faces,
     const math::Vector3 *hull_verts_in,
     CountT total_num_hull_verts)
+{
+    return loadObjectsImpl(metadatas, obj_aabbs, prim_offsets, prim_counts,
+        num_objs, primitives_in, primitive_aabbs, total_num_primitives,
+        hull_halfedges_in, total_num_hull_halfedges,
+        hull_face_base_halfedges_in, hull_face_planes_in,
+        total_num_hull_faces, hull_verts_in, total_num_hull_verts, false);
+}
+
+CountT PhysicsLoader::loadObjects(const CookedRigidBodies &cooked)
+{
+    return loadObjectsImpl(cooked.metadatas, cooked.objectAABBs,
+        cooked.primOffsets, cooked.primCounts, cooked.numObjects,
+        cooked.collisionPrimitives, cooked.primitiveAABBs,
+        cooked.numPrimitives, cooked.halfEdges, cooked.numHalfEdges,
+        cooked.faceBaseHEs, cooked.facePlanes, cooked.numFaces,
+        cooked.positions, cooked.numVertices, true);
+}
+
+CountT PhysicsLoader::loadObjectsImpl(
+    const RigidBodyMetadata *metadatas,
+    const math::AABB *obj_aabbs,
+    const uint32_t *prim_offsets,
+    const uint32_t *prim_counts,
+    CountT num_objs,
+    const CollisionPrimitive *primitives_in,
+    const math::AABB *primitive_aabbs,
+    CountT total_num_primitives,
+    const geometry::HalfEdge *hull_halfedges_in,
+    CountT total_num_hull_halfedges,
+    const uint32_t *hull_face_base_halfedges_in,
+    const geometry::Plane *hull_face_planes_in,
+    CountT total_num_hull_faces,
+    const math::Vector3 *hull_verts_in,
+    CountT total_num_hull_verts,
+    bool hull_ptrs_are_offsets)
 {
     CountT cur_obj_offset = impl_->curObjOffset;
     impl_->curObjOffset += num_objs;
@@ -1643,10 +2956,17 @@ CountT PhysicsLoader::loadObjects(
 
         HalfEdgeMesh &he_mesh = cur_primitive.hull.halfEdgeMesh;
 
-        // FIXME: incoming HalfEdgeMeshes should have offsets or something
-        CountT hedge_offset = he_mesh.halfEdges - hull_halfedges_in;
-        CountT face_offset = he_mesh.facePlanes - hull_face_planes_in;
-        CountT vert_offset = he_mesh.vertices - hull_verts_in;
+        CountT hedge_offset, face_offset, vert_offset;
+        if (hull_ptrs_are_offsets) {
+            hedge_offset = decodeCookedOffset(he_mesh.halfEdges);
+            face_offset = decodeCookedOffset(he_mesh.facePlanes);
+            vert_offset = decodeCookedOffset(he_mesh.vertices);
+        } else {
+            // FIXME: incoming HalfEdgeMeshes should have offsets or something
+            hedge_offset = he_mesh.halfEdges - hull_halfedges_in;
+            face_offset = he_mesh.facePlanes - hull_face_planes_in;
+            vert_offset = he_mesh.vertices - hull_verts_in;
+        }
 
         he_mesh.halfEdges = hull_halfedges + hedge_offset;
         he_mesh.faceBaseHalfEdges = hull_face_base_halfedges + face_offset;
@@ -1674,6 +2994,63 @@ CountT PhysicsLoader::loadObjects(
     return cur_obj_offset;
 }
 
+Optional<CountT> PhysicsLoader::loadCookedObjects(const char *path,
+                                                  uint64_t source_hash)
+{
+    Optional<MappedFile> mapped = mapCookedFile(path);
+    if (!mapped.has_value()) {
+        return Optional<CountT>::none();
+    }
+
+    Optional<CookedRigidBodies> cooked = readCookedRigidBodies(
+        mapped->data, mapped->numBytes, source_hash);
+    if (!cooked.has_value()) {
+        unmapCookedFile(*mapped);
+        return Optional<CountT>::none();
+    }
+
+    // loadObjects copies everything out of the mapping
+    CountT obj_offset = loadObjects(*cooked);
+    unmapCookedFile(*mapped);
+
+    return obj_offset;
+}
+
+Optional<CountT> PhysicsLoader::loadOrCookObjects(
+    const char *path,
+    const SourceCollisionObject *collision_objs,
+    CountT num_objects,
+    bool build_hulls,
+    const HullSimplification &hull_simplification)
+{
+    uint64_t source_hash = hashSourceObjects(collision_objs, num_objects,
+        build_hulls, hull_simplification);
+
+    Optional<CountT> cached = loadCookedObjects(path, source_hash);
+    if (cached.has_value()) {
+        return cached;
+    }
+
+    Optional<ImportedRigidBodies> imported = importRigidBodyData(
+        collision_objs, num_objects, build_hulls, hull_simplification);
+    if (!imported.has_value()) {
+        return Optional<CountT>::none();
+    }
+
+    // Load through the cooked blob so cache hits and misses take the same
+    // path. Failing to write the cache only costs a cook next time.
+    HeapArray<char> blob = cookRigidBodies(*imported, source_hash);
+    writeCookedBlob(path, blob);
+
+    Optional<CookedRigidBodies> cooked = readCookedRigidBodies(
+        blob.data(), blob.size(), source_hash);
+    if (!cooked.has_value()) {
+        FATAL("PhysicsLoader: freshly cooked rigid bodies failed validation");
+    }
+
+    return loadObjects(*cooked);
+}
+
 ObjectManager & PhysicsLoader::getObjectManager()
 {
     return *impl_->mgr;
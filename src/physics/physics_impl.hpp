@@ -4,27 +4,188 @@
 
 namespace madrona::phys {
 
+// Carries contact lambdas from one substep to the next (and across steps)
+// so the solver can warm start persistent contacts. Manifolds are keyed by
+// entity pair + ContactID, individual points are matched by position in the
+// reference body's local space. Entries are double buffered: the solver
+// reads the previous substep's table while writing the current one, and
+// stale entries are invalidated by bumping the generation rather than
+// clearing memory.
+struct ContactCache {
+    struct Entry {
+        Entity ref;
+        Entity alt;
+        ContactID id;
+        uint32_t generation;
+        int32_t numPoints;
+        math::Vector3 localPoints[4];
+        float lambdaN[4];
+    };
+
+    Entry *entries[2];
+    uint32_t capacity;
+    uint32_t readIdx;
+    uint32_t generation;
+
+    // Points further apart than this aren't considered the same contact
+    static constexpr inline float pointMatchDistance = 0.05f;
+
+    ContactCache(CountT max_contacts);
+
+    const Entry * lookup(Entity ref, Entity alt, ContactID id) const;
+    void insert(Entity ref, Entity alt, ContactID id, int32_t num_points,
+                const math::Vector3 *local_points, const float *lambdas);
+    void swap();
+    void clear();
+};
+
+// Entity pairs that never collide, see
+// RigidBodyPhysicsSystem::disableCollisions. Open addressed set keyed by the
+// pair ordered by entity id. Removed pairs leave tombstones, which are
+// dropped in place once Used + Removed slots would pass half the capacity.
+struct CollisionExclusions {
+    enum class SlotState : uint32_t {
+        Empty,
+        Used,
+        Removed,
+    };
+
+    struct Entry {
+        Entity a;
+        Entity b;
+        SlotState state;
+    };
+
+    Entry *entries;
+    uint32_t capacity;
+    // Used + Removed slots, bounded to keep probes short
+    uint32_t numOccupied;
+    uint32_t numExcluded;
+
+    CollisionExclusions(CountT max_pairs);
+
+    inline bool contains(Entity a, Entity b) const;
+    bool containsSlow(Entity a, Entity b) const;
+    void add(Entity a, Entity b);
+    void remove(Entity a, Entity b);
+    void clear();
+    void dropTombstones();
+};
+
+// Sleep state for each non-static body, indexed by the body's LeafID in the
+// dynamic BVH. Islands are tracked with a union-find over the island field:
+// the solver merges bodies that share a contact or joint during the step,
+// and at the end of the step every island at rest for long enough is put to
+// sleep as a whole.
+struct SleepData {
+    struct Body {
+        float restTime;
+        float islandRestTime;
+        // Union-find parent while awake, the island's root once asleep
+        int32_t island;
+        bool asleep;
+        bool wakeRequested;
+        bool wakeIsland;
+    };
+
+    Body *bodies;
+    CountT maxBodies;
+    float energyThreshold;
+    float timeToSleep;
+
+    SleepData(CountT max_bodies);
+
+    inline bool isAsleep(broadphase::LeafID leaf_id) const;
+
+    void resetBody(int32_t idx);
+    int32_t findIsland(int32_t idx);
+    void mergeIslands(int32_t a, int32_t b);
+};
+
 struct SolverData {
     Contact *contacts;
     AtomicCount numContacts;
+    ContactCache contactCache;
 
     JointConstraint *jointConstraints;
     AtomicCount numJointConstraints;
 
+    // Constraint coloring, see solver::colorConstraints. batchItems holds
+    // contact indices and bitwise-negated joint indices, grouped by color.
+    // Color maxColors is the overflow batch, solved serially.
+    static constexpr inline CountT maxColors = 8;
+    int32_t *batchItems;
+    int32_t colorOffsets[maxColors + 2];
+    uint8_t *itemColors;
+    uint32_t *bodyColorMasks;
+
     CountT maxContacts;
     float deltaT;
     float h;
     math::Vector3 g;
     float gMagnitude;
     float restitutionThreshold;
+    // See RigidBodyPhysicsSystem::configureSpeculativeContacts
+    float speculativeMotionThreshold;
+    // See RigidBodyPhysicsSystem::configureContactWarmStart
+    bool warmStartContacts;
 
     inline SolverData(CountT max_contacts_per_step,
                       CountT max_joint_constraints,
+                      CountT max_bodies,
                       float delta_t,
                       CountT num_substeps,
                       math::Vector3 gravity);
 };
 
+bool CollisionExclusions::contains(Entity a, Entity b) const
+{
+    // Most worlds have no exclusions, keep the broadphase check free there
+    return numExcluded != 0 && containsSlow(a, b);
+}
+
+bool SleepData::isAsleep(broadphase::LeafID leaf_id) const
+{
+    // Only dynamic tree leaves have sleep state
+    assert(!leaf_id.isStatic);
+    return bodies[leaf_id.id].asleep;
+}
+
+namespace solver {
+
+// Fills SolverData::batchItems and colorOffsets from this substep's
+// contacts and joint constraints
+void colorConstraints(Context &ctx, SolverData &solver);
+
+// Solve one batch item: a contact index, or a bitwise-negated joint index
+void solvePositionsForItem(Context &ctx,
+                           ObjectManager &obj_mgr,
+                           SolverData &solver,
+                           int32_t item);
+
+void solveVelocitiesForItem(Context &ctx,
+                            ObjectManager &obj_mgr,
+                            SolverData &solver,
+                            int32_t item);
+
+#ifndef MADRONA_GPU_MODE
+// Solve up to simd::laneWidth items of one color batch at once, contacts
+// through the SoA kernels. Must match the item functions bit for bit.
+void solvePositionsForLanes(Context &ctx,
+                            ObjectManager &obj_mgr,
+                            SolverData &solver,
+                            const int32_t *items,
+                            CountT num_items);
+
+void solveVelocitiesForLanes(Context &ctx,
+                             ObjectManager &obj_mgr,
+                             SolverData &solver,
+                             const int32_t *items,
+                             CountT num_items);
+#endif
+
+}
+
 namespace broadphase {
 
 TaskGraphNodeID setupBVHTasks(
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <madrona/math.hpp>
+
+#if defined(MADRONA_X64)
+#include <immintrin.h>
+#elif defined(MADRONA_ARM)
+#include <arm_neon.h>
+#endif
+
+// 4-wide float math for the contact solver's SoA kernels. Each lane holds
+// one contact; masks select which lanes an update applies to. Only used on
+// the CPU backend, where each GPU thread already is a lane.
+
+namespace madrona::phys::solver::simd {
+
+inline constexpr CountT laneWidth = 4;
+
+#if defined(MADRONA_X64)
+struct Mask4 {
+    __m128 v;
+};
+
+struct Float4 {
+    __m128 v;
+
+    Float4() = default;
+    Float4(__m128 x) : v(x) {}
+    Float4(float x) : v(_mm_set1_ps(x)) {}
+
+    static inline Float4 load(const float *x) { return _mm_loadu_ps(x); }
+    inline void store(float *x) const { _mm_storeu_ps(x, v); }
+};
+
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a) {
+    return _mm_xor_ps(a.v, _mm_set1_ps(-0.f));
+}
+
+// Return b if either operand is NaN, callers pass the fallback second
+inline Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+inline Float4 sqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+inline Float4 abs(Float4 a) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v);
+}
+
+inline Mask4 operator<(Float4 a, Float4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline Mask4 operator<=(Float4 a, Float4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+inline Mask4 operator>(Float4 a, Float4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline Mask4 operator!=(Float4 a, Float4 b) { return { _mm_cmpneq_ps(a.v, b.v) }; }
+
+inline Mask4 operator&(Mask4 a, Mask4 b) { return { _mm_and_ps(a.v, b.v) }; }
+inline Mask4 operator|(Mask4 a, Mask4 b) { return { _mm_or_ps(a.v, b.v) }; }
+inline bool any(Mask4 m) { return _mm_movemask_ps(m.v) != 0; }
+
+inline Mask4 laneMask(uint32_t bits)
+{
+    return { _mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_and_si128(_mm_set1_epi32((int32_t)bits),
+                      _mm_setr_epi32(1, 2, 4, 8)),
+        _mm_setr_epi32(1, 2, 4, 8))) };
+}
+
+// m ? a : b per lane
+inline Float4 select(Mask4 m, Float4 a, Float4 b)
+{
+    return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v));
+}
+#elif defined(MADRONA_ARM)
+struct Mask4 {
+    uint32x4_t v;
+};
+
+struct Float4 {
+    float32x4_t v;
+
+    Float4() = default;
+    Float4(float32x4_t x) : v(x) {}
+    Float4(float x) : v(vdupq_n_f32(x)) {}
+
+    static inline Float4 load(const float *x) { return vld1q_f32(x); }
+    inline void store(float *x) const { vst1q_f32(x, v); }
+};
+
+inline Float4 operator+(Float4 a, Float4 b) { return vaddq_f32(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return vsubq_f32(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return vmulq_f32(a.v, b.v); }
+inline Float4 operator/(Float4 a, Float4 b) { return vdivq_f32(a.v, b.v); }
+inline Float4 operator-(Float4 a) { return vnegq_f32(a.v); }
+
+// Return the number if one operand is NaN, like fminf / fmaxf
+inline Float4 min(Float4 a, Float4 b) { return vminnmq_f32(a.v, b.v); }
+inline Float4 max(Float4 a, Float4 b) { return vmaxnmq_f32(a.v, b.v); }
+inline Float4 sqrt(Float4 a) { return vsqrtq_f32(a.v); }
+inline Float4 abs(Float4 a) { return vabsq_f32(a.v); }
+
+inline Mask4 operator<(Float4 a, Float4 b) { return { vcltq_f32(a.v, b.v) }; }
+inline Mask4 operator<=(Float4 a, Float4 b) { return { vcleq_f32(a.v, b.v) }; }
+inline Mask4 operator>(Float4 a, Float4 b) { return { vcgtq_f32(a.v, b.v) }; }
+inline Mask4 operator!=(Float4 a, Float4 b) {
+    return { vmvnq_u32(vceqq_f32(a.v, b.v)) };
+}
+
+inline Mask4 operator&(Mask4 a, Mask4 b) { return { vandq_u32(a.v, b.v) }; }
+inline Mask4 operator|(Mask4 a, Mask4 b) { return { vorrq_u32(a.v, b.v) }; }
+inline bool any(Mask4 m) { return vmaxvq_u32(m.v) != 0; }
+
+inline Mask4 laneMask(uint32_t bits)
+{
+    const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    uint32x4_t bits_v = vld1q_u32(lane_bits);
+    return { vtstq_u32(vdupq_n_u32(bits), bits_v) };
+}
+
+inline Float4 select(Mask4 m, Float4 a, Float4 b)
+{
+    return vbslq_f32(m.v, a.v, b.v);
+}
+#else
+struct Mask4 {
+    bool v[4];
+};
+
+struct Float4 {
+    float v[4];
+
+    Float4() = default;
+    Float4(float x) : v { x, x, x, x } {}
+
+    static inline Float4 load(const float *x)
+    {
+        Float4 r;
+        for (CountT i = 0; i < 4; i++) r.v[i] = x[i];
+        return r;
+    }
+
+    inline void store(float *x) const
+    {
+        for (CountT i = 0; i < 4; i++) x[i] = v[i];
+    }
+};
+
+#define MADRONA_SIMD_LANEWISE(ret, expr) \
+    ret r;                               \
+    for (CountT i = 0; i < 4; i++) {     \
+        r.v[i] = (expr);                 \
+    }                                    \
+    return r
+
+inline Float4 operator+(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Float4, a.v[i] + b.v[i]); }
+inline Float4 operator-(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Float4, a.v[i] - b.v[i]); }
+inline Float4 operator*(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Float4, a.v[i] * b.v[i]); }
+inline Float4 operator/(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Float4, a.v[i] / b.v[i]); }
+inline Float4 operator-(Float4 a) { MADRONA_SIMD_LANEWISE(Float4, -a.v[i]); }
+
+inline Float4 min(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Float4, fminf(a.v[i], b.v[i])); }
+inline Float4 max(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Float4, fmaxf(a.v[i], b.v[i])); }
+inline Float4 sqrt(Float4 a) { MADRONA_SIMD_LANEWISE(Float4, sqrtf(a.v[i])); }
+inline Float4 abs(Float4 a) { MADRONA_SIMD_LANEWISE(Float4, fabsf(a.v[i])); }
+
+inline Mask4 operator<(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Mask4, a.v[i] < b.v[i]); }
+inline Mask4 operator<=(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Mask4, a.v[i] <= b.v[i]); }
+inline Mask4 operator>(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Mask4, a.v[i] > b.v[i]); }
+inline Mask4 operator!=(Float4 a, Float4 b) { MADRONA_SIMD_LANEWISE(Mask4, a.v[i] != b.v[i]); }
+
+inline Mask4 operator&(Mask4 a, Mask4 b) { MADRONA_SIMD_LANEWISE(Mask4, a.v[i] && b.v[i]); }
+inline Mask4 operator|(Mask4 a, Mask4 b) { MADRONA_SIMD_LANEWISE(Mask4, a.v[i] || b.v[i]); }
+inline bool any(Mask4 m) { return m.v[0] || m.v[1] || m.v[2] || m.v[3]; }
+
+inline Mask4 laneMask(uint32_t bits)
+{
+    MADRONA_SIMD_LANEWISE(Mask4, (bits & (1_u32 << i)) != 0);
+}
+
+inline Float4 select(Mask4 m, Float4 a, Float4 b)
+{
+    MADRONA_SIMD_LANEWISE(Float4, m.v[i] ? a.v[i] : b.v[i]);
+}
+
+#undef MADRONA_SIMD_LANEWISE
+#endif
+
+// 4 Vector3s, one per lane
+struct Vector3x4 {
+    Float4 x, y, z;
+
+    MADRONA_ALWAYS_INLINE static inline Vector3x4 gather(const math::Vector3 *v)
+    {
+        float xs[4] = { v[0].x, v[1].x, v[2].x, v[3].x };
+        float ys[4] = { v[0].y, v[1].y, v[2].y, v[3].y };
+        float zs[4] = { v[0].z, v[1].z, v[2].z, v[3].z };
+
+        return { Float4::load(xs), Float4::load(ys), Float4::load(zs) };
+    }
+
+    MADRONA_ALWAYS_INLINE inline void scatter(math::Vector3 *v) const
+    {
+        float xs[4], ys[4], zs[4];
+        x.store(xs);
+        y.store(ys);
+        z.store(zs);
+
+        for (CountT i = 0; i < 4; i++) {
+            v[i] = { xs[i], ys[i], zs[i] };
+        }
+    }
+};
+
+inline Vector3x4 operator+(Vector3x4 a, Vector3x4 b)
+{
+    return { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+inline Vector3x4 operator-(Vector3x4 a, Vector3x4 b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+inline Vector3x4 operator*(Float4 s, Vector3x4 v)
+{
+    return { s * v.x, s * v.y, s * v.z };
+}
+
+// Multiplies by the reciprocal like math::Vector3 does, so lanes match the
+// scalar solver bit for bit
+inline Vector3x4 operator/(Vector3x4 v, Float4 s)
+{
+    Float4 inv = Float4(1.f) / s;
+    return { v.x * inv, v.y * inv, v.z * inv };
+}
+
+MADRONA_ALWAYS_INLINE inline Float4 dot(Vector3x4 a, Vector3x4 b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+MADRONA_ALWAYS_INLINE inline Vector3x4 cross(Vector3x4 a, Vector3x4 b)
+{
+    return {
+        a.y * b.z - a.z * b.y,
+        a.z * b.x - a.x * b.z,
+        a.x * b.y - a.y * b.x,
+    };
+}
+
+inline Float4 length(Vector3x4 v)
+{
+    return sqrt(dot(v, v));
+}
+
+inline Vector3x4 multDiag(Vector3x4 diag, Vector3x4 v)
+{
+    return { diag.x * v.x, diag.y * v.y, diag.z * v.z };
+}
+
+inline Vector3x4 select(Mask4 m, Vector3x4 a, Vector3x4 b)
+{
+    return { select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z) };
+}
+
+// 4 Quats, one per lane
+struct Quat4 {
+    Float4 w, x, y, z;
+
+    MADRONA_ALWAYS_INLINE static inline Quat4 gather(const math::Quat *q)
+    {
+        float ws[4] = { q[0].w, q[1].w, q[2].w, q[3].w };
+        float xs[4] = { q[0].x, q[1].x, q[2].x, q[3].x };
+        float ys[4] = { q[0].y, q[1].y, q[2].y, q[3].y };
+        float zs[4] = { q[0].z, q[1].z, q[2].z, q[3].z };
+
+        return {
+            Float4::load(ws), Float4::load(xs),
+            Float4::load(ys), Float4::load(zs),
+        };
+    }
+
+    MADRONA_ALWAYS_INLINE inline void scatter(math::Quat *q) const
+    {
+        float ws[4], xs[4], ys[4], zs[4];
+        w.store(ws);
+        x.store(xs);
+        y.store(ys);
+        z.store(zs);
+
+        for (CountT i = 0; i < 4; i++) {
+            q[i] = { ws[i], xs[i], ys[i], zs[i] };
+        }
+    }
+
+    inline Quat4 inv() const
+    {
+        return { w, -x, -y, -z };
+    }
+
+    MADRONA_ALWAYS_INLINE inline Quat4 normalize() const
+    {
+        Float4 inv_length = Float4(1.f) / sqrt(w * w + x * x + y * y + z * z);
+        return { w * inv_length, x * inv_length,
+                 y * inv_length, z * inv_length };
+    }
+
+    MADRONA_ALWAYS_INLINE inline Vector3x4 rotateVec(Vector3x4 v) const
+    {
+        Vector3x4 pure { x, y, z };
+
+        Vector3x4 pure_x_v = cross(pure, v);
+        Vector3x4 pure_x_pure_x_v = cross(pure, pure_x_v);
+
+        Vector3x4 t = Vector3x4 {
+            pure_x_v.x * w + pure_x_pure_x_v.x,
+            pure_x_v.y * w + pure_x_pure_x_v.y,
+            pure_x_v.z * w + pure_x_pure_x_v.z,
+        };
+
+        return v + Float4(2.f) * t;
+    }
+
+    static inline Quat4 fromAngularVec(Vector3x4 v)
+    {
+        return { Float4(0.f), v.x, v.y, v.z };
+    }
+};
+
+inline Quat4 operator+(Quat4 a, Quat4 b)
+{
+    return { a.w + b.w, a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+inline Quat4 operator-(Quat4 a, Quat4 b)
+{
+    return { a.w - b.w, a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+MADRONA_ALWAYS_INLINE inline Quat4 operator*(Quat4 a, Quat4 b)
+{
+    return {
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+    };
+}
+
+inline Quat4 select(Mask4 m, Quat4 a, Quat4 b)
+{
+    return {
+        select(m, a.w, b.w), select(m, a.x, b.x),
+        select(m, a.y, b.y), select(m, a.z, b.z),
+    };
+}
+
+}
@@ -0,0 +1,470 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/physics.hpp>
+#include <madrona/physics_assets.hpp>
+#include <madrona/importer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace madrona;
+using namespace madrona::math;
+using namespace madrona::phys;
+using namespace madrona::phys::broadphase;
+
+namespace madrona::phys::broadphase {
+
+class BVHTestAccess {
+public:
+    static void refitAndRotate(BVH &bvh)
+    {
+        bvh.refitAndRotate();
+    }
+
+    static int32_t maxIncrementalDepth()
+    {
+        return BVH::max_incremental_depth_;
+    }
+
+    // Number of internal nodes on the longest path from the root
+    static int32_t depth(const BVH &bvh)
+    {
+        struct StackEntry {
+            int32_t nodeID;
+            int32_t depth;
+        };
+
+        StackEntry stack[128];
+        stack[0] = { 0, 1 };
+        CountT stack_size = 1;
+
+        int32_t max_depth = 0;
+        while (stack_size > 0) {
+            StackEntry entry = stack[--stack_size];
+            max_depth = std::max(max_depth, entry.depth);
+
+            const BVH::Node &node = bvh.nodes_[entry.nodeID];
+            for (CountT i = 0; i < 4; i++) {
+                if (node.hasChild(i) && !node.isLeaf(i)) {
+                    stack[stack_size++] = {
+                        node.children[i],
+                        entry.depth + 1,
+                    };
+                }
+            }
+        }
+
+        return max_depth;
+    }
+
+    // Checks that every linked leaf's parent link and every node's
+    // bookkeeping match the tree, the way refitAndRotate computes them
+    static void checkNodes(const BVH &bvh)
+    {
+        int32_t stack[128];
+        stack[0] = 0;
+        CountT stack_size = 1;
+
+        std::vector<int32_t> post_order;
+        while (stack_size > 0) {
+            int32_t node_idx = stack[--stack_size];
+            post_order.push_back(node_idx);
+
+            const BVH::Node &node = bvh.nodes_[node_idx];
+            for (CountT i = 0; i < 4; i++) {
+                if (!node.hasChild(i)) {
+                    continue;
+                }
+
+                if (node.isLeaf(i)) {
+                    EXPECT_EQ(bvh.leaf_parents_[node.leafIDX(i)],
+                              ((uint32_t)node_idx << 2) | (uint32_t)i);
+                } else {
+                    EXPECT_EQ(bvh.nodes_[node.children[i]].parentID,
+                              node_idx);
+                    stack[stack_size++] = node.children[i];
+                }
+            }
+        }
+
+        for (int32_t node_idx : post_order) {
+            const BVH::Node &node = bvh.nodes_[node_idx];
+
+            int32_t height = 0;
+            float sah = 0.f;
+            for (CountT i = 0; i < 4; i++) {
+                if (node.hasChild(i)) {
+                    height = std::max(height, 1);
+                }
+
+                if (node.hasChild(i) && !node.isLeaf(i)) {
+                    const BVH::NodeInfo &child_info =
+                        bvh.node_info_[node.children[i]];
+                    height = std::max(height, child_info.height + 1);
+                    sah += node.childAABB(i).surfaceArea() + child_info.sah;
+                }
+            }
+
+            const BVH::NodeInfo &info = bvh.node_info_[node_idx];
+            EXPECT_EQ(info.height, height) << "node " << node_idx;
+            EXPECT_EQ(info.sah, sah) << "node " << node_idx;
+        }
+    }
+};
+
+}
+
+namespace {
+
+// Unit cube given as explicit faces, so importing doesn't build a hull
+struct CubeObjects {
+    std::array<Vector3, 8> positions;
+    std::array<uint32_t, 24> indices {
+        0, 2, 3, 1,
+        4, 5, 7, 6,
+        0, 1, 5, 4,
+        2, 6, 7, 3,
+        0, 4, 6, 2,
+        1, 3, 7, 5,
+    };
+    std::array<uint32_t, 6> faceCounts { 4, 4, 4, 4, 4, 4 };
+    imp::SourceMesh mesh;
+    PhysicsLoader::SourceCollisionPrimitive prim;
+    PhysicsLoader loader;
+
+    CubeObjects()
+        : loader(ExecMode::CPU, 1)
+    {
+        for (CountT i = 0; i < 8; i++) {
+            positions[i] = {
+                (i & 1) ? 0.5f : -0.5f,
+                (i & 2) ? 0.5f : -0.5f,
+                (i & 4) ? 0.5f : -0.5f,
+            };
+        }
+
+        mesh = {
+            .positions = positions.data(),
+            .normals = nullptr,
+            .tangentAndSigns = nullptr,
+            .uvs = nullptr,
+            .indices = indices.data(),
+            .faceCounts = faceCounts.data(),
+            .numVertices = 8,
+            .numFaces = 6,
+            .materialIDX = 0,
+        };
+
+        prim.type = CollisionPrimitive::Type::Hull;
+        prim.hullInput.mesh = &mesh;
+
+        PhysicsLoader::SourceCollisionObject obj {
+            .prims = Span<const PhysicsLoader::SourceCollisionPrimitive>(
+                &prim, 1),
+            .invMass = 1.f,
+            .friction = { 0.5f, 0.5f },
+        };
+
+        Optional<PhysicsLoader::ImportedRigidBodies> imported =
+            loader.importRigidBodyData(&obj, 1, false);
+        if (!imported.has_value()) {
+            FATAL("Failed to import test cube");
+        }
+
+        loader.loadObjects(imported->metadatas.data(),
+            imported->objectAABBs.data(),
+            imported->primOffsets.data(),
+            imported->primCounts.data(),
+            1,
+            imported->collisionPrimitives.data(),
+            imported->primitiveAABBs.data(),
+            imported->collisionPrimitives.size(),
+            imported->hullData.halfEdges.data(),
+            imported->hullData.halfEdges.size(),
+            imported->hullData.faceBaseHEs.data(),
+            imported->hullData.facePlanes.data(),
+            imported->hullData.facePlanes.size(),
+            imported->hullData.positions.data(),
+            imported->hullData.positions.size());
+    }
+
+    const ObjectManager & objectManager()
+    {
+        return loader.getObjectManager();
+    }
+};
+
+struct LiveLeaf {
+    LeafID id;
+    Entity e;
+    AABB aabb;
+};
+
+// Entry distance of the ray into aabb, or INFINITY if it misses
+float rayAABBDistance(Vector3 o, Vector3 d, const AABB &aabb)
+{
+    float t_enter = 0.f;
+    float t_exit = INFINITY;
+    for (CountT i = 0; i < 3; i++) {
+        float t1 = (aabb.pMin[i] - o[i]) / d[i];
+        float t2 = (aabb.pMax[i] - o[i]) / d[i];
+        t_enter = fmaxf(t_enter, fminf(t1, t2));
+        t_exit = fminf(t_exit, fmaxf(t1, t2));
+    }
+
+    return t_enter <= t_exit ? t_enter : INFINITY;
+}
+
+// Drives a BVH the way the physics step does: leaves are reserved and
+// removed between updates, and every update writes the new leaf bounds,
+// updates the tree and then refits the moved leaves.
+class BVHChurn {
+public:
+    BVHChurn(const ObjectManager &obj_mgr, CountT max_leaves,
+             BuildMethod build_method, uint32_t seed)
+        : obj_mgr_(obj_mgr),
+          bvh_(&obj_mgr, max_leaves, 0.f, 0.f, build_method),
+          rng_(seed),
+          next_entity_id_(0)
+    {
+        bvh_.rebuildOnUpdate();
+    }
+
+    void add(Vector3 pos, float scale)
+    {
+        Entity e { 0, next_entity_id_++ };
+        LeafID leaf_id = bvh_.reserveLeaf(e, base::ObjectID { 0 });
+        leaves_.push_back({ leaf_id, e, AABB::invalid() });
+        place(leaves_.back(), pos, scale);
+    }
+
+    void removeRandom()
+    {
+        LiveLeaf &leaf = pickLeaf();
+        bvh_.removeLeaf(leaf.id);
+        leaf = leaves_.back();
+        leaves_.pop_back();
+    }
+
+    void nudgeRandom(float max_offset)
+    {
+        std::uniform_real_distribution<float> offset(-max_offset, max_offset);
+
+        LiveLeaf &leaf = pickLeaf();
+        Vector3 center = (leaf.aabb.pMin + leaf.aabb.pMax) / 2.f;
+        place(leaf, center + Vector3 { offset(rng_), offset(rng_),
+                                       offset(rng_) }, leafScale(leaf));
+    }
+
+    void teleportRandom(Vector3 pos)
+    {
+        LiveLeaf &leaf = pickLeaf();
+        place(leaf, pos, leafScale(leaf));
+    }
+
+    void update()
+    {
+        bvh_.updateTree();
+
+        for (const LiveLeaf &leaf : leaves_) {
+            bvh_.refitLeaf(leaf.id, bvh_.getLeafAABB(leaf.id));
+        }
+    }
+
+    void checkOverlaps(const AABB &query)
+    {
+        std::vector<int32_t> found;
+        bvh_.findOverlaps(query, [&](Entity e) {
+            found.push_back(e.id);
+        });
+
+        std::vector<int32_t> expected;
+        for (const LiveLeaf &leaf : leaves_) {
+            if (leaf.aabb.overlaps(query)) {
+                expected.push_back(leaf.e.id);
+            }
+        }
+
+        std::sort(found.begin(), found.end());
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(found, expected);
+    }
+
+    void checkRay(Vector3 o, Vector3 d)
+    {
+        float expected_t = INFINITY;
+        Entity expected_e = Entity::none();
+        for (const LiveLeaf &leaf : leaves_) {
+            float t = rayAABBDistance(o, d, leaf.aabb);
+            if (t < expected_t) {
+                expected_t = t;
+                expected_e = leaf.e;
+            }
+        }
+
+        float hit_t;
+        Vector3 hit_normal;
+        Entity hit = bvh_.traceRay(o, d, &hit_t, &hit_normal);
+
+        EXPECT_EQ(hit.id, expected_e.id);
+        if (hit != Entity::none() && hit == expected_e) {
+            EXPECT_NEAR(hit_t, expected_t, 1e-3f);
+        }
+    }
+
+    BVH & bvh() { return bvh_; }
+    CountT numLive() const { return (CountT)leaves_.size(); }
+
+private:
+    LiveLeaf & pickLeaf()
+    {
+        std::uniform_int_distribution<size_t> pick(0, leaves_.size() - 1);
+        return leaves_[pick(rng_)];
+    }
+
+    static float leafScale(const LiveLeaf &leaf)
+    {
+        return leaf.aabb.pMax.x - leaf.aabb.pMin.x;
+    }
+
+    void place(LiveLeaf &leaf, Vector3 pos, float scale)
+    {
+        bvh_.updateLeafPosition(leaf.id, pos, Quat { 1, 0, 0, 0 },
+            Diag3x3::uniform(scale), Vector3::zero(),
+            obj_mgr_.rigidBodyAABBs[0]);
+        leaf.aabb = bvh_.getLeafAABB(leaf.id);
+    }
+
+    const ObjectManager &obj_mgr_;
+    BVH bvh_;
+    std::vector<LiveLeaf> leaves_;
+    std::mt19937 rng_;
+    int32_t next_entity_id_;
+};
+
+}
+
+// Inserts, removes and moves leaves over many updates so the tree is
+// maintained incrementally (insertLeaf, refitAndRotate and subtree
+// rebuilds) rather than rebuilt, and checks queries against brute force.
+TEST(BVH, IncrementalUpdatesMatchBruteForce)
+{
+    CubeObjects cube;
+
+    constexpr CountT max_leaves = 512;
+    constexpr CountT max_changes_per_update = 8;
+    constexpr float world_size = 20.f;
+
+    for (BuildMethod build_method :
+            { BuildMethod::Midpoint, BuildMethod::BinnedSAH }) {
+        SCOPED_TRACE(build_method == BuildMethod::Midpoint ?
+            "Midpoint" : "BinnedSAH");
+
+        BVHChurn churn(cube.objectManager(), max_leaves, build_method, 3);
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<float> coord(-world_size, world_size);
+        std::uniform_real_distribution<float> scale(0.2f, 2.f);
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        std::uniform_int_distribution<CountT> num_changes(
+            0, max_changes_per_update);
+
+        auto randomPos = [&]() {
+            return Vector3 { coord(rng), coord(rng), coord(rng) };
+        };
+
+        for (CountT i = 0; i < 200; i++) {
+            churn.add(randomPos(), scale(rng));
+        }
+        churn.update();
+
+        CountT max_live = churn.numLive();
+        for (CountT step = 0; step < 300; step++) {
+            // Every 50 steps, spawn a tight cluster: inserting into the
+            // same spot repeatedly is what pushes the tree deepest
+            bool cluster = step % 50 == 25;
+            Vector3 cluster_pos = randomPos();
+
+            CountT num_removed = std::min(num_changes(rng),
+                                          churn.numLive() - 1);
+            for (CountT i = 0; i < num_removed; i++) {
+                churn.removeRandom();
+            }
+
+            CountT num_added = cluster ? max_changes_per_update :
+                num_changes(rng);
+            for (CountT i = 0; i < num_added; i++) {
+                Vector3 pos = cluster_pos;
+                if (!cluster) {
+                    pos = randomPos();
+                } else {
+                    pos += 1e-3f * Vector3 { unit(rng), unit(rng), unit(rng) };
+                }
+
+                churn.add(pos, scale(rng));
+            }
+
+            // Mostly small motion, with occasional teleports that degrade
+            // the tree enough to need rotations and subtree rebuilds
+            for (CountT i = 0; i < 4; i++) {
+                churn.teleportRandom(randomPos());
+            }
+            for (CountT i = 0; i < 36; i++) {
+                churn.nudgeRandom(0.5f);
+            }
+
+            churn.update();
+
+            max_live = std::max(max_live, churn.numLive());
+
+            // Removed IDs are reused, so the high water mark only grows
+            // by what is added between two updates
+            EXPECT_LE(churn.bvh().numLeaves(),
+                      max_live + max_changes_per_update);
+
+            EXPECT_LE(BVHTestAccess::depth(churn.bvh()),
+                      BVHTestAccess::maxIncrementalDepth());
+
+            for (CountT i = 0; i < 4; i++) {
+                Vector3 center = randomPos();
+                Vector3 half_extents = Vector3 {
+                    fabsf(unit(rng)), fabsf(unit(rng)), fabsf(unit(rng)),
+                } * 5.f;
+                churn.checkOverlaps({
+                    center - half_extents,
+                    center + half_extents,
+                });
+
+                Vector3 dir = normalize(
+                    Vector3 { unit(rng), unit(rng), unit(rng) } +
+                    Vector3 { 0, 0, 1e-3f });
+                Vector3 o = -3.f * world_size * dir +
+                    Vector3 { unit(rng), unit(rng), unit(rng) } * world_size;
+                churn.checkRay(o, dir);
+            }
+
+            // Subtrees rebuilt by the update only get their bookkeeping on
+            // the next pass. Another pass without changes recomputes every
+            // node's, including the children of rotated nodes.
+            if (step % 10 == 0) {
+                BVHTestAccess::refitAndRotate(churn.bvh());
+                BVHTestAccess::checkNodes(churn.bvh());
+                EXPECT_LE(BVHTestAccess::depth(churn.bvh()),
+                          BVHTestAccess::maxIncrementalDepth());
+            }
+
+            if (HasFailure()) {
+                return;
+            }
+        }
+    }
+}
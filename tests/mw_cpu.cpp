@@ -0,0 +1,167 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/mw_cpu.hpp>
+#include <madrona/custom_context.hpp>
+#include <madrona/taskgraph_builder.hpp>
+
+using namespace madrona;
+
+namespace {
+
+struct Action {
+    int32_t v;
+};
+
+struct Observation {
+    int32_t v;
+};
+
+struct Agent : Archetype<Action, Observation> {};
+
+constexpr CountT numAgentsPerWorld = 3;
+
+class Engine;
+
+struct Sim : public WorldBase {
+    struct Config {};
+    struct Init {};
+
+    static void registerTypes(ECSRegistry &registry, const Config &)
+    {
+        registry.registerComponent<Action>();
+        registry.registerComponent<Observation>();
+        registry.registerArchetype<Agent>();
+
+        registry.exportColumn<Agent, Action>(0);
+        registry.exportColumn<Agent, Observation>(1);
+    }
+
+    static void setupTasks(TaskGraphBuilder &builder, const Config &);
+
+    inline Sim(Engine &ctx, const Config &, const Init &);
+};
+
+class Engine : public CustomContext<Engine, Sim> {
+    using CustomContext::CustomContext;
+};
+
+Sim::Sim(Engine &ctx, const Config &, const Init &)
+    : WorldBase(ctx)
+{
+    for (CountT i = 0; i < numAgentsPerWorld; i++) {
+        ctx.makeEntity<Agent>();
+    }
+}
+
+void observeSystem(Engine &, const Action &action, Observation &obs)
+{
+    obs.v = action.v * 10;
+}
+
+void Sim::setupTasks(TaskGraphBuilder &builder, const Config &)
+{
+    builder.addToGraph<ParallelForNode<Engine, observeSystem,
+        Action, Observation>>({});
+}
+
+using Executor = TaskGraphExecutor<Engine, Sim, Sim::Config, Sim::Init>;
+
+}
+
+// With double buffered exports, actions written through getExported between
+// steps must reach the worlds, and results only show up after wait().
+TEST(MWCPU, DoubleBufferedExports)
+{
+    constexpr CountT num_worlds = 4;
+
+    HeapArray<Sim::Init> inits(num_worlds);
+
+    Executor exec({
+        .numWorlds = num_worlds,
+        .numExportedBuffers = 2,
+        .numWorkers = 1,
+        .doubleBufferExports = true,
+    }, Sim::Config {}, inits.data());
+
+    auto *actions = (Action *)exec.getExported(0);
+    auto *obs = (const Observation *)exec.getExported(1);
+    CountT stride = exec.getExportedRowsPerWorld(0);
+    EXPECT_EQ(stride, exec.getExportedRowsPerWorld(1));
+
+    auto setActions = [&](int32_t base) {
+        for (CountT w = 0; w < num_worlds; w++) {
+            for (CountT i = 0; i < numAgentsPerWorld; i++) {
+                actions[w * stride + i].v = base + int32_t(w * 10 + i);
+            }
+        }
+    };
+
+    auto checkObs = [&](int32_t base) {
+        for (CountT w = 0; w < num_worlds; w++) {
+            for (CountT i = 0; i < numAgentsPerWorld; i++) {
+                EXPECT_EQ(obs[w * stride + i].v,
+                          (base + int32_t(w * 10 + i)) * 10);
+            }
+        }
+    };
+
+    setActions(1);
+    exec.run();
+    checkObs(1);
+
+    setActions(100);
+    exec.runAsync();
+    // The buffers keep the state from before the run until wait()
+    checkObs(1);
+    exec.wait();
+    checkObs(100);
+
+    // Only the stepped worlds are synced
+    setActions(1000);
+    std::array<int32_t, 1> stepped { 2 };
+    exec.run(Span<const int32_t>(stepped.data(), stepped.size()));
+
+    for (CountT w = 0; w < num_worlds; w++) {
+        for (CountT i = 0; i < numAgentsPerWorld; i++) {
+            int32_t base = w == 2 ? 1000 : 100;
+            EXPECT_EQ(obs[w * stride + i].v,
+                      (base + int32_t(w * 10 + i)) * 10);
+        }
+    }
+}
+
+TEST(MWCPU, SelectWorldsValidation)
+{
+    constexpr CountT num_worlds = 4;
+
+    HeapArray<Sim::Init> inits(num_worlds);
+
+    Executor exec({
+        .numWorlds = num_worlds,
+        .numExportedBuffers = 2,
+        .numWorkers = 1,
+    }, Sim::Config {}, inits.data());
+
+    GTEST_FLAG_SET(death_test_style, "threadsafe");
+
+    std::array<int32_t, 2> duplicate { 1, 1 };
+    EXPECT_DEATH(exec.run(
+        Span<const int32_t>(duplicate.data(), duplicate.size())),
+        "more than once");
+
+    std::array<int32_t, 1> out_of_range { int32_t(num_worlds) };
+    EXPECT_DEATH(exec.run(
+        Span<const int32_t>(out_of_range.data(), out_of_range.size())),
+        "out of range");
+
+    // A valid selection still runs after a rejected one
+    std::array<int32_t, 2> valid { 3, 0 };
+    exec.run(Span<const int32_t>(valid.data(), valid.size()));
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/mw_cpu.hpp>
+#include <madrona/custom_context.hpp>
+#include <madrona/taskgraph_builder.hpp>
+
+#include <array>
+#include <random>
+#include <vector>
+
+using namespace madrona;
+
+namespace {
+
+struct SortKey {
+    uint32_t v;
+};
+
+// Columns of different sizes, all derived from the row's original index,
+// to check each one is permuted along with the keys
+struct Payload {
+    uint64_t hash;
+    uint16_t idx;
+};
+
+struct Wide {
+    float v[3];
+};
+
+struct Item : Archetype<Payload, SortKey, Wide> {};
+
+enum class KeyPattern : uint32_t {
+    Sorted,
+    Equal,
+    Reverse,
+    // Only the second lowest byte differs between keys, so the sort skips
+    // every other radix pass
+    MiddleDigit,
+    // Only the top byte differs, with many duplicates
+    TopDigit,
+    Random,
+    NumPatterns,
+};
+
+class Engine;
+
+struct Sim : public WorldBase {
+    struct Config {};
+
+    struct Init {
+        KeyPattern pattern;
+        CountT numRows;
+    };
+
+    static void registerTypes(ECSRegistry &registry, const Config &)
+    {
+        registry.registerComponent<SortKey>();
+        registry.registerComponent<Payload>();
+        registry.registerComponent<Wide>();
+        registry.registerArchetype<Item>();
+    }
+
+    static void setupTasks(TaskGraphBuilder &builder, const Config &)
+    {
+        builder.addToGraph<SortArchetypeNode<Item, SortKey>>({});
+    }
+
+    inline Sim(Engine &ctx, const Config &, const Init &init);
+
+    Engine *ctx;
+    // In creation order, which is the original row order
+    std::vector<Entity> items;
+    std::vector<uint32_t> keys;
+};
+
+class Engine : public CustomContext<Engine, Sim> {
+    using CustomContext::CustomContext;
+};
+
+uint32_t makeKey(KeyPattern pattern, CountT i, CountT num_rows,
+                 std::mt19937 &rng)
+{
+    switch (pattern) {
+    case KeyPattern::Sorted: {
+        return uint32_t(i * 3);
+    }
+    case KeyPattern::Equal: {
+        return 0xdeadbeef;
+    }
+    case KeyPattern::Reverse: {
+        return uint32_t((num_rows - i) * 7919);
+    }
+    case KeyPattern::MiddleDigit: {
+        return 0x5a0000c3 | (uint32_t((i * 37) & 0xff) << 8);
+    }
+    case KeyPattern::TopDigit: {
+        return uint32_t((num_rows - i) & 0xff) << 24;
+    }
+    case KeyPattern::Random: {
+        // Half the keys come from a small range to get duplicates
+        return (i & 1) ? rng() : rng() % 64;
+    }
+    default: MADRONA_UNREACHABLE();
+    }
+}
+
+Sim::Sim(Engine &ctx, const Config &, const Init &init)
+    : WorldBase(ctx),
+      ctx(&ctx),
+      items(),
+      keys()
+{
+    std::mt19937 rng(ctx.worldID().idx);
+
+    for (CountT i = 0; i < init.numRows; i++) {
+        Entity e = ctx.makeEntity<Item>();
+        uint32_t key = makeKey(init.pattern, i, init.numRows, rng);
+
+        ctx.get<SortKey>(e).v = key;
+        ctx.get<Payload>(e) = {
+            .hash = uint64_t(i) * 0x9e3779b97f4a7c15,
+            .idx = uint16_t(i),
+        };
+        ctx.get<Wide>(e) = {{ float(i), -float(i), float(i) * 0.5f }};
+
+        items.push_back(e);
+        keys.push_back(key);
+    }
+}
+
+using Executor = TaskGraphExecutor<Engine, Sim, Sim::Config, Sim::Init>;
+
+// The table must be sorted by key, stable for equal keys, with every
+// column and Entity -> Loc mapping moved along with the keys
+void checkSorted(Sim &sim)
+{
+    Engine &ctx = *sim.ctx;
+    CountT num_rows = sim.items.size();
+
+    // Original index of the item in each row
+    std::vector<CountT> row_items(num_rows, -1);
+
+    for (CountT i = 0; i < num_rows; i++) {
+        Entity e = sim.items[i];
+        Loc loc = ctx.loc(e);
+
+        ASSERT_GE(loc.row, 0);
+        ASSERT_LT(loc.row, num_rows);
+        EXPECT_EQ(row_items[loc.row], -1) << "row " << loc.row;
+        row_items[loc.row] = i;
+
+        // The entity column and the Loc agree
+        EXPECT_EQ(ctx.getDirect<Entity>(0, loc), e) << "item " << i;
+
+        EXPECT_EQ(ctx.get<SortKey>(e).v, sim.keys[i]) << "item " << i;
+
+        const Payload &payload = ctx.get<Payload>(e);
+        EXPECT_EQ(payload.hash, uint64_t(i) * 0x9e3779b97f4a7c15) <<
+            "item " << i;
+        EXPECT_EQ(payload.idx, uint16_t(i)) << "item " << i;
+
+        const Wide &wide = ctx.get<Wide>(e);
+        EXPECT_EQ(wide.v[0], float(i)) << "item " << i;
+        EXPECT_EQ(wide.v[1], -float(i)) << "item " << i;
+        EXPECT_EQ(wide.v[2], float(i) * 0.5f) << "item " << i;
+
+        if (::testing::Test::HasFailure()) {
+            return;
+        }
+    }
+
+    for (CountT row = 1; row < num_rows; row++) {
+        CountT prev = row_items[row - 1];
+        CountT cur = row_items[row];
+
+        ASSERT_LE(sim.keys[prev], sim.keys[cur]) << "row " << row;
+        if (sim.keys[prev] == sim.keys[cur]) {
+            ASSERT_LT(prev, cur) << "row " << row;
+        }
+    }
+}
+
+}
+
+// Each world's table gets a different key pattern. 10000 rows spans
+// several of the blocks the column copies are split into.
+TEST(SortArchetype, SortsEveryColumn)
+{
+    constexpr CountT num_worlds = (CountT)KeyPattern::NumPatterns;
+    constexpr CountT num_rows = 10000;
+
+    HeapArray<Sim::Init> inits(num_worlds);
+    for (CountT i = 0; i < num_worlds; i++) {
+        inits[i] = {
+            .pattern = KeyPattern(i),
+            .numRows = num_rows,
+        };
+    }
+
+    Executor exec({
+        .numWorlds = num_worlds,
+        .numExportedBuffers = 0,
+        .numWorkers = 2,
+    }, Sim::Config {}, inits.data());
+
+    exec.run();
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        SCOPED_TRACE(i);
+        checkSorted(exec.getWorldData(i));
+    }
+
+    // Sorting an already sorted table is a no-op
+    exec.run();
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        SCOPED_TRACE(i);
+        checkSorted(exec.getWorldData(i));
+    }
+
+    // New keys are sorted again with the scratch memory of the first run
+    std::mt19937 rng(5);
+    for (CountT i = 0; i < num_worlds; i++) {
+        Sim &sim = exec.getWorldData(i);
+
+        for (CountT j = 0; j < num_rows; j++) {
+            uint32_t key = makeKey(KeyPattern::Reverse, j, num_rows, rng);
+            sim.ctx->get<SortKey>(sim.items[j]).v = key;
+            sim.keys[j] = key;
+        }
+    }
+
+    exec.run();
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        SCOPED_TRACE(i);
+        checkSorted(exec.getWorldData(i));
+    }
+}
+
+// Tables of 0 and 1 rows, and one just past a block boundary
+TEST(SortArchetype, SmallTables)
+{
+    constexpr std::array<CountT, 4> num_rows { 0, 1, 2, 4097 };
+
+    HeapArray<Sim::Init> inits(num_rows.size());
+    for (CountT i = 0; i < (CountT)num_rows.size(); i++) {
+        inits[i] = {
+            .pattern = KeyPattern::Reverse,
+            .numRows = num_rows[i],
+        };
+    }
+
+    Executor exec({
+        .numWorlds = (uint32_t)num_rows.size(),
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config {}, inits.data());
+
+    exec.run();
+
+    for (CountT i = 0; i < (CountT)num_rows.size(); i++) {
+        SCOPED_TRACE(i);
+        checkSorted(exec.getWorldData(i));
+    }
+}
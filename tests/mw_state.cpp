@@ -0,0 +1,128 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/state.hpp>
+
+#include <fstream>
+#include <string>
+
+using namespace madrona;
+
+namespace {
+
+struct Position {
+    float x, y, z;
+};
+
+struct Velocity {
+    float x, y, z;
+};
+
+struct Mass {
+    float v;
+};
+
+struct alignas(16) Action {
+    int32_t v[4];
+};
+
+struct Body : Archetype<Position, Velocity, Mass> {};
+struct Agent : Archetype<Position, Action> {};
+struct Marker : Archetype<Position> {};
+
+}
+
+#ifdef __linux__
+static CountT numMappings()
+{
+    std::ifstream maps("/proc/self/maps");
+
+    CountT num_lines = 0;
+    std::string line;
+    while (std::getline(maps, line)) {
+        num_lines++;
+    }
+
+    return num_lines;
+}
+
+// Builds a StateManager with num_worlds worlds, adds entities to every
+// world and exports a column. Returns the number of mappings this added.
+static CountT mappingsForWorlds(CountT num_worlds)
+{
+    CountT num_before = numMappings();
+
+    StateManager state(num_worlds);
+    StateCache cache;
+    state.registerComponent<Position>();
+    state.registerComponent<Velocity>();
+    state.registerComponent<Mass>();
+    state.registerComponent<Action>();
+    state.registerArchetype<Body>();
+    state.registerArchetype<Agent>();
+    state.registerArchetype<Marker>();
+
+    Action *actions = state.exportColumn<Agent, Action>();
+    Position *body_positions = state.exportColumn<Body, Position>();
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        for (CountT j = 0; j < 3; j++) {
+            state.makeEntityNow<Body>(uint32_t(i), cache);
+        }
+        state.makeEntityNow<Agent>(uint32_t(i), cache);
+        state.makeEntityNow<Marker>(uint32_t(i), cache);
+    }
+
+    // Exported columns alias the live world-major table columns
+    const StateManager::ExportInfo *info = state.getExportInfo(actions);
+    EXPECT_NE(info, nullptr);
+    EXPECT_NE(state.getExportInfo(body_positions), nullptr);
+
+    uint32_t agent_id = state.archetypeID<Agent>().id;
+    int32_t action_col = state.getArchetypeColumnIndex(agent_id,
+        state.componentID<Action>().id);
+    for (CountT i = 0; i < num_worlds; i++) {
+        auto *world_actions = (Action *)state.getArchetypeColumn(
+            uint32_t(i), agent_id, action_col);
+        EXPECT_EQ(world_actions, actions + i * info->rowsPerWorld);
+        world_actions[0].v[0] = int32_t(i);
+    }
+
+    return numMappings() - num_before;
+}
+
+// Per world tables must not add mappings per world, otherwise large world
+// counts run into vm.max_map_count (65530 by default)
+TEST(MWState, MappingsIndependentOfWorldCount)
+{
+    CountT few_worlds = mappingsForWorlds(16);
+    CountT many_worlds = mappingsForWorlds(16384);
+
+    EXPECT_LE(many_worlds, few_worlds + 16);
+    EXPECT_LT(many_worlds, 1024);
+}
+#endif
+
+TEST(MWState, RowsPerWorld)
+{
+    StateManager state(4, 1000);
+    StateCache cache;
+    state.registerComponent<Position>();
+    state.registerArchetype<Marker>();
+
+    Position *positions = state.exportColumn<Marker, Position>();
+    EXPECT_EQ(state.getExportInfo(positions)->rowsPerWorld, 1000);
+
+    for (CountT i = 0; i < 1000; i++) {
+        Entity e = state.makeEntityNow<Marker>(3, cache);
+        state.get<Position>(3, e).value() = { float(i), 0.f, 0.f };
+    }
+
+    EXPECT_EQ(positions[3 * 1000 + 999].x, 999.f);
+}
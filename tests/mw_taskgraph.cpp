@@ -0,0 +1,338 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/mw_cpu.hpp>
+#include <madrona/custom_context.hpp>
+#include <madrona/taskgraph_builder.hpp>
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+using namespace madrona;
+
+namespace {
+
+// Every row's stage values are derived from the previous stage's, so a node
+// that starts before its dependencies finish sees stale values
+struct RowInfo {
+    int32_t worldIdx;
+    int32_t rowIdx;
+    int32_t numVisits;
+};
+
+struct ValueA {
+    int32_t v;
+};
+
+struct ValueB {
+    int32_t v;
+};
+
+struct ValueC {
+    int32_t v;
+};
+
+struct ValueD {
+    int32_t v;
+};
+
+struct Item : Archetype<RowInfo, ValueA, ValueB, ValueC, ValueD> {};
+
+struct StepState {
+    int32_t step;
+};
+
+class Engine;
+
+// A diamond of parallel nodes (A before B and C, both before D) followed
+// by a single invocation node that finishes the step:
+//   A -> B -> D -> finish
+//   A -> C -> D
+struct Sim : public WorldBase {
+    struct Config {};
+
+    struct Init {
+        CountT numRows;
+    };
+
+    static void registerTypes(ECSRegistry &registry, const Config &)
+    {
+        registry.registerComponent<RowInfo>();
+        registry.registerComponent<ValueA>();
+        registry.registerComponent<ValueB>();
+        registry.registerComponent<ValueC>();
+        registry.registerComponent<ValueD>();
+        registry.registerArchetype<Item>();
+        registry.registerSingleton<StepState>();
+    }
+
+    static void setupTasks(TaskGraphBuilder &builder, const Config &);
+
+    inline Sim(Engine &ctx, const Config &, const Init &init);
+
+    // Rows each stage has finished this step, 0: A, 1: B, 2: C, 3: D
+    std::atomic<int32_t> numFinished[4];
+    std::atomic<int32_t> numErrors;
+    int32_t numRows;
+    int32_t numSteps;
+    Engine *ctx;
+    std::vector<Entity> items;
+};
+
+class Engine : public CustomContext<Engine, Sim> {
+    using CustomContext::CustomContext;
+};
+
+Sim::Sim(Engine &ctx, const Config &, const Init &init)
+    : WorldBase(ctx),
+      numFinished {},
+      numErrors(0),
+      numRows((int32_t)init.numRows),
+      numSteps(0),
+      ctx(&ctx),
+      items()
+{
+    ctx.singleton<StepState>().step = 0;
+
+    for (CountT i = 0; i < init.numRows; i++) {
+        Entity e = ctx.makeEntity<Item>();
+        ctx.get<RowInfo>(e) = {
+            .worldIdx = ctx.worldID().idx,
+            .rowIdx = (int32_t)i,
+            .numVisits = 0,
+        };
+        ctx.get<ValueA>(e).v = 0;
+        ctx.get<ValueB>(e).v = 0;
+        ctx.get<ValueC>(e).v = 0;
+        ctx.get<ValueD>(e).v = 0;
+
+        items.push_back(e);
+    }
+}
+
+void checkFinished(Engine &ctx, CountT stage)
+{
+    Sim &sim = ctx.data();
+    if (sim.numFinished[stage].load(std::memory_order_relaxed) !=
+            sim.numRows) {
+        sim.numErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void stageA(Engine &ctx, RowInfo &info, ValueA &a)
+{
+    Sim &sim = ctx.data();
+
+    // Rows must only be visited by their own world's context
+    if (info.worldIdx != ctx.worldID().idx) {
+        sim.numErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    info.numVisits += 1;
+    a.v = info.rowIdx + ctx.singleton<StepState>().step;
+
+    sim.numFinished[0].fetch_add(1, std::memory_order_relaxed);
+}
+
+void stageB(Engine &ctx, const ValueA &a, ValueB &b)
+{
+    checkFinished(ctx, 0);
+    b.v = a.v * 2;
+    ctx.data().numFinished[1].fetch_add(1, std::memory_order_relaxed);
+}
+
+void stageC(Engine &ctx, const ValueA &a, ValueC &c)
+{
+    checkFinished(ctx, 0);
+    c.v = a.v * 3;
+    ctx.data().numFinished[2].fetch_add(1, std::memory_order_relaxed);
+}
+
+void stageD(Engine &ctx, const ValueB &b, const ValueC &c, ValueD &d)
+{
+    checkFinished(ctx, 1);
+    checkFinished(ctx, 2);
+
+    if (b.v * 3 != c.v * 2) {
+        ctx.data().numErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    d.v = b.v + c.v;
+    ctx.data().numFinished[3].fetch_add(1, std::memory_order_relaxed);
+}
+
+void finishStep(Engine &ctx, StepState &state)
+{
+    Sim &sim = ctx.data();
+    checkFinished(ctx, 3);
+
+    for (std::atomic<int32_t> &num_finished : sim.numFinished) {
+        num_finished.store(0, std::memory_order_relaxed);
+    }
+
+    state.step += 1;
+    sim.numSteps += 1;
+}
+
+void Sim::setupTasks(TaskGraphBuilder &builder, const Config &)
+{
+    auto a = builder.addToGraph<ParallelForNode<Engine, stageA,
+        RowInfo, ValueA>>({});
+    auto b = builder.addToGraph<ParallelForNode<Engine, stageB,
+        ValueA, ValueB>>({a});
+    auto c = builder.addToGraph<ParallelForNode<Engine, stageC,
+        ValueA, ValueC>>({a});
+    auto d = builder.addToGraph<ParallelForNode<Engine, stageD,
+        ValueB, ValueC, ValueD>>({b, c});
+    builder.addToGraph<ParallelForNode<Engine, finishStep,
+        StepState>>({d});
+}
+
+using Executor = TaskGraphExecutor<Engine, Sim, Sim::Config, Sim::Init>;
+
+// Checks world_idx went through num_steps full steps, each visiting every
+// row exactly once
+void checkWorld(Executor &exec, CountT world_idx, int32_t num_steps)
+{
+    Sim &sim = exec.getWorldData(world_idx);
+    Engine &ctx = *sim.ctx;
+
+    EXPECT_EQ(sim.numErrors.load(), 0) << "world " << world_idx;
+    EXPECT_EQ(sim.numSteps, num_steps) << "world " << world_idx;
+    EXPECT_EQ(ctx.singleton<StepState>().step, num_steps) <<
+        "world " << world_idx;
+
+    if (num_steps == 0) {
+        return;
+    }
+
+    for (Entity e : sim.items) {
+        const RowInfo &info = ctx.get<RowInfo>(e);
+        int32_t a = info.rowIdx + num_steps - 1;
+
+        EXPECT_EQ(info.worldIdx, (int32_t)world_idx);
+        EXPECT_EQ(info.numVisits, num_steps) <<
+            "world " << world_idx << ", row " << info.rowIdx;
+        EXPECT_EQ(ctx.get<ValueD>(e).v, a * 5) <<
+            "world " << world_idx << ", row " << info.rowIdx;
+    }
+}
+
+}
+
+// Nodes must not start before every invocation of their dependencies has
+// finished, in any world, while independent nodes (B and C) may overlap
+TEST(TaskGraph, DependenciesOrderNodes)
+{
+    constexpr CountT num_worlds = 4;
+    constexpr int32_t num_steps = 20;
+
+    HeapArray<Sim::Init> inits(num_worlds);
+    for (CountT i = 0; i < num_worlds; i++) {
+        inits[i].numRows = 2000;
+    }
+
+    Executor exec({
+        .numWorlds = num_worlds,
+        .numExportedBuffers = 0,
+        .numWorkers = 4,
+    }, Sim::Config {}, inits.data());
+
+    for (int32_t i = 0; i < num_steps; i++) {
+        exec.run();
+    }
+
+    for (CountT i = 0; i < num_worlds; i++) {
+        checkWorld(exec, i, num_steps);
+    }
+}
+
+// ParallelForNode invocations are split into chunks across workers. Every
+// row must be visited exactly once, whether the world's table is empty,
+// smaller than a chunk or split into many chunks.
+TEST(TaskGraph, ParallelForCoversEveryRowOnce)
+{
+    constexpr std::array<CountT, 8> num_rows {
+        0, 1, 31, 32, 33, 257, 4099, 50000,
+    };
+    constexpr int32_t num_steps = 5;
+
+    HeapArray<Sim::Init> inits(num_rows.size());
+    for (CountT i = 0; i < (CountT)num_rows.size(); i++) {
+        inits[i].numRows = num_rows[i];
+    }
+
+    Executor exec({
+        .numWorlds = (uint32_t)num_rows.size(),
+        .numExportedBuffers = 0,
+        .numWorkers = 3,
+    }, Sim::Config {}, inits.data());
+
+    for (int32_t i = 0; i < num_steps; i++) {
+        exec.run();
+    }
+
+    for (CountT i = 0; i < (CountT)num_rows.size(); i++) {
+        checkWorld(exec, i, num_steps);
+    }
+
+    // A single world gets split across all the workers
+    HeapArray<Sim::Init> single_init(1);
+    single_init[0].numRows = 50000;
+
+    Executor single_exec({
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 4,
+    }, Sim::Config {}, single_init.data());
+
+    for (int32_t i = 0; i < num_steps; i++) {
+        single_exec.run();
+    }
+
+    checkWorld(single_exec, 0, num_steps);
+}
+
+// Worlds only ever see their own rows, and stepping a subset of the worlds
+// leaves the others untouched
+TEST(TaskGraph, WorldsRunIndependently)
+{
+    constexpr CountT num_worlds = 6;
+
+    HeapArray<Sim::Init> inits(num_worlds);
+    for (CountT i = 0; i < num_worlds; i++) {
+        inits[i].numRows = 500 + 100 * i;
+    }
+
+    Executor exec({
+        .numWorlds = num_worlds,
+        .numExportedBuffers = 0,
+        .numWorkers = 4,
+    }, Sim::Config {}, inits.data());
+
+    exec.run();
+
+    std::array<int32_t, 2> odd_worlds { 1, 3 };
+    for (CountT i = 0; i < 3; i++) {
+        exec.run(Span<const int32_t>(odd_worlds.data(), odd_worlds.size()));
+    }
+
+    std::array<bool, num_worlds> mask {
+        false, false, true, false, false, true,
+    };
+    exec.run(Span<const bool>(mask.data(), mask.size()));
+
+    checkWorld(exec, 0, 1);
+    checkWorld(exec, 1, 4);
+    checkWorld(exec, 2, 2);
+    checkWorld(exec, 3, 4);
+    checkWorld(exec, 4, 1);
+    checkWorld(exec, 5, 2);
+}
@@ -0,0 +1,1252 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/mw_cpu.hpp>
+#include <madrona/custom_context.hpp>
+#include <madrona/physics.hpp>
+#include <madrona/physics_assets.hpp>
+#include <madrona/importer.hpp>
+
+#include "../src/physics/physics_impl.hpp"
+#include "../src/physics/solver_simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace madrona;
+using namespace madrona::base;
+using namespace madrona::math;
+using namespace madrona::phys;
+
+namespace {
+
+// Columns must line up with phys::Cols
+struct PhysicsBody : Archetype<
+    Position,
+    Rotation,
+    Scale,
+    Velocity,
+    ObjectID,
+    ResponseType,
+    solver::SubstepPrevState,
+    solver::PreSolvePositional,
+    solver::PreSolveVelocity,
+    ExternalForce,
+    ExternalTorque,
+    broadphase::LeafID
+> {};
+
+enum class Object : int32_t {
+    Ground,
+    Cube,
+};
+
+// A ground plane (z = 0, facing +z) and a unit cube given as explicit
+// faces, so importing doesn't build a hull
+struct TestObjects {
+    std::array<Vector3, 8> positions;
+    std::array<uint32_t, 24> indices {
+        0, 2, 3, 1,
+        4, 5, 7, 6,
+        0, 1, 5, 4,
+        2, 6, 7, 3,
+        0, 4, 6, 2,
+        1, 3, 7, 5,
+    };
+    std::array<uint32_t, 6> faceCounts { 4, 4, 4, 4, 4, 4 };
+    imp::SourceMesh mesh;
+    std::array<PhysicsLoader::SourceCollisionPrimitive, 2> prims;
+    PhysicsLoader loader;
+
+    TestObjects()
+        : loader(ExecMode::CPU, 2)
+    {
+        for (CountT i = 0; i < 8; i++) {
+            positions[i] = {
+                (i & 1) ? 0.5f : -0.5f,
+                (i & 2) ? 0.5f : -0.5f,
+                (i & 4) ? 0.5f : -0.5f,
+            };
+        }
+
+        mesh = {
+            .positions = positions.data(),
+            .normals = nullptr,
+            .tangentAndSigns = nullptr,
+            .uvs = nullptr,
+            .indices = indices.data(),
+            .faceCounts = faceCounts.data(),
+            .numVertices = 8,
+            .numFaces = 6,
+            .materialIDX = 0,
+        };
+
+        prims[0].type = CollisionPrimitive::Type::Plane;
+        prims[1].type = CollisionPrimitive::Type::Hull;
+        prims[1].hullInput.mesh = &mesh;
+
+        std::array<PhysicsLoader::SourceCollisionObject, 2> objs {{
+            {
+                .prims = Span<const PhysicsLoader::SourceCollisionPrimitive>(
+                    &prims[0], 1),
+                .invMass = 0.f,
+                .friction = { 0.5f, 0.5f },
+            },
+            {
+                .prims = Span<const PhysicsLoader::SourceCollisionPrimitive>(
+                    &prims[1], 1),
+                .invMass = 1.f,
+                .friction = { 0.5f, 0.5f },
+            },
+        }};
+
+        Optional<PhysicsLoader::ImportedRigidBodies> imported =
+            loader.importRigidBodyData(objs.data(), objs.size(), false);
+        if (!imported.has_value()) {
+            FATAL("Failed to import test objects");
+        }
+
+        loader.loadObjects(imported->metadatas.data(),
+            imported->objectAABBs.data(),
+            imported->primOffsets.data(),
+            imported->primCounts.data(),
+            objs.size(),
+            imported->collisionPrimitives.data(),
+            imported->primitiveAABBs.data(),
+            imported->collisionPrimitives.size(),
+            imported->hullData.halfEdges.data(),
+            imported->hullData.halfEdges.size(),
+            imported->hullData.faceBaseHEs.data(),
+            imported->hullData.facePlanes.data(),
+            imported->hullData.facePlanes.size(),
+            imported->hullData.positions.data(),
+            imported->hullData.positions.size());
+    }
+
+    ObjectManager * objectManager()
+    {
+        return &loader.getObjectManager();
+    }
+};
+
+struct BodyDesc {
+    Object obj;
+    ResponseType responseType;
+    Vector3 position;
+    Vector3 linearVelocity = Vector3::zero();
+};
+
+class Engine;
+
+struct Sim : public WorldBase {
+    static constexpr inline float deltaT = 1.f / 30.f;
+    static constexpr inline CountT numSubsteps = 4;
+    static constexpr inline CountT maxBodies = 64;
+    static constexpr inline CountT maxContacts = maxBodies * 16;
+    static constexpr inline CountT maxJoints = 16;
+
+    struct Config {
+        ObjectManager *objMgr;
+        // Only runs the broadphase, copying its candidates into
+        // Sim::candidates
+        bool recordCandidates = false;
+    };
+
+    struct Init {
+        std::vector<BodyDesc> bodies;
+        bool warmStartContacts = true;
+        // Sleeping is off unless a test asks for it
+        float timeToSleep = INFINITY;
+    };
+
+    static void registerTypes(ECSRegistry &registry, const Config &)
+    {
+        base::registerTypes(registry);
+        RigidBodyPhysicsSystem::registerTypes(registry);
+
+        registry.registerArchetype<PhysicsBody>();
+    }
+
+    static void setupTasks(TaskGraphBuilder &builder, const Config &cfg);
+
+    inline Sim(Engine &ctx, const Config &cfg, const Init &init);
+
+    Entity addBody(const BodyDesc &desc);
+    void removeBody(Entity e);
+
+    Engine *ctx;
+    std::vector<Entity> bodies;
+    std::vector<CandidateCollision> candidates;
+};
+
+class Engine : public CustomContext<Engine, Sim> {
+    using CustomContext::CustomContext;
+};
+
+// Tests run a single worker, so this never runs concurrently
+void recordCandidateSystem(Engine &ctx, const CandidateCollision &candidate)
+{
+    ctx.data().candidates.push_back(candidate);
+}
+
+void Sim::setupTasks(TaskGraphBuilder &builder, const Config &cfg)
+{
+    auto broadphase =
+        RigidBodyPhysicsSystem::setupBroadphaseTasks(builder, {});
+
+    if (cfg.recordCandidates) {
+        auto find_overlaps =
+            broadphase::setupPreIntegrationTasks(builder, {broadphase});
+        auto record = builder.addToGraph<ParallelForNode<Engine,
+            recordCandidateSystem, CandidateCollision>>({find_overlaps});
+        builder.addToGraph<ClearTmpNode<CandidateTemporary>>({record});
+        return;
+    }
+
+    auto substeps = RigidBodyPhysicsSystem::setupSubstepTasks(
+        builder, {broadphase}, numSubsteps);
+    RigidBodyPhysicsSystem::setupCleanupTasks(builder, {substeps});
+}
+
+Sim::Sim(Engine &ctx, const Config &cfg, const Init &init)
+    : WorldBase(ctx),
+      ctx(&ctx),
+      bodies(),
+      candidates()
+{
+    RigidBodyPhysicsSystem::init(ctx, cfg.objMgr, deltaT, numSubsteps,
+                                 Vector3 { 0, 0, -9.8f }, maxBodies,
+                                 maxContacts, maxJoints);
+    RigidBodyPhysicsSystem::configureContactWarmStart(
+        ctx, init.warmStartContacts);
+    RigidBodyPhysicsSystem::configureSleep(ctx, 0.01f, init.timeToSleep);
+
+    for (const BodyDesc &desc : init.bodies) {
+        bodies.push_back(addBody(desc));
+    }
+}
+
+Entity Sim::addBody(const BodyDesc &desc)
+{
+    Entity e = ctx->makeEntity<PhysicsBody>();
+    ctx->get<Position>(e) = desc.position;
+    ctx->get<Rotation>(e) = Quat { 1, 0, 0, 0 };
+    ctx->get<Scale>(e) = Diag3x3 { 1, 1, 1 };
+    ctx->get<Velocity>(e) = { desc.linearVelocity, Vector3::zero() };
+    ctx->get<ObjectID>(e) = ObjectID { (int32_t)desc.obj };
+    ctx->get<ResponseType>(e) = desc.responseType;
+    ctx->get<ExternalForce>(e) = Vector3::zero();
+    ctx->get<ExternalTorque>(e) = Vector3::zero();
+    ctx->get<broadphase::LeafID>(e) = RigidBodyPhysicsSystem::registerEntity(
+        *ctx, e, ObjectID { (int32_t)desc.obj }, desc.responseType);
+
+    return e;
+}
+
+void Sim::removeBody(Entity e)
+{
+    RigidBodyPhysicsSystem::unregisterEntity(*ctx,
+        ctx->get<broadphase::LeafID>(e), ctx->get<ResponseType>(e));
+    ctx->destroyEntity(e);
+}
+
+using Executor = TaskGraphExecutor<Engine, Sim, Sim::Config, Sim::Init>;
+
+// Unit cubes resting on top of each other on the ground
+std::vector<BodyDesc> makeStack(CountT num_cubes)
+{
+    std::vector<BodyDesc> bodies;
+    bodies.push_back({ Object::Ground, ResponseType::Static, Vector3::zero() });
+
+    for (CountT i = 0; i < num_cubes; i++) {
+        bodies.push_back({
+            Object::Cube,
+            ResponseType::Dynamic,
+            Vector3 { 0, 0, 0.5f + (float)i },
+        });
+    }
+
+    return bodies;
+}
+
+}
+
+// Without the contact cache every substep corrects each contact from zero,
+// one point at a time, and the uneven pushes keep even a single resting
+// cube sliding and spinning. Starting the position solve from the previous
+// substep's lambdas lets it come to rest, and keeps a small stack from
+// wandering off.
+TEST(Physics, WarmStartSettlesStacks)
+{
+    constexpr CountT num_steps = 120;
+
+    TestObjects objects;
+
+    std::array<Sim::Init, 4> inits;
+    for (CountT i = 0; i < 4; i++) {
+        // Worlds 0 & 1 hold a single cube, 2 & 3 a stack of two
+        inits[i].bodies = makeStack(i < 2 ? 1 : 2);
+        inits[i].warmStartContacts = (i % 2) == 1;
+    }
+
+    Executor exec({
+        .numWorlds = 4,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config { objects.objectManager() }, inits.data());
+
+    for (CountT i = 0; i < num_steps; i++) {
+        exec.run();
+    }
+
+    // Furthest any cube has moved off the stack's axis
+    auto maxDrift = [&](CountT world_idx) {
+        Sim &sim = exec.getWorldData(world_idx);
+
+        float max_drift = 0.f;
+        for (CountT i = 1; i < (CountT)sim.bodies.size(); i++) {
+            Position pos = sim.ctx->get<Position>(sim.bodies[i]);
+            max_drift = std::max(max_drift,
+                Vector3 { pos.x, pos.y, 0 }.length());
+        }
+
+        return max_drift;
+    };
+
+    auto cubeVelocity = [&](CountT world_idx) {
+        Sim &sim = exec.getWorldData(world_idx);
+        return sim.ctx->get<Velocity>(sim.bodies[1]);
+    };
+
+    Velocity cold_vel = cubeVelocity(0);
+    Velocity warm_vel = cubeVelocity(1);
+
+    EXPECT_GT(cold_vel.linear.length(), 1e-3f);
+    EXPECT_GT(cold_vel.angular.length(), 1e-3f);
+    EXPECT_LT(warm_vel.linear.length(), 1e-4f);
+    EXPECT_LT(warm_vel.angular.length(), 1e-4f);
+    EXPECT_LT(maxDrift(1), 1e-3f);
+
+    EXPECT_LT(maxDrift(3), 0.25f * maxDrift(2));
+
+    for (CountT w = 0; w < 4; w++) {
+        Sim &sim = exec.getWorldData(w);
+        Position top = sim.ctx->get<Position>(sim.bodies.back());
+        float rest_height = (float)sim.bodies.size() - 1.5f;
+
+        EXPECT_NEAR(top.z, rest_height, 0.01f) << "world " << w;
+    }
+}
+
+namespace {
+
+bool isAsleep(Sim &sim, Entity e)
+{
+    return RigidBodyPhysicsSystem::isBodyAsleep(*sim.ctx,
+        sim.ctx->get<broadphase::LeafID>(e));
+}
+
+int32_t islandRoot(Sim &sim, Entity e)
+{
+    SleepData &sleep = sim.ctx->singleton<SleepData>();
+    return sleep.bodies[sim.ctx->get<broadphase::LeafID>(e).id].island;
+}
+
+Sim::Init makeSleepingInit(std::vector<BodyDesc> bodies)
+{
+    Sim::Init init;
+    init.bodies = std::move(bodies);
+    init.timeToSleep = 0.5f;
+
+    return init;
+}
+
+// Steps until every body in the world is asleep, fails after max_steps
+void runUntilAsleep(Executor &exec, Sim &sim, CountT max_steps)
+{
+    for (CountT i = 0; i < max_steps; i++) {
+        exec.run();
+
+        bool all_asleep = true;
+        for (CountT j = 1; j < (CountT)sim.bodies.size(); j++) {
+            all_asleep = all_asleep && isAsleep(sim, sim.bodies[j]);
+        }
+
+        if (all_asleep) {
+            return;
+        }
+    }
+
+    ADD_FAILURE() << "Bodies didn't fall asleep in " << max_steps << " steps";
+}
+
+}
+
+TEST(Physics, RestingIslandSleeps)
+{
+    TestObjects objects;
+    Sim::Init init = makeSleepingInit(makeStack(2));
+
+    Executor exec({
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config { objects.objectManager() }, &init);
+
+    Sim &sim = exec.getWorldData(0);
+    Entity bottom = sim.bodies[1];
+    Entity top = sim.bodies[2];
+
+    // The stack needs timeToSleep (15 steps) at rest first
+    for (CountT i = 0; i < 10; i++) {
+        exec.run();
+        EXPECT_FALSE(isAsleep(sim, bottom));
+        EXPECT_FALSE(isAsleep(sim, top));
+    }
+
+    runUntilAsleep(exec, sim, 30);
+    EXPECT_EQ(islandRoot(sim, bottom), islandRoot(sim, top));
+
+    Position bottom_pos = sim.ctx->get<Position>(bottom);
+    Position top_pos = sim.ctx->get<Position>(top);
+
+    for (CountT i = 0; i < 30; i++) {
+        exec.run();
+        EXPECT_TRUE(isAsleep(sim, bottom));
+        EXPECT_TRUE(isAsleep(sim, top));
+    }
+
+    // Sleeping bodies aren't integrated or solved at all
+    Position bottom_after = sim.ctx->get<Position>(bottom);
+    Position top_after = sim.ctx->get<Position>(top);
+    EXPECT_EQ(bottom_pos.x, bottom_after.x);
+    EXPECT_EQ(bottom_pos.y, bottom_after.y);
+    EXPECT_EQ(bottom_pos.z, bottom_after.z);
+    EXPECT_EQ(top_pos.x, top_after.x);
+    EXPECT_EQ(top_pos.y, top_after.y);
+    EXPECT_EQ(top_pos.z, top_after.z);
+}
+
+TEST(Physics, SleepingBodyWakesOnContact)
+{
+    TestObjects objects;
+    Sim::Init init = makeSleepingInit(makeStack(1));
+
+    Executor exec({
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config { objects.objectManager() }, &init);
+
+    Sim &sim = exec.getWorldData(0);
+    Entity resting = sim.bodies[1];
+
+    runUntilAsleep(exec, sim, 30);
+
+    Entity falling = sim.addBody({
+        Object::Cube,
+        ResponseType::Dynamic,
+        Vector3 { 0.25f, 0, 3.f },
+    });
+    sim.bodies.push_back(falling);
+
+    bool woke = false;
+    for (CountT i = 0; i < 30 && !woke; i++) {
+        exec.run();
+        woke = !isAsleep(sim, resting);
+    }
+    EXPECT_TRUE(woke);
+
+    // Once the pair settles it sleeps again as one island
+    runUntilAsleep(exec, sim, 120);
+    EXPECT_EQ(islandRoot(sim, resting), islandRoot(sim, falling));
+    EXPECT_GT(sim.ctx->get<Position>(falling).z, 1.f);
+}
+
+TEST(Physics, SleepingBodyWakesOnVelocity)
+{
+    TestObjects objects;
+    Sim::Init init = makeSleepingInit(makeStack(1));
+
+    Executor exec({
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config { objects.objectManager() }, &init);
+
+    Sim &sim = exec.getWorldData(0);
+    Entity cube = sim.bodies[1];
+
+    runUntilAsleep(exec, sim, 30);
+
+    float rest_z = sim.ctx->get<Position>(cube).z;
+    sim.ctx->get<Velocity>(cube).linear = Vector3 { 0, 0, 3.f };
+
+    exec.run();
+
+    EXPECT_FALSE(isAsleep(sim, cube));
+    EXPECT_GT(sim.ctx->get<Position>(cube).z, rest_z + 0.05f);
+}
+
+// Removing the body an island is rooted at must not leave the rest of the
+// island asleep (and floating), or linked to whichever body gets the
+// root's leaf ID next.
+TEST(Physics, UnregisteringIslandRootWakesIsland)
+{
+    TestObjects objects;
+    Sim::Init init = makeSleepingInit(makeStack(2));
+
+    Executor exec({
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config { objects.objectManager() }, &init);
+
+    Sim &sim = exec.getWorldData(0);
+    Entity bottom = sim.bodies[1];
+    Entity top = sim.bodies[2];
+
+    runUntilAsleep(exec, sim, 30);
+
+    broadphase::LeafID root_leaf = sim.ctx->get<broadphase::LeafID>(bottom);
+    ASSERT_EQ(islandRoot(sim, top), root_leaf.id);
+
+    sim.removeBody(bottom);
+    sim.bodies.erase(sim.bodies.begin() + 1);
+
+    exec.run();
+    EXPECT_FALSE(isAsleep(sim, top));
+
+    // The freed ID is handed out again once the tree has been updated
+    Entity other = sim.addBody({
+        Object::Cube,
+        ResponseType::Dynamic,
+        Vector3 { 5.f, 0, 0.5f },
+    });
+    sim.bodies.push_back(other);
+    EXPECT_EQ(sim.ctx->get<broadphase::LeafID>(other).id, root_leaf.id);
+
+    runUntilAsleep(exec, sim, 120);
+
+    // The top cube fell onto the ground and sleeps in its own island
+    EXPECT_NEAR(sim.ctx->get<Position>(top).z, 0.5f, 0.01f);
+    EXPECT_NE(islandRoot(sim, top), islandRoot(sim, other));
+
+    sim.ctx->get<Velocity>(other).linear = Vector3 { 0, 0, 3.f };
+    exec.run();
+
+    EXPECT_FALSE(isAsleep(sim, other));
+    EXPECT_TRUE(isAsleep(sim, top));
+}
+
+namespace {
+
+// Checks the batches colorConstraints built from the contacts and joints
+// currently in the solver
+void checkColoring(Sim &sim)
+{
+    Engine &ctx = *sim.ctx;
+    SolverData &solver = ctx.singleton<SolverData>();
+
+    CountT num_contacts = solver.numContacts.load_relaxed();
+    CountT num_joints = solver.numJointConstraints.load_relaxed();
+    CountT num_items = num_contacts + num_joints;
+    constexpr CountT overflow_color = SolverData::maxColors;
+
+    ASSERT_EQ(solver.colorOffsets[0], 0);
+    ASSERT_EQ(solver.colorOffsets[overflow_color + 1], num_items);
+
+    // Leaf IDs of the item's non-static bodies, -1 for static ones
+    auto itemBodies = [&](int32_t item) {
+        Loc locs[2];
+        if (item >= 0) {
+            locs[0] = solver.contacts[item].ref;
+            locs[1] = solver.contacts[item].alt;
+        } else {
+            locs[0] = ctx.loc(solver.jointConstraints[~item].e1);
+            locs[1] = ctx.loc(solver.jointConstraints[~item].e2);
+        }
+
+        std::array<int32_t, 2> bodies;
+        for (CountT i = 0; i < 2; i++) {
+            broadphase::LeafID leaf_id =
+                ctx.getDirect<broadphase::LeafID>(Cols::LeafID, locs[i]);
+            ResponseType response_type =
+                ctx.getDirect<ResponseType>(Cols::ResponseType, locs[i]);
+
+            bodies[i] = broadphase::isStaticLeaf(leaf_id, response_type) ?
+                -1 : leaf_id.id;
+        }
+
+        return bodies;
+    };
+
+    auto sharesBody = [&](int32_t a, int32_t b) {
+        for (int32_t body_a : itemBodies(a)) {
+            for (int32_t body_b : itemBodies(b)) {
+                if (body_a != -1 && body_a == body_b) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    };
+
+    // Every item is batched exactly once
+    std::vector<int32_t> seen(num_items, 0);
+    for (CountT i = 0; i < num_items; i++) {
+        int32_t item = solver.batchItems[i];
+        CountT idx = item >= 0 ? item : num_contacts + ~item;
+        ASSERT_LT(idx, num_items);
+        seen[idx] += 1;
+    }
+
+    for (CountT i = 0; i < num_items; i++) {
+        EXPECT_EQ(seen[i], 1) << "item " << i;
+    }
+
+    for (CountT c = 0; c < overflow_color; c++) {
+        int32_t start = solver.colorOffsets[c];
+        int32_t end = solver.colorOffsets[c + 1];
+        ASSERT_LE(start, end);
+
+        for (int32_t i = start; i < end; i++) {
+            for (int32_t j = i + 1; j < end; j++) {
+                EXPECT_FALSE(sharesBody(solver.batchItems[i],
+                                        solver.batchItems[j]))
+                    << "color " << c;
+            }
+        }
+    }
+
+    // Items only overflow when each color already holds an item sharing
+    // one of their bodies
+    for (int32_t i = solver.colorOffsets[overflow_color];
+         i < solver.colorOffsets[overflow_color + 1]; i++) {
+        for (CountT c = 0; c < overflow_color; c++) {
+            bool conflict = false;
+            for (int32_t j = solver.colorOffsets[c];
+                 j < solver.colorOffsets[c + 1] && !conflict; j++) {
+                conflict = sharesBody(solver.batchItems[i],
+                                      solver.batchItems[j]);
+            }
+
+            EXPECT_TRUE(conflict) << "overflow item could use color " << c;
+        }
+    }
+
+    for (CountT i = 0; i < Sim::maxBodies; i++) {
+        EXPECT_EQ(solver.bodyColorMasks[i], 0u) << "body " << i;
+    }
+}
+
+}
+
+TEST(Physics, ConstraintColoring)
+{
+    constexpr CountT num_cubes = 40;
+
+    TestObjects objects;
+
+    // A static ground, one kinematic body and a row of dynamic cubes.
+    // Their poses don't matter, the contacts below are made up.
+    Sim::Init init;
+    init.bodies = makeStack(0);
+    init.bodies.push_back({
+        Object::Cube,
+        ResponseType::Kinematic,
+        Vector3 { 0, 0, 10.f },
+    });
+
+    for (CountT i = 0; i < num_cubes; i++) {
+        init.bodies.push_back({
+            Object::Cube,
+            ResponseType::Dynamic,
+            Vector3 { 2.f * (float)i, 0, 0.5f },
+        });
+    }
+
+    Executor exec({
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config { objects.objectManager() }, &init);
+
+    Sim &sim = exec.getWorldData(0);
+    Engine &ctx = *sim.ctx;
+    SolverData &solver = ctx.singleton<SolverData>();
+
+    Entity ground = sim.bodies[0];
+    Entity kinematic = sim.bodies[1];
+    auto cube = [&](CountT i) {
+        return sim.bodies[2 + i];
+    };
+
+    auto addContact = [&](Entity a, Entity b) {
+        CountT idx = solver.numContacts.load_relaxed();
+        solver.contacts[idx] = {};
+        solver.contacts[idx].ref = ctx.loc(a);
+        solver.contacts[idx].alt = ctx.loc(b);
+        solver.numContacts.store_relaxed(idx + 1);
+    };
+
+    auto addJoint = [&](Entity a, Entity b) {
+        CountT idx = solver.numJointConstraints.load_relaxed();
+        solver.jointConstraints[idx].e1 = a;
+        solver.jointConstraints[idx].e2 = b;
+        solver.numJointConstraints.store_relaxed(idx + 1);
+    };
+
+    auto reset = [&]() {
+        solver.numContacts.store_relaxed(0);
+        solver.numJointConstraints.store_relaxed(0);
+    };
+
+    // One cube touching 12 others fills every color, the rest overflow
+    for (CountT i = 1; i <= 12; i++) {
+        addContact(cube(0), cube(i));
+    }
+
+    solver::colorConstraints(ctx, solver);
+    checkColoring(sim);
+
+    constexpr CountT overflow_color = SolverData::maxColors;
+    for (CountT c = 0; c < overflow_color; c++) {
+        EXPECT_EQ(solver.colorOffsets[c + 1] - solver.colorOffsets[c], 1);
+    }
+    EXPECT_EQ(solver.colorOffsets[overflow_color + 1] -
+              solver.colorOffsets[overflow_color], 12 - overflow_color);
+
+    // Static bodies don't take up colors, so any number of contacts with
+    // the ground fit in a single batch. The kinematic body does.
+    reset();
+    for (CountT i = 0; i < num_cubes; i++) {
+        addContact(ground, cube(i));
+    }
+    addContact(kinematic, cube(0));
+    addContact(cube(1), kinematic);
+
+    solver::colorConstraints(ctx, solver);
+    checkColoring(sim);
+    EXPECT_EQ(solver.colorOffsets[1], num_cubes);
+    EXPECT_EQ(solver.colorOffsets[overflow_color + 1] -
+              solver.colorOffsets[overflow_color], 0);
+
+    // Random constraint graphs, dense enough to overflow now and then
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<CountT> pick_body(-2, num_cubes - 1);
+    auto randomBody = [&]() {
+        CountT idx = pick_body(rng);
+        if (idx == -2) {
+            return ground;
+        } else if (idx == -1) {
+            return kinematic;
+        } else {
+            return cube(idx);
+        }
+    };
+
+    CountT num_overflowed = 0;
+    for (CountT round = 0; round < 50; round++) {
+        reset();
+
+        CountT num_contacts = std::uniform_int_distribution<CountT>(
+            0, Sim::maxContacts / 4)(rng);
+        for (CountT i = 0; i < num_contacts; i++) {
+            Entity a = randomBody();
+            Entity b = randomBody();
+            if (a == b) {
+                continue;
+            }
+
+            addContact(a, b);
+        }
+
+        CountT num_joints = std::uniform_int_distribution<CountT>(
+            0, Sim::maxJoints)(rng);
+        for (CountT i = 0; i < num_joints; i++) {
+            CountT a = std::uniform_int_distribution<CountT>(
+                0, num_cubes - 2)(rng);
+            addJoint(cube(a), cube(a + 1));
+        }
+
+        solver::colorConstraints(ctx, solver);
+        checkColoring(sim);
+
+        num_overflowed += solver.colorOffsets[overflow_color + 1] -
+            solver.colorOffsets[overflow_color];
+    }
+
+    EXPECT_GT(num_overflowed, 0);
+
+    reset();
+}
+
+namespace {
+
+struct BodyState {
+    Vector3 x;
+    Quat q;
+    Velocity vel;
+};
+
+// Compares bits rather than values, so 0 vs -0 and differing NaNs count
+template <typename T>
+bool bitEqual(const T &a, const T &b)
+{
+    return memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+Vector3 randomVector(std::mt19937 &rng, float range)
+{
+    std::uniform_real_distribution<float> coord(-range, range);
+    return Vector3 { coord(rng), coord(rng), coord(rng) };
+}
+
+Quat randomRotation(std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> coord(-1.f, 1.f);
+    return Quat { coord(rng), coord(rng), coord(rng), coord(rng) }
+        .normalize();
+}
+
+}
+
+// The CPU solves each color batch through the SoA kernels in
+// solver_simd.hpp, the GPU one constraint at a time through the scalar
+// functions. Both must produce exactly the same bodies and lambdas.
+TEST(Physics, SIMDSolverMatchesScalar)
+{
+    constexpr CountT max_lanes = solver::simd::laneWidth;
+    constexpr CountT num_trials = 2000;
+
+    TestObjects objects;
+
+    // Lane i uses cubes 2i and 2i + 1, so lanes never share a body
+    Sim::Init init;
+    init.bodies = makeStack(0);
+    for (CountT i = 0; i < 2 * max_lanes; i++) {
+        init.bodies.push_back({
+            Object::Cube,
+            ResponseType::Dynamic,
+            Vector3 { 2.f * (float)i, 0, 0.5f },
+        });
+    }
+
+    Executor exec({
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config { objects.objectManager() }, &init);
+
+    Sim &sim = exec.getWorldData(0);
+    Engine &ctx = *sim.ctx;
+    SolverData &solver = ctx.singleton<SolverData>();
+    ObjectManager &obj_mgr = *ctx.singleton<ObjectData>().mgr;
+
+    CountT num_bodies = sim.bodies.size();
+    std::vector<BodyState> before(num_bodies);
+    std::vector<BodyState> scalar(num_bodies);
+    std::vector<BodyState> lanes(num_bodies);
+    std::array<Contact, max_lanes> contacts_before;
+    std::array<Contact, max_lanes> scalar_contacts;
+
+    auto save = [&](std::vector<BodyState> &states) {
+        for (CountT i = 0; i < num_bodies; i++) {
+            Entity e = sim.bodies[i];
+            states[i] = {
+                ctx.get<Position>(e),
+                ctx.get<Rotation>(e),
+                ctx.get<Velocity>(e),
+            };
+        }
+    };
+
+    auto restore = [&](const std::vector<BodyState> &states) {
+        for (CountT i = 0; i < num_bodies; i++) {
+            Entity e = sim.bodies[i];
+            ctx.get<Position>(e) = states[i].x;
+            ctx.get<Rotation>(e) = states[i].q;
+            ctx.get<Velocity>(e) = states[i].vel;
+        }
+    };
+
+    std::mt19937 rng(19);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    // Guards against the solves skipping every contact
+    CountT num_moved = 0;
+    CountT num_braked = 0;
+
+    for (CountT trial = 0; trial < num_trials; trial++) {
+        for (CountT i = 1; i < num_bodies; i++) {
+            Entity e = sim.bodies[i];
+            Vector3 x = randomVector(rng, 2.f);
+            Quat q = randomRotation(rng);
+
+            ctx.get<Position>(e) = x;
+            ctx.get<Rotation>(e) = q;
+            ctx.get<Velocity>(e) = {
+                randomVector(rng, 2.f),
+                randomVector(rng, 2.f),
+            };
+            ctx.get<solver::SubstepPrevState>(e) = {
+                x + randomVector(rng, 0.1f),
+                randomRotation(rng),
+            };
+            ctx.get<solver::PreSolvePositional>(e) = {
+                x + randomVector(rng, 0.05f),
+                randomRotation(rng),
+            };
+            ctx.get<solver::PreSolveVelocity>(e) = {
+                randomVector(rng, 2.f),
+                randomVector(rng, 2.f),
+            };
+        }
+
+        CountT num_lanes =
+            std::uniform_int_distribution<CountT>(1, max_lanes)(rng);
+        int32_t items[max_lanes];
+
+        for (CountT lane = 0; lane < num_lanes; lane++) {
+            Entity a = sim.bodies[1 + 2 * lane];
+            Entity b = sim.bodies[2 + 2 * lane];
+
+            // Some contacts are against the static ground, on either side
+            float ground = unit(rng);
+            if (ground < 0.125f) {
+                a = sim.bodies[0];
+            } else if (ground < 0.25f) {
+                b = sim.bodies[0];
+            }
+
+            Contact &contact = solver.contacts[lane];
+            contact = {};
+            contact.ref = ctx.loc(a);
+            contact.alt = ctx.loc(b);
+            contact.numPoints =
+                std::uniform_int_distribution<int32_t>(1, 4)(rng);
+            contact.normal = randomVector(rng, 1.f).normalize();
+            contact.speculative = unit(rng) < 0.25f;
+
+            for (CountT i = 0; i < contact.numPoints; i++) {
+                // Mostly penetrating, some separated (speculative) points
+                float depth = unit(rng) * 0.15f - 0.05f;
+                contact.points[i] = Vector4::fromVector3(
+                    randomVector(rng, 1.f), depth);
+
+                // Some points start without a warm start lambda
+                contact.lambdaN[i] = unit(rng) < 0.25f ?
+                    0.f : -2.f * unit(rng);
+            }
+
+            items[lane] = (int32_t)lane;
+        }
+
+        auto compare = [&](const char *pass) {
+            for (CountT i = 0; i < num_bodies; i++) {
+                EXPECT_TRUE(bitEqual(scalar[i].x, lanes[i].x)) <<
+                    pass << ", trial " << trial << ", body " << i;
+                EXPECT_TRUE(bitEqual(scalar[i].q, lanes[i].q)) <<
+                    pass << ", trial " << trial << ", body " << i;
+                EXPECT_TRUE(bitEqual(scalar[i].vel, lanes[i].vel)) <<
+                    pass << ", trial " << trial << ", body " << i;
+            }
+
+            for (CountT lane = 0; lane < num_lanes; lane++) {
+                EXPECT_TRUE(bitEqual(scalar_contacts[lane].lambdaN,
+                                     solver.contacts[lane].lambdaN)) <<
+                    pass << ", trial " << trial << ", lane " << lane;
+            }
+        };
+
+        // Position solve
+        save(before);
+        std::copy_n(solver.contacts, num_lanes, contacts_before.begin());
+
+        for (CountT lane = 0; lane < num_lanes; lane++) {
+            solver::solvePositionsForItem(ctx, obj_mgr, solver, items[lane]);
+        }
+        save(scalar);
+        std::copy_n(solver.contacts, num_lanes, scalar_contacts.begin());
+
+        restore(before);
+        std::copy_n(contacts_before.begin(), num_lanes, solver.contacts);
+
+        solver::solvePositionsForLanes(ctx, obj_mgr, solver,
+                                       items, num_lanes);
+        save(lanes);
+        compare("positions");
+
+        num_moved += !bitEqual(before[1].x, scalar[1].x);
+
+        // Velocity solve, continuing from the position solve
+        save(before);
+        std::copy_n(solver.contacts, num_lanes, contacts_before.begin());
+
+        for (CountT lane = 0; lane < num_lanes; lane++) {
+            solver::solveVelocitiesForItem(ctx, obj_mgr, solver,
+                                           items[lane]);
+        }
+        save(scalar);
+        std::copy_n(solver.contacts, num_lanes, scalar_contacts.begin());
+
+        restore(before);
+        std::copy_n(contacts_before.begin(), num_lanes, solver.contacts);
+
+        solver::solveVelocitiesForLanes(ctx, obj_mgr, solver,
+                                        items, num_lanes);
+        save(lanes);
+        compare("velocities");
+
+        num_braked += !bitEqual(before[1].vel, scalar[1].vel);
+
+        if (::testing::Test::HasFailure()) {
+            break;
+        }
+    }
+
+    EXPECT_GT(num_moved, num_trials / 2);
+    EXPECT_GT(num_braked, num_trials / 2);
+}
+
+// Random add / remove / contains calls, checked against std::set. A small
+// capacity and a small pool of entities keep the table churning through
+// tombstones, and so through dropTombstones.
+TEST(Physics, CollisionExclusionsMatchSet)
+{
+    constexpr CountT max_pairs = 64;
+    constexpr CountT num_entities = 24;
+    constexpr CountT num_ops = 200'000;
+
+    std::mt19937 rng(21);
+
+    // Live entities never share an id, but their generations differ
+    std::vector<Entity> entities;
+    for (CountT i = 0; i < num_entities; i++) {
+        entities.push_back(Entity {
+            std::uniform_int_distribution<uint32_t>(0, 3)(rng),
+            (int32_t)(i * 7 + 3),
+        });
+    }
+
+    auto key = [](Entity a, Entity b) {
+        if (b.id < a.id) {
+            std::swap(a, b);
+        }
+
+        return std::make_pair(
+            (uint64_t(a.gen) << 32) | uint32_t(a.id),
+            (uint64_t(b.gen) << 32) | uint32_t(b.id));
+    };
+
+    CollisionExclusions exclusions(max_pairs);
+    std::set<std::pair<uint64_t, uint64_t>> expected;
+
+    std::uniform_int_distribution<CountT> pick_entity(0, num_entities - 1);
+    std::uniform_int_distribution<CountT> pick_op(0, 99);
+
+    auto checkAll = [&](CountT op) {
+        EXPECT_EQ(exclusions.numExcluded, expected.size()) << "op " << op;
+        EXPECT_LE(exclusions.numOccupied, exclusions.capacity / 2) <<
+            "op " << op;
+
+        for (Entity a : entities) {
+            for (Entity b : entities) {
+                if (a == b) {
+                    continue;
+                }
+
+                EXPECT_EQ(exclusions.contains(a, b),
+                          expected.count(key(a, b)) == 1) << "op " << op;
+            }
+        }
+    };
+
+    CountT num_adds = 0;
+    CountT num_removes = 0;
+    for (CountT op = 0; op < num_ops; op++) {
+        Entity a = entities[pick_entity(rng)];
+        Entity b = entities[pick_entity(rng)];
+        if (a == b) {
+            continue;
+        }
+
+        CountT kind = pick_op(rng);
+        if (kind < 40 && (CountT)expected.size() < max_pairs) {
+            exclusions.add(a, b);
+            expected.insert(key(a, b));
+            num_adds += 1;
+        } else if (kind < 80) {
+            exclusions.remove(a, b);
+            expected.erase(key(a, b));
+            num_removes += 1;
+        } else if (kind < 99) {
+            ASSERT_EQ(exclusions.contains(a, b),
+                      expected.count(key(a, b)) == 1) << "op " << op;
+        } else {
+            exclusions.dropTombstones();
+        }
+
+        if (op % 10'000 == 0) {
+            checkAll(op);
+        }
+
+        if (::testing::Test::HasFailure()) {
+            break;
+        }
+    }
+
+    checkAll(num_ops);
+    EXPECT_GT(num_adds, num_ops / 8);
+    EXPECT_GT(num_removes, num_ops / 8);
+
+    exclusions.clear();
+    for (Entity a : entities) {
+        for (Entity b : entities) {
+            EXPECT_FALSE(exclusions.contains(a, b));
+        }
+    }
+
+    rawDealloc(exclusions.entries);
+}
+
+namespace {
+
+// Unordered pairs of Sim::bodies indices the last step's broadphase
+// emitted candidates for
+std::set<std::pair<CountT, CountT>> candidatePairs(Sim &sim)
+{
+    auto bodyIdx = [&](Loc loc) {
+        for (CountT i = 0; i < (CountT)sim.bodies.size(); i++) {
+            if (sim.ctx->loc(sim.bodies[i]) == loc) {
+                return i;
+            }
+        }
+
+        ADD_FAILURE() << "candidate for an unknown body";
+        return CountT(-1);
+    };
+
+    std::set<std::pair<CountT, CountT>> pairs;
+    for (const CandidateCollision &candidate : sim.candidates) {
+        CountT a = bodyIdx(candidate.a);
+        CountT b = bodyIdx(candidate.b);
+        pairs.insert({ std::min(a, b), std::max(a, b) });
+    }
+
+    return pairs;
+}
+
+}
+
+// Collision filters and exclusions are applied while traversing the BVHs,
+// so the pairs they drop must not even reach the CandidateTemporary table
+TEST(Physics, FilteredPairsEmitNoCandidates)
+{
+    constexpr CountT num_cubes = 6;
+
+    TestObjects objects;
+
+    // Cubes overlapping each other and the ground, so every pair is a
+    // candidate unless filtered out
+    Sim::Init init;
+    init.bodies = makeStack(0);
+    for (CountT i = 0; i < num_cubes; i++) {
+        init.bodies.push_back({
+            Object::Cube,
+            ResponseType::Dynamic,
+            Vector3 { 0.1f * (float)i, 0, 0.45f },
+        });
+    }
+
+    Executor exec({
+        .numWorlds = 1,
+        .numExportedBuffers = 0,
+        .numWorkers = 1,
+    }, Sim::Config { objects.objectManager(), true }, &init);
+
+    Sim &sim = exec.getWorldData(0);
+    Engine &ctx = *sim.ctx;
+
+    constexpr CountT ground = 0;
+    auto cube = [](CountT i) {
+        return 1 + i;
+    };
+
+    auto step = [&]() {
+        sim.candidates.clear();
+        exec.run();
+        return candidatePairs(sim);
+    };
+
+    auto setFilter = [&](CountT body, CollisionFilter filter) {
+        Entity e = sim.bodies[body];
+        RigidBodyPhysicsSystem::setCollisionFilter(ctx,
+            ctx.get<broadphase::LeafID>(e), ctx.get<ResponseType>(e), filter);
+    };
+
+    // Cube 0 only accepts group 1, which cube 5 leaves. Cube 1 is in no
+    // group at all. Cubes 2 and 3 are excluded from each other, cube 4
+    // from the ground (a static tree pair).
+    setFilter(cube(0), CollisionFilter { 1u << 1, 1u << 1 });
+    setFilter(cube(1), CollisionFilter { 0, ~0u });
+    setFilter(cube(5), CollisionFilter { ~0u & ~(1u << 1), ~0u });
+    RigidBodyPhysicsSystem::disableCollisions(ctx,
+        sim.bodies[cube(2)], sim.bodies[cube(3)]);
+    RigidBodyPhysicsSystem::disableCollisions(ctx,
+        sim.bodies[cube(4)], sim.bodies[ground]);
+
+    auto collides = [&](CountT a, CountT b) {
+        if (a > b) {
+            std::swap(a, b);
+        }
+
+        if (a == cube(1) || b == cube(1)) {
+            return false;
+        }
+
+        if (a == cube(0) && b == cube(5)) {
+            return false;
+        }
+
+        if ((a == cube(2) && b == cube(3)) ||
+                (a == ground && b == cube(4))) {
+            return false;
+        }
+
+        return true;
+    };
+
+    std::set<std::pair<CountT, CountT>> pairs = step();
+
+    for (CountT a = 0; a < (CountT)sim.bodies.size(); a++) {
+        for (CountT b = a + 1; b < (CountT)sim.bodies.size(); b++) {
+            EXPECT_EQ(pairs.count({ a, b }) == 1, collides(a, b)) <<
+                "bodies " << a << " and " << b;
+        }
+    }
+
+    // Re-enabling the excluded pairs brings their candidates back
+    RigidBodyPhysicsSystem::enableCollisions(ctx,
+        sim.bodies[cube(3)], sim.bodies[cube(2)]);
+    RigidBodyPhysicsSystem::enableCollisions(ctx,
+        sim.bodies[ground], sim.bodies[cube(4)]);
+
+    pairs = step();
+    EXPECT_EQ(pairs.count({ cube(2), cube(3) }), 1u);
+    EXPECT_EQ(pairs.count({ ground, cube(4) }), 1u);
+    EXPECT_EQ(pairs.count({ ground, cube(1) }), 0u);
+}
@@ -0,0 +1,586 @@
+/*
+ * Copyright 2021-2023 Brennan Shacklett and contributors
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <gtest/gtest.h>
+
+#include <madrona/physics_assets.hpp>
+#include <madrona/importer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace madrona;
+using namespace madrona::math;
+using namespace madrona::phys;
+using namespace madrona::phys::geometry;
+
+using SourceCollisionPrimitive = PhysicsLoader::SourceCollisionPrimitive;
+using SourceCollisionObject = PhysicsLoader::SourceCollisionObject;
+
+namespace {
+
+// Boxes given as explicit face meshes, so importing doesn't build hulls
+struct BoxSources {
+    static constexpr CountT numObjects = 3;
+
+    std::array<uint32_t, 24> indices {
+        0, 2, 3, 1,
+        4, 5, 7, 6,
+        0, 1, 5, 4,
+        2, 6, 7, 3,
+        0, 4, 6, 2,
+        1, 3, 7, 5,
+    };
+    std::array<uint32_t, 6> faceCounts { 4, 4, 4, 4, 4, 4 };
+
+    std::array<std::array<Vector3, 8>, numObjects> positions;
+    std::array<imp::SourceMesh, numObjects> meshes;
+    std::array<std::array<SourceCollisionPrimitive, 2>, numObjects> prims;
+    std::vector<SourceCollisionObject> objs;
+
+    BoxSources()
+    {
+        for (CountT i = 0; i < numObjects; i++) {
+            Vector3 half_extents {
+                0.5f + 0.25f * i,
+                1.f,
+                0.75f + 0.1f * i,
+            };
+
+            for (CountT j = 0; j < 8; j++) {
+                positions[i][j] = {
+                    (j & 1) ? half_extents.x : -half_extents.x,
+                    (j & 2) ? half_extents.y : -half_extents.y,
+                    (j & 4) ? half_extents.z : -half_extents.z,
+                };
+            }
+
+            meshes[i] = {
+                .positions = positions[i].data(),
+                .normals = nullptr,
+                .tangentAndSigns = nullptr,
+                .uvs = nullptr,
+                .indices = indices.data(),
+                .faceCounts = faceCounts.data(),
+                .numVertices = 8,
+                .numFaces = 6,
+                .materialIDX = 0,
+            };
+
+            prims[i][0].type = CollisionPrimitive::Type::Hull;
+            prims[i][0].hullInput.mesh = &meshes[i];
+            prims[i][1].type = CollisionPrimitive::Type::Sphere;
+            prims[i][1].sphere.radius = 0.5f;
+
+            // Only the middle object also has a sphere
+            objs.push_back({
+                .prims = Span<const SourceCollisionPrimitive>(
+                    prims[i].data(), i == 1 ? 2 : 1),
+                .invMass = 1.f / (i + 1),
+                .friction = { 0.5f, 0.25f },
+            });
+        }
+    }
+
+    uint64_t hash() const
+    {
+        return PhysicsLoader::hashSourceObjects(
+            objs.data(), numObjects, false);
+    }
+};
+
+// Latitude / longitude ellipsoid with the given radii, given as faces like
+// BoxSources
+struct EllipsoidSource {
+    std::vector<Vector3> positions;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> faceCounts;
+    imp::SourceMesh mesh;
+    SourceCollisionPrimitive prim;
+    SourceCollisionObject obj;
+
+    EllipsoidSource(Vector3 radii, uint32_t num_rings, uint32_t num_segments)
+        : obj {
+              .prims = Span<const SourceCollisionPrimitive>(&prim, 1),
+              .invMass = 1.f,
+              .friction = { 0.5f, 0.25f },
+          }
+    {
+        positions.push_back({ 0, 0, radii.z });
+        for (uint32_t r = 1; r < num_rings; r++) {
+            float phi = math::pi * r / num_rings;
+            for (uint32_t s = 0; s < num_segments; s++) {
+                float theta = 2.f * math::pi * s / num_segments;
+                positions.push_back({
+                    radii.x * sinf(phi) * cosf(theta),
+                    radii.y * sinf(phi) * sinf(theta),
+                    radii.z * cosf(phi),
+                });
+            }
+        }
+        positions.push_back({ 0, 0, -radii.z });
+        uint32_t south = uint32_t(positions.size() - 1);
+
+        auto ringVert = [&](uint32_t r, uint32_t s) {
+            return 1 + (r - 1) * num_segments + s % num_segments;
+        };
+
+        auto addFace = [&](std::initializer_list<uint32_t> face) {
+            indices.insert(indices.end(), face);
+            faceCounts.push_back(uint32_t(face.size()));
+        };
+
+        for (uint32_t s = 0; s < num_segments; s++) {
+            addFace({ 0, ringVert(1, s), ringVert(1, s + 1) });
+            addFace({ south, ringVert(num_rings - 1, s + 1),
+                      ringVert(num_rings - 1, s) });
+        }
+
+        for (uint32_t r = 1; r < num_rings - 1; r++) {
+            for (uint32_t s = 0; s < num_segments; s++) {
+                addFace({
+                    ringVert(r, s), ringVert(r + 1, s),
+                    ringVert(r + 1, s + 1), ringVert(r, s + 1),
+                });
+            }
+        }
+
+        mesh = {
+            .positions = positions.data(),
+            .normals = nullptr,
+            .tangentAndSigns = nullptr,
+            .uvs = nullptr,
+            .indices = indices.data(),
+            .faceCounts = faceCounts.data(),
+            .numVertices = uint32_t(positions.size()),
+            .numFaces = uint32_t(faceCounts.size()),
+            .materialIDX = 0,
+        };
+
+        prim.type = CollisionPrimitive::Type::Hull;
+        prim.hullInput.mesh = &mesh;
+    }
+};
+
+// Distance from v to the closest point of hull, 0 inside it
+float distanceToHull(const HalfEdgeMesh &hull, Vector3 v)
+{
+    bool inside = true;
+    for (uint32_t face_idx = 0; face_idx < hull.numFaces; face_idx++) {
+        Plane plane = hull.facePlanes[face_idx];
+        if (dot(plane.normal, v) - plane.d > 0.f) {
+            inside = false;
+        }
+    }
+
+    if (inside) {
+        return 0.f;
+    }
+
+    // Closest point on the boundary: inside a face or on one of its edges
+    float min_dist2 = FLT_MAX;
+    for (uint32_t face_idx = 0; face_idx < hull.numFaces; face_idx++) {
+        Plane plane = hull.facePlanes[face_idx];
+        bool over_face = true;
+
+        uint32_t start_hedge = hull.faceBaseHalfEdges[face_idx];
+        uint32_t cur_hedge = start_hedge;
+        do {
+            const HalfEdge &hedge = hull.halfEdges[cur_hedge];
+            Vector3 a = hull.vertices[hedge.rootVertex];
+            Vector3 b = hull.vertices[hull.halfEdges[hedge.next].rootVertex];
+            Vector3 ab = b - a;
+
+            if (dot(cross(ab, plane.normal), v - a) > 0.f) {
+                over_face = false;
+            }
+
+            float t = std::clamp(dot(v - a, ab) / ab.length2(), 0.f, 1.f);
+            min_dist2 = fminf(min_dist2, (a + t * ab - v).length2());
+
+            cur_hedge = hedge.next;
+        } while (cur_hedge != start_hedge);
+
+        if (over_face) {
+            float plane_dist = dot(plane.normal, v) - plane.d;
+            min_dist2 = fminf(min_dist2, plane_dist * plane_dist);
+        }
+    }
+
+    return sqrtf(min_dist2);
+}
+
+std::string tmpCookedPath(const char *name)
+{
+    return (std::filesystem::temp_directory_path() /
+        (std::string("madrona_test_") + name + ".bin")).string();
+}
+
+HeapArray<char> readFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    HeapArray<char> data(file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+
+    return data;
+}
+
+void writeFile(const std::string &path, const HeapArray<char> &data)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+}
+
+}
+
+TEST(PhysicsAssets, CookedRoundTrip)
+{
+    BoxSources src;
+    CountT num_objs = BoxSources::numObjects;
+
+    PhysicsLoader direct_loader(ExecMode::CPU, num_objs);
+    Optional<PhysicsLoader::ImportedRigidBodies> imported =
+        direct_loader.importRigidBodyData(src.objs.data(), num_objs, false);
+    ASSERT_TRUE(imported.has_value());
+
+    direct_loader.loadObjects(imported->metadatas.data(),
+        imported->objectAABBs.data(),
+        imported->primOffsets.data(),
+        imported->primCounts.data(),
+        num_objs,
+        imported->collisionPrimitives.data(),
+        imported->primitiveAABBs.data(),
+        imported->collisionPrimitives.size(),
+        imported->hullData.halfEdges.data(),
+        imported->hullData.halfEdges.size(),
+        imported->hullData.faceBaseHEs.data(),
+        imported->hullData.facePlanes.data(),
+        imported->hullData.facePlanes.size(),
+        imported->hullData.positions.data(),
+        imported->hullData.positions.size());
+
+    std::string path = tmpCookedPath("round_trip");
+    ASSERT_TRUE(PhysicsLoader::writeCookedRigidBodies(
+        path.c_str(), *imported, src.hash()));
+
+    // Only the final file is left behind
+    for (const auto &entry : std::filesystem::directory_iterator(
+            std::filesystem::path(path).parent_path())) {
+        EXPECT_EQ(entry.path().string().find(path + ".tmp"),
+                  std::string::npos);
+    }
+
+    PhysicsLoader cooked_loader(ExecMode::CPU, num_objs);
+    EXPECT_FALSE(cooked_loader.loadCookedObjects(
+        path.c_str(), src.hash() ^ 1).has_value());
+
+    Optional<CountT> cooked_offset =
+        cooked_loader.loadCookedObjects(path.c_str(), src.hash());
+    ASSERT_TRUE(cooked_offset.has_value());
+    EXPECT_EQ(*cooked_offset, 0);
+
+    const ObjectManager &a = direct_loader.getObjectManager();
+    const ObjectManager &b = cooked_loader.getObjectManager();
+    CountT num_prims = imported->collisionPrimitives.size();
+
+    EXPECT_EQ(memcmp(a.metadata, b.metadata,
+                     sizeof(RigidBodyMetadata) * num_objs), 0);
+    EXPECT_EQ(memcmp(a.rigidBodyAABBs, b.rigidBodyAABBs,
+                     sizeof(AABB) * num_objs), 0);
+    EXPECT_EQ(memcmp(a.rigidBodyPrimitiveOffsets,
+                     b.rigidBodyPrimitiveOffsets,
+                     sizeof(uint32_t) * num_objs), 0);
+    EXPECT_EQ(memcmp(a.rigidBodyPrimitiveCounts, b.rigidBodyPrimitiveCounts,
+                     sizeof(uint32_t) * num_objs), 0);
+    EXPECT_EQ(memcmp(a.primitiveAABBs, b.primitiveAABBs,
+                     sizeof(AABB) * num_prims), 0);
+
+    for (CountT i = 0; i < num_prims; i++) {
+        const CollisionPrimitive &prim_a = a.collisionPrimitives[i];
+        const CollisionPrimitive &prim_b = b.collisionPrimitives[i];
+        ASSERT_EQ(prim_a.type, prim_b.type);
+
+        if (prim_a.type == CollisionPrimitive::Type::Sphere) {
+            EXPECT_EQ(prim_a.sphere.radius, prim_b.sphere.radius);
+            continue;
+        }
+
+        const HalfEdgeMesh &mesh_a = prim_a.hull.halfEdgeMesh;
+        const HalfEdgeMesh &mesh_b = prim_b.hull.halfEdgeMesh;
+        ASSERT_EQ(mesh_a.numHalfEdges, mesh_b.numHalfEdges);
+        ASSERT_EQ(mesh_a.numFaces, mesh_b.numFaces);
+        ASSERT_EQ(mesh_a.numVertices, mesh_b.numVertices);
+
+        EXPECT_EQ(memcmp(mesh_a.halfEdges, mesh_b.halfEdges,
+                         sizeof(HalfEdge) * mesh_a.numHalfEdges), 0);
+        EXPECT_EQ(memcmp(mesh_a.faceBaseHalfEdges, mesh_b.faceBaseHalfEdges,
+                         sizeof(uint32_t) * mesh_a.numFaces), 0);
+        EXPECT_EQ(memcmp(mesh_a.facePlanes, mesh_b.facePlanes,
+                         sizeof(Plane) * mesh_a.numFaces), 0);
+        EXPECT_EQ(memcmp(mesh_a.vertices, mesh_b.vertices,
+                         sizeof(Vector3) * mesh_a.numVertices), 0);
+    }
+
+    std::filesystem::remove(path);
+}
+
+// Every offset, count and index in the blob is checked before use
+TEST(PhysicsAssets, CorruptedCookedBlob)
+{
+    BoxSources src;
+    CountT num_objs = BoxSources::numObjects;
+
+    PhysicsLoader loader(ExecMode::CPU, num_objs);
+    Optional<PhysicsLoader::ImportedRigidBodies> imported =
+        loader.importRigidBodyData(src.objs.data(), num_objs, false);
+    ASSERT_TRUE(imported.has_value());
+
+    HeapArray<char> blob =
+        PhysicsLoader::cookRigidBodies(*imported, src.hash());
+    ASSERT_TRUE(PhysicsLoader::readCookedRigidBodies(
+        blob.data(), blob.size(), src.hash()).has_value());
+
+    // Corrupts a copy of the blob through pointers into the original view,
+    // so the test doesn't depend on the blob layout
+    auto corruptCopy = [&](auto &&corrupt) {
+        HeapArray<char> copy(blob.size());
+        memcpy(copy.data(), blob.data(), blob.size());
+
+        PhysicsLoader::CookedRigidBodies view =
+            *PhysicsLoader::readCookedRigidBodies(
+                blob.data(), blob.size(), src.hash());
+
+        auto at = [&](const auto *ptr) {
+            using T = std::remove_cv_t<std::remove_pointer_t<
+                decltype(ptr)>>;
+            return (T *)(copy.data() + ((const char *)ptr - blob.data()));
+        };
+
+        corrupt(view, at);
+
+        return copy;
+    };
+
+    auto firstHull = [](const PhysicsLoader::CookedRigidBodies &view) {
+        for (CountT i = 0; i < view.numPrimitives; i++) {
+            if (view.collisionPrimitives[i].type ==
+                    CollisionPrimitive::Type::Hull) {
+                return i;
+            }
+        }
+
+        return CountT(-1);
+    };
+
+    using View = PhysicsLoader::CookedRigidBodies;
+    std::vector<HeapArray<char>> corrupted;
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        at(view.primOffsets)[num_objs - 1] = (uint32_t)view.numPrimitives;
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        at(view.primCounts)[0] = 0xFFFF'FFFF;
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        at(view.collisionPrimitives)[0].type =
+            (CollisionPrimitive::Type)0x80;
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        CountT hull_idx = firstHull(view);
+        HalfEdgeMesh &mesh =
+            at(view.collisionPrimitives)[hull_idx].hull.halfEdgeMesh;
+        mesh.halfEdges = (HalfEdge *)(uintptr_t)view.numHalfEdges;
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        CountT hull_idx = firstHull(view);
+        HalfEdgeMesh &mesh =
+            at(view.collisionPrimitives)[hull_idx].hull.halfEdgeMesh;
+        mesh.facePlanes = (Plane *)(uintptr_t)(view.numFaces - 1);
+        mesh.faceBaseHalfEdges = (uint32_t *)(uintptr_t)(view.numFaces - 1);
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        CountT hull_idx = firstHull(view);
+        at(view.collisionPrimitives)[hull_idx].hull.halfEdgeMesh.numVertices =
+            (uint32_t)view.numVertices + 1;
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        CountT hull_idx = firstHull(view);
+        at(view.collisionPrimitives)[hull_idx].hull.halfEdgeMesh.numHalfEdges
+            -= 1;
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        at(view.halfEdges)[3].next = 1000;
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        at(view.halfEdges)[5].rootVertex = 8;
+    }));
+
+    corrupted.push_back(corruptCopy([&](const View &view, auto at) {
+        at(view.faceBaseHEs)[2] = 1000;
+    }));
+
+    for (CountT i = 0; i < (CountT)corrupted.size(); i++) {
+        const HeapArray<char> &bad = corrupted[i];
+        EXPECT_FALSE(PhysicsLoader::readCookedRigidBodies(
+            bad.data(), bad.size(), src.hash()).has_value())
+            << "corruption " << i;
+    }
+
+    // Size doesn't match the header
+    EXPECT_FALSE(PhysicsLoader::readCookedRigidBodies(
+        blob.data(), blob.size() - 1, src.hash()).has_value());
+}
+
+TEST(PhysicsAssets, LoadOrCookReplacesBadCache)
+{
+    BoxSources src;
+    CountT num_objs = BoxSources::numObjects;
+
+    std::string path = tmpCookedPath("load_or_cook");
+    std::filesystem::remove(path);
+
+    // Cache miss: cooks from source and writes the blob
+    {
+        PhysicsLoader loader(ExecMode::CPU, num_objs);
+        EXPECT_TRUE(loader.loadOrCookObjects(
+            path.c_str(), src.objs.data(), num_objs, false).has_value());
+    }
+
+    // Corrupt the cached blob's primitive ranges
+    HeapArray<char> cached = readFile(path);
+    Optional<PhysicsLoader::CookedRigidBodies> view =
+        PhysicsLoader::readCookedRigidBodies(
+            cached.data(), cached.size(), src.hash());
+    ASSERT_TRUE(view.has_value());
+    ((uint32_t *)view->primCounts)[0] = 0xFFFF'FFFF;
+    writeFile(path, cached);
+
+    {
+        PhysicsLoader loader(ExecMode::CPU, num_objs);
+        EXPECT_FALSE(loader.loadCookedObjects(
+            path.c_str(), src.hash()).has_value());
+    }
+
+    // Falls back to cooking and repairs the cache
+    {
+        PhysicsLoader loader(ExecMode::CPU, num_objs);
+        EXPECT_TRUE(loader.loadOrCookObjects(
+            path.c_str(), src.objs.data(), num_objs, false).has_value());
+    }
+
+    {
+        PhysicsLoader loader(ExecMode::CPU, num_objs);
+        EXPECT_TRUE(loader.loadCookedObjects(
+            path.c_str(), src.hash()).has_value());
+    }
+
+    std::filesystem::remove(path);
+}
+
+// The simplified hull contains the source hull, so the distance between them
+// is how far its vertices reach beyond the source hull. Merging down to the
+// budgets must keep that within maxMergeDistance of the largest extent.
+TEST(PhysicsAssets, SimplifiedHullDistance)
+{
+    constexpr float default_max_merge_distance = 0.1f;
+
+    for (Vector3 radii : { Vector3 { 0.5f, 0.5f, 0.5f },
+                           Vector3 { 1.f, 0.5f, 0.5f } }) {
+        EllipsoidSource src(radii, 12, 24);
+        float max_extent = 2.f * fmaxf(radii.x, fmaxf(radii.y, radii.z));
+
+        PhysicsLoader source_loader(ExecMode::CPU, 1);
+        Optional<PhysicsLoader::ImportedRigidBodies> source =
+            source_loader.importRigidBodyData(&src.obj, 1, false);
+        ASSERT_TRUE(source.has_value());
+        const HalfEdgeMesh &source_hull =
+            source->collisionPrimitives[0].hull.halfEdgeMesh;
+
+        auto simplify = [&](const PhysicsLoader::HullSimplification &cfg,
+                            float max_merge_distance) {
+            PhysicsLoader loader(ExecMode::CPU, 1);
+            Optional<PhysicsLoader::ImportedRigidBodies> imported =
+                loader.importRigidBodyData(&src.obj, 1, false, cfg);
+            EXPECT_TRUE(imported.has_value());
+            if (!imported.has_value()) {
+                return;
+            }
+
+            const HalfEdgeMesh &hull =
+                imported->collisionPrimitives[0].hull.halfEdgeMesh;
+            EXPECT_LT(hull.numFaces, source_hull.numFaces);
+
+            // Still conservative
+            for (uint32_t i = 0; i < source_hull.numVertices; i++) {
+                EXPECT_LT(distanceToHull(hull, source_hull.vertices[i]),
+                          1e-4f * max_extent);
+            }
+
+            float max_dist = 0.f;
+            for (uint32_t i = 0; i < hull.numVertices; i++) {
+                max_dist = fmaxf(max_dist,
+                    distanceToHull(source_hull, hull.vertices[i]));
+            }
+
+            EXPECT_GT(max_dist, 0.f);
+            EXPECT_LE(max_dist, max_merge_distance * max_extent * 1.001f);
+        };
+
+        // Budgets too small to meet within the default distance
+        simplify({
+            .maxFaces = 8,
+            .maxVertices = 0,
+            .mergeAngle = 0.f,
+            .clusterDistance = 0.f,
+            .maxMergeDistance = 0.f,
+        }, default_max_merge_distance);
+        simplify({
+            .maxFaces = 0,
+            .maxVertices = 12,
+            .mergeAngle = 0.f,
+            .clusterDistance = 0.f,
+            .maxMergeDistance = 0.f,
+        }, default_max_merge_distance);
+        simplify({
+            .maxFaces = 16,
+            .maxVertices = 0,
+            .mergeAngle = 0.f,
+            .clusterDistance = 0.f,
+            .maxMergeDistance = 0.05f,
+        }, 0.05f);
+
+        // A loose enough distance lets the budget through
+        PhysicsLoader loader(ExecMode::CPU, 1);
+        Optional<PhysicsLoader::ImportedRigidBodies> loose =
+            loader.importRigidBodyData(&src.obj, 1, false, {
+                .maxFaces = 8,
+                .maxVertices = 0,
+                .mergeAngle = 0.f,
+                .clusterDistance = 0.f,
+                .maxMergeDistance = 1.f,
+            });
+        ASSERT_TRUE(loose.has_value());
+        EXPECT_LE(loose->collisionPrimitives[0].hull.halfEdgeMesh.numFaces,
+                  8u);
+    }
+}
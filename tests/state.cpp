@@ -10,6 +10,7 @@
 #include <madrona/state.hpp>
 
 #include <array>
+#include <unordered_set>
 
 using namespace madrona;
 
@@ -224,6 +225,107 @@ TEST(State, DeleteMany)
     }
 }
 
+TEST(State, Transaction)
+{
+    StateManager state;
+    StateCache cache;
+    state.registerComponent<Component1>();
+    state.registerComponent<Component2>();
+    state.registerComponent<Component3>();
+    state.registerArchetype<Archetype1>();
+    state.registerArchetype<Archetype2>();
+
+    int num_entities = 1'000;
+
+    DynArray<Entity> entities(num_entities);
+
+    Transaction txn = state.makeTransaction();
+    for (int i = 0; i < num_entities; i++) {
+        if (i % 2 == 0) {
+            entities.push_back(state.makeEntity<Archetype1>(
+                txn, cache, Component1 { uint32_t(i) }));
+        } else {
+            entities.push_back(state.makeEntity<Archetype2>(
+                txn, cache, Component1 { uint32_t(i) },
+                Component2 { uint32_t(i), uint32_t(i * 2), uint32_t(i * 3) },
+                Component3 { (unsigned char)(i % 256) }));
+        }
+    }
+
+    // Nothing is applied until the transaction is committed & applied
+    for (Entity e : entities) {
+        EXPECT_FALSE(state.getLoc(e).valid());
+    }
+
+    state.commitTransaction(std::move(txn));
+    state.applyTransactions(cache);
+
+    for (int i = 0; i < num_entities; i++) {
+        Loc loc = state.getLoc(entities[i]);
+        EXPECT_TRUE(loc.valid());
+        EXPECT_EQ(state.get<Component1>(loc).value().v, uint32_t(i));
+
+        if (i % 2 == 1) {
+            Component2 &second = state.get<Component2>(loc).value();
+            EXPECT_EQ(second.x, uint32_t(i));
+            EXPECT_EQ(second.y, uint32_t(i * 2));
+            EXPECT_EQ(second.z, uint32_t(i * 3));
+            EXPECT_EQ(state.get<Component3>(loc).value().v, i % 256);
+        }
+    }
+
+    Transaction modify_txn = state.makeTransaction();
+    for (int i = 0; i < num_entities; i++) {
+        if (i % 3 == 0) {
+            state.destroyEntity(modify_txn, cache, entities[i]);
+            // Destroying twice in one batch is a no-op
+            state.destroyEntity(modify_txn, cache, entities[i]);
+        } else {
+            state.modifyEntity(modify_txn, entities[i],
+                               Component1 { uint32_t(-i) });
+        }
+    }
+    state.commitTransaction(std::move(modify_txn));
+    state.applyTransactions(cache);
+
+    for (int i = 0; i < num_entities; i++) {
+        if (i % 3 == 0) {
+            EXPECT_FALSE(state.getLoc(entities[i]).valid());
+        } else {
+            EXPECT_EQ(state.get<Component1>(entities[i]).value().v,
+                      uint32_t(-i));
+        }
+    }
+}
+
+TEST(State, DiscardTransaction)
+{
+    StateManager state;
+    StateCache cache;
+    state.registerComponent<Component1>();
+    state.registerArchetype<Archetype1>();
+
+    int num_entities = 1'000;
+
+    std::unordered_set<int32_t> discarded_ids;
+    {
+        Transaction txn = state.makeTransaction();
+        for (int i = 0; i < num_entities; i++) {
+            Entity e = state.makeEntity<Archetype1>(txn, cache,
+                Component1 { uint32_t(i) });
+            discarded_ids.insert(e.id);
+        }
+        // Dropped without being committed
+    }
+
+    // The IDs reserved by the dropped transaction are handed out again
+    for (int i = 0; i < 4 * num_entities; i++) {
+        Entity e = state.makeEntityNow<Archetype1>(cache);
+        discarded_ids.erase(e.id);
+    }
+    EXPECT_TRUE(discarded_ids.empty());
+}
+
 TEST(State, Reset)
 {
     StateManager state;
@@ -245,7 +347,7 @@ TEST(State, Reset)
         EXPECT_TRUE(state.get<Component1>(e).valid());
     }
 
-    state.clear<Archetype1>(cache);
+    state.clear<Archetype1>(cache, false);
 
     for (Entity e : initial_entities) {
         EXPECT_FALSE(state.get<Component1>(e).valid());
@@ -264,3 +366,41 @@ TEST(State, Reset)
         EXPECT_TRUE(state.get<Component1>(e).valid());
     }
 }
+
+TEST(State, Temporaries)
+{
+    StateManager state;
+    StateCache cache;
+    state.registerComponent<Component1>();
+    state.registerArchetype<Archetype1>();
+
+    uint32_t archetype_id = state.archetypeID<Archetype1>().id;
+
+    Loc single = state.makeTemporary<Archetype1>();
+    state.get<Component1>(single).value().v = 1234;
+
+    int num_temporaries = 10'000;
+    Loc base = state.makeTemporaries<Archetype1>(num_temporaries);
+
+    EXPECT_EQ(base.archetype, archetype_id);
+    EXPECT_EQ(base.row, single.row + 1);
+    EXPECT_EQ(state.numArchetypeRows(archetype_id),
+              CountT(num_temporaries + 1));
+
+    for (int i = 0; i < num_temporaries; i++) {
+        Loc loc { base.archetype, base.row + i };
+        state.get<Component1>(loc).value().v = uint32_t(i);
+    }
+
+    // The bulk rows are contiguous in the component's column
+    int32_t col_idx = state.getArchetypeColumnIndex(archetype_id,
+        state.componentID<Component1>().id);
+    auto *col = (Component1 *)state.getArchetypeColumn(archetype_id, col_idx);
+    EXPECT_EQ(col[single.row].v, 1234u);
+    for (int i = 0; i < num_temporaries; i++) {
+        EXPECT_EQ(col[base.row + i].v, uint32_t(i));
+    }
+
+    state.clear<Archetype1>(cache, true);
+    EXPECT_EQ(state.numArchetypeRows(archetype_id), 0);
+}